@@ -25,9 +25,12 @@
  *
  **************************************************************************/
 
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_tess.h"
@@ -41,6 +44,32 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/** Most threads running the vertex shader of one chunk, caller included */
+#define LLVM_VS_MAX_THREADS 8
+
+/** Fewest vertices worth handing to another thread */
+#define LLVM_VS_MIN_THREAD_VERTICES 512
+
+DEBUG_GET_ONCE_NUM_OPTION(draw_vs_threads, "DRAW_VS_THREADS", -1)
+
+
+struct llvm_middle_end;
+
+/** A range of the vertices of a chunk fetched and shaded by one thread */
+struct llvm_vs_job {
+   struct llvm_middle_end *fpme;
+   struct util_queue_fence fence;
+
+   struct vertex_header *verts;
+   unsigned count;
+   unsigned start;
+   const unsigned *elts;
+   unsigned vertex_id_offset;
+
+   bool clipped;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -58,6 +87,13 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /* Worker threads for the vertex shader, started on the first chunk big
+    * enough to use them.
+    */
+   struct util_queue vs_queue;
+   unsigned vs_threads;
+   struct llvm_vs_job vs_jobs[LLVM_VS_MAX_THREADS];
 };
 
 
@@ -491,6 +527,118 @@ emit(struct pt_emit *emit,
 }
 
 
+static void
+llvm_vs_job_run(struct llvm_vs_job *job)
+{
+   struct llvm_middle_end *fpme = job->fpme;
+   struct draw_context *draw = fpme->draw;
+
+   job->clipped = fpme->current_variant->jit_func(&fpme->llvm->vs_jit_context,
+                                                  &fpme->llvm->jit_resources[PIPE_SHADER_VERTEX],
+                                                  job->verts,
+                                                  draw->pt.user.vbuffer,
+                                                  job->count,
+                                                  job->start,
+                                                  fpme->vertex_size,
+                                                  draw->pt.vertex_buffer,
+                                                  draw->instance_id,
+                                                  job->vertex_id_offset,
+                                                  draw->start_instance,
+                                                  job->elts,
+                                                  draw->pt.user.drawid,
+                                                  draw->pt.user.viewid);
+}
+
+
+static void
+llvm_vs_job_execute(void *data, void *gdata, int thread_index)
+{
+   /* Same as the calling thread, see draw_vbo(). */
+   util_fpstate_set_denorms_to_zero(util_fpstate_get());
+
+   llvm_vs_job_run(data);
+}
+
+
+static bool
+llvm_middle_end_init_vs_threads(struct llvm_middle_end *fpme)
+{
+   if (util_queue_is_initialized(&fpme->vs_queue))
+      return true;
+
+   int64_t threads = debug_get_option_draw_vs_threads();
+   if (threads < 0)
+      threads = util_get_cpu_caps()->nr_cpus;
+   fpme->vs_threads = CLAMP(threads, 1, LLVM_VS_MAX_THREADS);
+
+   if (fpme->vs_threads > 1 &&
+       !util_queue_init(&fpme->vs_queue, "drawvs", LLVM_VS_MAX_THREADS,
+                        fpme->vs_threads - 1, 0, NULL))
+      fpme->vs_threads = 1;
+
+   return fpme->vs_threads > 1;
+}
+
+
+/**
+ * Run vertex fetch, the vertex shader and the clip test of a chunk.
+ *
+ * Large chunks are split in ranges shaded concurrently by the worker
+ * threads. Every vertex keeps its place in the output, so everything after
+ * this sees the primitives in their original order.
+ */
+static bool
+llvm_middle_end_run_vs(struct llvm_middle_end *fpme,
+                       struct vertex_header *verts,
+                       unsigned count,
+                       unsigned start,
+                       const unsigned *elts,
+                       unsigned vertex_id_offset)
+{
+   const unsigned vector_length = lp_native_vector_width / 32;
+   unsigned num_jobs = 1;
+
+   if (fpme->vs_threads != 1 && count >= 2 * LLVM_VS_MIN_THREAD_VERTICES &&
+       llvm_middle_end_init_vs_threads(fpme))
+      num_jobs = MIN2(fpme->vs_threads, count / LLVM_VS_MIN_THREAD_VERTICES);
+
+   /* The shader writes whole vectors of vertices, so ranges must not
+    * share one.
+    */
+   const unsigned range = align(DIV_ROUND_UP(count, num_jobs), vector_length);
+   unsigned first = 0;
+   unsigned i;
+
+   for (i = 0; first < count; i++, first += range) {
+      struct llvm_vs_job *job = &fpme->vs_jobs[i];
+
+      job->fpme = fpme;
+      job->verts = (struct vertex_header *)
+         ((uint8_t *)verts + first * fpme->vertex_size);
+      job->count = MIN2(range, count - first);
+      job->start = elts ? start : start + first;
+      job->elts = elts ? elts + first : NULL;
+      job->vertex_id_offset = vertex_id_offset;
+
+      /* The caller shades the first range itself. */
+      if (i > 0)
+         util_queue_add_job(&fpme->vs_queue, job, &job->fence,
+                            llvm_vs_job_execute, NULL, 0);
+   }
+   num_jobs = i;
+
+   llvm_vs_job_run(&fpme->vs_jobs[0]);
+
+   bool clipped = fpme->vs_jobs[0].clipped;
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&fpme->vs_jobs[i].fence);
+      clipped |= fpme->vs_jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -555,20 +703,9 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
          elts = fetch_info->elts;
       }
       /* Run vertex fetch shader */
-      clipped = fpme->current_variant->jit_func(&fpme->llvm->vs_jit_context,
-                                                &fpme->llvm->jit_resources[PIPE_SHADER_VERTEX],
-                                                llvm_vert_info.verts,
-                                                draw->pt.user.vbuffer,
-                                                fetch_info->count,
-                                                start,
-                                                fpme->vertex_size,
-                                                draw->pt.vertex_buffer,
-                                                draw->instance_id,
-                                                vertex_id_offset,
-                                                draw->start_instance,
-                                                elts,
-                                                draw->pt.user.drawid,
-                                                draw->pt.user.viewid);
+      clipped = llvm_middle_end_run_vs(fpme, llvm_vert_info.verts,
+                                       fetch_info->count, start, elts,
+                                       vertex_id_offset);
 
       /* Finished with fetch and vs */
       fetch_info = NULL;
@@ -829,6 +966,11 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
 
+   if (util_queue_is_initialized(&fpme->vs_queue))
+      util_queue_destroy(&fpme->vs_queue);
+   for (unsigned i = 0; i < ARRAY_SIZE(fpme->vs_jobs); i++)
+      util_queue_fence_destroy(&fpme->vs_jobs[i].fence);
+
    if (fpme->fetch)
       draw_pt_fetch_destroy(fpme->fetch);
 
@@ -867,6 +1009,9 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->draw = draw;
 
+   for (unsigned i = 0; i < ARRAY_SIZE(fpme->vs_jobs); i++)
+      util_queue_fence_init(&fpme->vs_jobs[i].fence);
+
    fpme->fetch = draw_pt_fetch_create(draw);
    if (!fpme->fetch)
       goto fail;
@@ -25,7 +25,12 @@
 
 #include <stdbool.h>
 
+#include <inttypes.h>
+
+#include "util/bitset.h"
+#include "util/log.h"
 #include "util/macros.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 
@@ -33,8 +38,15 @@
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
 
-#define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+#define SEGMENT_SIZE 4096
+
+/* The fetch cache is 4-way set associative with FIFO replacement, and big
+ * enough to hold every fetch of a segment.
+ */
+#define CACHE_WAYS   4
+#define CACHE_SETS   (SEGMENT_SIZE / CACHE_WAYS)
+
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vsplit_stats, "DRAW_VSPLIT_STATS", false)
 
 struct vsplit_frontend {
    struct draw_pt_front_end base;
@@ -54,21 +66,34 @@ struct vsplit_frontend {
 
    struct {
       /* map a fetch element to a draw element */
-      unsigned fetches[MAP_SIZE];
-      uint16_t draws[MAP_SIZE];
-      bool has_max_fetch;
+      unsigned fetches[CACHE_SETS][CACHE_WAYS];
+      uint16_t draws[CACHE_SETS][CACHE_WAYS];
+      /* number of fetches added to a set, wrapping from 2 * CACHE_WAYS
+       * back to CACHE_WAYS once it's full
+       */
+      uint8_t fill[CACHE_SETS];
 
       uint16_t num_fetch_elts;
       uint16_t num_draw_elts;
    } cache;
+
+   /* DRAW_VSPLIT_STATS, for indexed draws only */
+   struct {
+      bool enabled;
+      void (*run)(struct draw_pt_front_end *frontend,
+                  unsigned start, unsigned count);
+
+      uint64_t indices;
+      uint64_t unique;
+      uint64_t fetches;
+   } stats;
 };
 
 
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = false;
+   memset(vsplit->cache.fill, 0, sizeof(vsplit->cache.fill));
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
@@ -77,6 +102,8 @@ vsplit_clear_cache(struct vsplit_frontend *vsplit)
 static void
 vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 {
+   vsplit->stats.fetches += vsplit->cache.num_fetch_elts;
+
    vsplit->middle->run(vsplit->middle,
          vsplit->fetch_elts, vsplit->cache.num_fetch_elts,
          vsplit->draw_elts, vsplit->cache.num_draw_elts, flags);
@@ -89,23 +116,31 @@ vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 static inline void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch)
 {
-   unsigned hash;
+   const unsigned set = fetch % CACHE_SETS;
+   const unsigned fill = vsplit->cache.fill[set];
+   const unsigned valid = MIN2(fill, CACHE_WAYS);
+   unsigned way;
+
+   for (way = 0; way < valid; way++) {
+      if (vsplit->cache.fetches[set][way] == fetch)
+         break;
+   }
 
-   hash = fetch % MAP_SIZE;
+   if (way == valid) {
+      /* replace the oldest entry of a full set */
+      way = fill % CACHE_WAYS;
+      vsplit->cache.fill[set] = fill + 1 < 2 * CACHE_WAYS ? fill + 1 : CACHE_WAYS;
 
-   /* If the value isn't in the cache or it's an overflow due to the
-    * element bias */
-   if (vsplit->cache.fetches[hash] != fetch) {
       /* update cache */
-      vsplit->cache.fetches[hash] = fetch;
-      vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
+      vsplit->cache.fetches[set][way] = fetch;
+      vsplit->cache.draws[set][way] = vsplit->cache.num_fetch_elts;
 
       /* add fetch */
       assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
       vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
    }
 
-   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = vsplit->cache.draws[hash];
+   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = vsplit->cache.draws[set][way];
 }
 
 
@@ -128,12 +163,6 @@ vsplit_add_cache_uint8(struct vsplit_frontend *vsplit, const uint8_t *elts,
    unsigned elt_idx;
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* unlike the uint32_t case this can only happen with elt_bias */
-   if (elt_bias && elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = true;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -146,12 +175,6 @@ vsplit_add_cache_uint16(struct vsplit_frontend *vsplit, const uint16_t *elts,
    unsigned elt_idx;
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* unlike the uint32_t case this can only happen with elt_bias */
-   if (elt_bias && elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = true;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -171,13 +194,6 @@ vsplit_add_cache_uint32(struct vsplit_frontend *vsplit, const uint32_t *elts,
     */
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* Take care for DRAW_MAX_FETCH_IDX (since cache is initialized to -1). */
-   if (elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      /* force update - any value will do except DRAW_MAX_FETCH_IDX */
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = true;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -201,6 +217,55 @@ vsplit_add_cache_uint32(struct vsplit_frontend *vsplit, const uint32_t *elts,
 #include "draw_pt_vsplit_tmp.h"
 
 
+/**
+ * Count the distinct indices of an indexed draw, along with what vsplit
+ * fetched for it.
+ */
+static void
+vsplit_run_stats(struct draw_pt_front_end *frontend,
+                 unsigned start, unsigned count)
+{
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+   struct draw_context *draw = vsplit->draw;
+   const void *elts = draw->pt.user.elts;
+   const unsigned elt_size = draw->pt.user.eltSize;
+   unsigned min = ~0u, max = 0;
+
+   vsplit->stats.run(frontend, start, count);
+
+   const unsigned end = MIN2(util_clamped_uadd(start, count),
+                             draw->pt.user.eltMax);
+   if (start >= end)
+      return;
+
+#define VSPLIT_ELT(i) \
+   (elt_size == 1 ? ((const uint8_t *)elts)[i] : \
+    elt_size == 2 ? ((const uint16_t *)elts)[i] : ((const uint32_t *)elts)[i])
+
+   for (unsigned i = start; i < end; i++) {
+      min = MIN2(min, VSPLIT_ELT(i));
+      max = MAX2(max, VSPLIT_ELT(i));
+   }
+
+   /* don't bother with sparse index ranges of over 64M */
+   if (max - min >= (1u << 26))
+      return;
+
+   BITSET_WORD *seen = CALLOC(BITSET_WORDS(max - min + 1), sizeof(BITSET_WORD));
+   if (!seen)
+      return;
+
+   for (unsigned i = start; i < end; i++)
+      BITSET_SET(seen, VSPLIT_ELT(i) - min);
+
+#undef VSPLIT_ELT
+
+   vsplit->stats.indices += end - start;
+   vsplit->stats.unique += __bitset_count(seen, BITSET_WORDS(max - min + 1));
+   FREE(seen);
+}
+
+
 static void
 vsplit_prepare(struct draw_pt_front_end *frontend,
                enum mesa_prim in_prim,
@@ -227,6 +292,11 @@ vsplit_prepare(struct draw_pt_front_end *frontend,
       break;
    }
 
+   if (vsplit->stats.enabled && vsplit->draw->pt.user.eltSize) {
+      vsplit->stats.run = vsplit->base.run;
+      vsplit->base.run = vsplit_run_stats;
+   }
+
    /* split only */
    vsplit->prim = in_prim;
 
@@ -252,6 +322,16 @@ vsplit_flush(struct draw_pt_front_end *frontend, unsigned flags)
 static void
 vsplit_destroy(struct draw_pt_front_end *frontend)
 {
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+
+   if (vsplit->stats.indices) {
+      mesa_logi("vsplit: %" PRIu64 " indices, %" PRIu64 " unique, "
+                "%" PRIu64 " vertices shaded (%.3f per unique index)",
+                vsplit->stats.indices, vsplit->stats.unique,
+                vsplit->stats.fetches,
+                (double)vsplit->stats.fetches / vsplit->stats.unique);
+   }
+
    FREE(frontend);
 }
 
@@ -269,6 +349,7 @@ draw_pt_vsplit(struct draw_context *draw)
    vsplit->base.flush   = vsplit_flush;
    vsplit->base.destroy = vsplit_destroy;
    vsplit->draw = draw;
+   vsplit->stats.enabled = debug_get_option_draw_vsplit_stats();
 
    for (unsigned i = 0; i < SEGMENT_SIZE; i++)
       vsplit->identity_draw_elts[i] = i;
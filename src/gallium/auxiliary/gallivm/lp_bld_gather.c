@@ -381,6 +381,50 @@ lp_build_gather_avx2(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * 16 x 32bit gather with the AVX-512 gather instructions, used for the 16-wide
+ * fragment shader path. Unlike the AVX2 ones, the mask is a k register.
+ */
+static LLVMValueRef
+lp_build_gather_avx512(struct gallivm_state *gallivm,
+                       unsigned length,
+                       unsigned src_width,
+                       struct lp_type dst_type,
+                       LLVMValueRef base_ptr,
+                       LLVMValueRef offsets)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i1_type = LLVMIntTypeInContext(gallivm->context, 1);
+   LLVMTypeRef i32_type = LLVMIntTypeInContext(gallivm->context, 32);
+   LLVMTypeRef src_type, src_vec_type;
+   LLVMValueRef res;
+   struct lp_type res_type = dst_type;
+   res_type.length *= length;
+
+   assert(src_width == 32 && length == 16);
+   assert(LLVMTypeOf(base_ptr) == LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0));
+
+   src_type = dst_type.floating ? LLVMFloatTypeInContext(gallivm->context) :
+                                  i32_type;
+   src_vec_type = LLVMVectorType(src_type, length);
+
+   const char *intrinsic = dst_type.floating ?
+      "llvm.x86.avx512.mask.gather.dps.512" :
+      "llvm.x86.avx512.mask.gather.dpi.512";
+
+   LLVMValueRef passthru = LLVMGetUndef(src_vec_type);
+   LLVMValueRef mask = LLVMConstAllOnes(LLVMVectorType(i1_type, length));
+   LLVMValueRef scale = LLVMConstInt(i32_type, 1, 0);
+
+   LLVMValueRef args[] = { passthru, base_ptr, offsets, mask, scale };
+
+   res = lp_build_intrinsic(builder, intrinsic, src_vec_type, args, 5, 0);
+   res = LLVMBuildBitCast(builder, res, lp_build_vec_type(gallivm, res_type), "");
+
+   return res;
+}
+
+
 /**
  * Gather elements from scatter positions in memory into a single vector.
  * Use for fetching texels from a texture.
@@ -491,6 +535,10 @@ lp_build_gather(struct gallivm_state *gallivm,
               src_width == 32 && (length == 4 || length == 8)) {
       return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
                                   base_ptr, offsets);
+   } else if (util_get_cpu_caps()->has_avx512f && !need_expansion &&
+              src_width == 32 && length == 16) {
+      return lp_build_gather_avx512(gallivm, length, src_width, dst_type,
+                                    base_ptr, offsets);
    /*
     * This looks bad on paper wrt throughtput/latency on Haswell.
     * Even on Broadwell it doesn't look stellar.
@@ -67,6 +67,7 @@ struct gallivm_state
    LLVMBuilderRef builder;
    struct lp_cached_code *cache;
    unsigned compiled;
+   bool no_opt;   /**< skip IR optimizations, lowest codegen opt level */
    LLVMValueRef coro_malloc_hook;
    LLVMValueRef coro_free_hook;
    LLVMValueRef debug_printf_hook;
@@ -91,6 +92,14 @@ struct gallivm_state *
 gallivm_create(const char *name, lp_context_ref *context,
                struct lp_cached_code *cache);
 
+/**
+ * Like gallivm_create(), but the module gets compiled as quickly as
+ * possible, trading code quality for compile time.
+ */
+struct gallivm_state *
+gallivm_create_fast(const char *name, lp_context_ref *context,
+                    struct lp_cached_code *cache);
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
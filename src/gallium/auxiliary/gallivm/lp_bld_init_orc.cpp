@@ -307,11 +307,13 @@ void lpjit_exit()
 LLVMErrorRef module_transform(void *Ctx, LLVMModuleRef mod) {
    struct lp_passmgr *mgr;
 
-   lp_passmgr_create(mod, &mgr);
+   bool optimize = !(gallivm_perf & GALLIVM_PERF_NO_OPT);
+
+   lp_passmgr_create(mod, &mgr, optimize);
 
    lp_passmgr_run(mgr, mod,
                   LPJit::get_instance()->tm,
-                  get_module_name(mod));
+                  get_module_name(mod), optimize);
 
    lp_passmgr_dispose(mgr);
    return LLVMErrorSuccess;
@@ -588,6 +590,14 @@ gallivm_create(const char *name, lp_context_ref *context,
    return gallivm;
 }
 
+/* The ORC JIT optimizes all modules the same way. */
+struct gallivm_state *
+gallivm_create_fast(const char *name, lp_context_ref *context,
+                    struct lp_cached_code *cache)
+{
+   return gallivm_create(name, context, cache);
+}
+
 void
 gallivm_destroy(struct gallivm_state *gallivm)
 {
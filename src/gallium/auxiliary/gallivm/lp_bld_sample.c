@@ -132,6 +132,7 @@ lp_sampler_static_texture_state(struct lp_static_texture_state *state,
    state->tiled = !!(texture->flags & PIPE_RESOURCE_FLAG_SPARSE);
    if (state->tiled)
       state->tiled_samples = texture->nr_samples;
+   state->microtiled = !!(texture->flags & LP_RESOURCE_FLAG_MICROTILED);
 
    /*
     * the layer / element / level parameters are all either dynamic
@@ -179,6 +180,7 @@ lp_sampler_static_texture_state_image(struct lp_static_texture_state *state,
       if (view->u.tex.is_2d_view_of_3d)
          state->target = PIPE_TEXTURE_2D;
    }
+   state->microtiled = !!(resource->flags & LP_RESOURCE_FLAG_MICROTILED);
 
    /*
     * the layer / element / level parameters are all either dynamic
@@ -2208,6 +2210,64 @@ lp_build_sample_offset(struct lp_build_context *bld,
 }
 
 
+/**
+ * Compute the offset of a texel in a micro-tiled texture, see
+ * LP_RESOURCE_FLAG_MICROTILED. The texel at (x, y) lives at
+ *
+ *    (y & ~3) * y_stride + ((x & ~3) * 4 + (y & 3) * 4 + (x & 3)) * bpp
+ *
+ * which, like the linear layout, is a sum of separate x and y terms.
+ * Only formats with 1x1 blocks are micro-tiled.
+ */
+void
+lp_build_microtiled_sample_offset(struct lp_build_context *bld,
+                                  const struct util_format_description *format_desc,
+                                  LLVMValueRef x,
+                                  LLVMValueRef y,
+                                  LLVMValueRef z,
+                                  LLVMValueRef y_stride,
+                                  LLVMValueRef z_stride,
+                                  LLVMValueRef *out_offset,
+                                  LLVMValueRef *out_i,
+                                  LLVMValueRef *out_j)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef three = lp_build_const_int_vec(gallivm, bld->type, 3);
+   LLVMValueRef not_three = lp_build_const_int_vec(gallivm, bld->type, ~3);
+   LLVMValueRef two = lp_build_const_int_vec(gallivm, bld->type, 2);
+   LLVMValueRef bpp = lp_build_const_int_vec(gallivm, bld->type,
+                                             format_desc->block.bits / 8);
+   LLVMValueRef index, offset;
+
+   assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+
+   /* texel index within the row of blocks */
+   index = LLVMBuildAnd(builder, x, not_three, "");
+   index = LLVMBuildShl(builder, index, two, "");
+   index = LLVMBuildOr(builder, index, LLVMBuildAnd(builder, x, three, ""), "");
+
+   if (y && y_stride) {
+      LLVMValueRef y_in_block = LLVMBuildAnd(builder, y, three, "");
+      y_in_block = LLVMBuildShl(builder, y_in_block, two, "");
+      index = LLVMBuildOr(builder, index, y_in_block, "");
+
+      offset = lp_build_mul(bld, index, bpp);
+      offset = lp_build_add(bld, offset,
+                            lp_build_mul(bld, LLVMBuildAnd(builder, y, not_three, ""),
+                                         y_stride));
+   } else {
+      offset = lp_build_mul(bld, index, bpp);
+   }
+
+   if (z && z_stride)
+      offset = lp_build_add(bld, offset, lp_build_mul(bld, z, z_stride));
+
+   *out_offset = offset;
+   *out_i = bld->zero;
+   *out_j = bld->zero;
+}
+
 
 void
 lp_build_tiled_sample_offset(struct lp_build_context *bld,
@@ -49,6 +49,12 @@ extern "C" {
 
 #define LP_MAX_TEXEL_BUFFER_ELEMENTS 134217728
 
+/**
+ * Resource flag for textures stored as 4x4 texel blocks, each block
+ * contiguous in memory, with the same row stride as the linear layout.
+ */
+#define LP_RESOURCE_FLAG_MICROTILED PIPE_RESOURCE_FLAG_DRV_PRIV
+
 struct util_format_description;
 struct lp_type;
 struct lp_build_context;
@@ -204,6 +210,7 @@ struct lp_static_texture_state
    unsigned level_zero_only:1;
    unsigned tiled:1;
    unsigned tiled_samples:5;
+   unsigned microtiled:1;    /**< 4x4 texel blocks, see lp_build_microtiled_sample_offset */
 };
 
 
@@ -776,6 +783,19 @@ lp_build_tiled_sample_offset(struct lp_build_context *bld,
                              LLVMValueRef *out_j);
 
 
+void
+lp_build_microtiled_sample_offset(struct lp_build_context *bld,
+                                  const struct util_format_description *format_desc,
+                                  LLVMValueRef x,
+                                  LLVMValueRef y,
+                                  LLVMValueRef z,
+                                  LLVMValueRef y_stride,
+                                  LLVMValueRef z_stride,
+                                  LLVMValueRef *out_offset,
+                                  LLVMValueRef *out_i,
+                                  LLVMValueRef *out_j);
+
+
 void
 lp_build_sample_soa_code(struct gallivm_state *gallivm,
                          const struct lp_static_texture_state *static_texture_state,
@@ -192,6 +192,11 @@ lp_build_sample_texel_soa(struct lp_build_sample_context *bld,
                                    bld->static_texture_state,
                                    x, y, z, width, height, z_stride,
                                    &offset, &i, &j);
+   } else if (bld->static_texture_state->microtiled) {
+      lp_build_microtiled_sample_offset(&bld->int_coord_bld,
+                                        bld->format_desc,
+                                        x, y, z, y_stride, z_stride,
+                                        &offset, &i, &j);
    } else {
       lp_build_sample_offset(&bld->int_coord_bld,
                              bld->format_desc,
@@ -3334,6 +3339,11 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
                                    bld->static_texture_state,
                                    x, y, z, width, height, img_stride_vec,
                                    &offset, &i, &j);
+   } else if (bld->static_texture_state->microtiled) {
+      lp_build_microtiled_sample_offset(int_coord_bld,
+                                        bld->format_desc,
+                                        x, y, z, row_stride_vec, img_stride_vec,
+                                        &offset, &i, &j);
    } else {
       lp_build_sample_offset(int_coord_bld,
                              bld->format_desc,
@@ -3865,6 +3875,7 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
                     derived_sampler_state.mag_img_filter;
 
       use_aos &= !static_texture_state->tiled;
+      use_aos &= !static_texture_state->microtiled;
 
       if (gallivm_perf & GALLIVM_PERF_NO_AOS_SAMPLING) {
          use_aos = 0;
@@ -5066,6 +5077,11 @@ lp_build_img_op_soa(const struct lp_static_texture_state *static_texture_state,
                                    static_texture_state,
                                    x, y, z, width, height, img_stride_vec,
                                    &offset, &i, &j);
+   } else if (static_texture_state->microtiled) {
+      lp_build_microtiled_sample_offset(&int_coord_bld,
+                                        format_desc,
+                                        x, y, z, row_stride_vec, img_stride_vec,
+                                        &offset, &i, &j);
    } else {
       lp_build_sample_offset(&int_coord_bld,
                              format_desc,
@@ -1321,6 +1321,12 @@ hud_parse_env_var(struct hud_context *hud, struct pipe_screen *screen,
       else if (strcmp(name, "API-thread-num-batches") == 0) {
          hud_thread_counter_install(pane, name, HUD_COUNTER_BATCHES);
       }
+      else if (strcmp(name, "driver-thread-stall") == 0) {
+         hud_tc_counter_install(pane, name, HUD_COUNTER_TC_STALL);
+      }
+      else if (strcmp(name, "driver-thread-batch-fill") == 0) {
+         hud_tc_counter_install(pane, name, HUD_COUNTER_TC_BATCH_FILL);
+      }
       else if (strcmp(name, "main-thread-busy") == 0) {
          hud_thread_busy_install(pane, name, true);
       }
@@ -1640,6 +1646,9 @@ print_help(struct pipe_screen *screen)
    for (i = 0; i < num_cpus; i++)
       printf("    cpu%i\n", i);
 
+   puts("    driver-thread-stall (% of time waiting for the driver thread)");
+   puts("    driver-thread-batch-fill (average % of a driver thread batch used)");
+
    if (has_occlusion_query(screen))
       puts("    samples-passed");
    if (has_streamout(screen))
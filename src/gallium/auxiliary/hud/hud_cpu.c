@@ -33,6 +33,7 @@
 #include "util/u_thread.h"
 #include "util/u_memory.h"
 #include "util/u_queue.h"
+#include "util/u_threaded_context.h"
 #include <stdio.h>
 #include <inttypes.h>
 #if DETECT_OS_WINDOWS
@@ -474,3 +475,89 @@ void hud_thread_counter_install(struct hud_pane *pane, const char *name,
    hud_pane_add_graph(pane, gr);
    hud_pane_set_max_value(pane, 100);
 }
+
+struct tc_counter_info {
+   enum hud_counter counter;
+   int64_t last_time;
+   uint64_t last_stall_ns;
+   unsigned last_batches;
+   unsigned last_slots;
+   unsigned last_batch_slots;
+};
+
+static void
+query_tc_counter(struct hud_graph *gr, struct pipe_context *pipe)
+{
+   struct tc_counter_info *info = gr->query_data;
+   struct threaded_context *tc = threaded_context_from_pipe(pipe);
+   int64_t now = os_time_get_nano();
+
+   if (!tc)
+      return;
+
+   uint64_t stall_ns = p_atomic_read(&tc->producer_stall_ns);
+   unsigned batches = p_atomic_read(&tc->num_batches);
+   unsigned slots = p_atomic_read(&tc->num_offloaded_slots);
+   unsigned batch_slots = p_atomic_read(&tc->num_batch_slots);
+
+   if (info->last_time) {
+      if (info->last_time + gr->pane->period*1000 <= now) {
+         double value;
+
+         switch (info->counter) {
+         case HUD_COUNTER_TC_STALL:
+            value = (stall_ns - info->last_stall_ns) * 100.0 /
+                    (now - info->last_time);
+            break;
+         case HUD_COUNTER_TC_BATCH_FILL:
+            value = batches == info->last_batches ? 0 :
+                    (slots - info->last_slots) * 100.0 /
+                    (batch_slots - info->last_batch_slots);
+            break;
+         default:
+            unreachable("invalid counter");
+         }
+         hud_graph_add_value(gr, value);
+
+         info->last_stall_ns = stall_ns;
+         info->last_batches = batches;
+         info->last_slots = slots;
+      info->last_batch_slots = batch_slots;
+         info->last_time = now;
+      }
+   } else {
+      /* initialize */
+      info->last_stall_ns = stall_ns;
+      info->last_batches = batches;
+      info->last_slots = slots;
+      info->last_batch_slots = batch_slots;
+      info->last_time = now;
+   }
+}
+
+void hud_tc_counter_install(struct hud_pane *pane, const char *name,
+                            enum hud_counter counter)
+{
+   struct hud_graph *gr = CALLOC_STRUCT(hud_graph);
+   if (!gr)
+      return;
+
+   strcpy(gr->name, name);
+
+   gr->query_data = CALLOC_STRUCT(tc_counter_info);
+   if (!gr->query_data) {
+      FREE(gr);
+      return;
+   }
+
+   ((struct tc_counter_info*)gr->query_data)->counter = counter;
+   gr->query_new_value = query_tc_counter;
+
+   /* Don't use free() as our callback as that messes up Gallium's
+    * memory debugger.  Use simple free_query_data() wrapper.
+    */
+   gr->free_query_data = free_query_data;
+
+   hud_pane_add_graph(pane, gr);
+   hud_pane_set_max_value(pane, 100);
+}
@@ -0,0 +1,840 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Vertex translation with AVX2, 8 vertices at a time.
+ *
+ * Unlike translate_sse, which generates code for a handful of formats and
+ * one vertex per iteration, this works from the format descriptions: every
+ * input format made of at most four 8 to 32 bit channels (including the
+ * packed 10_10_10_2 ones) and 16 or 32 bit floats is fetched with gathers,
+ * unpacked to 32 bit lanes and packed into the output format with plain
+ * vector arithmetic. Half floats are converted with F16C.
+ *
+ * Gathers read whole dwords. The bytes past the end of an element are only
+ * read when they belong to a vertex with a larger index in the same group
+ * of 8, which is in bounds, the others are read exactly.
+ */
+
+#include "util/detect.h"
+#include "util/compiler.h"
+#include "util/u_memory.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+#include "util/format/u_format.h"
+
+#include "translate.h"
+
+
+#if DETECT_ARCH_X86_64 && defined(__AVX2__) && defined(__F16C__)
+
+#include <immintrin.h>
+
+#define AVX2_LANES 8
+
+enum avx2_channel_kind {
+   AVX2_CHANNEL_CONST,
+   AVX2_CHANNEL_FLOAT32,
+   AVX2_CHANNEL_FLOAT16,
+   AVX2_CHANNEL_UNORM,
+   AVX2_CHANNEL_SNORM,
+   AVX2_CHANNEL_USCALED,
+   AVX2_CHANNEL_SSCALED,
+   AVX2_CHANNEL_UINT,
+   AVX2_CHANNEL_SINT,
+};
+
+/**
+ * One channel of a format, as found in the dwords of one element.
+ */
+struct avx2_channel {
+   enum avx2_channel_kind kind;
+   unsigned dword;
+   unsigned shift;
+   unsigned size;
+   float scale;      /**< largest normalized value */
+   float rcp;        /**< 1 / scale */
+   float min;
+   float max;
+   uint32_t value;   /**< for AVX2_CHANNEL_CONST */
+};
+
+struct translate_avx2_element {
+   enum translate_element_type type;
+   unsigned buffer;
+   unsigned input_offset;
+   unsigned instance_divisor;
+   unsigned output_offset;
+
+   unsigned input_size;
+   unsigned output_size;
+
+   /** Copy the element unmodified. */
+   bool copy;
+
+   /** The RGBA components of the input, after swizzling. */
+   struct avx2_channel input[4];
+
+   /** The channels of the output, and the RGBA component of each. */
+   struct avx2_channel output[4];
+   unsigned output_swizzle[4];
+   unsigned nr_output_channels;
+};
+
+struct translate_avx2_buffer {
+   const uint8_t *base_ptr;
+   unsigned stride;
+   unsigned max_index;
+};
+
+struct translate_avx2 {
+   struct translate translate;
+
+   unsigned nr_elements;
+   struct translate_avx2_element element[TRANSLATE_MAX_ATTRIBS];
+   struct translate_avx2_buffer buffer[TRANSLATE_MAX_ATTRIBS];
+};
+
+
+static inline struct translate_avx2 *
+translate_avx2(struct translate *translate)
+{
+   return (struct translate_avx2 *)translate;
+}
+
+
+static inline uint32_t
+avx2_hmax_epu32(__m256i v)
+{
+   __m128i m = _mm_max_epu32(_mm256_castsi256_si128(v),
+                             _mm256_extracti128_si256(v, 1));
+   m = _mm_max_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+   m = _mm_max_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+   return _mm_cvtsi128_si32(m);
+}
+
+
+static inline __m256
+avx2_u32_to_ps(__m256i v, unsigned size)
+{
+   if (size < 32)
+      return _mm256_cvtepi32_ps(v);
+
+   const __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16));
+   const __m256 lo =
+      _mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(0xffff)));
+   return _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.0f)), lo);
+}
+
+
+/* 32-bit normalized channels are scaled in double precision, as util_format
+ * does, since scaling in single precision can be off by one ulp.
+ */
+static inline __m256
+avx2_norm32_to_ps(__m256i v, bool is_signed)
+{
+   const __m256d scale = _mm256_set1_pd(is_signed ? 1.0 / 0x7fffffff :
+                                                    1.0 / 0xffffffff);
+   __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v));
+   __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1));
+
+   if (!is_signed) {
+      const __m256d two32 = _mm256_set1_pd(4294967296.0);
+      const __m256d zero = _mm256_setzero_pd();
+
+      lo = _mm256_add_pd(lo, _mm256_and_pd(_mm256_cmp_pd(lo, zero, _CMP_LT_OQ),
+                                           two32));
+      hi = _mm256_add_pd(hi, _mm256_and_pd(_mm256_cmp_pd(hi, zero, _CMP_LT_OQ),
+                                           two32));
+   }
+
+   return _mm256_insertf128_ps(
+      _mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_mul_pd(lo, scale))),
+      _mm256_cvtpd_ps(_mm256_mul_pd(hi, scale)), 1);
+}
+
+
+/* Truncating conversion of floats in [0, 2^32). */
+static inline __m256i
+avx2_ps_to_u32(__m256 f)
+{
+   const __m256 two31 = _mm256_set1_ps(2147483648.0f);
+   const __m256 big = _mm256_cmp_ps(f, two31, _CMP_GE_OQ);
+
+   f = _mm256_sub_ps(f, _mm256_and_ps(big, two31));
+   return _mm256_xor_si256(_mm256_cvttps_epi32(f),
+                           _mm256_slli_epi32(_mm256_castps_si256(big), 31));
+}
+
+
+static inline __m256i
+avx2_extract_unsigned(__m256i v, const struct avx2_channel *ch)
+{
+   if (ch->size == 32)
+      return v;
+
+   v = _mm256_srl_epi32(v, _mm_cvtsi32_si128(ch->shift));
+   return _mm256_and_si256(v, _mm256_set1_epi32((1u << ch->size) - 1));
+}
+
+
+static inline __m256i
+avx2_extract_signed(__m256i v, const struct avx2_channel *ch)
+{
+   if (ch->size == 32)
+      return v;
+
+   v = _mm256_sll_epi32(v, _mm_cvtsi32_si128(32 - ch->shift - ch->size));
+   return _mm256_sra_epi32(v, _mm_cvtsi32_si128(32 - ch->size));
+}
+
+
+/**
+ * Unpack one RGBA component of 8 elements to floats, or to integers for
+ * pure integer formats.
+ */
+static inline __m256i
+avx2_decode(const struct avx2_channel *ch, const __m256i *dw)
+{
+   const __m256i v = dw[ch->dword];
+   __m256 f;
+
+   switch (ch->kind) {
+   case AVX2_CHANNEL_CONST:
+      return _mm256_set1_epi32(ch->value);
+   case AVX2_CHANNEL_FLOAT32:
+      return v;
+   case AVX2_CHANNEL_FLOAT16: {
+      __m256i h = avx2_extract_unsigned(v, ch);
+      h = _mm256_packus_epi32(h, h);
+      h = _mm256_permute4x64_epi64(h, _MM_SHUFFLE(3, 1, 2, 0));
+      return _mm256_castps_si256(_mm256_cvtph_ps(_mm256_castsi256_si128(h)));
+   }
+   case AVX2_CHANNEL_UNORM:
+      if (ch->size == 32)
+         return _mm256_castps_si256(avx2_norm32_to_ps(v, false));
+      f = avx2_u32_to_ps(avx2_extract_unsigned(v, ch), ch->size);
+      return _mm256_castps_si256(_mm256_mul_ps(f, _mm256_set1_ps(ch->rcp)));
+   case AVX2_CHANNEL_SNORM:
+      if (ch->size == 32)
+         f = avx2_norm32_to_ps(v, true);
+      else
+         f = _mm256_mul_ps(_mm256_cvtepi32_ps(avx2_extract_signed(v, ch)),
+                           _mm256_set1_ps(ch->rcp));
+      return _mm256_castps_si256(_mm256_max_ps(f, _mm256_set1_ps(-1.0f)));
+   case AVX2_CHANNEL_USCALED:
+      f = avx2_u32_to_ps(avx2_extract_unsigned(v, ch), ch->size);
+      return _mm256_castps_si256(f);
+   case AVX2_CHANNEL_SSCALED:
+      f = _mm256_cvtepi32_ps(avx2_extract_signed(v, ch));
+      return _mm256_castps_si256(f);
+   case AVX2_CHANNEL_UINT:
+      return avx2_extract_unsigned(v, ch);
+   case AVX2_CHANNEL_SINT:
+      return avx2_extract_signed(v, ch);
+   }
+
+   unreachable("bad channel kind");
+}
+
+
+/**
+ * Pack one channel of 8 elements into its bits of the output dword.
+ */
+static inline __m256i
+avx2_encode(const struct avx2_channel *ch, __m256i x)
+{
+   __m256 f = _mm256_castsi256_ps(x);
+   __m256i v;
+
+   switch (ch->kind) {
+   case AVX2_CHANNEL_CONST:
+      v = _mm256_set1_epi32(ch->value);
+      break;
+   case AVX2_CHANNEL_FLOAT32:
+      return x;
+   case AVX2_CHANNEL_FLOAT16:
+      v = _mm256_cvtepu16_epi32(_mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+      break;
+   case AVX2_CHANNEL_UNORM:
+      f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()),
+                        _mm256_set1_ps(1.0f));
+      f = _mm256_add_ps(_mm256_mul_ps(f, _mm256_set1_ps(ch->scale)),
+                        _mm256_set1_ps(0.5f));
+      v = avx2_ps_to_u32(_mm256_min_ps(f, _mm256_set1_ps(ch->max)));
+      break;
+   case AVX2_CHANNEL_SNORM:
+      f = _mm256_min_ps(_mm256_max_ps(f, _mm256_set1_ps(-1.0f)),
+                        _mm256_set1_ps(1.0f));
+      f = _mm256_mul_ps(f, _mm256_set1_ps(ch->scale));
+      v = _mm256_cvtps_epi32(_mm256_min_ps(f, _mm256_set1_ps(ch->max)));
+      break;
+   case AVX2_CHANNEL_USCALED:
+      f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()),
+                        _mm256_set1_ps(ch->max));
+      v = avx2_ps_to_u32(f);
+      break;
+   case AVX2_CHANNEL_SSCALED:
+      f = _mm256_min_ps(_mm256_max_ps(f, _mm256_set1_ps(ch->min)),
+                        _mm256_set1_ps(ch->max));
+      v = _mm256_cvttps_epi32(f);
+      break;
+   case AVX2_CHANNEL_UINT:
+      if (ch->size == 32)
+         return x;
+      v = _mm256_min_epu32(x, _mm256_set1_epi32((1u << ch->size) - 1));
+      break;
+   case AVX2_CHANNEL_SINT:
+      if (ch->size == 32)
+         return x;
+      v = _mm256_max_epi32(x, _mm256_set1_epi32(-(1 << (ch->size - 1))));
+      v = _mm256_min_epi32(v, _mm256_set1_epi32((1 << (ch->size - 1)) - 1));
+      break;
+   default:
+      unreachable("bad channel kind");
+   }
+
+   if (ch->size == 32)
+      return v;
+
+   v = _mm256_and_si256(v, _mm256_set1_epi32((1u << ch->size) - 1));
+   return _mm256_sll_epi32(v, _mm_cvtsi32_si128(ch->shift));
+}
+
+
+/**
+ * Load the dwords of an element which is the same for all the vertices.
+ */
+static inline void
+avx2_fetch_uniform(const uint8_t *src, unsigned size, __m256i *dw)
+{
+   uint32_t tmp[4] = {0};
+
+   memcpy(tmp, src, size);
+   for (unsigned i = 0; i < DIV_ROUND_UP(size, 4); i++)
+      dw[i] = _mm256_set1_epi32(tmp[i]);
+}
+
+
+/**
+ * Gather the dwords of an element for 8 vertices.
+ */
+static inline void
+avx2_fetch(const uint8_t *src, unsigned stride, unsigned size,
+           __m256i idx, __m256i *dw)
+{
+   const unsigned ndw = DIV_ROUND_UP(size, 4);
+   const uint32_t hmax = avx2_hmax_epu32(idx);
+
+   if ((uint64_t)hmax * stride + ndw * 4 > INT32_MAX) {
+      /* The offsets don't fit the gathers. */
+      uint32_t index[AVX2_LANES];
+      uint32_t tmp[4][AVX2_LANES] = {{0}};
+
+      _mm256_storeu_si256((__m256i *)index, idx);
+      for (unsigned l = 0; l < AVX2_LANES; l++) {
+         uint32_t v[4] = {0};
+
+         memcpy(v, src + (size_t)index[l] * stride, size);
+         for (unsigned i = 0; i < ndw; i++)
+            tmp[i][l] = v[i];
+      }
+      for (unsigned i = 0; i < ndw; i++)
+         dw[i] = _mm256_loadu_si256((const __m256i *)tmp[i]);
+      return;
+   }
+
+   const __m256i offsets = _mm256_mullo_epi32(idx, _mm256_set1_epi32(stride));
+
+   for (unsigned i = 0; i < size / 4; i++)
+      dw[i] = _mm256_i32gather_epi32((const int *)(src + i * 4), offsets, 1);
+
+   if (size % 4) {
+      const unsigned i = size / 4;
+      const uint8_t *last = src + (size_t)hmax * stride + i * 4;
+      uint32_t tail = 0;
+
+      memcpy(&tail, last, size % 4);
+
+      if (stride + size >= ndw * 4) {
+         /* Reading past the element stays inside the element of the
+          * vertex with the largest index.
+          */
+         const __m256i safe = _mm256_cmpgt_epi32(_mm256_set1_epi32(hmax), idx);
+         dw[i] = _mm256_mask_i32gather_epi32(_mm256_set1_epi32(tail),
+                                             (const int *)(src + i * 4),
+                                             offsets, safe, 1);
+      } else {
+         uint32_t index[AVX2_LANES];
+         uint32_t tmp[AVX2_LANES];
+
+         _mm256_storeu_si256((__m256i *)index, idx);
+         for (unsigned l = 0; l < AVX2_LANES; l++) {
+            tmp[l] = 0;
+            memcpy(&tmp[l], src + (size_t)index[l] * stride + i * 4, size % 4);
+         }
+         dw[i] = _mm256_loadu_si256((const __m256i *)tmp);
+      }
+   }
+}
+
+
+/**
+ * Store the dwords of an element for the first \p n vertices.
+ */
+static inline void
+avx2_store(uint8_t *dst, unsigned stride, unsigned size, unsigned n,
+           const __m256i *dw)
+{
+   if (size == 16 && n == AVX2_LANES) {
+      const __m256i t0 = _mm256_unpacklo_epi32(dw[0], dw[1]);
+      const __m256i t1 = _mm256_unpackhi_epi32(dw[0], dw[1]);
+      const __m256i t2 = _mm256_unpacklo_epi32(dw[2], dw[3]);
+      const __m256i t3 = _mm256_unpackhi_epi32(dw[2], dw[3]);
+      const __m256i v[4] = {
+         _mm256_unpacklo_epi64(t0, t2),
+         _mm256_unpackhi_epi64(t0, t2),
+         _mm256_unpacklo_epi64(t1, t3),
+         _mm256_unpackhi_epi64(t1, t3),
+      };
+
+      for (unsigned l = 0; l < 4; l++) {
+         _mm_storeu_si128((__m128i *)(dst + l * stride),
+                          _mm256_castsi256_si128(v[l]));
+         _mm_storeu_si128((__m128i *)(dst + (l + 4) * stride),
+                          _mm256_extracti128_si256(v[l], 1));
+      }
+      return;
+   }
+
+   uint32_t tmp[4][AVX2_LANES];
+   for (unsigned i = 0; i < DIV_ROUND_UP(size, 4); i++)
+      _mm256_storeu_si256((__m256i *)tmp[i], dw[i]);
+
+   for (unsigned l = 0; l < n; l++, dst += stride) {
+      const uint32_t v[4] = { tmp[0][l], tmp[1][l], tmp[2][l], tmp[3][l] };
+
+      switch (size) {
+      case 4:
+         memcpy(dst, v, 4);
+         break;
+      case 8:
+         memcpy(dst, v, 8);
+         break;
+      case 12:
+         memcpy(dst, v, 12);
+         break;
+      case 16:
+         memcpy(dst, v, 16);
+         break;
+      default:
+         memcpy(dst, v, size);
+         break;
+      }
+   }
+}
+
+
+static inline __m256i
+avx2_load_indices(const void *elts, unsigned index_size, unsigned start,
+                  unsigned n)
+{
+   if (n == AVX2_LANES) {
+      switch (index_size) {
+      case 4:
+         return _mm256_loadu_si256((const __m256i *)elts);
+      case 2:
+         return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)elts));
+      case 1:
+         return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)elts));
+      default:
+         return _mm256_add_epi32(_mm256_set1_epi32(start),
+                                 _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+      }
+   }
+
+   /* Fill the unused lanes with the first vertex, so that they are
+    * fetched from valid addresses and don't change the largest index.
+    */
+   uint32_t index[AVX2_LANES];
+   for (unsigned l = 0; l < AVX2_LANES; l++) {
+      const unsigned i = l < n ? l : 0;
+
+      switch (index_size) {
+      case 4:
+         index[l] = ((const uint32_t *)elts)[i];
+         break;
+      case 2:
+         index[l] = ((const uint16_t *)elts)[i];
+         break;
+      case 1:
+         index[l] = ((const uint8_t *)elts)[i];
+         break;
+      default:
+         index[l] = start + i;
+         break;
+      }
+   }
+   return _mm256_loadu_si256((const __m256i *)index);
+}
+
+
+static ALWAYS_INLINE void
+avx2_run(struct translate_avx2 *p, const void *elts, unsigned index_size,
+         unsigned start, unsigned count, unsigned start_instance,
+         unsigned instance_id, void *output_buffer)
+{
+   const unsigned output_stride = p->translate.key.output_stride;
+   const uint8_t *uniform[TRANSLATE_MAX_ATTRIBS];
+
+   /* Instanced elements and the instance ID don't depend on the vertex. */
+   for (unsigned i = 0; i < p->nr_elements; i++) {
+      const struct translate_avx2_element *e = &p->element[i];
+      const struct translate_avx2_buffer *b = &p->buffer[e->buffer];
+
+      if (e->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         uniform[i] = (const uint8_t *)&instance_id;
+      } else if (e->instance_divisor) {
+         const unsigned index = start_instance + instance_id / e->instance_divisor;
+         uniform[i] = b->base_ptr + e->input_offset + (size_t)b->stride * index;
+      } else if (!b->stride) {
+         uniform[i] = b->base_ptr + e->input_offset;
+      } else {
+         uniform[i] = NULL;
+      }
+   }
+
+   for (unsigned v = 0; v < count; v += AVX2_LANES) {
+      const unsigned n = MIN2(count - v, AVX2_LANES);
+      const __m256i elt_idx =
+         avx2_load_indices((const uint8_t *)elts + v * index_size, index_size,
+                           start + v, n);
+      uint8_t *vert = (uint8_t *)output_buffer + (size_t)v * output_stride;
+
+      for (unsigned i = 0; i < p->nr_elements; i++) {
+         const struct translate_avx2_element *e = &p->element[i];
+         __m256i dw[4];
+
+         if (uniform[i]) {
+            avx2_fetch_uniform(uniform[i], e->input_size, dw);
+         } else {
+            const struct translate_avx2_buffer *b = &p->buffer[e->buffer];
+            __m256i idx = elt_idx;
+
+            /* clamp to avoid going out of bounds */
+            if (index_size)
+               idx = _mm256_min_epu32(idx, _mm256_set1_epi32(b->max_index));
+
+            avx2_fetch(b->base_ptr + e->input_offset, b->stride,
+                       e->input_size, idx, dw);
+         }
+
+         if (e->copy) {
+            avx2_store(vert + e->output_offset, output_stride,
+                       e->output_size, n, dw);
+            continue;
+         }
+
+         __m256i rgba[4], out[4];
+         for (unsigned c = 0; c < 4; c++) {
+            rgba[c] = avx2_decode(&e->input[c], dw);
+            out[c] = _mm256_setzero_si256();
+         }
+
+         for (unsigned c = 0; c < e->nr_output_channels; c++) {
+            const struct avx2_channel *ch = &e->output[c];
+
+            out[ch->dword] = _mm256_or_si256(out[ch->dword],
+               avx2_encode(ch, rgba[e->output_swizzle[c]]));
+         }
+
+         avx2_store(vert + e->output_offset, output_stride,
+                    e->output_size, n, out);
+      }
+   }
+}
+
+
+static void UTIL_CDECL
+avx2_run_elts(struct translate *translate,
+              const unsigned *elts,
+              unsigned count,
+              unsigned start_instance,
+              unsigned instance_id,
+              void *output_buffer)
+{
+   avx2_run(translate_avx2(translate), elts, 4, 0, count,
+            start_instance, instance_id, output_buffer);
+}
+
+static void UTIL_CDECL
+avx2_run_elts16(struct translate *translate,
+                const uint16_t *elts,
+                unsigned count,
+                unsigned start_instance,
+                unsigned instance_id,
+                void *output_buffer)
+{
+   avx2_run(translate_avx2(translate), elts, 2, 0, count,
+            start_instance, instance_id, output_buffer);
+}
+
+static void UTIL_CDECL
+avx2_run_elts8(struct translate *translate,
+               const uint8_t *elts,
+               unsigned count,
+               unsigned start_instance,
+               unsigned instance_id,
+               void *output_buffer)
+{
+   avx2_run(translate_avx2(translate), elts, 1, 0, count,
+            start_instance, instance_id, output_buffer);
+}
+
+static void UTIL_CDECL
+avx2_run_linear(struct translate *translate,
+                unsigned start,
+                unsigned count,
+                unsigned start_instance,
+                unsigned instance_id,
+                void *output_buffer)
+{
+   avx2_run(translate_avx2(translate), NULL, 0, start, count,
+            start_instance, instance_id, output_buffer);
+}
+
+
+static void
+avx2_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+
+   if (buf < ARRAY_SIZE(p->buffer)) {
+      p->buffer[buf].base_ptr = ptr;
+      p->buffer[buf].stride = stride;
+      p->buffer[buf].max_index = max_index;
+   }
+}
+
+
+static void
+avx2_release(struct translate *translate)
+{
+   FREE(translate);
+}
+
+
+/**
+ * Describe a channel of a format, or return false if it can't be
+ * converted.
+ */
+static bool
+avx2_init_channel(struct avx2_channel *ch,
+                  const struct util_format_channel_description *desc)
+{
+   const unsigned size = desc->size;
+
+   if (!size || size > 32 || (desc->shift % 32) + size > 32)
+      return false;
+
+   ch->dword = desc->shift / 32;
+   ch->shift = desc->shift % 32;
+   ch->size = size;
+
+   switch (desc->type) {
+   case UTIL_FORMAT_TYPE_VOID:
+      ch->kind = AVX2_CHANNEL_CONST;
+      ch->value = 0;
+      return true;
+   case UTIL_FORMAT_TYPE_FLOAT:
+      if (size == 32) {
+         ch->kind = AVX2_CHANNEL_FLOAT32;
+      } else if (size == 16 && ch->shift % 16 == 0) {
+         ch->kind = AVX2_CHANNEL_FLOAT16;
+      } else {
+         return false;
+      }
+      return true;
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+      if (desc->pure_integer) {
+         ch->kind = AVX2_CHANNEL_UINT;
+      } else if (desc->normalized) {
+         ch->kind = AVX2_CHANNEL_UNORM;
+      } else {
+         ch->kind = AVX2_CHANNEL_USCALED;
+      }
+      ch->scale = (float)u_uintN_max(size);
+      ch->rcp = 1.0f / ch->scale;
+      ch->min = 0.0f;
+      ch->max = MIN2(ch->scale, 4294967040.0f);
+      return true;
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (desc->pure_integer) {
+         ch->kind = AVX2_CHANNEL_SINT;
+      } else if (desc->normalized) {
+         ch->kind = AVX2_CHANNEL_SNORM;
+      } else {
+         ch->kind = AVX2_CHANNEL_SSCALED;
+      }
+      ch->scale = (float)u_intN_max(size);
+      ch->rcp = 1.0f / ch->scale;
+      ch->min = (float)u_intN_min(size);
+      ch->max = MIN2(ch->scale, 2147483520.0f);
+      return true;
+   default:
+      return false;
+   }
+}
+
+
+static bool
+avx2_is_plain(const struct util_format_description *desc)
+{
+   return desc->layout == UTIL_FORMAT_LAYOUT_PLAIN &&
+          desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB &&
+          desc->block.width == 1 && desc->block.height == 1 &&
+          desc->block.depth == 1 &&
+          desc->block.bits && desc->block.bits <= 128 &&
+          !(desc->block.bits & 7);
+}
+
+
+static bool
+avx2_is_legal_int_format_combo(const struct util_format_description *src,
+                               const struct util_format_description *dst)
+{
+   unsigned nr = MIN2(src->nr_channels, dst->nr_channels);
+
+   for (unsigned i = 0; i < nr; i++) {
+      /* The signs must match. */
+      if (src->channel[i].type != dst->channel[i].type)
+         return false;
+
+      /* Integers must not lose precision at any point in the pipeline. */
+      if (src->channel[i].size > dst->channel[i].size)
+         return false;
+   }
+   return true;
+}
+
+
+static bool
+avx2_init_element(struct translate_avx2_element *e,
+                  const struct translate_element *key)
+{
+   const struct util_format_description *in =
+      util_format_description(key->input_format);
+   const struct util_format_description *out =
+      util_format_description(key->output_format);
+
+   if (!in || !out || !avx2_is_plain(in) || !avx2_is_plain(out))
+      return false;
+
+   e->type = key->type;
+   e->buffer = key->input_buffer;
+   e->input_offset = key->input_offset;
+   e->instance_divisor = key->instance_divisor;
+   e->output_offset = key->output_offset;
+   e->input_size = in->block.bits / 8;
+   e->output_size = out->block.bits / 8;
+
+   if (key->input_format == key->output_format) {
+      e->copy = true;
+      return true;
+   }
+
+   const bool integer = util_format_is_pure_integer(key->input_format);
+   if (integer != util_format_is_pure_integer(key->output_format) ||
+       (integer && !avx2_is_legal_int_format_combo(in, out)))
+      return false;
+
+   for (unsigned c = 0; c < 4; c++) {
+      const unsigned swizzle = in->swizzle[c];
+      struct avx2_channel *ch = &e->input[c];
+
+      if (swizzle <= PIPE_SWIZZLE_W) {
+         if (!avx2_init_channel(ch, &in->channel[swizzle]))
+            return false;
+      } else {
+         memset(ch, 0, sizeof(*ch));
+         ch->kind = AVX2_CHANNEL_CONST;
+         if (swizzle == PIPE_SWIZZLE_1)
+            ch->value = integer ? 1 : fui(1.0f);
+      }
+   }
+
+   e->nr_output_channels = out->nr_channels;
+   for (unsigned c = 0; c < out->nr_channels; c++) {
+      if (!avx2_init_channel(&e->output[c], &out->channel[c]))
+         return false;
+
+      /* Output channels that no component maps to are written as zero. */
+      e->output_swizzle[c] = 0;
+      if (e->output[c].kind != AVX2_CHANNEL_CONST) {
+         unsigned k;
+         for (k = 0; k < 4; k++) {
+            if (out->swizzle[k] == c)
+               break;
+         }
+         if (k < 4) {
+            e->output_swizzle[c] = k;
+         } else {
+            e->output[c].kind = AVX2_CHANNEL_CONST;
+            e->output[c].value = 0;
+         }
+      }
+   }
+
+   return true;
+}
+
+
+struct translate *
+translate_avx2_create(const struct translate_key *key)
+{
+   struct translate_avx2 *p;
+
+   if (!util_get_cpu_caps()->has_avx2 || !util_get_cpu_caps()->has_f16c)
+      return NULL;
+
+   p = CALLOC_STRUCT(translate_avx2);
+   if (!p)
+      return NULL;
+
+   assert(key->nr_elements <= TRANSLATE_MAX_ATTRIBS);
+
+   p->translate.key = *key;
+   p->translate.release = avx2_release;
+   p->translate.set_buffer = avx2_set_buffer;
+   p->translate.run_elts = avx2_run_elts;
+   p->translate.run_elts16 = avx2_run_elts16;
+   p->translate.run_elts8 = avx2_run_elts8;
+   p->translate.run = avx2_run_linear;
+
+   for (unsigned i = 0; i < key->nr_elements; i++) {
+      if (key->element[i].input_buffer >= ARRAY_SIZE(p->buffer) ||
+          !avx2_init_element(&p->element[i], &key->element[i])) {
+         FREE(p);
+         return NULL;
+      }
+   }
+   p->nr_elements = key->nr_elements;
+
+   return &p->translate;
+}
+
+
+#else
+
+struct translate *
+translate_avx2_create(const struct translate_key *key)
+{
+   return NULL;
+}
+
+#endif
@@ -30,6 +30,7 @@
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
 #include "util/u_upload_mgr.h"
+#include "util/os_time.h"
 #include "driver_trace/tr_context.h"
 #include "util/log.h"
 #include "util/perf/cpu_trace.h"
@@ -581,6 +582,8 @@ tc_batch_flush(struct threaded_context *tc, bool full_copy)
    tc->bytes_mapped_estimate = 0;
    tc->bytes_replaced_estimate = 0;
    p_atomic_add(&tc->num_offloaded_slots, next->num_total_slots);
+   p_atomic_add(&tc->num_batch_slots, tc->batch_size);
+   p_atomic_inc(&tc->num_batches);
 
    if (next->token) {
       next->token->tc = NULL;
@@ -597,8 +600,11 @@ tc_batch_flush(struct threaded_context *tc, bool full_copy)
       tc_batch_increment_renderpass_info(tc, next_id, full_copy);
    }
 
+   /* This blocks while all the other batches are queued. */
+   int64_t start = os_time_get_nano();
    util_queue_add_job(&tc->queue, next, &next->fence, tc_batch_execute,
                       NULL, 0);
+   p_atomic_add(&tc->producer_stall_ns, os_time_get_nano() - start);
    tc->last = tc->next;
    tc->next = next_id;
    if (next_id == 0)
@@ -607,6 +613,26 @@ tc_batch_flush(struct threaded_context *tc, bool full_copy)
 
 }
 
+/* Return the size of the batches following one flushed because it's full,
+ * adapted to the driver thread. If the driver thread is idle, smaller
+ * batches give it work sooner. If batches pile up, larger ones make it pay
+ * the per-batch overhead less often.
+ */
+static unsigned
+tc_adapt_batch_size(struct threaded_context *tc)
+{
+   unsigned num_queued = 0;
+
+   for (unsigned i = 0; i < TC_MAX_BATCHES; i++)
+      num_queued += !util_queue_fence_is_signalled(&tc->batch_slots[i].fence);
+
+   if (num_queued == 0)
+      return MAX2(tc->batch_size / 2, TC_MIN_SLOTS_PER_BATCH);
+   else if (num_queued >= TC_MAX_BATCHES / 2)
+      return MIN2(tc->batch_size * 2, TC_SLOTS_PER_BATCH);
+   return tc->batch_size;
+}
+
 /* This is the function that adds variable-sized calls into the current
  * batch. It also flushes the batch if there is not enough space there.
  * All other higher-level "add" functions use it.
@@ -620,9 +646,16 @@ tc_add_sized_call(struct threaded_context *tc, enum tc_call_id id,
    assert(num_slots <= TC_SLOTS_PER_BATCH - 1);
    tc_debug_check(tc);
 
-   if (unlikely(next->num_total_slots + num_slots > TC_SLOTS_PER_BATCH - 1)) {
+   /* A call larger than batch_size still fits in an empty batch. */
+   if (unlikely(next->num_total_slots + num_slots > tc->batch_size - 1) &&
+       next->num_total_slots) {
+      /* Check the driver thread before this batch is queued, but flush it
+       * with the size it was filled to.
+       */
+      unsigned batch_size = tc_adapt_batch_size(tc);
       /* copy existing renderpass info during flush */
       tc_batch_flush(tc, true);
+      tc->batch_size = batch_size;
       next = &tc->batch_slots[tc->next];
       tc_assert(next->num_total_slots == 0);
       tc_assert(next->last_mergeable_call == NULL);
@@ -686,7 +719,7 @@ tc_enlarge_last_mergeable_call(struct threaded_context *tc, unsigned desired_num
 
    unsigned added_slots = desired_num_slots - call->num_slots;
 
-   if (unlikely(batch->num_total_slots + added_slots > TC_SLOTS_PER_BATCH - 1))
+   if (unlikely(batch->num_total_slots + added_slots > tc->batch_size - 1))
       return false;
 
    batch->num_total_slots += added_slots;
@@ -741,7 +774,9 @@ _tc_sync(struct threaded_context *tc, UNUSED const char *info, UNUSED const char
 
    /* Only wait for queued calls... */
    if (!util_queue_fence_is_signalled(&last->fence)) {
+      int64_t start = os_time_get_nano();
       util_queue_fence_wait(&last->fence);
+      p_atomic_add(&tc->producer_stall_ns, os_time_get_nano() - start);
       synced = true;
    }
 
@@ -1119,6 +1154,21 @@ threaded_context_unwrap_sync(struct pipe_context *pipe)
    return (struct pipe_context*)pipe->priv;
 }
 
+static void
+tc_destroy(struct pipe_context *_pipe);
+
+/**
+ * Return the threaded context if pipe is one, NULL otherwise.
+ */
+struct threaded_context *
+threaded_context_from_pipe(struct pipe_context *pipe)
+{
+   if (!pipe || pipe->destroy != tc_destroy)
+      return NULL;
+
+   return threaded_context(pipe);
+}
+
 
 /********************************************************************
  * simple functions
@@ -4027,10 +4077,10 @@ tc_draw_multi(struct pipe_context *_pipe, const struct pipe_draw_info *info,
    while (num_draws) {
       struct tc_batch *next = &tc->batch_slots[tc->next];
 
-      int nb_slots_left = TC_SLOTS_PER_BATCH - 1 - next->num_total_slots;
+      int nb_slots_left = (int)tc->batch_size - 1 - next->num_total_slots;
       /* If there isn't enough place for one draw, try to fill the next one */
       if (nb_slots_left < SLOTS_FOR_ONE_DRAW)
-         nb_slots_left = TC_SLOTS_PER_BATCH - 1;
+         nb_slots_left = tc->batch_size - 1;
       const int size_left_bytes = nb_slots_left * sizeof(struct tc_call_base);
 
       /* How many draws can we fit in the current batch */
@@ -4096,10 +4146,10 @@ tc_draw_user_indices_multi(struct pipe_context *_pipe,
    while (num_draws) {
       struct tc_batch *next = &tc->batch_slots[tc->next];
 
-      int nb_slots_left = TC_SLOTS_PER_BATCH - 1 - next->num_total_slots;
+      int nb_slots_left = (int)tc->batch_size - 1 - next->num_total_slots;
       /* If there isn't enough place for one draw, try to fill the next one */
       if (nb_slots_left < SLOTS_FOR_ONE_DRAW)
-         nb_slots_left = TC_SLOTS_PER_BATCH - 1;
+         nb_slots_left = tc->batch_size - 1;
       const int size_left_bytes = nb_slots_left * sizeof(struct tc_call_base);
 
       /* How many draws can we fit in the current batch */
@@ -4391,10 +4441,10 @@ tc_draw_vertex_state(struct pipe_context *_pipe,
    while (num_draws) {
       struct tc_batch *next = &tc->batch_slots[tc->next];
 
-      int nb_slots_left = TC_SLOTS_PER_BATCH - 1 - next->num_total_slots;
+      int nb_slots_left = (int)tc->batch_size - 1 - next->num_total_slots;
       /* If there isn't enough place for one draw, try to fill the next one */
       if (nb_slots_left < slots_for_one_draw)
-         nb_slots_left = TC_SLOTS_PER_BATCH - 1;
+         nb_slots_left = tc->batch_size - 1;
       const int size_left_bytes = nb_slots_left * sizeof(struct tc_call_base);
 
       /* How many draws can we fit in the current batch */
@@ -5251,6 +5301,7 @@ threaded_context_create(struct pipe_context *pipe,
       goto fail;
 
    tc->last_completed = -1;
+   tc->batch_size = TC_SLOTS_PER_BATCH;
    for (unsigned i = 0; i < TC_MAX_BATCHES; i++) {
 #if !defined(NDEBUG) && TC_DEBUG >= 1
       tc->batch_slots[i].sentinel = TC_SENTINEL;
@@ -252,6 +252,12 @@ struct tc_unflushed_batch_token;
  */
 #define TC_SLOTS_PER_BATCH    1536
 
+/* Batches are flushed once they reach threaded_context::batch_size, which
+ * adapts between this and TC_SLOTS_PER_BATCH to how fast the driver thread
+ * consumes them.
+ */
+#define TC_MIN_SLOTS_PER_BATCH 192
+
 /* The buffer list queue is much deeper than the batch queue because buffer
  * lists need to stay around until the driver internally flushes its command
  * buffer.
@@ -588,8 +594,14 @@ struct threaded_context {
 
    /* Counters for the HUD. */
    unsigned num_offloaded_slots;
+   unsigned num_batch_slots; /* sum of batch_size over the flushed batches */
    unsigned num_direct_slots;
    unsigned num_syncs;
+   unsigned num_batches;
+   uint64_t producer_stall_ns; /* time spent waiting for the driver thread */
+
+   /* Number of slots at which the unflushed batch is flushed. */
+   unsigned batch_size;
 
    bool use_forced_staging_uploads;
    bool add_all_gfx_bindings_to_buffer_list;
@@ -684,6 +696,7 @@ struct threaded_context {
 void threaded_resource_init(struct pipe_resource *res, bool allow_cpu_storage);
 void threaded_resource_deinit(struct pipe_resource *res);
 struct pipe_context *threaded_context_unwrap_sync(struct pipe_context *pipe);
+struct threaded_context *threaded_context_from_pipe(struct pipe_context *pipe);
 void tc_driver_internal_flush_notify(struct threaded_context *tc);
 
 /** function for getting the current renderpass info:
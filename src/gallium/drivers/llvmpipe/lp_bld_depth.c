@@ -514,6 +514,99 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Lane holding pixel (x, y) of a 4x4 block with 16-wide fragment vectors.
+ * Rows 0-1 are in the lower half and rows 2-3 in the upper half, each half
+ * in the 2x2 quad order of the 8-wide path.
+ */
+static unsigned
+lp_depth_lane_16(unsigned x, unsigned y)
+{
+   return (y / 2) * 8 + (x / 2) * 4 + (y % 2) * 2 + x % 2;
+}
+
+
+/**
+ * Load the 4x4 depth/stencil values for 16-wide fragment vectors, only for
+ * formats up to 32 bits.
+ */
+static LLVMValueRef
+lp_build_depth_stencil_load_16(struct gallivm_state *gallivm,
+                               struct lp_type zs_type,
+                               LLVMValueRef depth_ptr,
+                               LLVMValueRef depth_stride)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
+   LLVMValueRef shuffles[16];
+   LLVMValueRef rows[4];
+   struct lp_type row_type = zs_type;
+
+   assert(zs_type.length == 16 && zs_type.width <= 32);
+
+   row_type.length = 4;
+   LLVMTypeRef row_vec_type = lp_build_vec_type(gallivm, row_type);
+
+   for (unsigned y = 0; y < 4; y++) {
+      LLVMValueRef offset =
+         LLVMBuildMul(builder, depth_stride, lp_build_const_int32(gallivm, y), "");
+      LLVMValueRef ptr = LLVMBuildGEP2(builder, int8_type, depth_ptr,
+                                       &offset, 1, "");
+      ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(row_vec_type, 0), "");
+      rows[y] = LLVMBuildLoad2(builder, row_vec_type, ptr, "");
+   }
+
+   LLVMValueRef linear = lp_build_concat(gallivm, rows, row_type, 4);
+
+   /* linear holds pixel (x, y) at y * 4 + x */
+   for (unsigned y = 0; y < 4; y++) {
+      for (unsigned x = 0; x < 4; x++) {
+         shuffles[lp_depth_lane_16(x, y)] = lp_build_const_int32(gallivm, y * 4 + x);
+      }
+   }
+
+   return LLVMBuildShuffleVector(builder, linear, linear,
+                                 LLVMConstVector(shuffles, 16), "");
+}
+
+
+/**
+ * Store the 4x4 depth/stencil values of 16-wide fragment vectors, only for
+ * formats up to 32 bits.
+ */
+static void
+lp_build_depth_stencil_store_16(struct gallivm_state *gallivm,
+                                struct lp_type zs_type,
+                                LLVMValueRef depth_ptr,
+                                LLVMValueRef depth_stride,
+                                LLVMValueRef zs_value)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
+   LLVMValueRef shuffles[4];
+   struct lp_type row_type = zs_type;
+
+   assert(zs_type.length == 16 && zs_type.width <= 32);
+
+   row_type.length = 4;
+   LLVMTypeRef row_vec_type = lp_build_vec_type(gallivm, row_type);
+
+   for (unsigned y = 0; y < 4; y++) {
+      for (unsigned x = 0; x < 4; x++) {
+         shuffles[x] = lp_build_const_int32(gallivm, lp_depth_lane_16(x, y));
+      }
+      LLVMValueRef row = LLVMBuildShuffleVector(builder, zs_value, zs_value,
+                                                LLVMConstVector(shuffles, 4), "");
+      LLVMValueRef offset =
+         LLVMBuildMul(builder, depth_stride, lp_build_const_int32(gallivm, y), "");
+      LLVMValueRef ptr = LLVMBuildGEP2(builder, int8_type, depth_ptr,
+                                       &offset, 1, "");
+      ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(row_vec_type, 0), "");
+      LLVMBuildStore(builder, row, ptr);
+   }
+}
+
+
 /**
  * Load depth/stencil values.
  * The stored values are linear, swizzle them.
@@ -544,61 +637,68 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
    const unsigned depth_bytes = format_desc->block.bits / 8;
    struct lp_type zs_type = lp_depth_type(format_desc, z_src_type.length);
 
-   struct lp_type zs_load_type = zs_type;
-   zs_load_type.length = zs_load_type.length / 2;
+   if (z_src_type.length == 16) {
+      assert(!is_1d);
+      *z_fb = lp_build_depth_stencil_load_16(gallivm, zs_type, depth_ptr,
+                                             depth_stride);
+   } else {
+      struct lp_type zs_load_type = zs_type;
+      zs_load_type.length = zs_load_type.length / 2;
 
-   LLVMTypeRef zs_dst_type = lp_build_vec_type(gallivm, zs_load_type);
+      LLVMTypeRef zs_dst_type = lp_build_vec_type(gallivm, zs_load_type);
 
-   if (z_src_type.length == 4) {
-      LLVMValueRef looplsb = LLVMBuildAnd(builder, loop_counter,
-                                          lp_build_const_int32(gallivm, 1), "");
-      LLVMValueRef loopmsb = LLVMBuildAnd(builder, loop_counter,
-                                          lp_build_const_int32(gallivm, 2), "");
-      LLVMValueRef offset2 = LLVMBuildMul(builder, loopmsb,
-                                          depth_stride, "");
-      depth_offset1 = LLVMBuildMul(builder, looplsb,
-                                   lp_build_const_int32(gallivm, depth_bytes * 2), "");
-      depth_offset1 = LLVMBuildAdd(builder, depth_offset1, offset2, "");
-
-      /* just concatenate the loaded 2x2 values into 4-wide vector */
-      for (unsigned i = 0; i < 4; i++) {
-         shuffles[i] = lp_build_const_int32(gallivm, i);
-      }
-   } else {
-      unsigned i;
-      LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
-                                         lp_build_const_int32(gallivm, 1), "");
-      assert(z_src_type.length == 8);
-      depth_offset1 = LLVMBuildMul(builder, loopx2, depth_stride, "");
-      /*
-       * We load 2x4 values, and need to swizzle them (order
-       * 0,1,4,5,2,3,6,7) - not so hot with avx unfortunately.
-       */
-      for (i = 0; i < 8; i++) {
-         shuffles[i] = lp_build_const_int32(gallivm, (i&1) + (i&2) * 2 + (i&4) / 2);
+      if (z_src_type.length == 4) {
+         LLVMValueRef looplsb = LLVMBuildAnd(builder, loop_counter,
+                                             lp_build_const_int32(gallivm, 1), "");
+         LLVMValueRef loopmsb = LLVMBuildAnd(builder, loop_counter,
+                                             lp_build_const_int32(gallivm, 2), "");
+         LLVMValueRef offset2 = LLVMBuildMul(builder, loopmsb,
+                                             depth_stride, "");
+         depth_offset1 = LLVMBuildMul(builder, looplsb,
+                                      lp_build_const_int32(gallivm, depth_bytes * 2), "");
+         depth_offset1 = LLVMBuildAdd(builder, depth_offset1, offset2, "");
+
+         /* just concatenate the loaded 2x2 values into 4-wide vector */
+         for (unsigned i = 0; i < 4; i++) {
+            shuffles[i] = lp_build_const_int32(gallivm, i);
+         }
+      } else {
+         unsigned i;
+         LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
+                                            lp_build_const_int32(gallivm, 1), "");
+         assert(z_src_type.length == 8);
+         depth_offset1 = LLVMBuildMul(builder, loopx2, depth_stride, "");
+         /*
+          * We load 2x4 values, and need to swizzle them (order
+          * 0,1,4,5,2,3,6,7) - not so hot with avx unfortunately.
+          */
+         for (i = 0; i < 8; i++) {
+            shuffles[i] = lp_build_const_int32(gallivm, (i&1) + (i&2) * 2 + (i&4) / 2);
+         }
       }
-   }
 
-   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+      depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
 
-   /* Load current z/stencil values from z/stencil buffer */
-   LLVMTypeRef load_ptr_type = LLVMPointerType(zs_dst_type, 0);
-   LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
-   LLVMValueRef zs_dst_ptr =
-      LLVMBuildGEP2(builder, int8_type, depth_ptr, &depth_offset1, 1, "");
-   zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-   LLVMValueRef zs_dst1 = LLVMBuildLoad2(builder, zs_dst_type, zs_dst_ptr, "");
-   LLVMValueRef zs_dst2;
-   if (is_1d) {
-      zs_dst2 = lp_build_undef(gallivm, zs_load_type);
-   } else {
-      zs_dst_ptr = LLVMBuildGEP2(builder, int8_type, depth_ptr, &depth_offset2, 1, "");
+      /* Load current z/stencil values from z/stencil buffer */
+      LLVMTypeRef load_ptr_type = LLVMPointerType(zs_dst_type, 0);
+      LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
+      LLVMValueRef zs_dst_ptr =
+         LLVMBuildGEP2(builder, int8_type, depth_ptr, &depth_offset1, 1, "");
       zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-      zs_dst2 = LLVMBuildLoad2(builder, zs_dst_type, zs_dst_ptr, "");
+      LLVMValueRef zs_dst1 = LLVMBuildLoad2(builder, zs_dst_type, zs_dst_ptr, "");
+      LLVMValueRef zs_dst2;
+      if (is_1d) {
+         zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+      } else {
+         zs_dst_ptr = LLVMBuildGEP2(builder, int8_type, depth_ptr, &depth_offset2, 1, "");
+         zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
+         zs_dst2 = LLVMBuildLoad2(builder, zs_dst_type, zs_dst_ptr, "");
+      }
+
+      *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
+                                     LLVMConstVector(shuffles, zs_type.length), "");
    }
 
-   *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
-                                  LLVMConstVector(shuffles, zs_type.length), "");
    *s_fb = *z_fb;
 
    if (format_desc->block.bits == 8) {
@@ -712,6 +812,9 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
       depth_offset1 = LLVMBuildMul(builder, looplsb,
                                    lp_build_const_int32(gallivm, depth_bytes * 2), "");
       depth_offset1 = LLVMBuildAdd(builder, depth_offset1, offset2, "");
+   } else if (z_src_type.length == 16) {
+      /* the whole 4x4 block in one iteration, stored row by row below */
+      depth_offset1 = lp_build_const_int32(gallivm, 0);
    } else {
       LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
                                          lp_build_const_int32(gallivm, 1), "");
@@ -752,6 +855,13 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                lp_build_int_vec_type(gallivm, zs_type), "");
    }
 
+   if (z_src_type.length == 16) {
+      assert(!is_1d && format_desc->block.bits <= 32);
+      lp_build_depth_stencil_store_16(gallivm, zs_type, depth_ptr,
+                                      depth_stride, z_value);
+      return;
+   }
+
    if (format_desc->block.bits <= 32) {
       if (z_src_type.length == 4) {
          zs_dst1 = lp_build_extract_range(gallivm, z_value, 0, 2);
@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "util/u_memory.h"
+#include "gallivm/lp_bld_init.h"
+#include "lp_code_cache.h"
+
+
+static uint32_t
+lp_code_cache_hash(const void *key)
+{
+   /* The key is a SHA-1 hash already. */
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+
+static bool
+lp_code_cache_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, SHA1_DIGEST_LENGTH) == 0;
+}
+
+
+bool
+lp_code_cache_init(struct lp_code_cache *cache)
+{
+   cache->table = _mesa_hash_table_create(NULL, lp_code_cache_hash,
+                                          lp_code_cache_equal);
+   if (!cache->table)
+      return false;
+
+   (void) mtx_init(&cache->mutex, mtx_plain);
+   return true;
+}
+
+
+/**
+ * All contexts are gone by the time the screen is destroyed, and so are
+ * the entries.
+ */
+void
+lp_code_cache_fini(struct lp_code_cache *cache)
+{
+   assert(_mesa_hash_table_num_entries(cache->table) == 0);
+
+   _mesa_hash_table_destroy(cache->table, NULL);
+   mtx_destroy(&cache->mutex);
+}
+
+
+/**
+ * Returns a new reference to the entry of the given key, or NULL.
+ */
+struct lp_code_cache_entry *
+lp_code_cache_lookup(struct lp_code_cache *cache,
+                     const uint8_t key[SHA1_DIGEST_LENGTH])
+{
+   struct lp_code_cache_entry *entry = NULL;
+
+   mtx_lock(&cache->mutex);
+   struct hash_entry *he = _mesa_hash_table_search(cache->table, key);
+   if (he) {
+      entry = he->data;
+      entry->refcount++;
+   }
+   mtx_unlock(&cache->mutex);
+
+   return entry;
+}
+
+
+/**
+ * Add an entry, with its key and gallivm state set, holding one reference.
+ * If another context was quicker, the entry is left alone and a new
+ * reference to the other one is returned instead.
+ */
+struct lp_code_cache_entry *
+lp_code_cache_insert(struct lp_code_cache *cache,
+                     struct lp_code_cache_entry *entry)
+{
+   entry->refcount = 1;
+
+   mtx_lock(&cache->mutex);
+   struct hash_entry *he = _mesa_hash_table_search(cache->table, entry->key);
+   if (he) {
+      entry = he->data;
+      entry->refcount++;
+   } else {
+      _mesa_hash_table_insert(cache->table, entry->key, entry);
+   }
+   mtx_unlock(&cache->mutex);
+
+   return entry;
+}
+
+
+void
+lp_code_cache_unref(struct lp_code_cache *cache,
+                    struct lp_code_cache_entry *entry)
+{
+   mtx_lock(&cache->mutex);
+   bool last = --entry->refcount == 0;
+   if (last)
+      _mesa_hash_table_remove_key(cache->table, entry->key);
+   mtx_unlock(&cache->mutex);
+
+   if (last) {
+      gallivm_destroy(entry->gallivm);
+      FREE(entry);
+   }
+}
@@ -0,0 +1,68 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Compiled code shared by all contexts of a screen.
+ *
+ * Entries are keyed by a SHA-1 of everything their code depends on, so the
+ * code does not depend on the context it was compiled in, as shown by the
+ * disk cache reusing it across processes. Once the IR is freed, a gallivm
+ * state only holds machine code, so it can outlive the LLVM context of the
+ * context which compiled it.
+ *
+ * Entries are reference counted, and destroyed with their gallivm state
+ * once the last context using them lets go.
+ */
+
+#ifndef LP_CODE_CACHE_H
+#define LP_CODE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "c11/threads.h"
+#include "util/hash_table.h"
+#include "util/mesa-sha1.h"
+
+struct gallivm_state;
+
+
+/**
+ * Must be the first member of the structures holding the code, which are
+ * allocated with MALLOC/CALLOC and freed with the last reference.
+ */
+struct lp_code_cache_entry
+{
+   unsigned refcount;  /**< protected by lp_code_cache::mutex */
+   uint8_t key[SHA1_DIGEST_LENGTH];
+   struct gallivm_state *gallivm;
+};
+
+
+struct lp_code_cache
+{
+   mtx_t mutex;
+   struct hash_table *table;
+};
+
+
+bool
+lp_code_cache_init(struct lp_code_cache *cache);
+
+void
+lp_code_cache_fini(struct lp_code_cache *cache);
+
+struct lp_code_cache_entry *
+lp_code_cache_lookup(struct lp_code_cache *cache,
+                     const uint8_t key[SHA1_DIGEST_LENGTH]);
+
+struct lp_code_cache_entry *
+lp_code_cache_insert(struct lp_code_cache *cache,
+                     struct lp_code_cache_entry *entry);
+
+void
+lp_code_cache_unref(struct lp_code_cache *cache,
+                    struct lp_code_cache_entry *entry);
+
+#endif /* LP_CODE_CACHE_H */
@@ -107,7 +107,17 @@ llvmpipe_destroy(struct pipe_context *pipe)
 
    llvmpipe_sampler_matrix_destroy(llvmpipe);
 
+   /* Destroying the variants above dropped their pending optimized
+    * compiles from the queue, so it must outlive them. Only compiles of
+    * variants that were never destroyed can be left, and they are dropped
+    * here.
+    */
+   if (llvmpipe->fs_tiered_compile)
+      util_queue_destroy(&llvmpipe->fs_opt_queue);
+
    lp_context_destroy(&llvmpipe->context);
+   if (llvmpipe->fs_tiered_compile)
+      lp_context_destroy(&llvmpipe->fs_opt_context);
 
    align_free(llvmpipe);
 }
@@ -272,6 +282,22 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->context.ref)
       goto fail;
 
+#if !GALLIVM_USE_ORCJIT
+   /* Optimized fragment shader variants are compiled in their own LLVM
+    * context by a low priority background thread.
+    */
+   if (lp_screen->fs_tiered_compile &&
+       util_queue_init(&llvmpipe->fs_opt_queue, "lpfsopt", 64, 1,
+                       UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                       UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY, NULL)) {
+      lp_context_create(&llvmpipe->fs_opt_context);
+      if (llvmpipe->fs_opt_context.ref)
+         llvmpipe->fs_tiered_compile = true;
+      else
+         util_queue_destroy(&llvmpipe->fs_opt_queue);
+   }
+#endif
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -35,6 +35,7 @@
 
 #include "draw/draw_vertex.h"
 #include "util/u_blitter.h"
+#include "util/u_queue.h"
 
 #include "lp_tex_sample.h"
 #include "lp_jit.h"
@@ -175,6 +176,15 @@ struct llvmpipe_context {
    struct lp_cs_variant_list_item cs_variants_list;
    unsigned nr_cs_variants;
    unsigned nr_cs_instrs;
+
+   /** Shader variant code memory, see lp_variant_cache.h */
+   uint64_t variant_clock;
+   uint64_t fs_variant_bytes;
+   uint64_t cs_variant_bytes;
+   unsigned nr_variant_evictions;
+   unsigned nr_eviction_recompiles;
+   struct lp_evicted_variants fs_evicted_variants;
+   struct lp_evicted_variants cs_evicted_variants;
    struct lp_cs_context *csctx;
 
    struct lp_cs_context *task_ctx;
@@ -192,6 +202,11 @@ struct llvmpipe_context {
    /** The LLVMContext to use for LLVM related work */
    lp_context_ref context;
 
+   /** Background compilation of optimized fragment shader variants */
+   bool fs_tiered_compile;
+   struct util_queue fs_opt_queue;
+   lp_context_ref fs_opt_context;  /**< only used by the queue thread */
+
    int max_global_buffers;
    struct pipe_resource **global_buffers;
 
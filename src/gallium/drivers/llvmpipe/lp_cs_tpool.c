@@ -30,20 +30,138 @@
 
 #include "util/u_thread.h"
 #include "util/u_memory.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
+#include "util/thread_sched.h"
+#include "lp_debug.h"
 #include "lp_cs_tpool.h"
 
+/* Number of chunks each worker splits its own range into. Small chunks
+ * keep the tail balanced, large ones keep the CAS traffic down.
+ */
+#define LP_CS_TPOOL_CHUNKS_PER_THREAD 16
+
+static inline uint64_t
+range_pack(unsigned start, unsigned end)
+{
+   return ((uint64_t)end << 32) | start;
+}
+
+static inline unsigned
+range_start(uint64_t range)
+{
+   return (unsigned)range;
+}
+
+static inline unsigned
+range_end(uint64_t range)
+{
+   return (unsigned)(range >> 32);
+}
+
+/**
+ * Claim up to max_count iterations from the front of a range.
+ * Used by the owning thread.
+ */
+static bool
+range_claim_front(uint64_t *range, unsigned max_count,
+                  unsigned *start, unsigned *count)
+{
+   uint64_t old = p_atomic_read(range);
+
+   for (;;) {
+      unsigned s = range_start(old), e = range_end(old);
+      if (s >= e)
+         return false;
+
+      unsigned n = MIN2(max_count, e - s);
+      uint64_t prev = p_atomic_cmpxchg(range, old, range_pack(s + n, e));
+      if (prev == old) {
+         *start = s;
+         *count = n;
+         return true;
+      }
+      old = prev;
+   }
+}
+
+/**
+ * Steal the back half of a range. Used by threads whose own range is
+ * empty.
+ */
+static bool
+range_steal_back(uint64_t *range, unsigned *start, unsigned *count)
+{
+   uint64_t old = p_atomic_read(range);
+
+   for (;;) {
+      unsigned s = range_start(old), e = range_end(old);
+      if (s >= e)
+         return false;
+
+      unsigned n = DIV_ROUND_UP(e - s, 2);
+      uint64_t prev = p_atomic_cmpxchg(range, old, range_pack(s, e - n));
+      if (prev == old) {
+         *start = e - n;
+         *count = n;
+         return true;
+      }
+      old = prev;
+   }
+}
+
+/**
+ * Run iterations of a task until no range has any work left.
+ * Returns the number of iterations executed by this thread.
+ */
+static unsigned
+lp_cs_tpool_run_task(struct lp_cs_tpool_task *task, unsigned idx,
+                     struct lp_cs_local_mem *lmem)
+{
+   uint64_t *own = &task->ranges[idx].range;
+   unsigned executed = 0;
+   unsigned start, count;
+
+   for (;;) {
+      while (range_claim_front(own, task->iter_grain, &start, &count)) {
+         for (unsigned i = 0; i < count; i++)
+            task->work(task->data, start + i, lmem);
+         executed += count;
+      }
+
+      /* Own range drained, look for a victim. Stolen work is put in our
+       * own (empty) range so that it can in turn be stolen from us.
+       */
+      bool stole = false;
+      for (unsigned v = 1; v < task->num_ranges; v++) {
+         unsigned victim = (idx + v) % task->num_ranges;
+         if (range_steal_back(&task->ranges[victim].range, &start, &count)) {
+            p_atomic_set(own, range_pack(start, start + count));
+            stole = true;
+            break;
+         }
+      }
+      if (!stole)
+         return executed;
+   }
+}
+
 static int
 lp_cs_tpool_worker(void *data)
 {
-   struct lp_cs_tpool *pool = data;
+   struct lp_cs_tpool_thread *thread = data;
+   struct lp_cs_tpool *pool = thread->pool;
    struct lp_cs_local_mem lmem;
 
    memset(&lmem, 0, sizeof(lmem));
    mtx_lock(&pool->m);
 
+   /* pool->num_threads is final once the creating thread drops the lock. */
+   if (!(LP_PERF & PERF_NO_PIN_THREADS))
+      util_thread_sched_pin_pool_thread(thread->idx, pool->num_threads);
+
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
-      unsigned iter_per_thread;
 
       while (list_is_empty(&pool->workqueue) && !pool->shutdown)
          cnd_wait(&pool->new_work, &pool->m);
@@ -53,29 +171,18 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
-
-      unsigned this_iter = task->iter_start;
-
-      iter_per_thread = task->iter_per_thread;
-
-      if (task->iter_remainder &&
-          task->iter_start + task->iter_remainder == task->iter_total) {
-         task->iter_remainder--;
-         iter_per_thread = 1;
-      }
-
-      task->iter_start += iter_per_thread;
-
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
-
+      task->num_workers++;
       mtx_unlock(&pool->m);
-      for (unsigned i = 0; i < iter_per_thread; i++)
-         task->work(task->data, this_iter + i, &lmem);
+
+      unsigned executed = lp_cs_tpool_run_task(task, thread->idx, &lmem);
+      if (executed)
+         p_atomic_add(&task->iter_finished, executed);
 
       mtx_lock(&pool->m);
-      task->iter_finished += iter_per_thread;
-      if (task->iter_finished == task->iter_total)
+      /* Nothing left to claim, so stop handing the task out. */
+      if (!list_is_empty(&task->list))
+         list_delinit(&task->list);
+      if (--task->num_workers == 0)
          cnd_broadcast(&task->finish);
    }
    mtx_unlock(&pool->m);
@@ -96,13 +203,26 @@ lp_cs_tpool_create(unsigned num_threads)
 
    list_inithead(&pool->workqueue);
    assert (num_threads <= LP_MAX_THREADS);
+
+   if (num_threads) {
+      pool->threads = CALLOC(num_threads, sizeof(*pool->threads));
+      pool->thread_data = CALLOC(num_threads, sizeof(*pool->thread_data));
+      if (!pool->threads || !pool->thread_data)
+         num_threads = 0;
+   }
+
+   mtx_lock(&pool->m);
    for (unsigned i = 0; i < num_threads; i++) {
-      if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker, pool)) {
+      pool->thread_data[i].pool = pool;
+      pool->thread_data[i].idx = i;
+      if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker,
+                                          &pool->thread_data[i])) {
          num_threads = i;  /* previous thread is max */
          break;
       }
    }
    pool->num_threads = num_threads;
+   mtx_unlock(&pool->m);
    return pool;
 }
 
@@ -123,6 +243,8 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->threads);
+   FREE(pool->thread_data);
    FREE(pool);
 }
 
@@ -142,7 +264,9 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       FREE(lmem.local_mem_ptr);
       return NULL;
    }
-   task = CALLOC_STRUCT(lp_cs_tpool_task);
+   task = align_calloc(sizeof(*task) +
+                       pool->num_threads * sizeof(task->ranges[0]),
+                       CACHE_LINE_SIZE);
    if (!task) {
       return NULL;
    }
@@ -150,10 +274,19 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->work = work;
    task->data = data;
    task->iter_total = num_iters;
+   task->num_ranges = pool->num_threads;
 
-   task->iter_per_thread = num_iters / pool->num_threads;
-   task->iter_remainder = num_iters % pool->num_threads;
+   unsigned iter_per_thread = num_iters / pool->num_threads;
+   unsigned iter_remainder = num_iters % pool->num_threads;
+   unsigned start = 0;
+   for (unsigned i = 0; i < pool->num_threads; i++) {
+      unsigned count = iter_per_thread + (i < iter_remainder ? 1 : 0);
+      task->ranges[i].range = range_pack(start, start + count);
+      start += count;
+   }
+   task->iter_grain = MAX2(iter_per_thread / LP_CS_TPOOL_CHUNKS_PER_THREAD, 1);
 
+   list_inithead(&task->list);
    cnd_init(&task->finish);
 
    mtx_lock(&pool->m);
@@ -174,12 +307,18 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
    if (!pool || !task)
       return;
 
+   /* The task may only be freed once every iteration has run and no
+    * worker still holds a pointer to it.
+    */
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   while (p_atomic_read(&task->iter_finished) < task->iter_total ||
+          task->num_workers)
       cnd_wait(&task->finish, &pool->m);
+   if (!list_is_empty(&task->list))
+      list_delinit(&task->list);
    mtx_unlock(&pool->m);
 
    cnd_destroy(&task->finish);
-   FREE(task);
+   align_free(task);
    *task_handle = NULL;
 }
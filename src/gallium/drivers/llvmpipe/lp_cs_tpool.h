@@ -30,6 +30,13 @@
  * structs with just unique indexes in them.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
+ *
+ * The iteration space of a task is split into one contiguous range per
+ * worker thread. Each worker claims small chunks from the front of its
+ * own range and, once that is drained, steals half of what is left at
+ * the back of another worker's range. Claiming is done with a CAS on a
+ * packed 64-bit [start, end) pair, so the pool mutex is only taken when
+ * a worker picks up or releases a task, not per chunk.
  */
 #ifndef LP_CS_QUEUE
 #define LP_CS_QUEUE
@@ -37,15 +44,24 @@
 #include "util/compiler.h"
 
 #include "util/u_thread.h"
+#include "util/u_memory.h"
 #include "util/list.h"
 
 #include "lp_limits.h"
 
+struct lp_cs_tpool;
+
+struct lp_cs_tpool_thread {
+   struct lp_cs_tpool *pool;
+   unsigned idx;
+};
+
 struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
+   struct lp_cs_tpool_thread *thread_data;
    unsigned num_threads;
    struct list_head workqueue;
    bool shutdown;
@@ -58,16 +74,24 @@ struct lp_cs_local_mem {
 
 typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
 
+/* Per-thread slice of a task's iteration space, packed as
+ * (end << 32) | start so that it can be updated with a single CAS.
+ */
+struct lp_cs_tpool_range {
+   EXCLUSIVE_CACHELINE(uint64_t range);
+};
+
 struct lp_cs_tpool_task {
    lp_cs_tpool_task_func work;
    void *data;
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
-   unsigned iter_per_thread;
-   unsigned iter_remainder;
+   unsigned iter_finished;  /* atomic */
+   unsigned iter_grain;     /* iterations claimed per chunk by the owner */
+   unsigned num_workers;    /* threads currently inside the task, under pool->m */
+   unsigned num_ranges;
+   struct lp_cs_tpool_range ranges[];
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
@@ -65,6 +65,8 @@
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
 #define PERF_NO_RAST_LINEAR 0x100  	/* disable linear rast */
 #define PERF_NO_SHADE       0x200  	/* disable fragment shaders */
+#define PERF_NO_PIN_THREADS 0x400  	/* don't pin worker threads to L3 domains */
+#define PERF_NO_HIZ         0x800  	/* disable hierarchical Z culling */
 
 
 extern int LP_PERF;
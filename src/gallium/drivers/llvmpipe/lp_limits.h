@@ -66,7 +66,19 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 32
+/**
+ * Upper bound for LP_NUM_THREADS. Per-thread state is allocated for the
+ * actual number of threads, so this only needs to cover the largest
+ * machines we expect to run on.
+ */
+#define LP_MAX_THREADS 1024
+
+/**
+ * Max number of scenes a context can have binned or waiting to be
+ * rasterized. LP_SCENE_DEPTH can lower it. Must be a power of two, it is
+ * also the size of the rasterizer's scene queue.
+ */
+#define MAX_SCENES 64
 
 
 /**
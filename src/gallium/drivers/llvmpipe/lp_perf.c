@@ -87,6 +87,7 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_fully_covered_16x16:     %9u (%3.0f%% of %u)\n", lp_count.nr_fully_covered_16, p2, total_16);
       debug_printf("llvmpipe:   nr_partially_covered_16x16: %9u (%3.0f%% of %u)\n", lp_count.nr_partially_covered_16, p3, total_16);
       debug_printf("llvmpipe:   nr_empty_16x16:             %9u (%3.0f%% of %u)\n", lp_count.nr_empty_16, p1, total_16);
+      debug_printf("llvmpipe:   nr_hiz_culled_16x16:        %9u\n", lp_count.nr_hiz_culled_16);
 
       total_4 = (lp_count.nr_empty_4 +
                  lp_count.nr_fully_covered_4 +
@@ -118,9 +119,26 @@ lp_print_counters(void)
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
+      debug_printf("llvmpipe: nr_scenes:                    %9u\n", lp_count.nr_scenes);
+      debug_printf("llvmpipe:   avg scenes already queued:  %9.2f\n",
+                   lp_count.nr_scenes ? (float) lp_count.scene_queue_depth / (float) lp_count.nr_scenes : 0.0f);
+      debug_printf("llvmpipe:   nr_setup_scene_waits:       %9u (%.2f sec)\n",
+                   lp_count.nr_scene_waits, lp_count.scene_wait_time / 1000000.0);
+      debug_printf("llvmpipe: rasterizer busy:              %.2f sec\n", lp_count.rast_busy_time / 1000000.0);
+      debug_printf("llvmpipe: rasterizer idle:              %.2f sec\n", lp_count.rast_idle_time / 1000000.0);
+
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
+      debug_printf("llvmpipe: nr_fs_opt_compiles:           %u\n", lp_count.nr_fs_opt_compiles);
+      debug_printf("llvmpipe: total FS opt compile time:    %.2f sec\n", lp_count.fs_opt_compile_time / 1000000.0);
+      debug_printf("llvmpipe: nr_fs_variant_swaps:          %u\n", lp_count.nr_fs_variant_swaps);
+      debug_printf("llvmpipe: nr_fs_shared_code_hits:       %u\n", lp_count.nr_fs_shared_code_hits);
+      debug_printf("llvmpipe: nr_sample_shared_code_hits:   %u\n", lp_count.nr_sample_shared_code_hits);
+      debug_printf("llvmpipe: live variant code:            %.2f MB\n", lp_count.variant_code_bytes / (1024.0 * 1024.0));
+      debug_printf("llvmpipe: nr_variant_evictions:         %u\n", lp_count.nr_variant_evictions);
+      debug_printf("llvmpipe: nr_eviction_recompiles:       %u\n", lp_count.nr_eviction_recompiles);
+
    }
 }
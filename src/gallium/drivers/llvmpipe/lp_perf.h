@@ -56,6 +56,7 @@ struct lp_counters
    unsigned nr_empty_16;
    unsigned nr_fully_covered_16;
    unsigned nr_partially_covered_16;
+   unsigned nr_hiz_culled_16;
    unsigned nr_empty_4;
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
@@ -65,9 +66,33 @@ struct lp_counters
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
+   /* Tiered fragment shader compilation */
+   unsigned nr_fs_opt_compiles;
+   int64_t fs_opt_compile_time;  /**< total, in microseconds */
+   unsigned nr_fs_variant_swaps;
+
+   /* Fragment shader variants reusing code compiled by another context */
+   unsigned nr_fs_shared_code_hits;
+
+   /* Sample functions reusing code compiled by another context */
+   unsigned nr_sample_shared_code_hits;
+
+   /* Shader variant eviction */
+   int64_t variant_code_bytes;  /**< live FS and CS variant code */
+   unsigned nr_variant_evictions;
+   unsigned nr_eviction_recompiles;
+
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   /* Scene pipeline occupancy */
+   unsigned nr_scenes;
+   unsigned scene_queue_depth;  /**< sum of scenes already queued at each flush */
+   unsigned nr_scene_waits;     /**< setup waited for a scene to be freed */
+   int64_t scene_wait_time;     /**< total, in microseconds */
+   int64_t rast_busy_time;      /**< total, in microseconds */
+   int64_t rast_idle_time;      /**< total, in microseconds */
 };
 
 
@@ -33,6 +33,7 @@
 #include "util/u_pack_color.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
+#include "util/thread_sched.h"
 #include "util/u_memset.h"
 #include "util/os_time.h"
 
@@ -78,7 +79,7 @@ lp_rast_begin(struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, rast->num_threads > 1);
 }
 
 
@@ -117,8 +118,8 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          task->color_tiles[i] = scene->cbufs[i].map +
-                                scene->cbufs[i].stride * task->y +
-                                scene->cbufs[i].format_bytes * task->x;
+                                lp_scene_surface_offset(&scene->cbufs[i],
+                                                        task->x, task->y);
       }
    }
    if (scene->fb.zsbuf) {
@@ -126,6 +127,41 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
    }
+
+   lp_rast_hiz_begin_tile(task);
+}
+
+
+/**
+ * Fill a 4x4 aligned rectangle of a micro-tiled color buffer. Each row of
+ * 4x4 blocks is a row of 16 texels per block with four times the stride,
+ * the rest of a rectangle not a multiple of 4 in size is filled in runs
+ * of up to four texels, so that pixels outside of it are left alone.
+ */
+static void
+lp_rast_fill_microtiled(uint8_t *map, enum pipe_format format,
+                        unsigned stride, unsigned x, unsigned y,
+                        unsigned width, unsigned height,
+                        union util_color *uc)
+{
+   const unsigned width4 = width & ~3;
+   const unsigned height4 = height & ~3;
+
+   assert(x % 4 == 0 && y % 4 == 0);
+
+   if (width4 && height4) {
+      util_fill_rect(map, format, stride * 4, x * 4, y / 4,
+                     width4 * 4, height4 / 4, uc);
+   }
+
+   for (unsigned j = 0; j < height; j++) {
+      const unsigned py = y + j;
+      for (unsigned i = j < height4 ? width4 : 0; i < width; i += 4) {
+         const unsigned px = x + i;
+         util_fill_rect(map, format, stride * 4, px * 4 + (py % 4) * 4,
+                        py / 4, MIN2(4, width - i), 1, uc);
+      }
+   }
 }
 
 
@@ -156,6 +192,18 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
           "%s clear value (target format %d) raw 0x%x,0x%x,0x%x,0x%x\n",
           __func__, format, uc.ui[0], uc.ui[1], uc.ui[2], uc.ui[3]);
 
+   if (scene->cbufs[cbuf].microtiled) {
+      for (unsigned layer = 0; layer <= scene->fb_max_layer; layer++) {
+         lp_rast_fill_microtiled(scene->cbufs[cbuf].map +
+                                    layer * scene->cbufs[cbuf].layer_stride,
+                                 format, scene->cbufs[cbuf].stride,
+                                 task->x, task->y, task->width, task->height,
+                                 &uc);
+      }
+      LP_COUNT(nr_color_tile_clear);
+      return;
+   }
+
    for (unsigned s = 0; s < scene->cbufs[cbuf].nr_samples; s++) {
       void *map = (char *) scene->cbufs[cbuf].map
          + scene->cbufs[cbuf].sample_stride * s;
@@ -285,6 +333,10 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
             dst_layer += scene->zsbuf.layer_stride;
          }
       }
+
+      if (task->hiz.enabled)
+         lp_rast_hiz_clear(task, arg.clear_zstencil.value,
+                           arg.clear_zstencil.mask);
    }
 }
 
@@ -317,16 +369,26 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
 
    const struct lp_fragment_shader_variant *variant = state->variant;
 
+   unsigned culled = 0;
+   if (task->hiz.enabled) {
+      culled = lp_rast_hiz_cull_blocks(task, inputs, 0, 0xffff);
+      if (culled == 0xffff)
+         return;
+   }
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (unsigned y = 0; y < task->height; y += 4){
       for (unsigned x = 0; x < task->width; x += 4) {
+         if (culled & (1 << ((y / 16) * 4 + x / 16)))
+            continue;
+
          /* color buffer */
          uint8_t *color[PIPE_MAX_COLOR_BUFS];
          unsigned stride[PIPE_MAX_COLOR_BUFS];
          unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
          for (unsigned i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
-               stride[i] = scene->cbufs[i].stride;
+               stride[i] = lp_scene_surface_block_stride(&scene->cbufs[i]);
                sample_stride[i] = scene->cbufs[i].sample_stride;
                color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
                                           tile_y + y,
@@ -434,7 +496,7 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
    unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
-         stride[i] = scene->cbufs[i].stride;
+         stride[i] = lp_scene_surface_block_stride(&scene->cbufs[i]);
          sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer + inputs->view_index);
@@ -1057,14 +1119,18 @@ rasterize_scene(struct lp_rasterizer_task *task,
 #endif
 
    if (!task->rast->no_rast) {
-      /* loop over scene bins, rasterize each */
-      struct cmd_bin *bin;
-      int i, j;
+      /* loop over scene bin chunks, rasterize each bin in them */
+      const struct lp_scene_chunk *chunk;
 
       assert(scene);
-      while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-         if (!is_empty_bin(bin))
-            rasterize_bin(task, bin, i, j);
+      while ((chunk = lp_scene_bin_iter_next(scene))) {
+         for (unsigned j = chunk->y; j < chunk->y + chunk->h; j++) {
+            for (unsigned i = chunk->x; i < chunk->x + chunk->w; i++) {
+               const struct cmd_bin *bin = lp_scene_get_bin(scene, i, j);
+               if (!is_empty_bin(bin))
+                  rasterize_bin(task, bin, i, j);
+            }
+         }
       }
    }
 
@@ -1149,6 +1215,16 @@ lp_rast_finish(struct lp_rasterizer *rast)
 }
 
 
+/**
+ * Number of scenes queued but not yet picked up by the rasterizer threads.
+ */
+unsigned
+lp_rast_queued_scenes(struct lp_rasterizer *rast)
+{
+   return rast->num_threads ? lp_scene_queue_count(rast->full_scenes) : 0;
+}
+
+
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
@@ -1167,13 +1243,29 @@ thread_function(void *init_data)
    snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    u_thread_setname(thread_name);
 
+   /* Pin first, so that the stack and anything this thread allocates while
+    * rasterizing are faulted in on the memory node closest to it. The task
+    * and its format cache were allocated by lp_rast_create on the creating
+    * thread, though.
+    */
+   if (!(LP_PERF & PERF_NO_PIN_THREADS))
+      util_thread_sched_pin_pool_thread(task->thread_index, rast->num_threads);
+
    /* Make sure that denorms are treated like zeros. This is
     * the behavior required by D3D10. OpenGL doesn't care.
     */
    unsigned fpstate = util_fpstate_get();
    util_fpstate_set_denorms_to_zero(fpstate);
 
+   /* Thread 0 accounts for the whole pool's busy/idle time, as all threads
+    * start and finish each scene together.
+    */
+   const bool count_time = task->thread_index == 0 &&
+                           (LP_DEBUG & DEBUG_COUNTERS);
+
    while (1) {
+      int64_t idle_start = count_time ? os_time_get_nano() : 0;
+
       /* wait for work */
       if (debug)
          debug_printf("thread %d waiting for work\n", task->thread_index);
@@ -1182,6 +1274,10 @@ thread_function(void *init_data)
       if (rast->exit_flag)
          break;
 
+      int64_t busy_start = count_time ? os_time_get_nano() : 0;
+      if (count_time)
+         LP_COUNT_ADD(rast_idle_time, (busy_start - idle_start) / 1000);
+
       if (task->thread_index == 0) {
          /* thread[0]:
           *  - get next scene to rasterize
@@ -1210,6 +1306,9 @@ thread_function(void *init_data)
          lp_rast_end(rast);
       }
 
+      if (count_time)
+         LP_COUNT_ADD(rast_busy_time, (os_time_get_nano() - busy_start) / 1000);
+
       /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
@@ -1260,6 +1359,12 @@ lp_rast_create(unsigned num_threads)
       goto no_rast;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof(*rast->tasks));
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof(*rast->threads));
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
@@ -1292,7 +1397,7 @@ lp_rast_create(unsigned num_threads)
    return rast;
 
 no_thread_data_cache:
-   for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (unsigned i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
@@ -1300,6 +1405,9 @@ no_thread_data_cache:
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
+no_tasks:
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 no_rast:
    return NULL;
@@ -1359,6 +1467,8 @@ lp_rast_destroy(struct lp_rasterizer *rast)
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
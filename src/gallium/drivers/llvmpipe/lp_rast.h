@@ -117,7 +117,7 @@ struct lp_rast_shader_inputs {
    unsigned layer:11;
    unsigned view_index:14;
    unsigned stride;             /* how much to advance data between a0, dadx, dady */
-   unsigned pad[2];
+   float zmin, zmax;            /* bounds of the vertex depths, for hiz culling */
    /* followed by a0, dadx, dady and planes[] */
 };
 
@@ -243,6 +243,9 @@ lp_rast_queue_scene(struct lp_rasterizer *rast,
 void
 lp_rast_finish(struct lp_rasterizer *rast);
 
+unsigned
+lp_rast_queued_scenes(struct lp_rasterizer *rast);
+
 
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
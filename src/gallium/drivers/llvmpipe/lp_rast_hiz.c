@@ -0,0 +1,180 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Hierarchical Z for the rasterizer.
+ *
+ * Each rasterizer task keeps a conservative maximum of the depth buffer
+ * for every 16x16 block of the tile it works on. Blocks where a primitive
+ * is entirely behind that maximum are skipped before any fragment shading,
+ * which removes most of the cost of occluded geometry in scenes with heavy
+ * overdraw.
+ *
+ * The maximum starts out unknown at the beginning of every tile, is set by
+ * depth clears, lowered by primitives known to write every pixel of a block
+ * and raised by those which can increase the depth. The depth range of a
+ * primitive over a block comes from its depth plane equation, narrowed by
+ * the depth range of its vertices computed in setup.
+ *
+ * Only single sampled, single layer depth buffers are tracked.
+ */
+
+#include <math.h>
+
+#include "util/format/u_format.h"
+#include "util/u_math.h"
+#include "util/u_pack_color.h"
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_rast_priv.h"
+#include "lp_scene.h"
+#include "lp_state_fs.h"
+
+
+void
+lp_rast_hiz_begin_tile(struct lp_rasterizer_task *task)
+{
+   const struct lp_scene *scene = task->scene;
+
+   task->hiz.enabled = false;
+
+   if (!scene->fb.zsbuf || scene->zsbuf.nr_samples > 1 ||
+       scene->fb_max_layer > 0 || (LP_PERF & PERF_NO_HIZ))
+      return;
+
+   const enum pipe_format format = scene->fb.zsbuf->format;
+   const struct util_format_description *desc = util_format_description(format);
+   if (!util_format_has_depth(desc))
+      return;
+
+   /* Fragment depths are rounded to the depth buffer precision before the
+    * test, the tracked maxima aren't.
+    */
+   const unsigned bits =
+      util_format_get_component_bits(format, UTIL_FORMAT_COLORSPACE_ZS, 0);
+   if (desc->channel[desc->swizzle[0]].type == UTIL_FORMAT_TYPE_FLOAT)
+      task->hiz.margin = 0.0f;
+   else
+      task->hiz.margin = 1.0f / (float)((1ull << bits) - 1);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(task->hiz.zmax); i++)
+      task->hiz.zmax[i] = INFINITY;
+
+   task->hiz.enabled = true;
+}
+
+
+/**
+ * Depth/stencil clear of the whole tile.
+ */
+void
+lp_rast_hiz_clear(struct lp_rasterizer_task *task,
+                  uint64_t value, uint64_t mask)
+{
+   const enum pipe_format format = task->scene->fb.zsbuf->format;
+   const uint64_t zmask = util_pack64_mask_z(format, ~0);
+   float z = INFINITY;
+
+   if (!(mask & zmask))
+      return;
+
+   if ((mask & zmask) == zmask)
+      util_format_unpack_z_float(format, &z, &value, 1);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(task->hiz.zmax); i++)
+      task->hiz.zmax[i] = z;
+}
+
+
+/**
+ * Test a primitive against the hierarchical Z of the tile, and account for
+ * the depths it is about to write.
+ *
+ * \param partial  blocks partially covered by the primitive
+ * \param full  blocks entirely covered by the primitive
+ * \return the blocks where the primitive is occluded and needn't be shaded
+ */
+unsigned
+lp_rast_hiz_cull_blocks(struct lp_rasterizer_task *task,
+                        const struct lp_rast_shader_inputs *inputs,
+                        unsigned partial, unsigned full)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   unsigned blocks = partial | full;
+   unsigned culled = 0;
+
+   assert(task->hiz.enabled);
+
+   if (variant->hiz_invalidate) {
+      while (blocks) {
+         const int i = u_bit_scan(&blocks);
+         task->hiz.zmax[i] = INFINITY;
+      }
+      return 0;
+   }
+
+   if (!variant->hiz_cull && !variant->hiz_lower && !variant->hiz_raise)
+      return 0;
+
+   /* Same plane equation as the fragment shader, polygon offset included. */
+   const float (*a0)[4] = GET_A0(inputs);
+   const float (*dadx)[4] = GET_DADX(inputs);
+   const float (*dady)[4] = GET_DADY(inputs);
+   const float offset = a0[0][0];
+   const float z0 = a0[0][2] + offset;
+   const float dzdx = dadx[0][2];
+   const float dzdy = dady[0][2];
+
+   if (!isfinite(z0) || !isfinite(dzdx) || !isfinite(dzdy)) {
+      if (variant->hiz_raise) {
+         while (blocks) {
+            const int i = u_bit_scan(&blocks);
+            task->hiz.zmax[i] = INFINITY;
+         }
+      }
+      return 0;
+   }
+
+   const bool clamp = variant->key.restrict_depth_values;
+   const float margin = task->hiz.margin;
+
+   while (blocks) {
+      const int i = u_bit_scan(&blocks);
+      const unsigned bit = 1 << i;
+
+      /* Pixel centers and sample positions of the block, with a pixel of
+       * slack for the fixed point snapping of the vertices.
+       */
+      const float x0 = task->x + (i & 3) * 16 - 1.0f;
+      const float y0 = task->y + (i >> 2) * 16 - 1.0f;
+      const float x1 = x0 + 18.0f;
+      const float y1 = y0 + 18.0f;
+
+      /* The shader's evaluation of the plane rounds differently. */
+      const float err = (fabsf(a0[0][2]) + fabsf(offset) +
+                         fabsf(dzdx) * x1 + fabsf(dzdy) * y1) * (1.0f / (1 << 20)) +
+                        fabsf(dzdx) + fabsf(dzdy);
+
+      float zlo = z0 + MIN2(dzdx * x0, dzdx * x1) + MIN2(dzdy * y0, dzdy * y1);
+      float zhi = z0 + MAX2(dzdx * x0, dzdx * x1) + MAX2(dzdy * y0, dzdy * y1);
+      zlo = MAX2(zlo, inputs->zmin + offset) - err;
+      zhi = MIN2(zhi, inputs->zmax + offset) + err;
+      if (clamp) {
+         zlo = CLAMP(zlo, 0.0f, 1.0f);
+         zhi = CLAMP(zhi, 0.0f, 1.0f);
+      }
+
+      if (variant->hiz_cull && zlo > task->hiz.zmax[i] + margin) {
+         culled |= bit;
+      } else if (variant->hiz_raise) {
+         task->hiz.zmax[i] = MAX2(task->hiz.zmax[i], zhi);
+      } else if (variant->hiz_lower && (full & bit)) {
+         task->hiz.zmax[i] = MIN2(task->hiz.zmax[i], zhi);
+      }
+   }
+
+   LP_COUNT_ADD(nr_hiz_culled_16, util_bitcount(culled));
+
+   return culled;
+}
@@ -100,6 +100,13 @@ struct lp_rasterizer_task
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   /** Hierarchical Z of the current tile, see lp_rast_hiz.c */
+   struct {
+      bool enabled;
+      float margin;     /**< depth quantization error */
+      float zmax[16];   /**< max depth of each 16x16 block, in mask order */
+   } hiz;
+
    util_semaphore work_ready;
    util_semaphore work_done;
 #ifdef _WIN32
@@ -124,11 +131,11 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** A task object for each rasterization thread (at least one) */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -149,6 +156,36 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          unsigned x, unsigned y,
                          unsigned mask);
 
+void
+lp_rast_hiz_begin_tile(struct lp_rasterizer_task *task);
+
+void
+lp_rast_hiz_clear(struct lp_rasterizer_task *task,
+                  uint64_t value, uint64_t mask);
+
+unsigned
+lp_rast_hiz_cull_blocks(struct lp_rasterizer_task *task,
+                        const struct lp_rast_shader_inputs *inputs,
+                        unsigned partial, unsigned full);
+
+
+/**
+ * Mask of the 16x16 blocks of the tile touched by a rectangle.
+ * \param x0, y0, x1, y1  inclusive bounds of the rectangle, in tile coords
+ */
+static inline unsigned
+lp_rast_hiz_rect_blocks(unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+   const unsigned bx0 = x0 / 16, bx1 = MIN2(x1 / 16, 3);
+   const unsigned by0 = y0 / 16, by1 = MIN2(y1 / 16, 3);
+   const unsigned row = BITFIELD_RANGE(bx0, bx1 - bx0 + 1);
+   unsigned mask = 0;
+
+   for (unsigned by = by0; by <= by1; by++)
+      mask |= row << (by * 4);
+   return mask;
+}
+
 
 /**
  * Get the pointer to a 4x4 color block (within a 64x64 tile).
@@ -174,8 +211,8 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
    unsigned px = x % TILE_SIZE;
    unsigned py = y % TILE_SIZE;
 
-   unsigned pixel_offset = px * task->scene->cbufs[buf].format_bytes +
-                           py * task->scene->cbufs[buf].stride;
+   unsigned pixel_offset = lp_scene_surface_offset(&task->scene->cbufs[buf],
+                                                   px, py);
    uint8_t *color = task->color_tiles[buf] + pixel_offset;
 
    if (layer) {
@@ -241,7 +278,7 @@ lp_rast_shade_quads_all(struct lp_rasterizer_task *task,
    /* color buffer */
    for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
-         stride[i] = scene->cbufs[i].stride;
+         stride[i] = lp_scene_surface_block_stride(&scene->cbufs[i]);
          sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer + inputs->view_index);
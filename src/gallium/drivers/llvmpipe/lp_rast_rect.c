@@ -165,6 +165,19 @@ lp_rast_rectangle(struct lp_rasterizer_task *task,
    struct u_rect box;
    intersect_rect_and_tile(task, rect, &box);
 
+   if (task->hiz.enabled) {
+      const int fx0 = align(box.x0, 16), fx1 = ((box.x1 + 1) & ~15) - 1;
+      const int fy0 = align(box.y0, 16), fy1 = ((box.y1 + 1) & ~15) - 1;
+      const unsigned blocks =
+         lp_rast_hiz_rect_blocks(box.x0, box.y0, box.x1, box.y1);
+      const unsigned full = fx0 < fx1 && fy0 < fy1 ?
+         lp_rast_hiz_rect_blocks(fx0, fy0, fx1, fy1) : 0;
+
+      if (lp_rast_hiz_cull_blocks(task, &rect->inputs, blocks & ~full,
+                                  full) == blocks)
+         return;
+   }
+
    /* The interior of the rectangle (if there is one) will be
     * rasterized as full 4x4 stamps.
     *
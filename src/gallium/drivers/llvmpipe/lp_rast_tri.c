@@ -62,6 +62,27 @@ block_full_16(struct lp_rasterizer_task *task,
          block_full_4(task, tri, x + ix, y + iy);
 }
 
+
+/**
+ * Whether a triangle confined to the size x size pixels at x, y (window
+ * coords) is occluded in all the 16x16 blocks these touch.
+ */
+static inline bool
+hiz_culled(struct lp_rasterizer_task *task,
+           const struct lp_rast_triangle *tri,
+           int x, int y, unsigned size)
+{
+   if (!task->hiz.enabled)
+      return false;
+
+   const unsigned tx = x - task->x;
+   const unsigned ty = y - task->y;
+   const unsigned blocks =
+      lp_rast_hiz_rect_blocks(tx, ty, tx + size - 1, ty + size - 1);
+
+   return lp_rast_hiz_cull_blocks(task, &tri->inputs, blocks, 0) == blocks;
+}
+
 static inline unsigned
 build_mask_linear(int32_t c, int32_t dcdx, int32_t dcdy)
 {
@@ -300,6 +321,9 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    struct { unsigned mask:16; unsigned i:8; unsigned j:8; } out[16];
    unsigned nr = 0;
 
+   if (hiz_culled(task, tri, x, y, 16))
+      return;
+
    /* p0 and p2 are aligned, p1 is not (plane size 24 bytes). */
    __m128i p0 = _mm_load_si128((__m128i *)&plane[0]); /* clo, chi, dcdx, dcdy */
    __m128i p1 = _mm_loadu_si128((__m128i *)&plane[1]);
@@ -409,6 +433,9 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
    const unsigned x = (arg.triangle.plane_mask & 0xff) + task->x;
    const unsigned y = (arg.triangle.plane_mask >> 8) + task->y;
 
+   if (hiz_culled(task, tri, x, y, 4))
+      return;
+
    /* p0 and p2 are aligned, p1 is not (plane size 24 bytes). */
    __m128i p0 = _mm_load_si128((__m128i *)&plane[0]); /* clo, chi, dcdx, dcdy */
    __m128i p1 = _mm_loadu_si128((__m128i *)&plane[1]);
@@ -583,6 +610,9 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    struct { unsigned mask:16; unsigned i:8; unsigned j:8; } out[16];
    unsigned nr = 0;
 
+   if (hiz_culled(task, tri, x, y, 16))
+      return;
+
    __m128i p0 = lp_plane_to_m128i(&plane[0]); /* c, dcdx, dcdy, eo */
    __m128i p1 = lp_plane_to_m128i(&plane[1]); /* c, dcdx, dcdy, eo */
    __m128i p2 = lp_plane_to_m128i(&plane[2]); /* c, dcdx, dcdy, eo */
@@ -305,6 +305,13 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
    LP_COUNT_ADD(nr_empty_16, util_bitcount(0xffff & ~(partial_mask | inmask)));
 
+   if (task->hiz.enabled) {
+      const unsigned culled =
+         lp_rast_hiz_cull_blocks(task, &tri->inputs, partial_mask, inmask);
+      partial_mask &= ~culled;
+      inmask &= ~culled;
+   }
+
    /* Iterate over partials:
     */
    while (partial_mask) {
@@ -394,6 +401,8 @@ TRI_16(struct lp_rasterizer_task *task,
    if (outmask == 0xffff)
       return;
 
+   if (hiz_culled(task, tri, x, y, 16))
+      return;
 
    /* Mask of sub-blocks which are inside all trivial reject planes,
     * but outside at least one trivial accept plane:
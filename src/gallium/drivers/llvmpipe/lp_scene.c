@@ -30,6 +30,7 @@
 #include "util/u_memory.h"
 #include "util/reallocarray.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/format/u_format.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
@@ -37,6 +38,8 @@
 #include "lp_context.h"
 #include "lp_state_fs.h"
 #include "lp_setup_context.h"
+#include "lp_screen.h"
+#include "lp_scene_pool.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -103,6 +106,7 @@ lp_scene_destroy(struct lp_scene *scene)
    lp_scene_end_rasterization(scene);
    mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   free(scene->chunks);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -147,6 +151,7 @@ lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y)
    struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
 
    bin->last_state = NULL;
+   bin->num_cmds = 0;
    bin->head = bin->tail;
    if (bin->tail) {
       bin->tail->next = NULL;
@@ -164,6 +169,7 @@ init_scene_texture(struct lp_scene_surface *ssurf, struct pipe_surface *psurf)
       ssurf->sample_stride = 0;
       ssurf->nr_samples = 0;
       ssurf->map = NULL;
+      ssurf->microtiled = false;
       return;
    }
 
@@ -180,6 +186,7 @@ init_scene_texture(struct lp_scene_surface *ssurf, struct pipe_surface *psurf)
                                          LP_TEX_USAGE_READ_WRITE);
       ssurf->format_bytes = util_format_get_blocksize(psurf->format);
       ssurf->nr_samples = util_res_sample_count(psurf->texture);
+      ssurf->microtiled = llvmpipe_resource_is_microtiled(psurf->texture);
    } else {
       struct llvmpipe_resource *lpr = llvmpipe_resource(psurf->texture);
       unsigned pixstride = util_format_get_blocksize(psurf->format);
@@ -190,6 +197,7 @@ init_scene_texture(struct lp_scene_surface *ssurf, struct pipe_surface *psurf)
       ssurf->map = lpr->data;
       ssurf->map += psurf->u.buf.first_element * pixstride;
       ssurf->format_bytes = util_format_get_blocksize(psurf->format);
+      ssurf->microtiled = false;
    }
 }
 
@@ -299,16 +307,20 @@ lp_scene_end_rasterization(struct lp_scene *scene)
       }
    }
 
-   /* Free all scene data blocks:
+   /* Return all scene data blocks to the pool:
     */
    {
       struct data_block_list *list = &scene->data;
-      struct data_block *block, *tmp;
 
-      for (block = list->head; block; block = tmp) {
-         tmp = block->next;
-         if (block != &list->first)
-            FREE(block);
+      /* The statically allocated first block is always the last one. */
+      if (list->head != &list->first) {
+         struct data_block *block = list->head;
+         while (block->next != &list->first)
+            block = block->next;
+         block->next = NULL;
+
+         lp_scene_pool_put_blocks(llvmpipe_screen(scene->pipe->screen)->scene_pool,
+                                  list->head);
       }
 
       list->head = &list->first;
@@ -355,23 +367,29 @@ lp_scene_new_cmd_block(struct lp_scene *scene,
 struct data_block *
 lp_scene_new_data_block(struct lp_scene *scene)
 {
-   if (scene->scene_size + DATA_BLOCK_SIZE > LP_SCENE_MAX_SIZE) {
-      if (0) debug_printf("%s: failed\n", __func__);
-      scene->alloc_failed = true;
+   struct llvmpipe_screen *screen = llvmpipe_screen(scene->pipe->screen);
+   const bool over_limit =
+      scene->scene_size + DATA_BLOCK_SIZE > LP_SCENE_MAX_SIZE;
+
+   struct data_block *block = NULL;
+   if (scene->scene_size + DATA_BLOCK_SIZE <= LP_SCENE_MAX_POOLED_SIZE)
+      block = lp_scene_pool_get_block(screen->scene_pool, over_limit);
+
+   if (!block) {
+      if (over_limit) {
+         if (0) debug_printf("%s: failed\n", __func__);
+         scene->alloc_failed = true;
+      }
       return NULL;
-   } else {
-      struct data_block *block = MALLOC_STRUCT(data_block);
-      if (!block)
-         return NULL;
+   }
 
-      scene->scene_size += sizeof *block;
+   scene->scene_size += sizeof *block;
 
-      block->used = 0;
-      block->next = scene->data.head;
-      scene->data.head = block;
+   block->used = 0;
+   block->next = scene->data.head;
+   scene->data.head = block;
 
-      return block;
-   }
+   return block;
 }
 
 
@@ -547,60 +565,86 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
-static bool
-next_bin(struct lp_scene *scene)
+static int
+compare_chunk_cost(const void *a, const void *b)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return false;
-   }
-   return true;
+   const struct lp_scene_chunk *ca = a, *cb = b;
+
+   if (ca->cost != cb->cost)
+      return ca->cost > cb->cost ? -1 : 1;
+
+   /* Keep raster order between chunks of equal cost. */
+   if (ca->y != cb->y)
+      return ca->y < cb->y ? -1 : 1;
+   return ca->x < cb->x ? -1 : (ca->x > cb->x);
 }
 
 
+/**
+ * Prepare the list of bin chunks to be rasterized.
+ * Called once per scene, before any thread calls lp_scene_bin_iter_next().
+ *
+ * Empty chunks are dropped. If sort_by_cost is set, the remaining chunks
+ * are handed out heaviest first so that the expensive regions of the
+ * scene don't end up being the tail of the rasterization.
+ */
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene)
+lp_scene_bin_iter_begin(struct lp_scene *scene, bool sort_by_cost)
 {
-   scene->curr_x = scene->curr_y = -1;
+   unsigned num_chunks = 0;
+
+   for (unsigned y = 0; y < scene->tiles_y; y += LP_SCENE_CHUNK_SIZE) {
+      for (unsigned x = 0; x < scene->tiles_x; x += LP_SCENE_CHUNK_SIZE) {
+         struct lp_scene_chunk *chunk = &scene->chunks[num_chunks];
+         bool empty = true;
+
+         chunk->x = x;
+         chunk->y = y;
+         chunk->w = MIN2(LP_SCENE_CHUNK_SIZE, scene->tiles_x - x);
+         chunk->h = MIN2(LP_SCENE_CHUNK_SIZE, scene->tiles_y - y);
+         chunk->cost = 0;
+
+         for (unsigned j = 0; j < chunk->h; j++) {
+            for (unsigned i = 0; i < chunk->w; i++) {
+               const struct cmd_bin *bin = lp_scene_get_bin(scene, x + i, y + j);
+               if (bin->head) {
+                  empty = false;
+                  chunk->cost += bin->num_cmds;
+               }
+            }
+         }
+
+         if (!empty)
+            num_chunks++;
+      }
+   }
+
+   if (sort_by_cost && num_chunks > 1)
+      qsort(scene->chunks, num_chunks, sizeof(scene->chunks[0]),
+            compare_chunk_cost);
+
+   scene->num_chunks = num_chunks;
+   scene->next_chunk = 0;
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * Return the next chunk of bins to be rendered, or NULL if there are
+ * none left.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work to do.
  */
-struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+const struct lp_scene_chunk *
+lp_scene_bin_iter_next(struct lp_scene *scene)
 {
-   struct cmd_bin *bin = NULL;
-
-   mtx_lock(&scene->mutex);
-
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+   if (p_atomic_read(&scene->next_chunk) >= scene->num_chunks)
+      return NULL;
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   unsigned idx = p_atomic_inc_return(&scene->next_chunk) - 1;
+   if (idx >= scene->num_chunks)
+      return NULL;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   return &scene->chunks[idx];
 }
 
 
@@ -627,6 +671,17 @@ lp_scene_begin_binning(struct lp_scene *scene,
       scene->num_alloced_tiles = num_required_tiles;
    }
 
+   unsigned num_required_chunks =
+      DIV_ROUND_UP(scene->tiles_x, LP_SCENE_CHUNK_SIZE) *
+      DIV_ROUND_UP(scene->tiles_y, LP_SCENE_CHUNK_SIZE);
+   if (scene->num_alloced_chunks < num_required_chunks) {
+      scene->chunks = reallocarray(scene->chunks, num_required_chunks,
+                                   sizeof(struct lp_scene_chunk));
+      if (!scene->chunks)
+         return;
+      scene->num_alloced_chunks = num_required_chunks;
+   }
+
    /*
     * Determine how many layers the fb has (used for clamping layer value).
     * OpenGL (but not d3d10) permits different amount of layers per rt,
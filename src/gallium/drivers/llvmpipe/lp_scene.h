@@ -40,6 +40,7 @@
 #include "lp_debug.h"
 
 struct lp_scene_queue;
+struct lp_scene_arena;
 struct lp_rast_state;
 
 /* We're limited to 2K by 2K for 32bit fixed point rasterization.
@@ -54,14 +55,23 @@ struct lp_rast_state;
  */
 #define CMD_BLOCK_MAX 29
 
-/* Bytes per data block.  This effectively limits the maximum constant buffer
- * size.
+/* Bytes per data block.  The scene pool carves blocks out of 2 MiB arenas,
+ * 64 bytes are left for the bookkeeping of the block and its share of the
+ * arena header, so that 32 blocks fill an arena, see lp_scene_pool.c.
  */
-#define DATA_BLOCK_SIZE (64 * 1024)
+#define DATA_BLOCK_SIZE (64 * 1024 - 64)
 
-/* Scene temporary storage is clamped to this size:
+/* Bins are handed out to rasterizer threads in square chunks of this many
+ * tiles per side, so that neighbouring tiles share caches.
+ */
+#define LP_SCENE_CHUNK_SIZE 2
+
+/* Scene temporary storage is clamped to this size, unless the extra
+ * blocks can be recycled from the screen's scene pool, in which case the
+ * scene may grow up to LP_SCENE_MAX_POOLED_SIZE before being flushed:
  */
 #define LP_SCENE_MAX_SIZE (36*1024*1024)
+#define LP_SCENE_MAX_POOLED_SIZE (4 * LP_SCENE_MAX_SIZE)
 
 /* The maximum amount of texture storage referenced by a scene is
  * clamped to this size:
@@ -87,6 +97,7 @@ struct data_block {
    uint8_t data[DATA_BLOCK_SIZE];
    unsigned used;
    struct data_block *next;
+   struct lp_scene_arena *arena;  /**< owning pool arena, see lp_scene_pool.c */
 };
 
 
@@ -98,6 +109,18 @@ struct cmd_bin {
    const struct lp_rast_state *last_state;  /* most recent state set in bin */
    struct cmd_block *head;
    struct cmd_block *tail;
+   unsigned num_cmds;  /* commands binned so far, used as a cost estimate */
+};
+
+
+/**
+ * A block of up to LP_SCENE_CHUNK_SIZE x LP_SCENE_CHUNK_SIZE bins which
+ * is rasterized by a single thread.
+ */
+struct lp_scene_chunk {
+   uint16_t x, y;  /* first bin, in tiles */
+   uint16_t w, h;  /* in tiles, smaller at the framebuffer edges */
+   unsigned cost;  /* sum of the bins' num_cmds */
 };
 
 
@@ -127,9 +150,34 @@ struct lp_scene_surface {
    unsigned format_bytes;
    unsigned sample_stride;
    unsigned nr_samples;
+   bool microtiled;  /**< 4x4 pixel blocks, see LP_RESOURCE_FLAG_MICROTILED */
 };
 
 
+/**
+ * Offset of the 4x4 aligned pixel (x, y) in a scene surface.
+ */
+static inline unsigned
+lp_scene_surface_offset(const struct lp_scene_surface *ssurf,
+                        unsigned x, unsigned y)
+{
+   assert(x % 4 == 0 && y % 4 == 0);
+   if (ssurf->microtiled)
+      x *= 4;
+   return y * ssurf->stride + x * ssurf->format_bytes;
+}
+
+
+/**
+ * Distance between the rows of a 4x4 pixel block in a scene surface.
+ */
+static inline unsigned
+lp_scene_surface_block_stride(const struct lp_scene_surface *ssurf)
+{
+   return ssurf->microtiled ? 4 * ssurf->format_bytes : ssurf->stride;
+}
+
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -195,11 +243,17 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
    mtx_t mutex;
 
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
+
+   /** Non-empty bin chunks, in the order they are handed out */
+   unsigned num_alloced_chunks;
+   unsigned num_chunks;
+   unsigned next_chunk;  /**< atomic, index of the next chunk to claim */
+   struct lp_scene_chunk *chunks;
+
    struct data_block_list data;
 };
 
@@ -340,6 +394,7 @@ lp_scene_bin_command(struct lp_scene *scene,
       tail->cmd[i] = cmd & LP_RAST_OP_MASK;
       tail->arg[i] = arg;
       tail->count++;
+      bin->num_cmds++;
    }
 
    return true;
@@ -396,10 +451,10 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene, bool sort_by_cost);
 
-struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+const struct lp_scene_chunk *
+lp_scene_bin_iter_next(struct lp_scene *scene);
 
 
 
@@ -0,0 +1,206 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "util/detect_os.h"
+#include "util/list.h"
+#include "util/u_memory.h"
+#include "util/u_thread.h"
+#include "lp_scene.h"
+#include "lp_scene_pool.h"
+
+#if DETECT_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+
+/* One transparent huge page on x86 and most other platforms. */
+#define LP_SCENE_ARENA_SIZE (2 * 1024 * 1024)
+
+/* Check whether the pool should be trimmed after this many scenes have
+ * given their blocks back.
+ */
+#define LP_SCENE_POOL_TRIM_INTERVAL 64
+
+
+struct lp_scene_arena {
+   struct list_head link;
+   struct data_block *free_blocks;
+   unsigned num_free;
+   /* the blocks follow */
+};
+
+#define LP_SCENE_ARENA_BLOCKS \
+   ((LP_SCENE_ARENA_SIZE - sizeof(struct lp_scene_arena)) / sizeof(struct data_block))
+
+
+struct lp_scene_pool {
+   mtx_t mutex;
+
+   /* Arenas with free blocks come first, full arenas last. */
+   struct list_head arenas;
+
+   unsigned num_free;     /**< free blocks in all arenas */
+   unsigned num_used;     /**< blocks handed out to scenes */
+   unsigned peak_used;    /**< highest num_used since the last trim */
+   unsigned num_puts;     /**< put_blocks calls since the last trim */
+};
+
+
+static struct lp_scene_arena *
+arena_create(void)
+{
+   /* No 64 KiB slot of the arena is lost to the bookkeeping. */
+   STATIC_ASSERT(LP_SCENE_ARENA_BLOCKS == LP_SCENE_ARENA_SIZE / (64 * 1024));
+
+   struct lp_scene_arena *arena =
+      align_malloc(LP_SCENE_ARENA_SIZE, LP_SCENE_ARENA_SIZE);
+   if (!arena)
+      return NULL;
+
+#if DETECT_OS_LINUX && defined(MADV_HUGEPAGE)
+   madvise(arena, LP_SCENE_ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+
+   struct data_block *blocks = (struct data_block *)(arena + 1);
+
+   arena->free_blocks = NULL;
+   for (unsigned i = 0; i < LP_SCENE_ARENA_BLOCKS; i++) {
+      blocks[i].arena = arena;
+      blocks[i].next = arena->free_blocks;
+      arena->free_blocks = &blocks[i];
+   }
+   arena->num_free = LP_SCENE_ARENA_BLOCKS;
+
+   return arena;
+}
+
+
+struct lp_scene_pool *
+lp_scene_pool_create(void)
+{
+   struct lp_scene_pool *pool = CALLOC_STRUCT(lp_scene_pool);
+   if (!pool)
+      return NULL;
+
+   (void) mtx_init(&pool->mutex, mtx_plain);
+   list_inithead(&pool->arenas);
+
+   return pool;
+}
+
+
+void
+lp_scene_pool_destroy(struct lp_scene_pool *pool)
+{
+   if (!pool)
+      return;
+
+   assert(pool->num_used == 0);
+
+   list_for_each_entry_safe(struct lp_scene_arena, arena, &pool->arenas, link)
+      align_free(arena);
+
+   mtx_destroy(&pool->mutex);
+   FREE(pool);
+}
+
+
+/**
+ * Get a data block for a scene.
+ * If recycled_only is set, only already allocated memory is handed out.
+ */
+struct data_block *
+lp_scene_pool_get_block(struct lp_scene_pool *pool, bool recycled_only)
+{
+   struct lp_scene_arena *arena = NULL;
+   struct data_block *block = NULL;
+
+   mtx_lock(&pool->mutex);
+
+   if (!list_is_empty(&pool->arenas)) {
+      arena = list_first_entry(&pool->arenas, struct lp_scene_arena, link);
+      if (!arena->num_free)
+         arena = NULL;
+   }
+
+   if (!arena && !recycled_only) {
+      arena = arena_create();
+      if (arena) {
+         list_add(&arena->link, &pool->arenas);
+         pool->num_free += arena->num_free;
+      }
+   }
+
+   if (arena) {
+      block = arena->free_blocks;
+      arena->free_blocks = block->next;
+      arena->num_free--;
+      pool->num_free--;
+      pool->num_used++;
+      pool->peak_used = MAX2(pool->peak_used, pool->num_used);
+
+      /* Keep full arenas out of the way of the next lookup. */
+      if (!arena->num_free) {
+         list_del(&arena->link);
+         list_addtail(&arena->link, &pool->arenas);
+      }
+   }
+
+   mtx_unlock(&pool->mutex);
+
+   return block;
+}
+
+
+/**
+ * Free arenas which have no block in use, as long as the pool holds more
+ * free blocks than the peak usage seen since the last trim.
+ */
+static void
+pool_trim(struct lp_scene_pool *pool)
+{
+   list_for_each_entry_safe(struct lp_scene_arena, arena, &pool->arenas, link) {
+      if (pool->num_free <= pool->peak_used)
+         break;
+
+      if (arena->num_free == LP_SCENE_ARENA_BLOCKS) {
+         list_del(&arena->link);
+         pool->num_free -= arena->num_free;
+         align_free(arena);
+      }
+   }
+
+   pool->peak_used = pool->num_used;
+   pool->num_puts = 0;
+}
+
+
+/**
+ * Give a NULL-terminated list of blocks, linked through data_block::next,
+ * back to the pool.
+ */
+void
+lp_scene_pool_put_blocks(struct lp_scene_pool *pool, struct data_block *blocks)
+{
+   mtx_lock(&pool->mutex);
+
+   while (blocks) {
+      struct data_block *block = blocks;
+      struct lp_scene_arena *arena = block->arena;
+
+      blocks = block->next;
+
+      block->next = arena->free_blocks;
+      arena->free_blocks = block;
+      if (!arena->num_free++)
+         list_move_to(&arena->link, &pool->arenas);
+      pool->num_free++;
+      pool->num_used--;
+   }
+
+   if (++pool->num_puts >= LP_SCENE_POOL_TRIM_INTERVAL)
+      pool_trim(pool);
+
+   mtx_unlock(&pool->mutex);
+}
@@ -0,0 +1,38 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Screen-wide pool of scene data blocks.
+ *
+ * Scenes are built out of DATA_BLOCK_SIZE data blocks which used to be
+ * malloc'ed while binning and freed as soon as the scene was rasterized.
+ * The pool instead carves them out of large, hugepage-friendly arenas and
+ * recycles them between scenes and contexts. Arenas that stay unused are
+ * returned to the system once the pool holds more free blocks than the
+ * recent peak usage.
+ */
+
+#ifndef LP_SCENE_POOL_H
+#define LP_SCENE_POOL_H
+
+#include "util/compiler.h"
+
+struct data_block;
+struct lp_scene_pool;
+
+
+struct lp_scene_pool *
+lp_scene_pool_create(void);
+
+void
+lp_scene_pool_destroy(struct lp_scene_pool *pool);
+
+struct data_block *
+lp_scene_pool_get_block(struct lp_scene_pool *pool, bool recycled_only);
+
+void
+lp_scene_pool_put_blocks(struct lp_scene_pool *pool, struct data_block *blocks);
+
+
+#endif /* LP_SCENE_POOL_H */
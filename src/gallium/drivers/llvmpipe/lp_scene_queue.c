@@ -134,3 +134,15 @@ lp_scene_enqueue(struct lp_scene_queue *queue, struct lp_scene *scene)
    cnd_signal(&queue->change);
    mtx_unlock(&queue->mutex);
 }
+
+
+/** Return the number of scenes waiting in the queue */
+unsigned
+lp_scene_queue_count(struct lp_scene_queue *queue)
+{
+   mtx_lock(&queue->mutex);
+   unsigned count = queue->tail - queue->head;
+   mtx_unlock(&queue->mutex);
+
+   return count;
+}
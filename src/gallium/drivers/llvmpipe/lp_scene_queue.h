@@ -47,6 +47,9 @@ lp_scene_dequeue(struct lp_scene_queue *queue, bool wait);
 void
 lp_scene_enqueue(struct lp_scene_queue *queue, struct lp_scene *scene);
 
+unsigned
+lp_scene_queue_count(struct lp_scene_queue *queue);
+
 
 
 
@@ -54,7 +54,9 @@
 #include "lp_limits.h"
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
+#include "lp_scene_pool.h"
 #include "lp_flush.h"
+#include "lp_state_fs.h"
 
 #include "frontend/sw_winsys.h"
 
@@ -101,6 +103,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
    { "no_rast_linear", PERF_NO_RAST_LINEAR, NULL },
    { "no_shade",       PERF_NO_SHADE, NULL },
+   { "no_pin_threads", PERF_NO_PIN_THREADS, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -933,6 +937,8 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_scene_pool_destroy(screen->scene_pool);
+
    lp_jit_screen_cleanup(screen);
 
    disk_cache_destroy(screen->disk_shader_cache);
@@ -952,6 +958,8 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
 #endif
    mtx_destroy(&screen->rast_mutex);
    mtx_destroy(&screen->cs_mutex);
+   lp_code_cache_fini(&screen->fs_code_cache);
+   lp_code_cache_fini(&screen->sample_code_cache);
    FREE(screen);
 }
 
@@ -1187,6 +1195,46 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
                                               screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
+   /* How many scenes a context may have binned or in flight before it has
+    * to wait for the rasterizer.
+    */
+   screen->max_scenes = debug_get_num_option("LP_SCENE_DEPTH", MAX_SCENES);
+   screen->max_scenes = CLAMP(screen->max_scenes, 1, MAX_SCENES);
+
+   screen->fs_tiered_compile = debug_get_bool_option("LP_FS_TIERED_COMPILE",
+                                                     false);
+
+   screen->variant_code_budget =
+      (uint64_t)debug_get_num_option("LP_VARIANT_CODE_BUDGET", 64) << 20;
+
+   /* 16-wide fragment shading, only when the CPU has 512-bit vectors. */
+   screen->fs_vector_width = debug_get_num_option("LP_FS_VECTOR_WIDTH",
+                                                  lp_native_vector_width);
+   if (screen->fs_vector_width != 512 ||
+       util_get_cpu_caps()->max_vector_bits < 512)
+      screen->fs_vector_width = lp_native_vector_width;
+
+   screen->microtile = debug_get_bool_option("LP_MICROTILE", false);
+
+   screen->scene_pool = lp_scene_pool_create();
+   if (!screen->scene_pool) {
+      FREE(screen);
+      return NULL;
+   }
+
+   if (!lp_code_cache_init(&screen->fs_code_cache)) {
+      lp_scene_pool_destroy(screen->scene_pool);
+      FREE(screen);
+      return NULL;
+   }
+
+   if (!lp_code_cache_init(&screen->sample_code_cache)) {
+      lp_code_cache_fini(&screen->fs_code_cache);
+      lp_scene_pool_destroy(screen->scene_pool);
+      FREE(screen);
+      return NULL;
+   }
+
 #if defined(HAVE_LIBDRM) && defined(HAVE_LINUX_UDMABUF_H)
    screen->udmabuf_fd = open("/dev/udmabuf", O_RDWR);
    llvmpipe_init_screen_fence_funcs(&screen->base);
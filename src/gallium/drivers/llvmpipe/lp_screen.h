@@ -41,9 +41,11 @@
 #include "util/vma.h"
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_misc.h"
+#include "lp_code_cache.h"
 
 struct sw_winsys;
 struct lp_cs_tpool;
+struct lp_scene_pool;
 
 struct llvmpipe_screen
 {
@@ -59,6 +61,22 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    mtx_t rast_mutex;
+   unsigned max_scenes;  /**< per-context scene pipeline depth */
+   bool fs_tiered_compile;  /**< quick FS variants, optimized in background */
+   uint64_t variant_code_budget;  /**< per context and shader stage, bytes */
+   unsigned fs_vector_width;  /**< bits, wider than native for 16-wide FS */
+   bool microtile;  /**< 4x4 micro-tiled layout for sampled textures */
+
+   /* Compiled fragment shader code shared by all contexts, keyed by the
+    * IR cache key.
+    */
+   struct lp_code_cache fs_code_cache;
+
+   /* Compiled sample, size and image functions of the sampler matrices of
+    * all contexts, keyed by their disk cache key.
+    */
+   struct lp_code_cache sample_code_cache;
+   struct lp_scene_pool *scene_pool;
 
    struct lp_cs_tpool *cs_tpool;
    mtx_t cs_mutex;
@@ -49,6 +49,7 @@
 #include "lp_texture.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_setup_context.h"
@@ -68,12 +69,28 @@ try_update_scene_state(struct lp_setup_context *setup);
 static unsigned
 lp_setup_wait_empty_scene(struct lp_setup_context *setup)
 {
-   /* just use the first scene if we run out */
-   if (setup->scenes[0]->fence) {
-      lp_fence_wait(setup->scenes[0]->fence);
-      lp_scene_end_rasterization(setup->scenes[0]);
+   /* Wait for the oldest scene in flight, it is the first one the
+    * rasterizer will be done with.
+    */
+   unsigned oldest = 0;
+   for (unsigned i = 1; i < setup->num_active_scenes; i++) {
+      const struct lp_fence *fence = setup->scenes[i]->fence;
+      const struct lp_fence *oldest_fence = setup->scenes[oldest]->fence;
+      if (fence && oldest_fence && (int)(fence->id - oldest_fence->id) < 0)
+         oldest = i;
+   }
+
+   if (setup->scenes[oldest]->fence) {
+      int64_t start = (LP_DEBUG & DEBUG_COUNTERS) ? os_time_get_nano() : 0;
+
+      lp_fence_wait(setup->scenes[oldest]->fence);
+      lp_scene_end_rasterization(setup->scenes[oldest]);
+
+      LP_COUNT(nr_scene_waits);
+      if (LP_DEBUG & DEBUG_COUNTERS)
+         LP_COUNT_ADD(scene_wait_time, (os_time_get_nano() - start) / 1000);
    }
-   return 0;
+   return oldest;
 }
 
 
@@ -95,9 +112,11 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
       }
    }
 
-   if (setup->num_active_scenes + 1 > MAX_SCENES) {
+   if (i < setup->num_active_scenes) {
+      /* reuse the idle scene found above */
+   } else if (setup->num_active_scenes + 1 > setup->max_scenes) {
       i = lp_setup_wait_empty_scene(setup);
-   } else if (i == setup->num_active_scenes) {
+   } else {
       /* allocate a new scene */
       struct lp_scene *scene = lp_scene_create(setup);
       if (!scene) {
@@ -210,6 +229,9 @@ lp_setup_rasterize_scene(struct lp_setup_context *setup)
    lp_scene_end_binning(scene);
 
    mtx_lock(&screen->rast_mutex);
+   LP_COUNT(nr_scenes);
+   if (LP_DEBUG & DEBUG_COUNTERS)
+      LP_COUNT_ADD(scene_queue_depth, lp_rast_queued_scenes(screen->rast));
    lp_rast_queue_scene(screen->rast, scene);
    mtx_unlock(&screen->rast_mutex);
 
@@ -1347,6 +1369,7 @@ lp_setup_create(struct pipe_context *pipe,
    setup->pipe = pipe;
 
    setup->num_threads = screen->num_threads;
+   setup->max_scenes = screen->max_scenes;
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
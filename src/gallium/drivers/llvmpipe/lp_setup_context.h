@@ -55,9 +55,8 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
+/** Number of scenes preallocated in the scene slab */
 #define INITIAL_SCENES 4
-#define MAX_SCENES 64
 
 
 
@@ -93,6 +92,7 @@ struct lp_setup_context
 
    struct slab_mempool scene_slab;
    int num_active_scenes;
+   int max_scenes;                       /**< scene pipeline depth */
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
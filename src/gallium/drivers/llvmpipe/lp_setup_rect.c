@@ -69,6 +69,8 @@ lp_setup_alloc_rectangle(struct lp_scene *scene, unsigned nr_inputs)
       return NULL;
 
    rect->inputs.stride = input_array_sz;
+   rect->inputs.zmin = -INFINITY;
+   rect->inputs.zmax = INFINITY;
 
    return rect;
 }
@@ -142,6 +144,11 @@ lp_setup_is_blit(const struct lp_setup_context *setup,
    const struct lp_fragment_shader_variant *variant =
       setup->fs.current.variant;
 
+   /* Blits copy rows of texels straight into the color buffer. */
+   if (setup->fb.cbufs[0] &&
+       llvmpipe_resource_is_microtiled(setup->fb.cbufs[0]->texture))
+      return false;
+
    if (variant->blit) {
       /*
        * Detect blits.
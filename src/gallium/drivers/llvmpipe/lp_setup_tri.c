@@ -109,6 +109,8 @@ lp_setup_alloc_triangle(struct lp_scene *scene,
       return NULL;
 
    tri->inputs.stride = input_array_sz;
+   tri->inputs.zmin = -INFINITY;
+   tri->inputs.zmax = INFINITY;
 
    {
       ASSERTED char *a = (char *)tri;
@@ -466,6 +468,8 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->inputs.layer = layer;
    tri->inputs.viewport_index = viewport_index;
    tri->inputs.view_index = setup->view_index;
+   tri->inputs.zmin = MIN3(v0[0][2], v1[0][2], v2[0][2]);
+   tri->inputs.zmax = MAX3(v0[0][2], v1[0][2], v2[0][2]);
 
    if (0)
       lp_dump_setup_coef(&setup->setup.variant->key,
@@ -1018,6 +1018,8 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
    list_del(&variant->list_item_global.list);
    lp->nr_cs_variants--;
    lp->nr_cs_instrs -= variant->nr_instrs;
+   lp->cs_variant_bytes -= variant->usage.code_size;
+   LP_COUNT_ADD(variant_code_bytes, -(int64_t)variant->usage.code_size);
 
    if(variant->function_name)
       FREE(variant->function_name);
@@ -1025,6 +1027,79 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
 }
 
 
+/**
+ * Evict compute shader variants until there is room for a new one within
+ * the variant count, instruction count and code memory limits.
+ */
+static void
+llvmpipe_evict_cs_variants(struct llvmpipe_context *lp,
+                           struct lp_compute_shader *shader)
+{
+   const uint64_t budget =
+      llvmpipe_screen(lp->pipe.screen)->variant_code_budget;
+
+   /* If we've exceeded the max number of shader variants, free 6.25% of
+    * them. When over the code budget, free another 6.25% of it so that we
+    * don't evict on every compile.
+    */
+   unsigned variants_to_cull = lp->nr_cs_variants >= LP_MAX_SHADER_VARIANTS
+      ? LP_MAX_SHADER_VARIANTS / 16 : 0;
+   const uint64_t bytes_target =
+      lp->cs_variant_bytes > budget ? budget - budget / 16 : budget;
+
+   if (!variants_to_cull &&
+       lp->nr_cs_instrs < LP_MAX_SHADER_INSTRUCTIONS &&
+       lp->cs_variant_bytes <= budget)
+      return;
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+      debug_printf("Evicting CS: %u cs variants,\t%u total variants,"
+                   "\t%u instrs,\t%u instrs/variant,\t%" PRIu64 " bytes\n",
+                   shader->variants_cached,
+                   lp->nr_cs_variants, lp->nr_cs_instrs,
+                   lp->nr_cs_instrs / MAX2(lp->nr_cs_variants, 1),
+                   lp->cs_variant_bytes);
+   }
+
+   struct lp_variant_victim *victims =
+      MALLOC(lp->nr_cs_variants * sizeof *victims);
+   if (!victims)
+      return;
+
+   unsigned nr_victims = 0;
+   struct lp_cs_variant_list_item *li;
+   LIST_FOR_EACH_ENTRY(li, &lp->cs_variants_list.list, list) {
+      victims[nr_victims].priority =
+         lp_variant_usage_priority(&li->base->usage, lp->variant_clock);
+      victims[nr_victims].variant = li->base;
+      nr_victims++;
+   }
+
+   lp_variant_victims_sort(victims, nr_victims);
+
+   for (unsigned i = 0;
+        i < nr_victims &&
+           (i < variants_to_cull ||
+            lp->nr_cs_instrs >= LP_MAX_SHADER_INSTRUCTIONS ||
+            lp->cs_variant_bytes > bytes_target);
+        i++) {
+      struct lp_compute_shader_variant *variant = victims[i].variant;
+
+      lp_evicted_variants_add(&lp->cs_evicted_variants,
+                              lp_evicted_variant_hash(variant->shader->no,
+                                                      &variant->key,
+                                                      variant->shader->variant_key_size));
+
+      llvmpipe_remove_cs_shader_variant(lp, variant);
+
+      lp->nr_variant_evictions++;
+      LP_COUNT(nr_variant_evictions);
+   }
+
+   FREE(victims);
+}
+
+
 static void
 llvmpipe_delete_compute_state(struct pipe_context *pipe,
                               void *cs)
@@ -1291,6 +1366,9 @@ generate_variant(struct llvmpipe_context *lp,
    variant->jit_function = (lp_jit_cs_func)
       gallivm_jit_function(variant->gallivm, variant->function, variant->function_name);
 
+   /* The object code, whether compiled or loaded from the disk cache. */
+   variant->usage.code_size = cached.data_size;
+
    if (needs_caching) {
       lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
    }
@@ -1343,40 +1421,13 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
                       ? lp->nr_cs_instrs / lp->nr_cs_variants : 0);
       }
 
-      /* First, check if we've exceeded the max number of shader variants.
-       * If so, free 6.25% of them (the least recently used ones).
-       */
-      unsigned variants_to_cull = lp->nr_cs_variants >= LP_MAX_SHADER_VARIANTS
-         ? LP_MAX_SHADER_VARIANTS / 16 : 0;
-
-      if (variants_to_cull ||
-          lp->nr_cs_instrs >= LP_MAX_SHADER_INSTRUCTIONS) {
-         if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-            debug_printf("Evicting CS: %u cs variants,\t%u total variants,"
-                         "\t%u instrs,\t%u instrs/variant\n",
-                         shader->variants_cached,
-                         lp->nr_cs_variants, lp->nr_cs_instrs,
-                         lp->nr_cs_instrs / lp->nr_cs_variants);
-         }
+      llvmpipe_evict_cs_variants(lp, shader);
 
-         /*
-          * We need to re-check lp->nr_cs_variants because an arbitrarily large
-          * number of shader variants (potentially all of them) could be
-          * pending for destruction on flush.
-          */
-         for (unsigned i = 0;
-              i < variants_to_cull ||
-                 lp->nr_cs_instrs >= LP_MAX_SHADER_INSTRUCTIONS; i++) {
-            struct lp_cs_variant_list_item *item;
-            if (list_is_empty(&lp->cs_variants_list.list)) {
-               break;
-            }
-            item = list_last_entry(&lp->cs_variants_list.list,
-                                   struct lp_cs_variant_list_item, list);
-            assert(item);
-            assert(item->base);
-            llvmpipe_remove_cs_shader_variant(lp, item->base);
-         }
+      if (lp_evicted_variants_remove(&lp->cs_evicted_variants,
+                                     lp_evicted_variant_hash(shader->no, key,
+                                                             shader->variant_key_size))) {
+         lp->nr_eviction_recompiles++;
+         LP_COUNT(nr_eviction_recompiles);
       }
 
       /*
@@ -1396,9 +1447,16 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
          list_add(&variant->list_item_global.list, &lp->cs_variants_list.list);
          lp->nr_cs_variants++;
          lp->nr_cs_instrs += variant->nr_instrs;
+         lp->cs_variant_bytes += variant->usage.code_size;
+         LP_COUNT_ADD(variant_code_bytes, variant->usage.code_size);
+         variant->usage.compile_time = dt;
          shader->variants_cached++;
       }
    }
+
+   if (variant)
+      lp_variant_usage_touch(&variant->usage, &lp->variant_clock);
+
    return variant;
 }
 
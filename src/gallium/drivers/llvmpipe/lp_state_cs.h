@@ -32,6 +32,7 @@
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "lp_jit.h"
+#include "lp_variant_cache.h"
 #include "lp_state_fs.h"
 
 struct lp_compute_shader_variant;
@@ -97,6 +98,8 @@ struct lp_compute_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   struct lp_variant_usage usage;
+
    struct lp_cs_variant_list_item list_item_global, list_item_local;
 
    struct lp_compute_shader *shader;
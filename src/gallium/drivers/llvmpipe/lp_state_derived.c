@@ -202,6 +202,7 @@ check_linear_rasterizer(struct llvmpipe_context *lp)
       (lp->framebuffer.nr_cbufs == 1 && lp->framebuffer.cbufs[0] &&
        util_res_sample_count(lp->framebuffer.cbufs[0]->texture) == 1 &&
        lp->framebuffer.cbufs[0]->texture->target == PIPE_TEXTURE_2D &&
+       !llvmpipe_resource_is_microtiled(lp->framebuffer.cbufs[0]->texture) &&
        (lp->framebuffer.cbufs[0]->format == PIPE_FORMAT_B8G8R8A8_UNORM ||
         lp->framebuffer.cbufs[0]->format == PIPE_FORMAT_B8G8R8X8_UNORM ||
         lp->framebuffer.cbufs[0]->format == PIPE_FORMAT_R8G8B8A8_UNORM ||
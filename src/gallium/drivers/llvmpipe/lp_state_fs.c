@@ -94,6 +94,7 @@
 #include "lp_bld_blend.h"
 #include "lp_bld_depth.h"
 #include "lp_bld_interp.h"
+#include "lp_code_cache.h"
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
@@ -108,6 +109,7 @@
 #include "lp_screen.h"
 #include "compiler/nir/nir_serialize.h"
 #include "util/mesa-sha1.h"
+#include "util/hash_table.h"
 
 
 /** Fragment shader number (for debugging) */
@@ -3194,7 +3196,7 @@ generate_fragment(struct llvmpipe_context *lp,
    const bool dual_source_blend = key->blend.rt[0].blend_enable &&
                                   util_blend_state_is_dual(&key->blend, 0);
 
-   assert(lp_native_vector_width / 32 >= 4);
+   assert(variant->vector_width / 32 >= 4);
 
    /* Adjust color input interpolation according to flatshade state:
     */
@@ -3217,7 +3219,7 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.sign = true;          /* values are signed */
    fs_type.norm = false;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
-   fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   fs_type.length = MIN2(variant->vector_width / 32, 16); /* n*4 elements per vector */
 
    struct lp_type blend_type;
    memset(&blend_type, 0, sizeof blend_type);
@@ -3510,6 +3512,48 @@ generate_fragment(struct llvmpipe_context *lp,
    lp_bld_llvm_sampler_soa_destroy(sampler);
    lp_bld_llvm_image_soa_destroy(image);
 
+   /*
+    * Blending handles 4 and 8 wide vectors, hand 16-wide fragment outputs
+    * over as two 8-wide halves, which have the same layout as two 8-wide
+    * loop iterations (rows 0-1 and 2-3 of the stamp).
+    */
+   struct lp_type blend_fs_type = fs_type;
+   unsigned blend_num_fs = num_fs;
+   LLVMValueRef blend_fs_mask[(16 / 4) * LP_MAX_SAMPLES];
+   if (fs_type.length == 16) {
+      const unsigned nr_outputs =
+         dual_source_blend ? MAX2(key->nr_cbufs, 2) : key->nr_cbufs;
+
+      assert(num_fs == 1);
+      blend_fs_type.length = 8;
+      blend_num_fs = 2;
+
+      LLVMTypeRef half_vec_type = lp_build_vec_type(gallivm, blend_fs_type);
+      for (unsigned s = 0; s < key->coverage_samples; s++) {
+         for (unsigned h = 0; h < 2; h++) {
+            blend_fs_mask[s * 2 + h] =
+               lp_build_extract_range(gallivm, fs_mask[s], h * 8, 8);
+         }
+      }
+
+      for (unsigned s = 0; s < key->min_samples; s++) {
+         for (unsigned cbuf = 0; cbuf < nr_outputs; cbuf++) {
+            for (unsigned chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+               LLVMValueRef ptr =
+                  LLVMBuildBitCast(builder, fs_out_color[s][cbuf][chan][0],
+                                   LLVMPointerType(half_vec_type, 0), "");
+               for (unsigned h = 0; h < 2; h++) {
+                  LLVMValueRef index = lp_build_const_int32(gallivm, h);
+                  fs_out_color[s][cbuf][chan][h] =
+                     LLVMBuildGEP2(builder, half_vec_type, ptr, &index, 1, "");
+               }
+            }
+         }
+      }
+   } else {
+      memcpy(blend_fs_mask, fs_mask, sizeof fs_mask);
+   }
+
    /* Loop over color outputs / color buffers to do blending */
    for (unsigned cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
       if (key->cbuf_format[cbuf] != PIPE_FORMAT_NONE &&
@@ -3543,7 +3587,7 @@ generate_fragment(struct llvmpipe_context *lp,
                                                          &index, 1, ""), "");
 
          for (unsigned s = 0; s < key->cbuf_nr_samples[cbuf]; s++) {
-            unsigned mask_idx = num_fs * (key->multisample ? s : 0);
+            unsigned mask_idx = blend_num_fs * (key->multisample ? s : 0);
             unsigned out_idx = key->min_samples == 1 ? 0 : s;
             LLVMValueRef out_ptr = color_ptr;
 
@@ -3560,7 +3604,8 @@ generate_fragment(struct llvmpipe_context *lp,
 
             generate_unswizzled_blend(gallivm, cbuf, variant,
                                       key->cbuf_format[cbuf],
-                                      num_fs, fs_type, &fs_mask[mask_idx],
+                                      blend_num_fs, blend_fs_type,
+                                      &blend_fs_mask[mask_idx],
                                       fs_out_color[out_idx],
                                       variant->jit_context_type,
                                       context_ptr, blend_vec_type, out_ptr, stride,
@@ -3727,6 +3772,8 @@ lp_debug_fs_variant(struct lp_fragment_shader_variant *variant)
    debug_printf("variant->opaque = %u\n", variant->opaque);
    debug_printf("variant->potentially_opaque = %u\n", variant->potentially_opaque);
    debug_printf("variant->blit = %u\n", variant->blit);
+   debug_printf("variant->hiz_cull = %u\n", variant->hiz_cull);
+   debug_printf("variant->hiz_lower = %u\n", variant->hiz_lower);
    debug_printf("shader->kind = %s\n", lp_debug_fs_kind(variant->shader->kind));
    debug_printf("\n");
 }
@@ -3748,6 +3795,8 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
    struct mesa_sha1 ctx;
    _mesa_sha1_init(&ctx);
    _mesa_sha1_update(&ctx, &variant->key, variant->shader->variant_key_size);
+   _mesa_sha1_update(&ctx, &variant->vector_width,
+                     sizeof variant->vector_width);
    _mesa_sha1_update(&ctx, ir_binary, ir_size);
    _mesa_sha1_final(&ctx, ir_sha1_cache_key);
 
@@ -3755,6 +3804,353 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 }
 
 
+/**
+ * Compiled code of a fragment shader variant, shared by the identical
+ * variants of all contexts of a screen, keyed by the IR cache key, which
+ * covers both the variant key and the NIR.
+ */
+struct lp_fs_code {
+   struct lp_code_cache_entry base;
+
+   lp_jit_frag_func jit_function[2];
+   lp_jit_linear_llvm_func jit_linear_llvm;
+   unsigned nr_instrs;
+   uint64_t code_size;
+};
+
+
+static struct lp_fs_code *
+lp_fs_code_lookup(struct llvmpipe_screen *screen,
+                  const unsigned char ir_sha1_cache_key[20])
+{
+   return (struct lp_fs_code *)
+      lp_code_cache_lookup(&screen->fs_code_cache, ir_sha1_cache_key);
+}
+
+
+/**
+ * Move the compiled code of a variant into the screen's code cache.
+ * Returns NULL, leaving the variant alone, if another context was quicker.
+ */
+static struct lp_fs_code *
+lp_fs_code_insert(struct llvmpipe_screen *screen,
+                  struct lp_fragment_shader_variant *variant,
+                  const unsigned char ir_sha1_cache_key[20])
+{
+   struct lp_fs_code *code = CALLOC_STRUCT(lp_fs_code);
+   if (!code)
+      return NULL;
+
+   memcpy(code->base.key, ir_sha1_cache_key, sizeof(code->base.key));
+   code->base.gallivm = variant->gallivm;
+   code->jit_function[RAST_WHOLE] = variant->jit_function[RAST_WHOLE];
+   code->jit_function[RAST_EDGE_TEST] = variant->jit_function[RAST_EDGE_TEST];
+   code->jit_linear_llvm = variant->jit_linear_llvm;
+   code->nr_instrs = variant->nr_instrs;
+   code->code_size = variant->usage.code_size;
+
+   struct lp_code_cache_entry *entry =
+      lp_code_cache_insert(&screen->fs_code_cache, &code->base);
+   if (entry != &code->base) {
+      lp_code_cache_unref(&screen->fs_code_cache, entry);
+      FREE(code);
+      return NULL;
+   }
+
+   variant->gallivm = NULL;
+   return code;
+}
+
+
+static void
+lp_fs_code_unref(struct llvmpipe_screen *screen, struct lp_fs_code *code)
+{
+   lp_code_cache_unref(&screen->fs_code_cache, &code->base);
+}
+
+
+/**
+ * Background compilation of the fully optimized functions of a variant
+ * which was first compiled without optimizations (LP_FS_TIERED_COMPILE).
+ *
+ * The job owns everything the compilation touches: a private clone of the
+ * NIR, as the compiler modifies it, and a scratch variant holding the
+ * gallivm state and the LLVM functions, living in the queue's own LLVM
+ * context. Only the jit_function pointers of the real variant are written,
+ * once the optimized code is ready.
+ */
+struct lp_fs_opt_job {
+   struct util_queue_fence fence;
+   struct llvmpipe_context *lp;
+   struct lp_fragment_shader_variant *variant;
+
+   struct lp_fragment_shader shader;
+   struct lp_fragment_shader_variant *opt;
+
+   /* Which functions to compile, RAST_WHOLE may be an alias of
+    * RAST_EDGE_TEST.
+    */
+   bool edge_test;
+   bool whole;
+   bool whole_is_edge_test;
+
+   struct lp_cached_code cached;
+   unsigned char ir_sha1_cache_key[20];
+   bool needs_caching;
+};
+
+
+static void
+lp_fs_opt_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_opt_job *job = data;
+   struct llvmpipe_context *lp = job->lp;
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant = job->variant;
+   struct lp_fragment_shader_variant *opt = job->opt;
+
+   int64_t t0 = os_time_get();
+
+   char module_name[64];
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u_opt",
+            variant->shader->no, variant->no);
+   opt->gallivm = gallivm_create(module_name, &lp->fs_opt_context,
+                                 &job->cached);
+   if (!opt->gallivm)
+      return;
+
+   lp_jit_init_types(opt);
+
+   if (job->edge_test)
+      generate_fragment(lp, &job->shader, opt, RAST_EDGE_TEST);
+   if (job->whole)
+      generate_fragment(lp, &job->shader, opt, RAST_WHOLE);
+
+   gallivm_compile_module(opt->gallivm);
+
+   lp_jit_frag_func edge_test = NULL, whole = NULL;
+   if (job->edge_test) {
+      edge_test = (lp_jit_frag_func)
+         gallivm_jit_function(opt->gallivm, opt->function[RAST_EDGE_TEST],
+                              opt->function_name[RAST_EDGE_TEST]);
+   }
+   if (job->whole) {
+      whole = (lp_jit_frag_func)
+         gallivm_jit_function(opt->gallivm, opt->function[RAST_WHOLE],
+                              opt->function_name[RAST_WHOLE]);
+   } else if (job->whole_is_edge_test) {
+      whole = edge_test;
+   }
+
+   if (job->needs_caching)
+      lp_disk_cache_insert_shader(screen, &job->cached, job->ir_sha1_cache_key);
+
+   gallivm_free_ir(opt->gallivm);
+
+   /* The rasterizer threads may be running the quickly compiled functions
+    * right now, they stay valid until the variant is destroyed.
+    */
+   if (edge_test)
+      p_atomic_set(&variant->jit_function[RAST_EDGE_TEST], edge_test);
+   if (whole)
+      p_atomic_set(&variant->jit_function[RAST_WHOLE], whole);
+
+   int64_t dt = os_time_get() - t0;
+   variant->opt_compile_time = dt;
+   p_atomic_inc(&variant->swaps);
+
+   LP_COUNT_ADD(fs_opt_compile_time, dt);
+   LP_COUNT(nr_fs_variant_swaps);
+}
+
+
+/**
+ * Queue the optimized compilation of a quickly compiled variant.
+ */
+static void
+lp_fs_opt_job_queue(struct llvmpipe_context *lp,
+                    struct lp_fragment_shader_variant *variant,
+                    const unsigned char ir_sha1_cache_key[20],
+                    bool needs_caching)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   struct lp_fs_opt_job *job = CALLOC_STRUCT(lp_fs_opt_job);
+   if (!job)
+      return;
+
+   job->opt = CALLOC(1, sizeof *job->opt + shader->variant_key_size -
+                        sizeof job->opt->key);
+   if (!job->opt) {
+      FREE(job);
+      return;
+   }
+
+   job->shader = *shader;
+   job->shader.base.ir.nir = nir_shader_clone(NULL, shader->base.ir.nir);
+   if (!job->shader.base.ir.nir) {
+      FREE(job->opt);
+      FREE(job);
+      return;
+   }
+
+   memcpy(&job->opt->key, &variant->key, shader->variant_key_size);
+   job->opt->opaque = variant->opaque;
+   job->opt->vector_width = variant->vector_width;
+   job->opt->no = variant->no;
+
+   job->edge_test = variant->function[RAST_EDGE_TEST] != NULL;
+   job->whole = variant->function[RAST_WHOLE] != NULL;
+   job->whole_is_edge_test = job->edge_test && !job->whole &&
+      variant->jit_function[RAST_WHOLE] == variant->jit_function[RAST_EDGE_TEST];
+
+   job->lp = lp;
+   job->variant = variant;
+   memcpy(job->ir_sha1_cache_key, ir_sha1_cache_key,
+          sizeof(job->ir_sha1_cache_key));
+   job->needs_caching = needs_caching;
+
+   util_queue_fence_init(&job->fence);
+   variant->opt_job = job;
+
+   LP_COUNT(nr_fs_opt_compiles);
+
+   util_queue_add_job(&lp->fs_opt_queue, job, &job->fence,
+                      lp_fs_opt_job_execute, NULL, 0);
+}
+
+
+/**
+ * Wait for or cancel the optimized compilation of a variant and free the
+ * job.
+ */
+static void
+lp_fs_opt_job_destroy(struct llvmpipe_context *lp,
+                      struct lp_fs_opt_job *job)
+{
+   struct lp_fragment_shader_variant *opt = job->opt;
+
+   util_queue_drop_job(&lp->fs_opt_queue, &job->fence);
+   util_queue_fence_destroy(&job->fence);
+
+   if (opt->gallivm)
+      gallivm_destroy(opt->gallivm);
+   if (opt->function_name[RAST_EDGE_TEST])
+      FREE(opt->function_name[RAST_EDGE_TEST]);
+   if (opt->function_name[RAST_WHOLE])
+      FREE(opt->function_name[RAST_WHOLE]);
+   FREE(opt);
+
+   ralloc_free(job->shader.base.ir.nir);
+   FREE(job);
+}
+
+
+/**
+ * Pick the width of the fragment vectors of a variant. 16-wide vectors
+ * shade a whole 4x4 stamp per iteration, but not all of the fragment
+ * pipeline can deal with them, so fall back to the native width for those
+ * variants.
+ */
+static unsigned
+lp_fs_variant_vector_width(const struct llvmpipe_screen *screen,
+                           const struct lp_fragment_shader *shader,
+                           const struct lp_fragment_shader_variant_key *key)
+{
+   const struct nir_shader *nir = shader->base.ir.nir;
+   const unsigned fallback_width = MIN2(screen->fs_vector_width, 256);
+
+   if (screen->fs_vector_width < 512)
+      return screen->fs_vector_width;
+
+   /* Only the upper half of the stamp is shaded for 1d resources, and
+    * framebuffer fetch and bindless sampling work on at most 8 pixels.
+    * The subgroup size reported to applications is the native one.
+    */
+   if (!nir || key->resource_1d ||
+       nir->info.fs.uses_fbfetch_output || nir->info.uses_bindless ||
+       nir->info.uses_wide_subgroup_intrinsics ||
+       BITSET_TEST(nir->info.system_values_read, SYSTEM_VALUE_SUBGROUP_SIZE) ||
+       BITSET_TEST(nir->info.system_values_read,
+                   SYSTEM_VALUE_SUBGROUP_INVOCATION))
+      return fallback_width;
+
+   if ((key->depth.enabled || key->stencil[0].enabled) &&
+       util_format_get_blocksizebits(key->zsbuf_format) > 32)
+      return fallback_width;
+
+   const struct lp_sampler_static_state *samplers =
+      lp_fs_variant_key_samplers(key);
+   for (unsigned i = 0; i < MAX2(key->nr_samplers, key->nr_sampler_views); i++) {
+      const struct util_format_description *desc =
+         util_format_description(samplers[i].texture_state.format);
+
+      if (desc && (desc->layout == UTIL_FORMAT_LAYOUT_S3TC ||
+                   desc->layout == UTIL_FORMAT_LAYOUT_RGTC))
+         return fallback_width;
+   }
+
+   return screen->fs_vector_width;
+}
+
+
+/**
+ * Whether a fragment which fails the depth test leaves the stencil buffer
+ * alone, whatever the outcome of the stencil test.
+ */
+static bool
+lp_stencil_keeps_occluded(const struct pipe_stencil_state *stencil)
+{
+   return !stencil->enabled || !stencil->writemask ||
+          (stencil->fail_op == PIPE_STENCIL_OP_KEEP &&
+           stencil->zfail_op == PIPE_STENCIL_OP_KEEP);
+}
+
+
+/**
+ * Classify how primitives drawn with a variant interact with the
+ * rasterizer's hierarchical Z.
+ */
+void
+lp_fs_variant_hiz(struct lp_fragment_shader_variant *variant,
+                  const struct shader_info *info)
+{
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const bool writes_z = info->outputs_written &
+                         BITFIELD64_BIT(FRAG_RESULT_DEPTH);
+   const unsigned func = key->depth.func;
+   const bool decreasing = func == PIPE_FUNC_LESS ||
+                           func == PIPE_FUNC_LEQUAL ||
+                           func == PIPE_FUNC_EQUAL;
+
+   if (!key->depth.enabled)
+      return;
+
+   /* Occluded fragments may only be skipped when nothing but the depth
+    * test would have rejected them, and their depth is the plane's.
+    */
+   variant->hiz_cull =
+      decreasing && !writes_z && !key->depth_clamp &&
+      (!info->writes_memory || info->fs.early_fragment_tests) &&
+      lp_stencil_keeps_occluded(&key->stencil[0]) &&
+      lp_stencil_keeps_occluded(&key->stencil[1]);
+
+   if (!key->depth.writemask || func == PIPE_FUNC_NEVER || decreasing) {
+      /* Only covered pixels known to have been written lower the max. */
+      variant->hiz_lower =
+         key->depth.writemask && func != PIPE_FUNC_NEVER &&
+         func != PIPE_FUNC_EQUAL && !writes_z && !key->depth_clamp &&
+         !key->stencil[0].enabled && !key->alpha.enabled &&
+         !key->blend.alpha_to_coverage && !key->multisample &&
+         !info->fs.uses_discard &&
+         !(info->outputs_written & BITFIELD64_BIT(FRAG_RESULT_SAMPLE_MASK));
+   } else if (writes_z || key->depth_clamp) {
+      variant->hiz_invalidate = 1;
+   } else {
+      variant->hiz_raise = 1;
+   }
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -3778,22 +4174,45 @@ generate_variant(struct llvmpipe_context *lp,
    memcpy(&variant->key, key, shader->variant_key_size);
 
    struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   variant->vector_width = lp_fs_variant_vector_width(screen, shader, key);
+
    struct lp_cached_code cached = { 0 };
    unsigned char ir_sha1_cache_key[20];
    bool needs_caching = false;
    if (shader->base.ir.nir) {
       lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
 
-      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-      if (!cached.data_size)
-         needs_caching = true;
+      /* Another context may have compiled this variant already. */
+      variant->code = lp_fs_code_lookup(screen, ir_sha1_cache_key);
+      if (variant->code) {
+         LP_COUNT(nr_fs_shared_code_hits);
+      } else {
+         lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+         if (!cached.data_size)
+            needs_caching = true;
+      }
    }
 
+   /* Compile quickly now and optimize in the background, unless the code
+    * comes from the disk cache anyway. Blits and linear shaders are cheap
+    * to compile and their linear functions are only built once.
+    */
+   const bool tiered =
+      lp->fs_tiered_compile && nir && !variant->code && !cached.data_size &&
+      shader->kind != LP_FS_KIND_BLIT_RGBA &&
+      shader->kind != LP_FS_KIND_BLIT_RGB1 &&
+      shader->kind != LP_FS_KIND_LLVM_LINEAR;
+
    char module_name[64];
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
             shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
-   if (!variant->gallivm) {
+   if (variant->code)
+      variant->gallivm = NULL;
+   else if (tiered)
+      variant->gallivm = gallivm_create_fast(module_name, &lp->context, &cached);
+   else
+      variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
+   if (!variant->gallivm && !variant->code) {
       FREE(variant);
       return NULL;
    }
@@ -3872,6 +4291,7 @@ generate_variant(struct llvmpipe_context *lp,
       }
 
       if (target == PIPE_TEXTURE_2D &&
+          !samp0->texture_state.microtiled &&
           min_img_filter == PIPE_TEX_FILTER_NEAREST &&
           mag_img_filter == PIPE_TEX_FILTER_NEAREST &&
           min_mip_filter == PIPE_TEX_MIPFILTER_NONE &&
@@ -3887,10 +4307,18 @@ generate_variant(struct llvmpipe_context *lp,
       }
    }
 
+   /* The linear samplers only know the linear texture layout. */
+   bool microtiled_textures = false;
+   for (unsigned i = 0; i < MAX2(key->nr_samplers, key->nr_sampler_views); i++) {
+      if (lp_fs_variant_key_samplers(key)[i].texture_state.microtiled)
+         microtiled_textures = true;
+   }
+
    /* Determine whether this shader + pipeline state is a candidate for
     * the linear path.
     */
    const bool linear_pipeline =
+         !microtiled_textures &&
          !key->stencil[0].enabled &&
          !key->depth.enabled &&
          !nir->info.fs.uses_discard &&
@@ -3902,21 +4330,32 @@ generate_variant(struct llvmpipe_context *lp,
 
    memcpy(&variant->key, key, sizeof *key);
 
+   lp_fs_variant_hiz(variant, &nir->info);
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
 
    llvmpipe_fs_variant_fastpath(variant);
 
-   lp_jit_init_types(variant);
+   if (variant->code) {
+      variant->jit_function[RAST_WHOLE] = variant->code->jit_function[RAST_WHOLE];
+      variant->jit_function[RAST_EDGE_TEST] =
+         variant->code->jit_function[RAST_EDGE_TEST];
+      variant->jit_linear_llvm = variant->code->jit_linear_llvm;
+      variant->nr_instrs = variant->code->nr_instrs;
+      variant->usage.code_size = variant->code->code_size;
+   } else {
+      lp_jit_init_types(variant);
 
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+      if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+         generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+      if (variant->jit_function[RAST_WHOLE] == NULL) {
+         if (variant->opaque) {
+            /* Specialized shader, which doesn't need to read the color buffer. */
+            generate_fragment(lp, shader, variant, RAST_WHOLE);
+         }
       }
    }
 
@@ -3936,7 +4375,7 @@ generate_variant(struct llvmpipe_context *lp,
       /* If the original fastpath doesn't cover this variant, try the new
        * code:
        */
-      if (variant->jit_linear == NULL) {
+      if (variant->jit_linear == NULL && !variant->code) {
          if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
              shader->kind == LP_FS_KIND_BLIT_RGB1 ||
              shader->kind == LP_FS_KIND_LLVM_LINEAR) {
@@ -3954,32 +4393,34 @@ generate_variant(struct llvmpipe_context *lp,
     * Compile everything
     */
 
+   if (!variant->code) {
 #if GALLIVM_USE_ORCJIT
 /* module has been moved into ORCJIT after gallivm_compile_module */
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+      variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
 
-   gallivm_compile_module(variant->gallivm);
+      gallivm_compile_module(variant->gallivm);
 #else
-   gallivm_compile_module(variant->gallivm);
+      gallivm_compile_module(variant->gallivm);
 
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+      variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
 #endif
 
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST],
-                                 variant->function_name[RAST_EDGE_TEST]);
-   }
+      if (variant->function[RAST_EDGE_TEST]) {
+         variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_EDGE_TEST],
+                                    variant->function_name[RAST_EDGE_TEST]);
+      }
 
-   if (variant->function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-         gallivm_jit_function(variant->gallivm,
-                              variant->function[RAST_WHOLE],
-                              variant->function_name[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-         variant->jit_function[RAST_EDGE_TEST];
+      if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_WHOLE],
+                                 variant->function_name[RAST_WHOLE]);
+      } else if (!variant->jit_function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+            variant->jit_function[RAST_EDGE_TEST];
+      }
    }
 
    if (linear_pipeline) {
@@ -3996,11 +4437,27 @@ generate_variant(struct llvmpipe_context *lp,
       lp_linear_check_variant(variant);
    }
 
-   if (needs_caching) {
+   /* The object code, whether compiled or loaded from the disk cache. */
+   if (!variant->code)
+      variant->usage.code_size = cached.data_size;
+
+   /* Only the optimized code goes to the disk cache. */
+   if (needs_caching && !tiered) {
       lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
    }
 
-   gallivm_free_ir(variant->gallivm);
+   if (variant->gallivm)
+      gallivm_free_ir(variant->gallivm);
+
+   if (tiered &&
+       (variant->function[RAST_EDGE_TEST] || variant->function[RAST_WHOLE])) {
+      lp_fs_opt_job_queue(lp, variant, ir_sha1_cache_key, needs_caching);
+   } else if (shader->base.ir.nir && !variant->code) {
+      /* Let the other contexts use this code too. Quickly compiled code
+       * is not shared, it gets replaced.
+       */
+      variant->code = lp_fs_code_insert(screen, variant, ir_sha1_cache_key);
+   }
 
    return variant;
 }
@@ -4138,11 +4595,15 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
 {
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del fs #%u var %u v created %u v cached %u "
-                   "v total cached %u inst %u total inst %u\n",
+                   "v total cached %u inst %u total inst %u "
+                   "compile %" PRId64 " us opt compile %" PRId64 " us "
+                   "swaps %u\n",
                    variant->shader->no, variant->no,
                    variant->shader->variants_created,
                    variant->shader->variants_cached,
-                   lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
+                   lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs,
+                   variant->usage.compile_time, variant->opt_compile_time,
+                   variant->swaps);
    }
 
    /* remove from shader's list */
@@ -4153,6 +4614,83 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
    list_del(&variant->list_item_global.list);
    lp->nr_fs_variants--;
    lp->nr_fs_instrs -= variant->nr_instrs;
+   lp->fs_variant_bytes -= variant->usage.code_size;
+   LP_COUNT_ADD(variant_code_bytes, -(int64_t)variant->usage.code_size);
+}
+
+
+/**
+ * Evict fragment shader variants until there is room for a new one within
+ * the variant count, instruction count and code memory limits.
+ */
+static void
+llvmpipe_evict_fs_variants(struct llvmpipe_context *lp,
+                           struct lp_fragment_shader *shader)
+{
+   const uint64_t budget =
+      llvmpipe_screen(lp->pipe.screen)->variant_code_budget;
+
+   /* If we've exceeded the max number of shader variants, free 6.25% of
+    * them. When over the code budget, free another 6.25% of it so that we
+    * don't evict on every compile.
+    */
+   const unsigned variants_to_cull =
+      lp->nr_fs_variants >= LP_MAX_SHADER_VARIANTS
+      ? LP_MAX_SHADER_VARIANTS / 16 : 0;
+   const uint64_t bytes_target =
+      lp->fs_variant_bytes > budget ? budget - budget / 16 : budget;
+
+   if (!variants_to_cull &&
+       lp->nr_fs_instrs < LP_MAX_SHADER_INSTRUCTIONS &&
+       lp->fs_variant_bytes <= budget)
+      return;
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+      debug_printf("Evicting FS: %u fs variants,\t%u total variants,"
+                   "\t%u instrs,\t%u instrs/variant,\t%" PRIu64 " bytes\n",
+                   shader->variants_cached,
+                   lp->nr_fs_variants, lp->nr_fs_instrs,
+                   lp->nr_fs_instrs / MAX2(lp->nr_fs_variants, 1),
+                   lp->fs_variant_bytes);
+   }
+
+   struct lp_variant_victim *victims =
+      MALLOC(lp->nr_fs_variants * sizeof *victims);
+   if (!victims)
+      return;
+
+   unsigned nr_victims = 0;
+   struct lp_fs_variant_list_item *li;
+   LIST_FOR_EACH_ENTRY(li, &lp->fs_variants_list.list, list) {
+      victims[nr_victims].priority =
+         lp_variant_usage_priority(&li->base->usage, lp->variant_clock);
+      victims[nr_victims].variant = li->base;
+      nr_victims++;
+   }
+
+   lp_variant_victims_sort(victims, nr_victims);
+
+   for (unsigned i = 0;
+        i < nr_victims &&
+           (i < variants_to_cull ||
+            lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS ||
+            lp->fs_variant_bytes > bytes_target);
+        i++) {
+      struct lp_fragment_shader_variant *variant = victims[i].variant;
+
+      lp_evicted_variants_add(&lp->fs_evicted_variants,
+                              lp_evicted_variant_hash(variant->shader->no,
+                                                      &variant->key,
+                                                      variant->shader->variant_key_size));
+
+      llvmpipe_remove_shader_variant(lp, variant);
+      lp_fs_variant_reference(lp, &variant, NULL);
+
+      lp->nr_variant_evictions++;
+      LP_COUNT(nr_variant_evictions);
+   }
+
+   FREE(victims);
 }
 
 
@@ -4160,7 +4698,12 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
-   gallivm_destroy(variant->gallivm);
+   if (variant->opt_job)
+      lp_fs_opt_job_destroy(lp, variant->opt_job);
+   if (variant->code)
+      lp_fs_code_unref(llvmpipe_screen(lp->pipe.screen), variant->code);
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
    lp_fs_reference(lp, &variant->shader, NULL);
    if (variant->function_name[RAST_EDGE_TEST])
       FREE(variant->function_name[RAST_EDGE_TEST]);
@@ -4710,45 +5253,13 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
                       lp->nr_fs_variants ? lp->nr_fs_instrs / lp->nr_fs_variants : 0);
       }
 
-      /* First, check if we've exceeded the max number of shader variants.
-       * If so, free 6.25% of them (the least recently used ones).
-       */
-      const unsigned variants_to_cull =
-         lp->nr_fs_variants >= LP_MAX_SHADER_VARIANTS
-         ? LP_MAX_SHADER_VARIANTS / 16 : 0;
-
-      if (variants_to_cull ||
-          lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS) {
-         if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-            debug_printf("Evicting FS: %u fs variants,\t%u total variants,"
-                         "\t%u instrs,\t%u instrs/variant\n",
-                         shader->variants_cached,
-                         lp->nr_fs_variants, lp->nr_fs_instrs,
-                         lp->nr_fs_instrs / lp->nr_fs_variants);
-         }
+      llvmpipe_evict_fs_variants(lp, shader);
 
-         /*
-          * We need to re-check lp->nr_fs_variants because an arbitrarily
-          * large number of shader variants (potentially all of them) could
-          * be pending for destruction on flush.
-          */
-
-         for (unsigned i = 0;
-              i < variants_to_cull ||
-                 lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS;
-              i++) {
-            struct lp_fs_variant_list_item *item;
-            if (list_is_empty(&lp->fs_variants_list.list)) {
-               break;
-            }
-            item = list_last_entry(&lp->fs_variants_list.list,
-                                   struct lp_fs_variant_list_item, list);
-            assert(item);
-            assert(item->base);
-            llvmpipe_remove_shader_variant(lp, item->base);
-            struct lp_fragment_shader_variant *variant = item->base;
-            lp_fs_variant_reference(lp, &variant, NULL);
-         }
+      if (lp_evicted_variants_remove(&lp->fs_evicted_variants,
+                                     lp_evicted_variant_hash(shader->no, key,
+                                                             shader->variant_key_size))) {
+         lp->nr_eviction_recompiles++;
+         LP_COUNT(nr_eviction_recompiles);
       }
 
       /*
@@ -4763,14 +5274,20 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
 
       /* Put the new variant into the list */
       if (variant) {
+         variant->usage.compile_time = dt;
          list_add(&variant->list_item_local.list, &shader->variants.list);
          list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
          lp->nr_fs_variants++;
          lp->nr_fs_instrs += variant->nr_instrs;
+         lp->fs_variant_bytes += variant->usage.code_size;
+         LP_COUNT_ADD(variant_code_bytes, variant->usage.code_size);
          shader->variants_cached++;
       }
    }
 
+   if (variant)
+      lp_variant_usage_touch(&variant->usage, &lp->variant_clock);
+
    /* Bind this variant */
    lp_setup_set_fs_variant(lp->setup, variant);
 }
@@ -39,6 +39,7 @@
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
 #include "lp_jit.h"
+#include "lp_variant_cache.h"
 
 struct lp_fragment_shader;
 
@@ -141,6 +142,11 @@ struct lp_fs_variant_list_item
 };
 
 
+struct lp_fs_opt_job;
+struct lp_fs_code;
+struct shader_info;
+struct llvmpipe_screen;
+
 struct lp_fragment_shader_variant
 {
    /*
@@ -151,10 +157,24 @@ struct lp_fragment_shader_variant
    unsigned opaque:1;
    unsigned blit:1;
    unsigned linear_input_mask:16;
+
+   /*
+    * How primitives drawn with this variant interact with the per-tile
+    * hierarchical Z of the rasterizer, see lp_rast_hiz.c.
+    */
+   unsigned hiz_cull:1;       /**< occluded blocks may be skipped */
+   unsigned hiz_lower:1;      /**< fully covered blocks lower the max depth */
+   unsigned hiz_raise:1;      /**< may write depths up to the plane's max */
+   unsigned hiz_invalidate:1; /**< may write any depth */
    struct pipe_reference reference;
 
    struct gallivm_state *gallivm;
 
+   /* Machine code shared with identical variants of other contexts, owns
+    * the gallivm state instead of the variant when set.
+    */
+   struct lp_fs_code *code;
+
    LLVMTypeRef jit_context_type;
    LLVMTypeRef jit_context_ptr_type;
    LLVMTypeRef jit_thread_data_type;
@@ -184,9 +204,23 @@ struct lp_fragment_shader_variant
    /* Bitmask to say what cbufs are unswizzled */
    unsigned unswizzled_cbufs;
 
+   /* Width of the fragment vectors in bits, 512 shades a whole 4x4 stamp
+    * per iteration (LP_FS_VECTOR_WIDTH).
+    */
+   unsigned vector_width;
+
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /* Background compilation of the fully optimized functions, when the
+    * variant was first compiled quickly (LP_FS_TIERED_COMPILE).
+    */
+   struct lp_fs_opt_job *opt_job;
+
+   struct lp_variant_usage usage;
+   int64_t opt_compile_time;  /**< background compile, in microseconds */
+   unsigned swaps;            /**< times jit_function got replaced */
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
 
@@ -241,6 +275,10 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
 void
 lp_debug_fs_variant(struct lp_fragment_shader_variant *variant);
 
+void
+lp_fs_variant_hiz(struct lp_fragment_shader_variant *variant,
+                  const struct shader_info *info);
+
 const char *
 lp_debug_fs_kind(enum lp_fs_kind kind);
 
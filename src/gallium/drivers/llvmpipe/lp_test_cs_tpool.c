@@ -0,0 +1,152 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Compute thread pool dispatch test and microbenchmark.
+ *
+ * Dispatches grids of empty work items of varying size through
+ * lp_cs_tpool, checks that every iteration runs exactly once and reports
+ * the dispatch cost per grid.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_test.h"
+
+
+struct cs_tpool_test_data {
+   unsigned *hits;
+};
+
+
+static void
+cs_tpool_test_empty(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct cs_tpool_test_data *test = data;
+
+   p_atomic_inc(&test->hits[iter_idx]);
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "threads\t"
+           "grid\t"
+           "dispatches\t"
+           "ns_per_dispatch\t"
+           "ns_per_item\n");
+
+   fflush(fp);
+}
+
+
+static bool
+test_cs_tpool(unsigned verbose, FILE *fp,
+              unsigned num_threads, unsigned grid, unsigned dispatches)
+{
+   struct lp_cs_tpool *pool = lp_cs_tpool_create(num_threads);
+   struct cs_tpool_test_data test;
+   bool success = true;
+
+   if (!pool)
+      return false;
+
+   test.hits = CALLOC(grid, sizeof(*test.hits));
+   if (!test.hits) {
+      lp_cs_tpool_destroy(pool);
+      return false;
+   }
+
+   int64_t start = os_time_get_nano();
+   for (unsigned d = 0; d < dispatches; d++) {
+      struct lp_cs_tpool_task *task;
+
+      task = lp_cs_tpool_queue_task(pool, cs_tpool_test_empty, &test, grid);
+      lp_cs_tpool_wait_for_task(pool, &task);
+   }
+   int64_t elapsed = os_time_get_nano() - start;
+
+   for (unsigned i = 0; i < grid; i++) {
+      if (test.hits[i] != dispatches) {
+         success = false;
+         break;
+      }
+   }
+
+   double ns_per_dispatch = (double)elapsed / dispatches;
+   double ns_per_item = ns_per_dispatch / grid;
+
+   if (verbose || !success) {
+      printf("%s: threads %2u grid %8u: %12.0f ns/dispatch %8.2f ns/item\n",
+             success ? "PASS" : "FAIL", num_threads, grid,
+             ns_per_dispatch, ns_per_item);
+      fflush(stdout);
+   }
+
+   if (fp) {
+      fprintf(fp, "%s\t%u\t%u\t%u\t%.0f\t%.2f\n",
+              success ? "pass" : "fail", num_threads, grid, dispatches,
+              ns_per_dispatch, ns_per_item);
+      fflush(fp);
+   }
+
+   FREE(test.hits);
+   lp_cs_tpool_destroy(pool);
+   return success;
+}
+
+
+static bool
+test_cs_tpool_grids(unsigned verbose, FILE *fp, unsigned max_grid)
+{
+   const unsigned nr_cpus = MIN2(util_get_cpu_caps()->nr_cpus, LP_MAX_THREADS);
+   bool success = true;
+
+   for (unsigned num_threads = 0; num_threads <= nr_cpus;
+        num_threads = num_threads ? num_threads * 2 : 1) {
+      for (unsigned grid = 1; grid <= max_grid; grid *= 8) {
+         /* Keep the total amount of work per run roughly constant. */
+         unsigned dispatches = MAX2(max_grid / grid, 4);
+
+         if (!test_cs_tpool(verbose, fp, num_threads, grid, dispatches))
+            success = false;
+      }
+   }
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_cs_tpool_grids(verbose, fp, 8 * 1024 * 1024);
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_cs_tpool_grids(verbose, fp, 64 * 1024);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_cs_tpool(verbose, fp, util_get_cpu_caps()->nr_cpus, 4096, 16);
+}
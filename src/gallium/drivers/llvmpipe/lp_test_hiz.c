@@ -0,0 +1,528 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Hierarchical Z test.
+ *
+ * Checks how fragment shader variants are classified for the rasterizer's
+ * hierarchical Z, and how the per-block max depths of a tile are set by
+ * clears, lowered, raised and invalidated by the primitives drawn with them.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "compiler/shader_info.h"
+#include "util/u_memory.h"
+#include "util/u_pack_color.h"
+
+#include "lp_rast_priv.h"
+#include "lp_scene.h"
+#include "lp_state_fs.h"
+#include "lp_test.h"
+
+
+#define ALL_BLOCKS 0xffff
+
+
+struct hiz_test {
+   struct lp_scene *scene;
+   struct pipe_surface zsbuf;
+   struct lp_rast_state state;
+   struct lp_rasterizer_task task;
+};
+
+
+struct hiz_variant_desc {
+   const char *name;
+   unsigned func;
+   bool no_depth;
+   bool writemask;
+   bool writes_z;
+   bool depth_clamp;
+   bool stencil_enabled;
+   unsigned stencil_zfail_op;
+   bool uses_discard;
+   bool writes_memory;
+   bool early_fragment_tests;
+   /* Expected classification */
+   bool cull, lower, raise, invalidate;
+};
+
+
+static const struct hiz_variant_desc variants[] = {
+   /* Without depth testing the hierarchical Z is left alone. */
+   { "no depth", PIPE_FUNC_GREATER, .no_depth = true },
+
+   /* Only LESS/LEQUAL with depth writes lower the max. */
+   { "less",   PIPE_FUNC_LESS,   .writemask = true, .cull = true, .lower = true },
+   { "lequal", PIPE_FUNC_LEQUAL, .writemask = true, .cull = true, .lower = true },
+   { "equal",  PIPE_FUNC_EQUAL,  .writemask = true, .cull = true },
+   { "less no write", PIPE_FUNC_LESS, .cull = true },
+   { "never",  PIPE_FUNC_NEVER,  .writemask = true },
+
+   /* Depth writes with other functions can raise the max. */
+   { "greater",  PIPE_FUNC_GREATER,  .writemask = true, .raise = true },
+   { "gequal",   PIPE_FUNC_GEQUAL,   .writemask = true, .raise = true },
+   { "notequal", PIPE_FUNC_NOTEQUAL, .writemask = true, .raise = true },
+   { "always",   PIPE_FUNC_ALWAYS,   .writemask = true, .raise = true },
+   { "greater no write", PIPE_FUNC_GREATER },
+
+   /* Shader written or clamped depths may be anything. */
+   { "greater writes z", PIPE_FUNC_GREATER, .writemask = true,
+     .writes_z = true, .invalidate = true },
+   { "greater depth clamp", PIPE_FUNC_GREATER, .writemask = true,
+     .depth_clamp = true, .invalidate = true },
+   { "less writes z", PIPE_FUNC_LESS, .writemask = true, .writes_z = true },
+   { "less depth clamp", PIPE_FUNC_LESS, .writemask = true,
+     .depth_clamp = true },
+
+   /* Occluded fragments which update the stencil buffer can't be skipped,
+    * and stencil testing keeps covered pixels from being known written.
+    */
+   { "less stencil keep", PIPE_FUNC_LESS, .writemask = true,
+     .stencil_enabled = true, .stencil_zfail_op = PIPE_STENCIL_OP_KEEP,
+     .cull = true },
+   { "less stencil zfail", PIPE_FUNC_LESS, .writemask = true,
+     .stencil_enabled = true, .stencil_zfail_op = PIPE_STENCIL_OP_INCR },
+
+   { "less discard", PIPE_FUNC_LESS, .writemask = true,
+     .uses_discard = true, .cull = true },
+   { "less writes memory", PIPE_FUNC_LESS, .writemask = true,
+     .writes_memory = true, .lower = true },
+   { "less writes memory early z", PIPE_FUNC_LESS, .writemask = true,
+     .writes_memory = true, .early_fragment_tests = true,
+     .cull = true, .lower = true },
+};
+
+
+static struct lp_fragment_shader_variant *
+create_variant(const struct hiz_variant_desc *desc)
+{
+   struct lp_fragment_shader_variant *variant =
+      CALLOC_STRUCT(lp_fragment_shader_variant);
+   struct lp_fragment_shader_variant_key *key = &variant->key;
+   struct shader_info info;
+
+   memset(&info, 0, sizeof(info));
+   info.stage = MESA_SHADER_FRAGMENT;
+   if (desc->writes_z)
+      info.outputs_written |= BITFIELD64_BIT(FRAG_RESULT_DEPTH);
+   info.writes_memory = desc->writes_memory;
+   info.fs.early_fragment_tests = desc->early_fragment_tests;
+   info.fs.uses_discard = desc->uses_discard;
+
+   key->depth.enabled = !desc->no_depth;
+   key->depth.func = desc->func;
+   key->depth.writemask = desc->writemask;
+   key->depth_clamp = desc->depth_clamp;
+
+   for (unsigned i = 0; i < 2; i++) {
+      key->stencil[i].enabled = desc->stencil_enabled;
+      key->stencil[i].func = PIPE_FUNC_ALWAYS;
+      key->stencil[i].fail_op = PIPE_STENCIL_OP_KEEP;
+      key->stencil[i].zpass_op = PIPE_STENCIL_OP_REPLACE;
+      key->stencil[i].zfail_op = desc->stencil_zfail_op;
+      key->stencil[i].valuemask = 0xff;
+      key->stencil[i].writemask = 0xff;
+   }
+
+   lp_fs_variant_hiz(variant, &info);
+
+   return variant;
+}
+
+
+static const struct hiz_variant_desc *
+find_variant_desc(const char *name)
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(variants); i++) {
+      if (!strcmp(variants[i].name, name))
+         return &variants[i];
+   }
+
+   assert(0);
+   return NULL;
+}
+
+
+static bool
+report(unsigned verbose, FILE *fp, const char *test, bool success)
+{
+   if (verbose || !success) {
+      printf("%s: %s\n", success ? "PASS" : "FAIL", test);
+      fflush(stdout);
+   }
+
+   if (fp) {
+      fprintf(fp, "%s\t%s\n", success ? "pass" : "fail", test);
+      fflush(fp);
+   }
+
+   return success;
+}
+
+
+static bool
+test_classify(unsigned verbose, FILE *fp)
+{
+   bool success = true;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(variants); i++) {
+      const struct hiz_variant_desc *desc = &variants[i];
+      struct lp_fragment_shader_variant *variant = create_variant(desc);
+      char name[128];
+
+      snprintf(name, sizeof(name), "classify %s", desc->name);
+      if (!report(verbose, fp, name,
+                  variant->hiz_cull == desc->cull &&
+                  variant->hiz_lower == desc->lower &&
+                  variant->hiz_raise == desc->raise &&
+                  variant->hiz_invalidate == desc->invalidate))
+         success = false;
+
+      FREE(variant);
+   }
+
+   return success;
+}
+
+
+static void
+begin_tile(struct hiz_test *t, enum pipe_format format)
+{
+   memset(&t->task, 0, sizeof(t->task));
+   t->zsbuf.format = format;
+   t->scene->fb.zsbuf = &t->zsbuf;
+   t->scene->zsbuf.nr_samples = 1;
+   t->scene->fb_max_layer = 0;
+   t->task.scene = t->scene;
+   t->task.state = &t->state;
+
+   lp_rast_hiz_begin_tile(&t->task);
+}
+
+
+static void
+clear(struct hiz_test *t, double z, bool depth, bool stencil)
+{
+   const enum pipe_format format = t->zsbuf.format;
+   uint64_t value = util_pack64_z_stencil(format, z, 0);
+   uint64_t mask = 0;
+
+   if (depth)
+      mask |= util_pack64_mask_z(format, ~0);
+   if (stencil)
+      mask |= util_pack64_mask_z_stencil(format, 0, 0xff);
+
+   lp_rast_hiz_clear(&t->task, value, mask);
+}
+
+
+/**
+ * Draw a constant depth primitive over the blocks, return the culled ones.
+ */
+static unsigned
+draw(struct hiz_test *t, struct lp_fragment_shader_variant *variant,
+     float z, unsigned partial, unsigned full)
+{
+   alignas(16) uint8_t data[sizeof(struct lp_rast_shader_inputs) +
+                            3 * 4 * sizeof(float)];
+   struct lp_rast_shader_inputs *inputs = (struct lp_rast_shader_inputs *)data;
+
+   memset(data, 0, sizeof(data));
+   inputs->stride = 4 * sizeof(float);
+   inputs->zmin = z;
+   inputs->zmax = z;
+   GET_A0(inputs)[0][2] = z;
+
+   t->state.variant = variant;
+   return lp_rast_hiz_cull_blocks(&t->task, inputs, partial, full);
+}
+
+
+static bool
+test_begin_tile(unsigned verbose, FILE *fp, struct hiz_test *t)
+{
+   bool success = true;
+
+   begin_tile(t, PIPE_FORMAT_Z32_FLOAT);
+   if (!report(verbose, fp, "begin tile z32 float", t->task.hiz.enabled))
+      success = false;
+
+   begin_tile(t, PIPE_FORMAT_S8_UINT);
+   if (!report(verbose, fp, "begin tile stencil only", !t->task.hiz.enabled))
+      success = false;
+
+   begin_tile(t, PIPE_FORMAT_Z32_FLOAT);
+   t->scene->zsbuf.nr_samples = 4;
+   lp_rast_hiz_begin_tile(&t->task);
+   if (!report(verbose, fp, "begin tile multisampled", !t->task.hiz.enabled))
+      success = false;
+
+   begin_tile(t, PIPE_FORMAT_Z32_FLOAT);
+   t->scene->fb_max_layer = 1;
+   lp_rast_hiz_begin_tile(&t->task);
+   if (!report(verbose, fp, "begin tile layered", !t->task.hiz.enabled))
+      success = false;
+
+   return success;
+}
+
+
+static bool
+test_lower(unsigned verbose, FILE *fp, struct hiz_test *t, const char *func)
+{
+   struct lp_fragment_shader_variant *writes =
+      create_variant(find_variant_desc(func));
+   struct lp_fragment_shader_variant *cull =
+      create_variant(find_variant_desc("less no write"));
+   char name[128];
+   bool success = true;
+
+   /* Nothing is known at the beginning of a tile. */
+   begin_tile(t, PIPE_FORMAT_Z32_FLOAT);
+   snprintf(name, sizeof(name), "%s unknown max", func);
+   if (!report(verbose, fp, name, draw(t, cull, 1.0f, ALL_BLOCKS, 0) == 0))
+      success = false;
+
+   /* Only fully covered blocks lower the max. */
+   draw(t, writes, 0.5f, ALL_BLOCKS, 0);
+   snprintf(name, sizeof(name), "%s partial doesn't lower", func);
+   if (!report(verbose, fp, name, draw(t, cull, 0.75f, ALL_BLOCKS, 0) == 0))
+      success = false;
+
+   draw(t, writes, 0.5f, 0, ALL_BLOCKS);
+   snprintf(name, sizeof(name), "%s full lowers", func);
+   if (!report(verbose, fp, name,
+               draw(t, cull, 0.75f, ALL_BLOCKS, 0) == ALL_BLOCKS))
+      success = false;
+
+   /* Lowering the first row doesn't touch the others, and primitives in
+    * front of the max aren't culled.
+    */
+   draw(t, writes, 0.25f, 0, 0x000f);
+   snprintf(name, sizeof(name), "%s lowers covered blocks", func);
+   if (!report(verbose, fp, name,
+               draw(t, cull, 0.375f, 0x00ff, 0xff00) == 0x000f))
+      success = false;
+
+   /* A primitive behind the max doesn't raise it. */
+   draw(t, writes, 0.875f, 0, ALL_BLOCKS);
+   snprintf(name, sizeof(name), "%s doesn't raise", func);
+   if (!report(verbose, fp, name,
+               draw(t, cull, 0.625f, ALL_BLOCKS, 0) == ALL_BLOCKS))
+      success = false;
+
+   FREE(writes);
+   FREE(cull);
+   return success;
+}
+
+
+static bool
+test_clear(unsigned verbose, FILE *fp, struct hiz_test *t)
+{
+   struct lp_fragment_shader_variant *cull =
+      create_variant(find_variant_desc("less no write"));
+   const float margin = 1.0f / 0xffffff;
+   bool success = true;
+
+   begin_tile(t, PIPE_FORMAT_Z32_FLOAT);
+   clear(t, 0.25, true, false);
+   if (!report(verbose, fp, "clear sets max",
+               draw(t, cull, 0.5f, ALL_BLOCKS, 0) == ALL_BLOCKS &&
+               draw(t, cull, 0.125f, ALL_BLOCKS, 0) == 0))
+      success = false;
+
+   /* 24-bit depths are only known to the depth buffer precision. */
+   begin_tile(t, PIPE_FORMAT_Z24_UNORM_S8_UINT);
+   clear(t, 0.25, true, true);
+   if (!report(verbose, fp, "clear z24 margin",
+               draw(t, cull, 0.25f + margin * 0.5f, ALL_BLOCKS, 0) == 0 &&
+               draw(t, cull, 0.25f + margin * 64.0f, ALL_BLOCKS, 0) == ALL_BLOCKS))
+      success = false;
+
+   clear(t, 1.0, false, true);
+   if (!report(verbose, fp, "stencil clear keeps max",
+               draw(t, cull, 0.5f, ALL_BLOCKS, 0) == ALL_BLOCKS))
+      success = false;
+
+   /* Clearing some of the depth bits leaves unknown depths. */
+   lp_rast_hiz_clear(&t->task, util_pack64_z(t->zsbuf.format, 0.0),
+                     util_pack64_mask_z(t->zsbuf.format, 0xff0000));
+   if (!report(verbose, fp, "masked clear invalidates",
+               draw(t, cull, 1.0f, ALL_BLOCKS, 0) == 0))
+      success = false;
+
+   FREE(cull);
+   return success;
+}
+
+
+static bool
+test_raise(unsigned verbose, FILE *fp, struct hiz_test *t, const char *func)
+{
+   struct lp_fragment_shader_variant *raise =
+      create_variant(find_variant_desc(func));
+   struct lp_fragment_shader_variant *cull =
+      create_variant(find_variant_desc("less no write"));
+   char name[128];
+   bool success = true;
+
+   begin_tile(t, PIPE_FORMAT_Z32_FLOAT);
+   clear(t, 0.25, true, false);
+
+   /* Changing the depth function, even partially covered blocks and
+    * primitives behind the max raise it.
+    */
+   snprintf(name, sizeof(name), "%s doesn't cull", func);
+   if (!report(verbose, fp, name, draw(t, raise, 0.75f, 0x0001, 0) == 0))
+      success = false;
+
+   snprintf(name, sizeof(name), "%s raises", func);
+   if (!report(verbose, fp, name,
+               draw(t, cull, 0.5f, ALL_BLOCKS, 0) == (ALL_BLOCKS & ~0x0001)))
+      success = false;
+
+   /* A primitive in front of the max leaves it. */
+   draw(t, raise, 0.125f, 0, 0x0002);
+   snprintf(name, sizeof(name), "%s doesn't lower", func);
+   if (!report(verbose, fp, name,
+               draw(t, cull, 0.5f, ALL_BLOCKS, 0) == (ALL_BLOCKS & ~0x0001)))
+      success = false;
+
+   /* Depths of a plane that can't be evaluated may be anything. */
+   draw(t, raise, NAN, 0x0004, 0);
+   snprintf(name, sizeof(name), "%s nan plane", func);
+   if (!report(verbose, fp, name,
+               draw(t, cull, 0.5f, ALL_BLOCKS, 0) == (ALL_BLOCKS & ~0x0005)))
+      success = false;
+
+   FREE(raise);
+   FREE(cull);
+   return success;
+}
+
+
+static bool
+test_invalidate(unsigned verbose, FILE *fp, struct hiz_test *t,
+                const char *func)
+{
+   struct lp_fragment_shader_variant *invalidate =
+      create_variant(find_variant_desc(func));
+   struct lp_fragment_shader_variant *cull =
+      create_variant(find_variant_desc("less no write"));
+   char name[128];
+   bool success = true;
+
+   begin_tile(t, PIPE_FORMAT_Z32_FLOAT);
+   clear(t, 0.25, true, false);
+
+   /* Even a primitive in front of the max. */
+   snprintf(name, sizeof(name), "%s doesn't cull", func);
+   if (!report(verbose, fp, name,
+               draw(t, invalidate, 0.125f, 0x0020, 0x0400) == 0))
+      success = false;
+
+   snprintf(name, sizeof(name), "%s invalidates", func);
+   if (!report(verbose, fp, name,
+               draw(t, cull, 0.5f, ALL_BLOCKS, 0) == (ALL_BLOCKS & ~0x0420)))
+      success = false;
+
+   FREE(invalidate);
+   FREE(cull);
+   return success;
+}
+
+
+/**
+ * Fully covered primitives in front of the max which can't lower it.
+ */
+static bool
+test_no_lower(unsigned verbose, FILE *fp, struct hiz_test *t,
+              const char *func)
+{
+   struct lp_fragment_shader_variant *variant =
+      create_variant(find_variant_desc(func));
+   struct lp_fragment_shader_variant *cull =
+      create_variant(find_variant_desc("less no write"));
+   char name[128];
+
+   begin_tile(t, PIPE_FORMAT_Z32_FLOAT);
+   clear(t, 0.5, true, false);
+
+   draw(t, variant, 0.25f, 0, ALL_BLOCKS);
+
+   snprintf(name, sizeof(name), "%s doesn't lower", func);
+   bool success = report(verbose, fp, name,
+                         draw(t, cull, 0.375f, ALL_BLOCKS, 0) == 0);
+
+   FREE(variant);
+   FREE(cull);
+   return success;
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "test\n");
+
+   fflush(fp);
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   static const char *no_lower[] = {
+      "equal", "less no write", "less stencil keep", "less stencil zfail",
+      "less discard", "less writes z", "less depth clamp",
+   };
+   struct hiz_test t;
+   bool success = true;
+
+   memset(&t, 0, sizeof(t));
+   t.scene = CALLOC_STRUCT(lp_scene);
+   if (!t.scene)
+      return false;
+
+   success &= test_classify(verbose, fp);
+   success &= test_begin_tile(verbose, fp, &t);
+   success &= test_lower(verbose, fp, &t, "less");
+   success &= test_lower(verbose, fp, &t, "lequal");
+   success &= test_clear(verbose, fp, &t);
+   success &= test_raise(verbose, fp, &t, "greater");
+   success &= test_raise(verbose, fp, &t, "always");
+   success &= test_invalidate(verbose, fp, &t, "greater writes z");
+   success &= test_invalidate(verbose, fp, &t, "greater depth clamp");
+   for (unsigned i = 0; i < ARRAY_SIZE(no_lower); i++)
+      success &= test_no_lower(verbose, fp, &t, no_lower[i]);
+
+   FREE(t.scene);
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return true;
+}
@@ -55,6 +55,7 @@
 #include "lp_setup.h"
 #include "lp_state.h"
 #include "lp_rast.h"
+#include "gallivm/lp_bld_sample.h"
 
 #include "frontend/sw_winsys.h"
 #include "git_sha1.h"
@@ -302,6 +303,10 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
    lpr->screen = screen;
    pipe_reference_init(&lpr->base.reference, 1);
    lpr->base.screen = &screen->base;
+   /* Only set by llvmpipe_resource_create(), not inherited from templates
+    * copied from other resources.
+    */
+   lpr->base.flags &= ~LP_RESOURCE_FLAG_MICROTILED;
 
 #if defined(HAVE_LIBDRM) && defined(HAVE_LINUX_UDMABUF_H)
    lpr->dmabuf_alloc = NULL;
@@ -403,11 +408,64 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
 }
 
 
+/**
+ * Whether a texture may use the micro-tiled layout. That is limited to
+ * textures which are only ever accessed by the CPU through transfers, by
+ * the samplers and as color buffers.
+ */
+static bool
+llvmpipe_can_microtile(const struct pipe_resource *templat)
+{
+   switch (templat->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      break;
+   default:
+      return false;
+   }
+
+   if (templat->nr_samples > 1 ||
+       templat->usage == PIPE_USAGE_STAGING ||
+       !(templat->bind & PIPE_BIND_SAMPLER_VIEW) ||
+       (templat->bind & (PIPE_BIND_DISPLAY_TARGET |
+                         PIPE_BIND_SCANOUT |
+                         PIPE_BIND_SHARED |
+                         PIPE_BIND_LINEAR |
+                         PIPE_BIND_SHADER_IMAGE |
+                         PIPE_BIND_DEPTH_STENCIL)) ||
+       (templat->flags & (PIPE_RESOURCE_FLAG_SPARSE |
+                          PIPE_RESOURCE_FLAG_MAP_PERSISTENT |
+                          PIPE_RESOURCE_FLAG_MAP_COHERENT)))
+      return false;
+
+   const struct util_format_description *desc =
+      util_format_description(templat->format);
+   return desc->block.width == 1 && desc->block.height == 1 &&
+          desc->colorspace != UTIL_FORMAT_COLORSPACE_ZS &&
+          util_format_get_num_planes(templat->format) == 1;
+}
+
+
 static struct pipe_resource *
 llvmpipe_resource_create(struct pipe_screen *_screen,
                          const struct pipe_resource *templat)
 {
-   return llvmpipe_resource_create_front(_screen, templat, NULL);
+   struct pipe_resource *pt =
+      llvmpipe_resource_create_front(_screen, templat, NULL);
+
+   /* The micro-tiled layout has the same size and strides as the linear
+    * one, only the texel order within the rows of 4x4 blocks differs.
+    */
+   if (pt && llvmpipe_screen(_screen)->microtile &&
+       llvmpipe_can_microtile(templat)) {
+      pt->flags |= LP_RESOURCE_FLAG_MICROTILED;
+      llvmpipe_resource(pt)->microtiled = true;
+   }
+
+   return pt;
 }
 
 #if defined(HAVE_LIBDRM) && defined(HAVE_LINUX_UDMABUF_H)
@@ -899,6 +957,43 @@ fail:
 }
 
 
+/**
+ * Copy a box of a micro-tiled texture level from or to a linear buffer of
+ * the box's size. Texels are stored in 4x4 blocks, each a contiguous run
+ * of 16 texels, so every row of the box is copied in runs of up to four
+ * texels.
+ */
+static void
+llvmpipe_microtile_copy(struct llvmpipe_resource *lpr, unsigned level,
+                        const struct pipe_box *box, uint8_t *linear,
+                        bool to_tiled)
+{
+   const unsigned bpp = util_format_get_blocksize(lpr->base.format);
+   const unsigned row_stride = lpr->row_stride[level];
+
+   for (int z = box->z; z < box->z + box->depth; z++) {
+      uint8_t *image = llvmpipe_get_texture_image_address(lpr, z, level);
+
+      for (int y = box->y; y < box->y + box->height; y++) {
+         uint8_t *row = image + (y & ~3) * row_stride + (y & 3) * 4 * bpp;
+
+         for (int x = box->x; x < box->x + box->width;) {
+            const unsigned n = MIN2(4 - (x & 3), box->x + box->width - x);
+            uint8_t *texels = row + ((x & ~3) * 4 + (x & 3)) * bpp;
+
+            if (to_tiled)
+               memcpy(texels, linear, n * bpp);
+            else
+               memcpy(linear, texels, n * bpp);
+
+            linear += n * bpp;
+            x += n;
+         }
+      }
+   }
+}
+
+
 void *
 llvmpipe_transfer_map_ms(struct pipe_context *pipe,
                          struct pipe_resource *resource,
@@ -919,6 +1014,10 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
    assert(resource);
    assert(level <= resource->last_level);
 
+   /* Microtiled resources are only mapped through a linear copy. */
+   if ((usage & PIPE_MAP_DIRECTLY) && llvmpipe_resource_is_microtiled(resource))
+      return NULL;
+
    /*
     * Transfers, like other pipe operations, must happen in order, so flush
     * the context if necessary.
@@ -1045,6 +1144,30 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
       screen->timestamp++;
    }
 
+   if (llvmpipe_resource_is_microtiled(resource)) {
+      /* Map a linear copy of the box, written back on unmap. */
+      pt->stride = box->width * util_format_get_blocksize(format);
+      pt->layer_stride = pt->stride * box->height;
+
+      lpt->map = malloc(pt->layer_stride * box->depth);
+      if (!lpt->map) {
+         llvmpipe_resource_unmap(resource, level, box->z);
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
+      /* The whole box is written back, so it needs the current texels
+       * unless the caller discards them.
+       */
+      if (!(usage & (PIPE_MAP_DISCARD_RANGE |
+                     PIPE_MAP_DISCARD_WHOLE_RESOURCE)))
+         llvmpipe_microtile_copy(lpr, level, box, lpt->map, false);
+
+      return lpt->map;
+   }
+
    map +=
       box->y / util_format_get_blockheight(format) * pt->stride +
       box->x / util_format_get_blockwidth(format) * util_format_get_blocksize(format);
@@ -1152,6 +1275,12 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
       }
    }
 
+   if (llvmpipe_resource_is_microtiled(resource) &&
+       (transfer->usage & PIPE_MAP_WRITE)) {
+      llvmpipe_microtile_copy(lpr, transfer->level, &transfer->box,
+                              lpt->map, true);
+   }
+
    llvmpipe_resource_unmap(resource,
                            transfer->level,
                            transfer->box.z);
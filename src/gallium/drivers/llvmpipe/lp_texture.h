@@ -116,6 +116,7 @@ struct llvmpipe_resource
    bool backable;
    struct pipe_memory_object *imported_memory;
    bool dmabuf;
+   bool microtiled;  /**< LP_RESOURCE_FLAG_MICROTILED layout */
 #if MESA_DEBUG
    struct list_head list;
 #endif
@@ -226,6 +227,13 @@ llvmpipe_resource_is_1d(const struct pipe_resource *resource)
 }
 
 
+static inline bool
+llvmpipe_resource_is_microtiled(const struct pipe_resource *resource)
+{
+   return llvmpipe_resource_const(resource)->microtiled;
+}
+
+
 static inline unsigned
 llvmpipe_layer_stride(struct pipe_resource *resource,
                       unsigned level)
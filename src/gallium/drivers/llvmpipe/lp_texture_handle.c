@@ -22,6 +22,7 @@
  */
 
 #include "lp_context.h"
+#include "lp_perf.h"
 #include "lp_texture_handle.h"
 #include "lp_screen.h"
 
@@ -34,7 +35,9 @@
 
 #include "pipe/p_context.h"
 #include "pipe/p_screen.h"
+#include "util/hash_table.h"
 #include "util/mesa-sha1.h"
+#include "util/u_memory.h"
 
 static const char *image_function_base_hash = "8ca89d7a4ab5830be6a1ba1140844081235b01164a8fce8316ca6a2f81f1a899";
 static const char *sample_function_base_hash = "0789b032c4a1ddba086e07496fe2a992b1ee08f78c0884a2923564b1ed52b9cc";
@@ -176,6 +179,16 @@ replace_sample_function_cache_locked(struct lp_sampler_matrix *matrix, struct ha
    util_dynarray_append(&matrix->trash_caches, struct hash_table *, old_cache);
 }
 
+/**
+ * A compiled sample, size or image function, shared by the sampler matrices
+ * of all contexts of a screen, keyed by its disk cache key. Each matrix
+ * holds a reference to the functions it uses until it is destroyed.
+ */
+struct lp_sample_code {
+   struct lp_code_cache_entry base;
+   void *function;
+};
+
 void
 llvmpipe_init_sampler_matrix(struct llvmpipe_context *ctx)
 {
@@ -187,6 +200,7 @@ llvmpipe_init_sampler_matrix(struct llvmpipe_context *ctx)
    struct lp_sampler_matrix *matrix = &ctx->sampler_matrix;
 
    util_dynarray_init(&matrix->gallivms, NULL);
+   util_dynarray_init(&matrix->codes, NULL);
 
    matrix->ctx = ctx;
 
@@ -235,10 +249,64 @@ llvmpipe_sampler_matrix_destroy(struct llvmpipe_context *ctx)
 
    util_dynarray_fini(&matrix->gallivms);
 
+   struct llvmpipe_screen *screen = llvmpipe_screen(ctx->pipe.screen);
+   util_dynarray_foreach (&matrix->codes, struct lp_sample_code *, code)
+      lp_code_cache_unref(&screen->sample_code_cache, &(*code)->base);
+
+   util_dynarray_fini(&matrix->codes);
+
    if (matrix->context.ref)
       lp_context_destroy(&matrix->context);
 }
 
+static void *
+lp_sample_code_lookup(struct llvmpipe_context *ctx, const uint8_t cache_key[SHA1_DIGEST_LENGTH])
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(ctx->pipe.screen);
+
+   struct lp_sample_code *code = (struct lp_sample_code *)
+      lp_code_cache_lookup(&screen->sample_code_cache, cache_key);
+   if (!code)
+      return NULL;
+
+   util_dynarray_append(&ctx->sampler_matrix.codes, struct lp_sample_code *, code);
+   LP_COUNT(nr_sample_shared_code_hits);
+
+   return code->function;
+}
+
+/**
+ * Hand the compiled code of a function over to the screen. Returns the
+ * function to use, which is another context's if it was quicker.
+ */
+static void *
+lp_sample_code_insert(struct llvmpipe_context *ctx, struct gallivm_state *gallivm,
+                      void *function, const uint8_t cache_key[SHA1_DIGEST_LENGTH])
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(ctx->pipe.screen);
+
+   struct lp_sample_code *code = CALLOC_STRUCT(lp_sample_code);
+   if (!code) {
+      util_dynarray_append(&ctx->sampler_matrix.gallivms, struct gallivm_state *, gallivm);
+      return function;
+   }
+
+   memcpy(code->base.key, cache_key, sizeof(code->base.key));
+   code->base.gallivm = gallivm;
+   code->function = function;
+
+   struct lp_sample_code *shared = (struct lp_sample_code *)
+      lp_code_cache_insert(&screen->sample_code_cache, &code->base);
+   if (shared != code) {
+      gallivm_destroy(gallivm);
+      FREE(code);
+   }
+
+   util_dynarray_append(&ctx->sampler_matrix.codes, struct lp_sample_code *, shared);
+
+   return shared->function;
+}
+
 static lp_context_ref *
 get_llvm_context(struct llvmpipe_context *ctx)
 {
@@ -266,9 +334,7 @@ compile_function(struct llvmpipe_context *ctx, struct gallivm_state *gallivm, LL
 
    gallivm_free_ir(gallivm);
 
-   util_dynarray_append(&ctx->sampler_matrix.gallivms, struct gallivm_state *, gallivm);
-
-   return function_ptr;
+   return lp_sample_code_insert(ctx, gallivm, function_ptr, cache_key);
 }
 
 static void *
@@ -306,6 +372,10 @@ compile_image_function(struct llvmpipe_context *ctx, struct lp_static_texture_st
    _mesa_sha1_update(&hash_ctx, &ms, sizeof(ms));
    _mesa_sha1_final(&hash_ctx, cache_key);
 
+   void *shared = lp_sample_code_lookup(ctx, cache_key);
+   if (shared)
+      return shared;
+
    struct lp_cached_code cached = { 0 };
    lp_disk_cache_find_shader(llvmpipe_screen(ctx->pipe.screen), &cached, cache_key);
    bool needs_caching = !cached.data_size;
@@ -464,6 +534,10 @@ compile_sample_function(struct llvmpipe_context *ctx, struct lp_static_texture_s
    _mesa_sha1_update(&hash_ctx, &sample_key, sizeof(sample_key));
    _mesa_sha1_final(&hash_ctx, cache_key);
 
+   void *shared = lp_sample_code_lookup(ctx, cache_key);
+   if (shared)
+      return shared;
+
    struct lp_cached_code cached = { 0 };
    lp_disk_cache_find_shader(llvmpipe_screen(ctx->pipe.screen), &cached, cache_key);
    bool needs_caching = !cached.data_size;
@@ -564,8 +638,10 @@ get_sample_function(uint64_t _matrix, uint64_t _texture_functions, uint64_t _sam
 
    void *result;
    {
+      p_atomic_inc(&matrix->cache_readers);
       struct hash_entry *entry = _mesa_hash_table_search(acquire_latest_sample_function_cache(matrix), &key);
       result = entry ? entry->data : NULL;
+      p_atomic_dec(&matrix->cache_readers);
    }
 
    if (!result) {
@@ -614,6 +690,10 @@ compile_jit_sample_function(struct llvmpipe_context *ctx, uint32_t sample_key)
    _mesa_sha1_update(&hash_ctx, &sample_key, sizeof(sample_key));
    _mesa_sha1_final(&hash_ctx, cache_key);
 
+   void *shared = lp_sample_code_lookup(ctx, cache_key);
+   if (shared)
+      return shared;
+
    struct lp_cached_code cached = { 0 };
    lp_disk_cache_find_shader(llvmpipe_screen(ctx->pipe.screen), &cached, cache_key);
    bool needs_caching = !cached.data_size;
@@ -721,6 +801,10 @@ compile_size_function(struct llvmpipe_context *ctx, struct lp_static_texture_sta
    _mesa_sha1_update(&hash_ctx, &samples, sizeof(samples));
    _mesa_sha1_final(&hash_ctx, cache_key);
 
+   void *shared = lp_sample_code_lookup(ctx, cache_key);
+   if (shared)
+      return shared;
+
    struct lp_cached_code cached = { 0 };
    lp_disk_cache_find_shader(llvmpipe_screen(ctx->pipe.screen), &cached, cache_key);
    bool needs_caching = !cached.data_size;
@@ -1067,14 +1151,31 @@ llvmpipe_clear_sample_functions_cache(struct llvmpipe_context *ctx, struct pipe_
 
    ctx->pipe.screen->fence_finish(ctx->pipe.screen, NULL, *fence, OS_TIMEOUT_INFINITE);
 
-   /* All work is finished, it's safe to move cache entries into the table. */
-   hash_table_foreach_remove(acquire_latest_sample_function_cache(matrix), entry) {
+   simple_mtx_lock(&matrix->lock);
+
+   /* All work of this context is finished, it's safe to move cache entries
+    * into the table. Texture handles can also be used by shaders of other
+    * contexts (lavapipe compute queues), so the cache is swapped for an
+    * empty one instead of being emptied in place, and the old tables are
+    * only freed once no reader is left.
+    */
+   struct hash_table *cache = acquire_latest_sample_function_cache(matrix);
+   hash_table_foreach(cache, entry) {
       struct sample_function_cache_key *key = (void *)entry->key;
       key->texture_functions->sample_functions[key->sampler_index][key->sample_key] = entry->data;
-      free(key);
    }
 
+   replace_sample_function_cache_locked(matrix, sample_function_cache_key_table_create(NULL));
+
+   while (p_atomic_read(&matrix->cache_readers))
+      thrd_yield();
+
+   hash_table_foreach(cache, entry)
+      free((void *)entry->key);
+
    util_dynarray_foreach (&matrix->trash_caches, struct hash_table *, trash)
       _mesa_hash_table_destroy(*trash, NULL);
    util_dynarray_clear(&matrix->trash_caches);
+
+   simple_mtx_unlock(&matrix->lock);
 }
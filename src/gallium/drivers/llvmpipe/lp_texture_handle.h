@@ -47,6 +47,9 @@ struct lp_sampler_matrix {
    void *compile_function;
    p_atomic_uint64_t latest_cache;
    struct util_dynarray trash_caches;
+   /* Lock-free readers of latest_cache; shaders of other contexts can be
+    * running while this context clears the cache. */
+   int32_t cache_readers;
    simple_mtx_t lock;
 
    struct llvmpipe_context *ctx;
@@ -55,6 +58,9 @@ struct lp_sampler_matrix {
    lp_context_ref context;
 
    struct util_dynarray gallivms;
+
+   /* References to the screen's shared functions used by this matrix. */
+   struct util_dynarray codes;
 };
 
 void llvmpipe_init_sampler_matrix(struct llvmpipe_context *ctx);
@@ -0,0 +1,135 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Eviction policy for the per-context shader variant caches.
+ *
+ * Variants are kept within a budget of machine code bytes per context, on
+ * top of the historical variant and instruction count limits. When over
+ * budget, the variants to evict are chosen LRU-K style, by the distance to
+ * their K-th most recent use, so that variants used only once are evicted
+ * before variants in steady use. That distance is weighted by the code size
+ * of the variant and by how long it took to compile, so cheap and large
+ * variants go first and expensive ones stay.
+ */
+
+#ifndef LP_VARIANT_CACHE_H
+#define LP_VARIANT_CACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util/hash_table.h"
+
+/** The K of LRU-K */
+#define LP_VARIANT_HISTORY 2
+
+/** Number of evicted variants remembered to detect recompiles */
+#define LP_EVICTED_VARIANTS 256
+
+
+struct lp_variant_usage
+{
+   uint64_t last_use[LP_VARIANT_HISTORY];  /**< most recent first, 0 = never */
+   uint64_t code_size;     /**< in bytes */
+   int64_t compile_time;   /**< in microseconds */
+};
+
+
+struct lp_variant_victim
+{
+   double priority;
+   void *variant;
+};
+
+
+/**
+ * Keys of recently evicted variants, to count the compiles that eviction
+ * caused.
+ */
+struct lp_evicted_variants
+{
+   uint32_t hash[LP_EVICTED_VARIANTS];
+   unsigned next;
+};
+
+
+static inline void
+lp_variant_usage_touch(struct lp_variant_usage *usage, uint64_t *clock)
+{
+   for (unsigned i = LP_VARIANT_HISTORY - 1; i > 0; i--)
+      usage->last_use[i] = usage->last_use[i - 1];
+   usage->last_use[0] = ++*clock;
+}
+
+
+/**
+ * Eviction priority, the variant with the highest one is evicted first.
+ */
+static inline double
+lp_variant_usage_priority(const struct lp_variant_usage *usage,
+                          uint64_t clock)
+{
+   /* Variants used fewer than K times are farther away than any other. */
+   const uint64_t kth_use = usage->last_use[LP_VARIANT_HISTORY - 1];
+   double distance = kth_use ? (double)(clock - kth_use)
+                             : (double)clock + (clock - usage->last_use[0]);
+
+   return distance * (usage->code_size + 1) / (usage->compile_time + 1);
+}
+
+
+static inline int
+lp_variant_victim_compare(const void *a, const void *b)
+{
+   const struct lp_variant_victim *va = a, *vb = b;
+
+   if (va->priority != vb->priority)
+      return va->priority < vb->priority ? 1 : -1;
+   return 0;
+}
+
+
+/**
+ * Sort victims, highest eviction priority first.
+ */
+static inline void
+lp_variant_victims_sort(struct lp_variant_victim *victims, unsigned count)
+{
+   qsort(victims, count, sizeof(*victims), lp_variant_victim_compare);
+}
+
+
+static inline uint32_t
+lp_evicted_variant_hash(unsigned shader_no, const void *key, size_t key_size)
+{
+   return _mesa_hash_data_with_seed(key, key_size, shader_no);
+}
+
+
+static inline void
+lp_evicted_variants_add(struct lp_evicted_variants *evicted, uint32_t hash)
+{
+   evicted->hash[evicted->next] = hash;
+   evicted->next = (evicted->next + 1) % LP_EVICTED_VARIANTS;
+}
+
+
+/**
+ * Returns whether a variant about to be compiled was evicted recently,
+ * forgetting about it.
+ */
+static inline bool
+lp_evicted_variants_remove(struct lp_evicted_variants *evicted, uint32_t hash)
+{
+   for (unsigned i = 0; i < LP_EVICTED_VARIANTS; i++) {
+      if (hash && evicted->hash[i] == hash) {
+         evicted->hash[i] = 0;
+         return true;
+      }
+   }
+   return false;
+}
+
+#endif /* LP_VARIANT_CACHE_H */
@@ -140,6 +140,90 @@ lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR fl
    return ret;
 }
 
+static void
+lvp_aabb_init_empty(struct lvp_aabb *aabb)
+{
+   aabb->min.x = INFINITY;
+   aabb->min.y = INFINITY;
+   aabb->min.z = INFINITY;
+   aabb->max.x = -INFINITY;
+   aabb->max.y = -INFINITY;
+   aabb->max.z = -INFINITY;
+}
+
+static void
+lvp_node_bounds(const uint8_t *dst, uint32_t node_id, struct lvp_aabb *aabb)
+{
+   uint32_t child_offset = node_id & (~3u);
+   uint32_t child_type = node_id & 3u;
+   const void *child_node = dst + child_offset;
+
+   switch (child_type) {
+   case lvp_bvh_node_triangle: {
+      const struct lvp_bvh_triangle_node *triangle = child_node;
+
+      aabb->min.x = MIN3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
+      aabb->min.y = MIN3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
+      aabb->min.z = MIN3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+
+      aabb->max.x = MAX3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
+      aabb->max.y = MAX3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
+      aabb->max.z = MAX3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+
+      break;
+   }
+   case lvp_bvh_node_internal: {
+      const struct lvp_bvh_box_node *box = child_node;
+
+      /* Inactive children have empty bounds, +INFINITY min and -INFINITY max,
+       * which fminf/fmaxf drop.
+       */
+      aabb->min.x = fminf(box->bounds[0].min.x, box->bounds[1].min.x);
+      aabb->min.y = fminf(box->bounds[0].min.y, box->bounds[1].min.y);
+      aabb->min.z = fminf(box->bounds[0].min.z, box->bounds[1].min.z);
+
+      aabb->max.x = fmaxf(box->bounds[0].max.x, box->bounds[1].max.x);
+      aabb->max.y = fmaxf(box->bounds[0].max.y, box->bounds[1].max.y);
+      aabb->max.z = fmaxf(box->bounds[0].max.z, box->bounds[1].max.z);
+
+      break;
+   }
+   case lvp_bvh_node_instance: {
+      const struct lvp_bvh_instance_node *instance = child_node;
+      const struct lvp_bvh_header *instance_header = (void *)(uintptr_t)instance->bvh_ptr;
+
+      float bounds[2][3];
+
+      float header_bounds[2][3];
+      memcpy(header_bounds, &instance_header->bounds, sizeof(struct lvp_aabb));
+
+      for (unsigned j = 0; j < 3; ++j) {
+         bounds[0][j] = instance->otw_matrix.values[j][3];
+         bounds[1][j] = instance->otw_matrix.values[j][3];
+         for (unsigned k = 0; k < 3; ++k) {
+            bounds[0][j] += MIN2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
+                                 instance->otw_matrix.values[j][k] * header_bounds[1][k]);
+            bounds[1][j] += MAX2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
+                                 instance->otw_matrix.values[j][k] * header_bounds[1][k]);
+         }
+      }
+
+      memcpy(aabb, bounds, sizeof(struct lvp_aabb));
+
+      break;
+   }
+   case lvp_bvh_node_aabb: {
+      const struct lvp_bvh_aabb_node *aabb_node = child_node;
+
+      memcpy(aabb, &aabb_node->bounds, sizeof(struct lvp_aabb));
+
+      break;
+   }
+   default:
+      unreachable("Invalid node type");
+   }
+}
+
 struct lvp_build_internal_ctx {
    uint8_t *dst;
    uint32_t dst_offset;
@@ -179,98 +263,378 @@ lvp_build_internal_node(struct lvp_build_internal_ctx *ctx, uint32_t first_leaf,
    }
 
    for (uint32_t i = 0; i < 2; i++) {
-      struct lvp_aabb *aabb = &node->bounds[i];
-
-      if (node->children[i] == LVP_BVH_INVALID_NODE) {
-         aabb->min.x = INFINITY;
-         aabb->min.y = INFINITY;
-         aabb->min.z = INFINITY;
-         aabb->max.x = -INFINITY;
-         aabb->max.y = -INFINITY;
-         aabb->max.z = -INFINITY;
-         continue;
-      }
+      if (node->children[i] == LVP_BVH_INVALID_NODE)
+         lvp_aabb_init_empty(&node->bounds[i]);
+      else
+         lvp_node_bounds(ctx->dst, node->children[i], &node->bounds[i]);
+   }
+
+   return node_id;
+}
 
-      uint32_t child_offset = node->children[i] & (~3u);
-      uint32_t child_type = node->children[i] & 3u;
-      void *child_node = (void *)(ctx->dst + child_offset);
+/* Binned SAH builder.
+ *
+ * Internal nodes are laid out in depth first order: the left child of a node
+ * directly follows it, and the right child follows the left subtree. With one
+ * primitive per leaf a subtree over n leaves always has n - 1 internal nodes,
+ * so the location of every subtree is known as soon as its parent is split,
+ * and large subtrees are built in parallel on the device's BVH thread pool.
+ * Leaf nodes keep the order of the input primitives.
+ */
 
-      switch (child_type) {
-      case lvp_bvh_node_triangle: {
-         struct lvp_bvh_triangle_node *triangle = child_node;
+#define LVP_BVH_BIN_COUNT 16
 
-         aabb->min.x = MIN3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
-         aabb->min.y = MIN3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
-         aabb->min.z = MIN3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+/* The traversal stack is shared by the top and bottom level BVHs. */
+#define LVP_BVH_MAX_DEPTH 24
 
-         aabb->max.x = MAX3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
-         aabb->max.y = MAX3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
-         aabb->max.z = MAX3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+/* Smallest subtree handed to another thread. */
+#define LVP_BVH_MIN_TASK_LEAVES 1024
 
-         break;
+struct lvp_bvh_builder {
+   uint8_t *dst;
+   uint32_t leaf_nodes_offset;
+   uint32_t leaf_node_type;
+   uint32_t leaf_node_size;
+
+   struct lvp_aabb *leaf_bounds;
+   uint32_t *leaves;
+
+   uint32_t task_leaves;
+};
+
+struct lvp_bvh_task {
+   struct lvp_bvh_builder *builder;
+   uint32_t node_offset;
+   uint32_t begin;
+   uint32_t end;
+   uint32_t depth;
+   struct util_queue_fence fence;
+};
+
+struct lvp_bvh_bin {
+   struct lvp_aabb bounds;
+   uint32_t count;
+};
+
+static inline float
+lvp_vec3_component(const lvp_vec3 *v, unsigned axis)
+{
+   return axis == 0 ? v->x : axis == 1 ? v->y : v->z;
+}
+
+static void
+lvp_aabb_extend(struct lvp_aabb *aabb, const struct lvp_aabb *other)
+{
+   aabb->min.x = fminf(aabb->min.x, other->min.x);
+   aabb->min.y = fminf(aabb->min.y, other->min.y);
+   aabb->min.z = fminf(aabb->min.z, other->min.z);
+   aabb->max.x = fmaxf(aabb->max.x, other->max.x);
+   aabb->max.y = fmaxf(aabb->max.y, other->max.y);
+   aabb->max.z = fmaxf(aabb->max.z, other->max.z);
+}
+
+static float
+lvp_aabb_half_area(const struct lvp_aabb *aabb)
+{
+   float x = aabb->max.x - aabb->min.x;
+   float y = aabb->max.y - aabb->min.y;
+   float z = aabb->max.z - aabb->min.z;
+   if (!(x >= 0.0f && y >= 0.0f && z >= 0.0f))
+      return 0.0f;
+   return x * y + y * z + z * x;
+}
+
+static inline float
+lvp_bvh_centroid(const struct lvp_bvh_builder *builder, uint32_t leaf, unsigned axis)
+{
+   const struct lvp_aabb *aabb = &builder->leaf_bounds[leaf];
+   return (lvp_vec3_component(&aabb->min, axis) + lvp_vec3_component(&aabb->max, axis)) * 0.5f;
+}
+
+static inline uint32_t
+lvp_bvh_bin_index(float centroid, float min, float scale)
+{
+   float bin = (centroid - min) * scale;
+   if (!(bin > 0.0f))
+      return 0;
+   if (!(bin < LVP_BVH_BIN_COUNT))
+      return LVP_BVH_BIN_COUNT - 1;
+   return (uint32_t)bin;
+}
+
+static inline uint32_t
+lvp_bvh_leaf_id(const struct lvp_bvh_builder *builder, uint32_t index)
+{
+   return (builder->leaf_nodes_offset + builder->leaves[index] * builder->leaf_node_size) |
+          builder->leaf_node_type;
+}
+
+/* Partitions the leaves in [begin, end) and returns the first leaf of the
+ * second half, picking the split with the lowest surface area heuristic.
+ */
+static uint32_t
+lvp_bvh_split(struct lvp_bvh_builder *builder, uint32_t begin, uint32_t end,
+              uint32_t depth, struct lvp_aabb child_bounds[2])
+{
+   struct lvp_aabb centroids;
+   lvp_aabb_init_empty(&centroids);
+   for (uint32_t i = begin; i < end; i++) {
+      uint32_t leaf = builder->leaves[i];
+      struct lvp_aabb point;
+      point.min.x = point.max.x = lvp_bvh_centroid(builder, leaf, 0);
+      point.min.y = point.max.y = lvp_bvh_centroid(builder, leaf, 1);
+      point.min.z = point.max.z = lvp_bvh_centroid(builder, leaf, 2);
+      lvp_aabb_extend(&centroids, &point);
+   }
+
+   struct lvp_bvh_bin bins[3][LVP_BVH_BIN_COUNT];
+   float scale[3];
+   for (unsigned axis = 0; axis < 3; axis++) {
+      float extent = lvp_vec3_component(&centroids.max, axis) -
+                     lvp_vec3_component(&centroids.min, axis);
+      scale[axis] = extent > 0.0f ? LVP_BVH_BIN_COUNT / extent : 0.0f;
+      for (unsigned b = 0; b < LVP_BVH_BIN_COUNT; b++) {
+         lvp_aabb_init_empty(&bins[axis][b].bounds);
+         bins[axis][b].count = 0;
       }
-      case lvp_bvh_node_internal: {
-         struct lvp_bvh_box_node *box = child_node;
+   }
 
-         aabb->min.x = MIN2(box->bounds[0].min.x, box->bounds[1].min.x);
-         aabb->min.y = MIN2(box->bounds[0].min.y, box->bounds[1].min.y);
-         aabb->min.z = MIN2(box->bounds[0].min.z, box->bounds[1].min.z);
+   for (uint32_t i = begin; i < end; i++) {
+      uint32_t leaf = builder->leaves[i];
+      for (unsigned axis = 0; axis < 3; axis++) {
+         if (!scale[axis])
+            continue;
+         uint32_t b = lvp_bvh_bin_index(lvp_bvh_centroid(builder, leaf, axis),
+                                        lvp_vec3_component(&centroids.min, axis), scale[axis]);
+         lvp_aabb_extend(&bins[axis][b].bounds, &builder->leaf_bounds[leaf]);
+         bins[axis][b].count++;
+      }
+   }
 
-         aabb->max.x = MAX2(box->bounds[0].max.x, box->bounds[1].max.x);
-         aabb->max.y = MAX2(box->bounds[0].max.y, box->bounds[1].max.y);
-         aabb->max.z = MAX2(box->bounds[0].max.z, box->bounds[1].max.z);
+   int best_axis = -1;
+   uint32_t best_bin = 0;
+   uint32_t best_count = 0;
+   float best_cost = INFINITY;
+   for (unsigned axis = 0; axis < 3; axis++) {
+      if (!scale[axis])
+         continue;
 
-         break;
+      float right_cost[LVP_BVH_BIN_COUNT];
+      struct lvp_aabb bounds;
+      uint32_t count = 0;
+      lvp_aabb_init_empty(&bounds);
+      for (unsigned b = LVP_BVH_BIN_COUNT - 1; b > 0; b--) {
+         lvp_aabb_extend(&bounds, &bins[axis][b].bounds);
+         count += bins[axis][b].count;
+         right_cost[b] = count ? count * lvp_aabb_half_area(&bounds) : INFINITY;
       }
-      case lvp_bvh_node_instance: {
-         struct lvp_bvh_instance_node *instance = child_node;
-         struct lvp_bvh_header *instance_header = (void *)(uintptr_t)instance->bvh_ptr;
-
-         float bounds[2][3];
-
-         float header_bounds[2][3];
-         memcpy(header_bounds, &instance_header->bounds, sizeof(struct lvp_aabb));
-
-         for (unsigned j = 0; j < 3; ++j) {
-            bounds[0][j] = instance->otw_matrix.values[j][3];
-            bounds[1][j] = instance->otw_matrix.values[j][3];
-            for (unsigned k = 0; k < 3; ++k) {
-               bounds[0][j] += MIN2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
-                                    instance->otw_matrix.values[j][k] * header_bounds[1][k]);
-               bounds[1][j] += MAX2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
-                                    instance->otw_matrix.values[j][k] * header_bounds[1][k]);
-            }
+
+      lvp_aabb_init_empty(&bounds);
+      count = 0;
+      for (unsigned b = 0; b < LVP_BVH_BIN_COUNT - 1; b++) {
+         lvp_aabb_extend(&bounds, &bins[axis][b].bounds);
+         count += bins[axis][b].count;
+         if (!count)
+            continue;
+         float cost = count * lvp_aabb_half_area(&bounds) + right_cost[b + 1];
+         if (cost < best_cost) {
+            best_cost = cost;
+            best_axis = axis;
+            best_bin = b;
+            best_count = count;
+         }
+      }
+   }
+
+   /* Fall back to a balanced split when the SAH split would make the tree
+    * too deep for the traversal stack.
+    */
+   uint32_t count = end - begin;
+   if (best_axis >= 0 &&
+       depth + 1 + util_logbase2_ceil(MAX2(best_count, count - best_count)) > LVP_BVH_MAX_DEPTH)
+      best_axis = -1;
+
+   uint32_t mid;
+   if (best_axis < 0) {
+      mid = begin + count / 2;
+   } else {
+      float min = lvp_vec3_component(&centroids.min, best_axis);
+      uint32_t i = begin, j = end;
+      while (i < j) {
+         uint32_t leaf = builder->leaves[i];
+         if (lvp_bvh_bin_index(lvp_bvh_centroid(builder, leaf, best_axis), min,
+                               scale[best_axis]) <= best_bin) {
+            i++;
+         } else {
+            builder->leaves[i] = builder->leaves[--j];
+            builder->leaves[j] = leaf;
          }
+      }
+      mid = i;
+      assert(mid - begin == best_count);
+   }
 
-         memcpy(aabb, bounds, sizeof(struct lvp_aabb));
+   lvp_aabb_init_empty(&child_bounds[0]);
+   lvp_aabb_init_empty(&child_bounds[1]);
+   for (uint32_t i = begin; i < end; i++)
+      lvp_aabb_extend(&child_bounds[i >= mid], &builder->leaf_bounds[builder->leaves[i]]);
 
-         break;
+   return mid;
+}
+
+/* Builds the subtree over the leaves [begin, end), with at least two leaves.
+ * When tasks is not NULL, subtrees smaller than builder->task_leaves are
+ * appended to it instead of being built.
+ */
+static void
+lvp_bvh_build_node(struct lvp_bvh_builder *builder, uint32_t node_offset,
+                   uint32_t begin, uint32_t end, uint32_t depth,
+                   struct util_dynarray *tasks)
+{
+   struct lvp_bvh_box_node *node = (void *)(builder->dst + node_offset);
+   struct lvp_aabb bounds[2];
+   uint32_t mid = lvp_bvh_split(builder, begin, end, depth, bounds);
+   uint32_t ranges[2][2] = { { begin, mid }, { mid, end } };
+   uint32_t child_offset = node_offset + sizeof(struct lvp_bvh_box_node);
+
+   for (uint32_t i = 0; i < 2; i++) {
+      uint32_t count = ranges[i][1] - ranges[i][0];
+
+      node->bounds[i] = bounds[i];
+
+      if (count == 1) {
+         node->children[i] = lvp_bvh_leaf_id(builder, ranges[i][0]);
+         continue;
       }
-      case lvp_bvh_node_aabb: {
-         struct lvp_bvh_aabb_node *aabb_node = child_node;
 
-         memcpy(aabb, &aabb_node->bounds, sizeof(struct lvp_aabb));
+      node->children[i] = child_offset | lvp_bvh_node_internal;
 
-         break;
+      if (tasks && count < builder->task_leaves) {
+         struct lvp_bvh_task task = {
+            .builder = builder,
+            .node_offset = child_offset,
+            .begin = ranges[i][0],
+            .end = ranges[i][1],
+            .depth = depth + 1,
+         };
+         util_dynarray_append(tasks, struct lvp_bvh_task, task);
+      } else {
+         lvp_bvh_build_node(builder, child_offset, ranges[i][0], ranges[i][1], depth + 1, tasks);
       }
-      default:
-         unreachable("Invalid node type");
+
+      child_offset += (count - 1) * sizeof(struct lvp_bvh_box_node);
+   }
+}
+
+static void
+lvp_bvh_build_task(void *data, void *gdata, int thread_index)
+{
+   struct lvp_bvh_task *task = data;
+
+   lvp_bvh_build_node(task->builder, task->node_offset, task->begin, task->end, task->depth, NULL);
+}
+
+static bool
+lvp_bvh_build(struct lvp_device *device, uint8_t *dst, uint32_t leaf_count,
+              uint32_t leaf_node_type, uint32_t leaf_node_size)
+{
+   struct lvp_bvh_header *header = (void *)dst;
+   struct lvp_bvh_builder builder = {
+      .dst = dst,
+      .leaf_nodes_offset = header->leaf_nodes_offset,
+      .leaf_node_type = leaf_node_type,
+      .leaf_node_size = leaf_node_size,
+      .leaf_bounds = malloc(leaf_count * sizeof(struct lvp_aabb)),
+      .leaves = malloc(leaf_count * sizeof(uint32_t)),
+   };
+
+   if (!builder.leaf_bounds || !builder.leaves) {
+      free(builder.leaf_bounds);
+      free(builder.leaves);
+      return false;
+   }
+
+   for (uint32_t i = 0; i < leaf_count; i++) {
+      builder.leaves[i] = i;
+      lvp_node_bounds(dst, lvp_bvh_leaf_id(&builder, i), &builder.leaf_bounds[i]);
+   }
+
+   struct lvp_bvh_box_node *root = (void *)(dst + LVP_BVH_ROOT_NODE_OFFSET);
+   if (leaf_count == 1) {
+      root->children[0] = lvp_bvh_leaf_id(&builder, 0);
+      root->children[1] = LVP_BVH_INVALID_NODE;
+      root->bounds[0] = builder.leaf_bounds[0];
+      lvp_aabb_init_empty(&root->bounds[1]);
+   } else if (util_queue_is_initialized(&device->bvh_queue) &&
+              leaf_count >= 2 * LVP_BVH_MIN_TASK_LEAVES) {
+      builder.task_leaves = MAX2(leaf_count / (4 * device->bvh_queue.num_threads),
+                                 LVP_BVH_MIN_TASK_LEAVES);
+
+      struct util_dynarray tasks;
+      util_dynarray_init(&tasks, NULL);
+      lvp_bvh_build_node(&builder, LVP_BVH_ROOT_NODE_OFFSET, 0, leaf_count, 1, &tasks);
+
+      util_dynarray_foreach(&tasks, struct lvp_bvh_task, task) {
+         util_queue_fence_init(&task->fence);
+         util_queue_add_job(&device->bvh_queue, task, &task->fence, lvp_bvh_build_task, NULL, 0);
+      }
+      util_dynarray_foreach(&tasks, struct lvp_bvh_task, task) {
+         util_queue_fence_wait(&task->fence);
+         util_queue_fence_destroy(&task->fence);
       }
+      util_dynarray_fini(&tasks);
+   } else {
+      lvp_bvh_build_node(&builder, LVP_BVH_ROOT_NODE_OFFSET, 0, leaf_count, 1, NULL);
    }
 
-   return node_id;
+   free(builder.leaf_bounds);
+   free(builder.leaves);
+   return true;
+}
+
+/* Update builds keep the topology of the source BVH and only recompute the
+ * bounds. Children always follow their parent, so walking the internal nodes
+ * backwards visits every child before its parent.
+ */
+static void
+lvp_bvh_refit(uint8_t *dst, uint32_t leaf_count)
+{
+   uint32_t internal_count = MAX2(leaf_count, 2) - 1;
+   struct lvp_bvh_box_node *nodes = (void *)(dst + LVP_BVH_ROOT_NODE_OFFSET);
+
+   for (uint32_t i = internal_count; i-- > 0;) {
+      for (uint32_t c = 0; c < 2; c++) {
+         if (nodes[i].children[c] == LVP_BVH_INVALID_NODE)
+            lvp_aabb_init_empty(&nodes[i].bounds[c]);
+         else
+            lvp_node_bounds(dst, nodes[i].children[c], &nodes[i].bounds[c]);
+      }
+   }
 }
 
 void
-lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *info,
+lvp_build_acceleration_structure(struct lvp_device *device,
+                                 VkAccelerationStructureBuildGeometryInfoKHR *info,
                                  const VkAccelerationStructureBuildRangeInfoKHR *ranges)
 {
    VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, info->dstAccelerationStructure);
    void *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
 
-   memset(dst, 0, accel_struct->size);
-
    struct lvp_bvh_header *header = dst;
+
+   /* The leaf count of the source BVH, if its topology can be refitted. */
+   uint32_t refit_leaf_count = 0;
+   if (info->mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR &&
+       info->srcAccelerationStructure) {
+      VK_FROM_HANDLE(vk_acceleration_structure, src_accel_struct, info->srcAccelerationStructure);
+      void *src = (void *)(uintptr_t)vk_acceleration_structure_get_va(src_accel_struct);
+      if (src != dst)
+         memcpy(dst, src, MIN2(src_accel_struct->size, accel_struct->size));
+      refit_leaf_count = header->leaf_count;
+   } else {
+      memset(dst, 0, accel_struct->size);
+   }
+
    header->instance_count = 0;
 
    struct lvp_bvh_box_node *root = (void *)((uint8_t *)dst + sizeof(struct lvp_bvh_header));
@@ -557,6 +921,7 @@ lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *in
    }
 
    leaf_count = primitive_index;
+   header->leaf_count = leaf_count;
 
    struct lvp_build_internal_ctx internal_ctx = {
       .dst = dst,
@@ -591,8 +956,13 @@ lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *in
       unreachable("Unknown VkGeometryTypeKHR");
    }
 
-   if (leaf_count) {
-      lvp_build_internal_node(&internal_ctx, 0, leaf_count - 1);
+   if (leaf_count && leaf_count == refit_leaf_count) {
+      lvp_bvh_refit(dst, leaf_count);
+   } else if (leaf_count) {
+      /* The median split builder needs no memory, use it if allocating fails. */
+      if (!lvp_bvh_build(device, dst, leaf_count, internal_ctx.leaf_node_type,
+                         internal_ctx.leaf_node_size))
+         lvp_build_internal_node(&internal_ctx, 0, leaf_count - 1);
    } else {
       root->children[0] = LVP_BVH_INVALID_NODE;
       root->children[1] = LVP_BVH_INVALID_NODE;
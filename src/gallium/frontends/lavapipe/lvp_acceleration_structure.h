@@ -84,7 +84,7 @@ struct lvp_bvh_header {
    uint32_t instance_count;
    uint32_t leaf_nodes_offset;
 
-   uint32_t padding;
+   uint32_t leaf_count;
 };
 
 struct lvp_accel_struct_serialization_header {
@@ -102,7 +102,8 @@ struct lvp_accel_struct_serialization_header {
 #define LVP_BVH_INVALID_NODE     0xFFFFFFFF
 
 void
-lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *info,
+lvp_build_acceleration_structure(struct lvp_device *device,
+                                 VkAccelerationStructureBuildGeometryInfoKHR *info,
                                  const VkAccelerationStructureBuildRangeInfoKHR *ranges);
 
 #endif
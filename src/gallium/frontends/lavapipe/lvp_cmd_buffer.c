@@ -82,6 +82,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_BeginCommandBuffer(
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
    vk_command_buffer_begin(&cmd_buffer->vk, pBeginInfo);
+   cmd_buffer->one_time_submit =
+      (pBeginInfo->flags & VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != 0;
 
    return VK_SUCCESS;
 }
@@ -91,5 +93,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_EndCommandBuffer(
 {
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
-   return vk_command_buffer_end(&cmd_buffer->vk);
+   VkResult result = vk_command_buffer_end(&cmd_buffer->vk);
+   if (result == VK_SUCCESS && !cmd_buffer->one_time_submit)
+      lvp_prune_cmd_queue(&cmd_buffer->vk.cmd_queue);
+
+   return result;
 }
@@ -0,0 +1,230 @@
+/*
+ * Copyright © 2019 Red Hat.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "lvp_private.h"
+
+/* Dynamic state commands which are dropped when overwritten before use.
+ * Their handlers in lvp_execute.c only store the command's values, so the
+ * last one of a kind wins regardless of what was recorded in between.
+ */
+static const struct {
+   enum vk_cmd_type type;
+   int dynamic; /* graphics pipeline state it is dynamic for, or -1 */
+} lvp_prune_states[] = {
+   { VK_CMD_SET_VIEWPORT, MESA_VK_DYNAMIC_VP_VIEWPORTS },
+   { VK_CMD_SET_SCISSOR, MESA_VK_DYNAMIC_VP_SCISSORS },
+   { VK_CMD_SET_VIEWPORT_WITH_COUNT, -1 },
+   { VK_CMD_SET_SCISSOR_WITH_COUNT, -1 },
+   { VK_CMD_SET_LINE_WIDTH, MESA_VK_DYNAMIC_RS_LINE_WIDTH },
+   { VK_CMD_SET_DEPTH_BIAS, MESA_VK_DYNAMIC_RS_DEPTH_BIAS_FACTORS },
+   { VK_CMD_SET_BLEND_CONSTANTS, MESA_VK_DYNAMIC_CB_BLEND_CONSTANTS },
+   { VK_CMD_SET_DEPTH_BOUNDS, MESA_VK_DYNAMIC_DS_DEPTH_BOUNDS_TEST_BOUNDS },
+   { VK_CMD_SET_STENCIL_COMPARE_MASK, MESA_VK_DYNAMIC_DS_STENCIL_COMPARE_MASK },
+   { VK_CMD_SET_STENCIL_WRITE_MASK, MESA_VK_DYNAMIC_DS_STENCIL_WRITE_MASK },
+   { VK_CMD_SET_STENCIL_REFERENCE, MESA_VK_DYNAMIC_DS_STENCIL_REFERENCE },
+   { VK_CMD_SET_STENCIL_OP, MESA_VK_DYNAMIC_DS_STENCIL_OP },
+   { VK_CMD_SET_CULL_MODE, MESA_VK_DYNAMIC_RS_CULL_MODE },
+   { VK_CMD_SET_FRONT_FACE, MESA_VK_DYNAMIC_RS_FRONT_FACE },
+   { VK_CMD_SET_PRIMITIVE_TOPOLOGY, MESA_VK_DYNAMIC_IA_PRIMITIVE_TOPOLOGY },
+   { VK_CMD_SET_PRIMITIVE_RESTART_ENABLE, MESA_VK_DYNAMIC_IA_PRIMITIVE_RESTART_ENABLE },
+   { VK_CMD_SET_DEPTH_TEST_ENABLE, MESA_VK_DYNAMIC_DS_DEPTH_TEST_ENABLE },
+   { VK_CMD_SET_DEPTH_WRITE_ENABLE, MESA_VK_DYNAMIC_DS_DEPTH_WRITE_ENABLE },
+   { VK_CMD_SET_DEPTH_COMPARE_OP, MESA_VK_DYNAMIC_DS_DEPTH_COMPARE_OP },
+   { VK_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE, MESA_VK_DYNAMIC_DS_DEPTH_BOUNDS_TEST_ENABLE },
+   { VK_CMD_SET_STENCIL_TEST_ENABLE, MESA_VK_DYNAMIC_DS_STENCIL_TEST_ENABLE },
+   { VK_CMD_SET_DEPTH_BIAS_ENABLE, MESA_VK_DYNAMIC_RS_DEPTH_BIAS_ENABLE },
+   { VK_CMD_SET_RASTERIZER_DISCARD_ENABLE, MESA_VK_DYNAMIC_RS_RASTERIZER_DISCARD_ENABLE },
+};
+
+static int
+lvp_prune_state_index(enum vk_cmd_type type)
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(lvp_prune_states); i++) {
+      if (lvp_prune_states[i].type == type)
+         return i;
+   }
+   return -1;
+}
+
+/* Whether cmd writes everything prev wrote. */
+static bool
+lvp_prune_state_overwrites(const struct vk_cmd_queue_entry *cmd,
+                          const struct vk_cmd_queue_entry *prev)
+{
+   switch (cmd->type) {
+   case VK_CMD_SET_VIEWPORT:
+      return cmd->u.set_viewport.first_viewport == prev->u.set_viewport.first_viewport &&
+             cmd->u.set_viewport.viewport_count == prev->u.set_viewport.viewport_count;
+   case VK_CMD_SET_SCISSOR:
+      return cmd->u.set_scissor.first_scissor == prev->u.set_scissor.first_scissor &&
+             cmd->u.set_scissor.scissor_count == prev->u.set_scissor.scissor_count;
+   case VK_CMD_SET_VIEWPORT_WITH_COUNT:
+      return cmd->u.set_viewport_with_count.viewport_count ==
+             prev->u.set_viewport_with_count.viewport_count;
+   case VK_CMD_SET_SCISSOR_WITH_COUNT:
+      return cmd->u.set_scissor_with_count.scissor_count ==
+             prev->u.set_scissor_with_count.scissor_count;
+   case VK_CMD_SET_STENCIL_COMPARE_MASK:
+      return cmd->u.set_stencil_compare_mask.face_mask == prev->u.set_stencil_compare_mask.face_mask;
+   case VK_CMD_SET_STENCIL_WRITE_MASK:
+      return cmd->u.set_stencil_write_mask.face_mask == prev->u.set_stencil_write_mask.face_mask;
+   case VK_CMD_SET_STENCIL_REFERENCE:
+      return cmd->u.set_stencil_reference.face_mask == prev->u.set_stencil_reference.face_mask;
+   case VK_CMD_SET_STENCIL_OP:
+      return cmd->u.set_stencil_op.face_mask == prev->u.set_stencil_op.face_mask;
+   default:
+      return true;
+   }
+}
+
+/* Commands which neither read nor write any state a pipeline bind or a
+ * dynamic state command touches.
+ */
+static bool
+lvp_prune_cmd_is_binding(enum vk_cmd_type type)
+{
+   switch (type) {
+   case VK_CMD_BIND_DESCRIPTOR_SETS:
+   case VK_CMD_BIND_DESCRIPTOR_SETS2_KHR:
+   case VK_CMD_PUSH_CONSTANTS:
+   case VK_CMD_PUSH_CONSTANTS2_KHR:
+   case VK_CMD_BIND_INDEX_BUFFER:
+   case VK_CMD_BIND_INDEX_BUFFER2_KHR:
+   case VK_CMD_BIND_VERTEX_BUFFERS:
+   case VK_CMD_BIND_VERTEX_BUFFERS2:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool
+lvp_prune_cmd_is_work(enum vk_cmd_type type)
+{
+   switch (type) {
+   case VK_CMD_DRAW:
+   case VK_CMD_DRAW_INDEXED:
+   case VK_CMD_DRAW_MULTI_EXT:
+   case VK_CMD_DRAW_MULTI_INDEXED_EXT:
+   case VK_CMD_DRAW_INDIRECT:
+   case VK_CMD_DRAW_INDEXED_INDIRECT:
+   case VK_CMD_DRAW_INDIRECT_COUNT:
+   case VK_CMD_DRAW_INDEXED_INDIRECT_COUNT:
+   case VK_CMD_DRAW_MESH_TASKS_EXT:
+   case VK_CMD_DRAW_MESH_TASKS_INDIRECT_EXT:
+   case VK_CMD_DRAW_MESH_TASKS_INDIRECT_COUNT_EXT:
+   case VK_CMD_DISPATCH:
+   case VK_CMD_DISPATCH_BASE:
+   case VK_CMD_DISPATCH_INDIRECT:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static int
+lvp_prune_bind_point_index(VkPipelineBindPoint bind_point)
+{
+   switch (bind_point) {
+   case VK_PIPELINE_BIND_POINT_GRAPHICS:
+      return 0;
+   case VK_PIPELINE_BIND_POINT_COMPUTE:
+      return 1;
+   case VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR:
+      return 2;
+   default:
+      return -1;
+   }
+}
+
+/**
+ * Redundant state pruning for reusable command buffers. The recorded
+ * vk_cmd_queue is still replayed through lvp_execute.c on every submission,
+ * this only removes the commands which can't change its result, so that no
+ * submission translates them:
+ *
+ * - binds of the pipeline which is already bound, with only draws,
+ *   dispatches, resource bindings and state the pipeline leaves dynamic
+ *   recorded since the previous bind. Each of them would otherwise redo all
+ *   of handle_graphics_pipeline() and invalidate the bound gallium state.
+ * - dynamic state commands overwritten by one of the same kind before any
+ *   draw, dispatch or other command could observe them.
+ */
+void
+lvp_prune_cmd_queue(struct vk_cmd_queue *queue)
+{
+   struct vk_cmd_queue dead = { .alloc = queue->alloc };
+   struct lvp_pipeline *bound[3] = { NULL };
+   struct vk_cmd_queue_entry *pending[ARRAY_SIZE(lvp_prune_states)] = { NULL };
+
+   list_inithead(&dead.cmds);
+
+   list_for_each_entry_safe(struct vk_cmd_queue_entry, cmd, &queue->cmds, cmd_link) {
+      if (lvp_prune_cmd_is_work(cmd->type) || lvp_prune_cmd_is_binding(cmd->type))
+         continue;
+
+      if (cmd->type == VK_CMD_BIND_PIPELINE) {
+         LVP_FROM_HANDLE(lvp_pipeline, pipeline, cmd->u.bind_pipeline.pipeline);
+         int idx = lvp_prune_bind_point_index(cmd->u.bind_pipeline.pipeline_bind_point);
+         if (idx < 0) {
+            memset(bound, 0, sizeof(bound));
+            continue;
+         }
+         if (bound[idx] == pipeline) {
+            list_del(&cmd->cmd_link);
+            list_addtail(&cmd->cmd_link, &dead.cmds);
+            continue;
+         }
+         bound[idx] = pipeline;
+         continue;
+      }
+
+      int state = lvp_prune_state_index(cmd->type);
+      if (state >= 0 && bound[0] &&
+          (lvp_prune_states[state].dynamic < 0 ||
+           !BITSET_TEST(bound[0]->graphics_state.dynamic, lvp_prune_states[state].dynamic)))
+         bound[0] = NULL;
+      if (state < 0)
+         memset(bound, 0, sizeof(bound));
+   }
+
+   list_for_each_entry_safe(struct vk_cmd_queue_entry, cmd, &queue->cmds, cmd_link) {
+      if (lvp_prune_cmd_is_binding(cmd->type))
+         continue;
+
+      int state = lvp_prune_state_index(cmd->type);
+      if (state < 0) {
+         memset(pending, 0, sizeof(pending));
+         continue;
+      }
+
+      struct vk_cmd_queue_entry *prev = pending[state];
+      if (prev && lvp_prune_state_overwrites(cmd, prev)) {
+         list_del(&prev->cmd_link);
+         list_addtail(&prev->cmd_link, &dead.cmds);
+      }
+      pending[state] = cmd;
+   }
+
+   vk_free_queue(&dead);
+}
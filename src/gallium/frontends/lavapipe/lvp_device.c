@@ -38,6 +38,7 @@
 #include "util/u_inlines.h"
 #include "util/os_memory.h"
 #include "util/os_time.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_thread.h"
 #include "util/u_atomic.h"
 #include "util/timespec.h"
@@ -1530,6 +1531,16 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
          .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
       };
    }
+
+   vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
+      p->queueFamilyProperties = (VkQueueFamilyProperties) {
+         .queueFlags = VK_QUEUE_COMPUTE_BIT |
+         VK_QUEUE_TRANSFER_BIT,
+         .queueCount = LVP_MAX_COMPUTE_QUEUES,
+         .timestampValidBits = 64,
+         .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
+      };
+   }
 }
 
 VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceMemoryProperties(
@@ -1627,6 +1638,11 @@ destroy_pipelines(struct lvp_queue *queue)
    while (util_dynarray_contains(&queue->pipeline_destroys, struct lvp_pipeline*)) {
       lvp_pipeline_destroy(queue->device, util_dynarray_pop(&queue->pipeline_destroys, struct lvp_pipeline*), true);
    }
+   simple_mtx_lock(&queue->cso_destroys_lock);
+   util_dynarray_foreach(&queue->cso_destroys, void *, cso)
+      queue->ctx->delete_compute_state(queue->ctx, *cso);
+   util_dynarray_clear(&queue->cso_destroys);
+   simple_mtx_unlock(&queue->cso_destroys_lock);
    simple_mtx_unlock(&queue->lock);
 }
 
@@ -1710,6 +1726,8 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
 
    simple_mtx_init(&queue->lock, mtx_plain);
    util_dynarray_init(&queue->pipeline_destroys, NULL);
+   simple_mtx_init(&queue->cso_destroys_lock, mtx_plain);
+   util_dynarray_init(&queue->cso_destroys, NULL);
 
    return VK_SUCCESS;
 }
@@ -1722,6 +1740,11 @@ lvp_queue_finish(struct lvp_queue *queue)
    destroy_pipelines(queue);
    simple_mtx_destroy(&queue->lock);
    util_dynarray_fini(&queue->pipeline_destroys);
+   simple_mtx_destroy(&queue->cso_destroys_lock);
+   util_dynarray_fini(&queue->cso_destroys);
+
+   if (queue->last_fence)
+      queue->device->pscreen->fence_reference(queue->device->pscreen, &queue->last_fence, NULL);
 
    u_upload_destroy(queue->uploader);
    cso_destroy_context(queue->cso);
@@ -1740,14 +1763,17 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO);
 
-   size_t state_size = lvp_get_rendering_state_size();
+   /* one rendering state per queue */
+   size_t state_size = align(lvp_get_rendering_state_size(), 8);
    device = vk_zalloc2(&physical_device->vk.instance->alloc, pAllocator,
-                       sizeof(*device) + state_size, 8,
+                       sizeof(*device) + state_size * (1 + LVP_MAX_COMPUTE_QUEUES), 8,
                        VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
    if (!device)
       return vk_error(instance, VK_ERROR_OUT_OF_HOST_MEMORY);
 
    device->queue.state = device + 1;
+   for (unsigned i = 0; i < LVP_MAX_COMPUTE_QUEUES; i++)
+      device->compute_queues[i].state = (uint8_t *)(device + 1) + state_size * (1 + i);
    device->poison_mem = debug_get_bool_option("LVP_POISON_MEMORY", false);
    device->print_cmds = debug_get_bool_option("LVP_CMD_DEBUG", false);
 
@@ -1774,15 +1800,49 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount == 1);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
-   result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
+   /* Every object is created on the context of the graphics queue, so it
+    * always exists, even if the application only asked for compute queues.
+    */
+   const VkDeviceQueueCreateInfo default_queue_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = 0,
+      .queueCount = 1,
+   };
+   const VkDeviceQueueCreateInfo *queue_info = &default_queue_info;
+   const VkDeviceQueueCreateInfo *compute_queue_info = NULL;
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *info = &pCreateInfo->pQueueCreateInfos[i];
+      assert(info->queueFamilyIndex < LVP_QUEUE_FAMILY_COUNT);
+      if (info->queueFamilyIndex == 0) {
+         assert(info->queueCount == 1);
+         queue_info = info;
+      } else {
+         assert(info->queueCount <= LVP_MAX_COMPUTE_QUEUES);
+         compute_queue_info = info;
+      }
+   }
+
+   result = lvp_queue_init(device, &device->queue, queue_info, 0);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, device);
       return result;
    }
 
+   if (compute_queue_info) {
+      for (uint32_t i = 0; i < compute_queue_info->queueCount; i++) {
+         result = lvp_queue_init(device, &device->compute_queues[i], compute_queue_info, i);
+         if (result != VK_SUCCESS) {
+            for (uint32_t j = 0; j < i; j++)
+               lvp_queue_finish(&device->compute_queues[j]);
+            lvp_queue_finish(&device->queue);
+            vk_device_finish(&device->vk);
+            vk_free(&device->vk.alloc, device);
+            return result;
+         }
+         device->compute_queue_count++;
+      }
+   }
+
    nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, NULL, "dummy_frag");
    struct pipe_shader_state shstate = {0};
    shstate.type = PIPE_SHADER_IR_NIR;
@@ -1804,6 +1864,11 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->group_handle_alloc = 1;
 
+   unsigned bvh_threads = util_get_cpu_caps()->nr_cpus;
+   if (device->vk.enabled_features.accelerationStructure && bvh_threads > 1)
+      util_queue_init(&device->bvh_queue, "lvpbvh", 64, bvh_threads,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+
    *pDevice = lvp_device_to_handle(device);
 
    return VK_SUCCESS;
@@ -1831,13 +1896,17 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 
    device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
 
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
+   if (util_queue_is_initialized(&device->bvh_queue))
+      util_queue_destroy(&device->bvh_queue);
+
    ralloc_free(device->bda.table);
    simple_mtx_destroy(&device->bda_lock);
    pipe_resource_reference(&device->zero_buffer, NULL);
 
+   /* pipelines destroyed by the graphics queue queue up compute CSOs */
    lvp_queue_finish(&device->queue);
+   for (uint32_t i = 0; i < device->compute_queue_count; i++)
+      lvp_queue_finish(&device->compute_queues[i]);
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
 }
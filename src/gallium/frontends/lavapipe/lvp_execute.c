@@ -83,6 +83,7 @@ struct lvp_render_attachment {
 struct rendering_state {
    struct pipe_context *pctx;
    struct lvp_device *device; //for uniform inlining only
+   struct lvp_queue *queue;
    struct u_upload_mgr *uploader;
    struct cso_context *cso;
 
@@ -380,6 +381,14 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
    }
 }
 
+static void *
+compute_shader_cso(struct rendering_state *state, struct lvp_shader *shader)
+{
+   if (state->queue == &state->device->queue)
+      return shader->shader_cso;
+   return lvp_shader_queue_cso(state->queue, shader);
+}
+
 static void emit_compute_state(struct rendering_state *state)
 {
    bool pcbuf_dirty = state->pcbuf_dirty[MESA_SHADER_COMPUTE];
@@ -393,8 +402,11 @@ static void emit_compute_state(struct rendering_state *state)
       state->constbuf_dirty[MESA_SHADER_COMPUTE] = false;
    }
 
-   if (state->inlines_dirty[MESA_SHADER_COMPUTE] &&
-       state->shaders[MESA_SHADER_COMPUTE]->inlines.can_inline) {
+   if (state->queue != &state->device->queue) {
+      if (state->compute_shader_dirty)
+         state->pctx->bind_compute_state(state->pctx, compute_shader_cso(state, state->shaders[MESA_SHADER_COMPUTE]));
+   } else if (state->inlines_dirty[MESA_SHADER_COMPUTE] &&
+              state->shaders[MESA_SHADER_COMPUTE]->inlines.can_inline) {
       update_inline_shader_state(state, MESA_SHADER_COMPUTE, pcbuf_dirty);
    } else if (state->compute_shader_dirty) {
       state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_COMPUTE]->shader_cso);
@@ -611,9 +623,14 @@ handle_compute_shader(struct rendering_state *state, struct lvp_shader *shader,
    state->dispatch_info.block[0] = shader->pipeline_nir->nir->info.workgroup_size[0];
    state->dispatch_info.block[1] = shader->pipeline_nir->nir->info.workgroup_size[1];
    state->dispatch_info.block[2] = shader->pipeline_nir->nir->info.workgroup_size[2];
-   state->inlines_dirty[MESA_SHADER_COMPUTE] = shader->inlines.can_inline;
-   if (!shader->inlines.can_inline)
+   if (state->queue != &state->device->queue) {
+      /* compute queues don't inline uniforms */
       state->compute_shader_dirty = true;
+   } else {
+      state->inlines_dirty[MESA_SHADER_COMPUTE] = shader->inlines.can_inline;
+      if (!shader->inlines.can_inline)
+         state->compute_shader_dirty = true;
+   }
 }
 
 static void handle_compute_pipeline(struct vk_cmd_queue_entry *cmd,
@@ -2877,6 +2894,21 @@ static void handle_pipeline_barrier(struct vk_cmd_queue_entry *cmd,
    finish_fence(state);
 }
 
+/* Queries are created on the context of the first queue using them, which
+ * is recorded for reading them back and destroying them.
+ */
+static struct pipe_query *
+get_query(struct rendering_state *state, struct lvp_query_pool *pool,
+          uint32_t query, enum pipe_query_type type, unsigned index)
+{
+   if (!pool->queries[query]) {
+      pool->queries[query] = state->pctx->create_query(state->pctx, type, index);
+      pool->query_ctx[query] = state->pctx;
+   }
+
+   return pool->queries[query];
+}
+
 static void handle_begin_query(struct vk_cmd_queue_entry *cmd,
                                struct rendering_state *state)
 {
@@ -2891,15 +2923,12 @@ static void handle_begin_query(struct vk_cmd_queue_entry *cmd,
 
    uint32_t count = util_bitcount(state->framebuffer.viewmask ? state->framebuffer.viewmask : BITFIELD_BIT(0));
    for (unsigned idx = 0; idx < count; idx++) {
-      if (!pool->queries[qcmd->query + idx]) {
-         enum pipe_query_type qtype = pool->base_type;
-         pool->queries[qcmd->query + idx] = state->pctx->create_query(state->pctx,
-                                                               qtype, 0);
-      }
+      struct pipe_query *query = get_query(state, pool, qcmd->query + idx,
+                                           pool->base_type, 0);
 
-      state->pctx->begin_query(state->pctx, pool->queries[qcmd->query + idx]);
+      state->pctx->begin_query(state->pctx, query);
       if (idx)
-         state->pctx->end_query(state->pctx, pool->queries[qcmd->query + idx]);
+         state->pctx->end_query(state->pctx, query);
    }
 }
 
@@ -2928,15 +2957,12 @@ static void handle_begin_query_indexed_ext(struct vk_cmd_queue_entry *cmd,
 
    uint32_t count = util_bitcount(state->framebuffer.viewmask ? state->framebuffer.viewmask : BITFIELD_BIT(0));
    for (unsigned idx = 0; idx < count; idx++) {
-      if (!pool->queries[qcmd->query + idx]) {
-         enum pipe_query_type qtype = pool->base_type;
-         pool->queries[qcmd->query + idx] = state->pctx->create_query(state->pctx,
-                                                                      qtype, qcmd->index);
-      }
+      struct pipe_query *query = get_query(state, pool, qcmd->query + idx,
+                                           pool->base_type, qcmd->index);
 
-      state->pctx->begin_query(state->pctx, pool->queries[qcmd->query + idx]);
+      state->pctx->begin_query(state->pctx, query);
       if (idx)
-         state->pctx->end_query(state->pctx, pool->queries[qcmd->query + idx]);
+         state->pctx->end_query(state->pctx, query);
    }
 }
 
@@ -2955,12 +2981,8 @@ static void handle_reset_query_pool(struct vk_cmd_queue_entry *cmd,
 {
    struct vk_cmd_reset_query_pool *qcmd = &cmd->u.reset_query_pool;
    LVP_FROM_HANDLE(lvp_query_pool, pool, qcmd->query_pool);
-   for (unsigned i = qcmd->first_query; i < qcmd->first_query + qcmd->query_count; i++) {
-      if (pool->queries[i]) {
-         state->pctx->destroy_query(state->pctx, pool->queries[i]);
-         pool->queries[i] = NULL;
-      }
-   }
+
+   lvp_query_pool_reset(pool, qcmd->first_query, qcmd->query_count);
 }
 
 static void handle_write_timestamp2(struct vk_cmd_queue_entry *cmd,
@@ -2974,11 +2996,9 @@ static void handle_write_timestamp2(struct vk_cmd_queue_entry *cmd,
 
    uint32_t count = util_bitcount(state->framebuffer.viewmask ? state->framebuffer.viewmask : BITFIELD_BIT(0));
    for (unsigned idx = 0; idx < count; idx++) {
-      if (!pool->queries[qcmd->query + idx]) {
-         pool->queries[qcmd->query + idx] = state->pctx->create_query(state->pctx, PIPE_QUERY_TIMESTAMP, 0);
-      }
-
-      state->pctx->end_query(state->pctx, pool->queries[qcmd->query + idx]);
+      state->pctx->end_query(state->pctx,
+                             get_query(state, pool, qcmd->query + idx,
+                                       PIPE_QUERY_TIMESTAMP, 0));
    }
 }
 
@@ -4756,7 +4776,7 @@ handle_build_acceleration_structures(struct vk_cmd_queue_entry *cmd, struct rend
    struct vk_cmd_build_acceleration_structures_khr *build = &cmd->u.build_acceleration_structures_khr;
 
    for (uint32_t i = 0; i < build->info_count; i++)
-      lvp_build_acceleration_structure(&build->infos[i], build->pp_build_range_infos[i]);
+      lvp_build_acceleration_structure(state->device, &build->infos[i], build->pp_build_range_infos[i]);
 }
 
 static void
@@ -4808,7 +4828,7 @@ static void emit_ray_tracing_state(struct rendering_state *state)
       state->constbuf_dirty[MESA_SHADER_RAYGEN] = false;
    }
 
-   state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_RAYGEN]->shader_cso);
+   state->pctx->bind_compute_state(state->pctx, compute_shader_cso(state, state->shaders[MESA_SHADER_RAYGEN]));
 
    state->pcbuf_dirty[MESA_SHADER_COMPUTE] = true;
    state->constbuf_dirty[MESA_SHADER_COMPUTE] = true;
@@ -5499,6 +5519,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    memset(state, 0, sizeof(*state));
    state->pctx = queue->ctx;
    state->device = device;
+   state->queue = queue;
    state->uploader = queue->uploader;
    state->cso = queue->cso;
    state->blend_dirty = true;
@@ -77,6 +77,15 @@ shader_destroy(struct lvp_device *device, struct lvp_shader *shader, bool locked
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
 
+   for (unsigned i = 0; i < device->compute_queue_count; i++) {
+      struct lvp_queue *queue = &device->compute_queues[i];
+      if (!shader->queue_csos[i])
+         continue;
+      simple_mtx_lock(&queue->cso_destroys_lock);
+      util_dynarray_append(&queue->cso_destroys, void *, shader->queue_csos[i]);
+      simple_mtx_unlock(&queue->cso_destroys_lock);
+   }
+
    lvp_pipeline_nir_ref(&shader->pipeline_nir, NULL);
    lvp_pipeline_nir_ref(&shader->tess_ccw, NULL);
 }
@@ -595,14 +604,14 @@ lvp_pipeline_xfb_init(struct lvp_pipeline *pipeline)
 }
 
 static void *
-lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir)
+lvp_shader_compile_stage(struct pipe_context *ctx, struct lvp_shader *shader, nir_shader *nir)
 {
    if (nir->info.stage == MESA_SHADER_COMPUTE) {
       struct pipe_compute_state shstate = {0};
       shstate.prog = nir;
       shstate.ir_type = PIPE_SHADER_IR_NIR;
       shstate.static_shared_mem = nir->info.shared_size;
-      return device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
+      return ctx->create_compute_state(ctx, &shstate);
    } else {
       struct pipe_shader_state shstate = {0};
       shstate.type = PIPE_SHADER_IR_NIR;
@@ -611,19 +620,19 @@ lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, n
 
       switch (nir->info.stage) {
       case MESA_SHADER_FRAGMENT:
-         return device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+         return ctx->create_fs_state(ctx, &shstate);
       case MESA_SHADER_VERTEX:
-         return device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
+         return ctx->create_vs_state(ctx, &shstate);
       case MESA_SHADER_GEOMETRY:
-         return device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
+         return ctx->create_gs_state(ctx, &shstate);
       case MESA_SHADER_TESS_CTRL:
-         return device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
+         return ctx->create_tcs_state(ctx, &shstate);
       case MESA_SHADER_TESS_EVAL:
-         return device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
+         return ctx->create_tes_state(ctx, &shstate);
       case MESA_SHADER_TASK:
-         return device->queue.ctx->create_ts_state(device->queue.ctx, &shstate);
+         return ctx->create_ts_state(ctx, &shstate);
       case MESA_SHADER_MESH:
-         return device->queue.ctx->create_ms_state(device->queue.ctx, &shstate);
+         return ctx->create_ms_state(ctx, &shstate);
       default:
          unreachable("illegal shader");
          break;
@@ -640,7 +649,7 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    if (!locked)
       simple_mtx_lock(&device->queue.lock);
 
-   void *state = lvp_shader_compile_stage(device, shader, nir);
+   void *state = lvp_shader_compile_stage(device->queue.ctx, shader, nir);
 
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
@@ -648,6 +657,28 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    return state;
 }
 
+/* CSOs belong to the context which created them, so compute queues compile
+ * their own copy of a compute shader the first time they bind it. Uniform
+ * inlining only happens on the graphics queue.
+ */
+void *
+lvp_shader_queue_cso(struct lvp_queue *queue, struct lvp_shader *shader)
+{
+   struct lvp_device *device = queue->device;
+   unsigned index = queue - device->compute_queues;
+
+   assert(index < device->compute_queue_count);
+   assert(shader->pipeline_nir->nir->info.stage == MESA_SHADER_COMPUTE);
+
+   if (!shader->queue_csos[index]) {
+      nir_shader *nir = nir_shader_clone(NULL, shader->pipeline_nir->nir);
+      device->physical_device->pscreen->finalize_nir(device->physical_device->pscreen, nir);
+      shader->queue_csos[index] = lvp_shader_compile_stage(queue->ctx, shader, nir);
+   }
+
+   return shader->queue_csos[index];
+}
+
 #ifndef NDEBUG
 static bool
 layouts_equal(const struct lvp_descriptor_set_layout *a, const struct lvp_descriptor_set_layout *b)
@@ -108,6 +108,12 @@ extern "C" {
 /* Currently lavapipe does not support more than 1 image plane */
 #define LVP_MAX_PLANE_COUNT 1
 
+/* Queue family 1 holds compute and transfer queues which each own a pipe
+ * context, so their submissions run concurrently with the graphics queue.
+ */
+#define LVP_QUEUE_FAMILY_COUNT 2
+#define LVP_MAX_COMPUTE_QUEUES 4
+
 #ifdef _WIN32
 #define lvp_printflike(a, b)
 #else
@@ -195,6 +201,10 @@ struct lvp_queue {
    void *state;
    struct util_dynarray pipeline_destroys;
    simple_mtx_t lock;
+
+   /* Compute queues: CSOs of destroyed shaders, deleted on the next submit. */
+   struct util_dynarray cso_destroys;
+   simple_mtx_t cso_destroys_lock;
 };
 
 struct lvp_pipeline_cache {
@@ -207,6 +217,8 @@ struct lvp_device {
    struct vk_device vk;
 
    struct lvp_queue queue;
+   struct lvp_queue compute_queues[LVP_MAX_COMPUTE_QUEUES];
+   uint32_t compute_queue_count;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
@@ -223,6 +235,9 @@ struct lvp_device {
    struct util_dynarray bda_image_handles;
 
    uint32_t group_handle_alloc;
+
+   /* threads building large acceleration structures */
+   struct util_queue bvh_queue;
 };
 
 void lvp_device_get_cache_uuid(void *uuid);
@@ -450,6 +465,8 @@ struct lvp_shader {
    struct lvp_pipeline_nir *tess_ccw;
    void *shader_cso;
    void *tess_ccw_cso;
+   /* compute CSOs created on the contexts of the compute queues */
+   void *queue_csos[LVP_MAX_COMPUTE_QUEUES];
    struct {
       uint32_t uniform_offsets[PIPE_MAX_CONSTANT_BUFFERS][MAX_INLINABLE_UNIFORMS];
       uint8_t count[PIPE_MAX_CONSTANT_BUFFERS];
@@ -618,6 +635,10 @@ struct lvp_query_pool {
    VkQueryPipelineStatisticFlags pipeline_stats;
    enum pipe_query_type base_type;
    void *data; /* Used by queries that are not implemented by pipe_query */
+   /* Context of the queue which created each pipe_query, the only one
+    * which may read it back or destroy it.
+    */
+   struct pipe_context **query_ctx;
    struct pipe_query *queries[0];
 };
 
@@ -626,6 +647,9 @@ struct lvp_cmd_buffer {
 
    struct lvp_device *                          device;
 
+   /* VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT was set at begin */
+   bool one_time_submit;
+
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
 };
 
@@ -739,6 +763,9 @@ VkResult lvp_image_bind_sparse(struct lvp_device *device,
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
                           struct lvp_cmd_buffer *cmd_buffer);
+void lvp_prune_cmd_queue(struct vk_cmd_queue *queue);
+void lvp_query_pool_reset(struct lvp_query_pool *pool,
+                          uint32_t first_query, uint32_t query_count);
 size_t
 lvp_get_rendering_state_size(void);
 struct lvp_image *lvp_swapchain_get_image(VkSwapchainKHR swapchain,
@@ -815,6 +842,8 @@ void
 lvp_inline_uniforms(nir_shader *nir, const struct lvp_shader *shader, const uint32_t *uniform_values, uint32_t ubo);
 void *
 lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir, bool locked);
+void *
+lvp_shader_queue_cso(struct lvp_queue *queue, struct lvp_shader *shader);
 bool
 lvp_nir_lower_ray_queries(struct nir_shader *shader);
 bool
@@ -75,6 +75,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateQueryPool(
    size_t pool_size = sizeof(*pool)
       + pCreateInfo->queryCount * query_size;
 
+   if (pipeq < PIPE_QUERY_TYPES)
+      pool_size += pCreateInfo->queryCount * sizeof(struct pipe_context *);
+
    pool = vk_zalloc2(&device->vk.alloc, pAllocator,
                     pool_size, 8,
                     VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
@@ -88,6 +91,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateQueryPool(
    pool->base_type = pipeq;
    pool->pipeline_stats = pCreateInfo->pipelineStatistics;
    pool->data = &pool->queries;
+   if (pipeq < PIPE_QUERY_TYPES)
+      pool->query_ctx = (struct pipe_context **)&pool->queries[pool->count];
 
    *pQueryPool = lvp_query_pool_to_handle(pool);
    return VK_SUCCESS;
@@ -104,11 +109,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyQueryPool(
    if (!pool)
       return;
 
-   if (pool->base_type < PIPE_QUERY_TYPES) {
-      for (unsigned i = 0; i < pool->count; i++)
-         if (pool->queries[i])
-            device->queue.ctx->destroy_query(device->queue.ctx, pool->queries[i]);
-   }
+   lvp_query_pool_reset(pool, 0, pool->count);
    vk_object_base_finish(&pool->base);
    vk_free2(&device->vk.alloc, pAllocator, pool);
 }
@@ -148,10 +149,11 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetQueryPoolResults(
       }
 
       if (pool->queries[i]) {
-         ready = device->queue.ctx->get_query_result(device->queue.ctx,
-                                                     pool->queries[i],
-                                                     (flags & VK_QUERY_RESULT_WAIT_BIT),
-                                                     &result);
+         struct pipe_context *ctx = pool->query_ctx[i];
+
+         ready = ctx->get_query_result(ctx, pool->queries[i],
+                                       (flags & VK_QUERY_RESULT_WAIT_BIT),
+                                       &result);
       } else {
          result.u64 = 0;
       }
@@ -218,24 +220,31 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetQueryPoolResults(
    return vk_result;
 }
 
+/* Destroy the pipe_queries on the contexts which created them. */
+void
+lvp_query_pool_reset(struct lvp_query_pool *pool,
+                     uint32_t first_query, uint32_t query_count)
+{
+   if (pool->base_type >= PIPE_QUERY_TYPES)
+      return;
+
+   for (uint32_t i = first_query; i < first_query + query_count; i++) {
+      if (pool->queries[i]) {
+         pool->query_ctx[i]->destroy_query(pool->query_ctx[i],
+                                           pool->queries[i]);
+         pool->queries[i] = NULL;
+         pool->query_ctx[i] = NULL;
+      }
+   }
+}
+
 VKAPI_ATTR void VKAPI_CALL lvp_ResetQueryPool(
    VkDevice                                    _device,
    VkQueryPool                                 queryPool,
    uint32_t                                    firstQuery,
    uint32_t                                    queryCount)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
    LVP_FROM_HANDLE(lvp_query_pool, pool, queryPool);
 
-   if (pool->base_type >= PIPE_QUERY_TYPES)
-      return;
-
-   for (uint32_t i = 0; i < queryCount; i++) {
-      uint32_t idx = i + firstQuery;
-
-      if (pool->queries[idx]) {
-         device->queue.ctx->destroy_query(device->queue.ctx, pool->queries[idx]);
-         pool->queries[idx] = NULL;
-      }
-   }
+   lvp_query_pool_reset(pool, firstQuery, queryCount);
 }
@@ -0,0 +1,269 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Checks that lvp_prune_cmd_queue() doesn't change the state seen by any
+ * draw. The same command stream is recorded twice, one copy is pruned, and
+ * both are run through a model of how lvp_execute.c applies pipeline binds
+ * and dynamic state. Each draw snapshots the modelled state, and the
+ * snapshots of both streams must be identical.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lvp_private.h"
+#include "vk_alloc.h"
+
+#define NUM_PIPELINES 3
+#define MAX_DRAWS 32
+
+struct model_state {
+   int pipeline;
+   float viewport[PIPE_MAX_VIEWPORTS];
+   uint32_t viewport_count;
+   float line_width;
+   uint32_t stencil_reference[2];
+};
+
+struct model {
+   struct lvp_pipeline *pipelines;
+   struct model_state state;
+   struct model_state draws[MAX_DRAWS];
+   unsigned num_draws;
+};
+
+static int
+pipeline_index(struct model *model, VkPipeline handle)
+{
+   LVP_FROM_HANDLE(lvp_pipeline, pipeline, handle);
+   return pipeline - model->pipelines;
+}
+
+static bool
+pipeline_dynamic(struct model *model, int index, enum mesa_vk_dynamic_graphics_state state)
+{
+   return BITSET_TEST(model->pipelines[index].graphics_state.dynamic, state);
+}
+
+/* Binding a pipeline applies its static state, marked with negative values
+ * unique to the pipeline, and leaves the dynamic state alone.
+ */
+static void
+model_bind_pipeline(struct model *model, int p)
+{
+   struct model_state *state = &model->state;
+   float marker = -1.0f - p;
+
+   state->pipeline = p;
+
+   if (!pipeline_dynamic(model, p, MESA_VK_DYNAMIC_VP_VIEWPORTS)) {
+      for (unsigned i = 0; i < PIPE_MAX_VIEWPORTS; i++)
+         state->viewport[i] = marker;
+   }
+   if (!pipeline_dynamic(model, p, MESA_VK_DYNAMIC_RS_LINE_WIDTH))
+      state->line_width = marker;
+   if (!pipeline_dynamic(model, p, MESA_VK_DYNAMIC_DS_STENCIL_REFERENCE)) {
+      state->stencil_reference[0] = 1000 + p;
+      state->stencil_reference[1] = 1000 + p;
+   }
+}
+
+static void
+model_execute(struct model *model, struct vk_cmd_queue *queue)
+{
+   memset(&model->state, 0, sizeof(model->state));
+   model->state.pipeline = -1;
+   model->num_draws = 0;
+
+   list_for_each_entry(struct vk_cmd_queue_entry, cmd, &queue->cmds, cmd_link) {
+      struct model_state *state = &model->state;
+
+      switch (cmd->type) {
+      case VK_CMD_BIND_PIPELINE:
+         model_bind_pipeline(model, pipeline_index(model, cmd->u.bind_pipeline.pipeline));
+         break;
+      case VK_CMD_SET_VIEWPORT:
+         for (unsigned i = 0; i < cmd->u.set_viewport.viewport_count; i++)
+            state->viewport[cmd->u.set_viewport.first_viewport + i] =
+               cmd->u.set_viewport.viewports[i].x;
+         break;
+      case VK_CMD_SET_VIEWPORT_WITH_COUNT:
+         state->viewport_count = cmd->u.set_viewport_with_count.viewport_count;
+         for (unsigned i = 0; i < state->viewport_count; i++)
+            state->viewport[i] = cmd->u.set_viewport_with_count.viewports[i].x;
+         break;
+      case VK_CMD_SET_LINE_WIDTH:
+         state->line_width = cmd->u.set_line_width.line_width;
+         break;
+      case VK_CMD_SET_STENCIL_REFERENCE:
+         if (cmd->u.set_stencil_reference.face_mask & VK_STENCIL_FACE_FRONT_BIT)
+            state->stencil_reference[0] = cmd->u.set_stencil_reference.reference;
+         if (cmd->u.set_stencil_reference.face_mask & VK_STENCIL_FACE_BACK_BIT)
+            state->stencil_reference[1] = cmd->u.set_stencil_reference.reference;
+         break;
+      case VK_CMD_DRAW:
+         assert(model->num_draws < MAX_DRAWS);
+         model->draws[model->num_draws++] = *state;
+         break;
+      default:
+         break;
+      }
+   }
+}
+
+static void
+set_viewport(struct vk_cmd_queue *queue, uint32_t first, uint32_t count, float x)
+{
+   VkViewport viewports[PIPE_MAX_VIEWPORTS];
+
+   for (unsigned i = 0; i < count; i++)
+      viewports[i] = (VkViewport) { .x = x + i, .width = 1, .height = 1 };
+
+   vk_enqueue_cmd_set_viewport(queue, first, count, viewports);
+}
+
+static void
+bind(struct vk_cmd_queue *queue, struct lvp_pipeline *pipeline)
+{
+   vk_enqueue_cmd_bind_pipeline(queue, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                lvp_pipeline_to_handle(pipeline));
+}
+
+static void
+draw(struct vk_cmd_queue *queue)
+{
+   vk_enqueue_cmd_draw(queue, 3, 1, 0, 0);
+}
+
+static void
+record(struct vk_cmd_queue *queue, struct lvp_pipeline *p)
+{
+   uint32_t push = 0;
+
+   /* Redundant rebinds around dynamic viewports, push constants and
+    * viewports overwritten before the draw.
+    */
+   bind(queue, &p[0]);
+   set_viewport(queue, 0, 2, 10);
+   draw(queue);
+   bind(queue, &p[0]);
+   set_viewport(queue, 0, 2, 20);
+   vk_enqueue_cmd_push_constants(queue, VK_NULL_HANDLE, VK_SHADER_STAGE_ALL,
+                                 0, sizeof(push), &push);
+   set_viewport(queue, 0, 2, 30);
+   bind(queue, &p[0]);
+   draw(queue);
+
+   /* A partial overwrite keeps the earlier command. */
+   set_viewport(queue, 0, 2, 40);
+   set_viewport(queue, 1, 1, 50);
+   draw(queue);
+
+   /* Line width is static in p[0], setting it makes the rebind restore
+    * the pipeline's value.
+    */
+   vk_enqueue_cmd_set_line_width(queue, 2.0f);
+   draw(queue);
+   bind(queue, &p[0]);
+   draw(queue);
+
+   /* Per face stencil references. */
+   vk_enqueue_cmd_set_stencil_reference(queue, VK_STENCIL_FACE_FRONT_BIT, 1);
+   vk_enqueue_cmd_set_stencil_reference(queue, VK_STENCIL_FACE_BACK_BIT, 2);
+   vk_enqueue_cmd_set_stencil_reference(queue, VK_STENCIL_FACE_FRONT_BIT, 3);
+   draw(queue);
+   vk_enqueue_cmd_set_stencil_reference(queue, VK_STENCIL_FACE_FRONT_AND_BACK, 4);
+   vk_enqueue_cmd_set_stencil_reference(queue, VK_STENCIL_FACE_FRONT_AND_BACK, 5);
+   draw(queue);
+
+   /* Switching pipelines and back: p[1] has static viewports, p[2] leaves
+    * everything dynamic.
+    */
+   bind(queue, &p[1]);
+   draw(queue);
+   bind(queue, &p[0]);
+   draw(queue);
+   bind(queue, &p[2]);
+   bind(queue, &p[2]);
+   set_viewport(queue, 0, 1, 60);
+   bind(queue, &p[1]);
+   bind(queue, &p[2]);
+   draw(queue);
+
+   /* Viewports with count, a smaller count doesn't overwrite. */
+   VkViewport viewports[2] = { { .x = 70, .width = 1, .height = 1 },
+                               { .x = 71, .width = 1, .height = 1 } };
+   vk_enqueue_cmd_set_viewport_with_count(queue, 2, viewports);
+   vk_enqueue_cmd_set_viewport_with_count(queue, 1, viewports);
+   draw(queue);
+   vk_enqueue_cmd_set_viewport_with_count(queue, 2, viewports);
+   viewports[0].x = 80;
+   vk_enqueue_cmd_set_viewport_with_count(queue, 2, viewports);
+   draw(queue);
+}
+
+static unsigned
+count_cmds(struct vk_cmd_queue *queue)
+{
+   return list_length(&queue->cmds);
+}
+
+int
+main(int argc, char **argv)
+{
+   struct lvp_pipeline pipelines[NUM_PIPELINES];
+   struct model reference = { .pipelines = pipelines };
+   struct model pruned = { .pipelines = pipelines };
+   struct vk_cmd_queue queue[2];
+   int ret = 0;
+
+   memset(pipelines, 0, sizeof(pipelines));
+   for (unsigned i = 0; i < NUM_PIPELINES; i++)
+      pipelines[i].base.type = VK_OBJECT_TYPE_PIPELINE;
+   BITSET_SET(pipelines[0].graphics_state.dynamic, MESA_VK_DYNAMIC_VP_VIEWPORTS);
+   BITSET_SET(pipelines[0].graphics_state.dynamic, MESA_VK_DYNAMIC_DS_STENCIL_REFERENCE);
+   BITSET_SET(pipelines[2].graphics_state.dynamic, MESA_VK_DYNAMIC_VP_VIEWPORTS);
+   BITSET_SET(pipelines[2].graphics_state.dynamic, MESA_VK_DYNAMIC_RS_LINE_WIDTH);
+   BITSET_SET(pipelines[2].graphics_state.dynamic, MESA_VK_DYNAMIC_DS_STENCIL_REFERENCE);
+
+   for (unsigned i = 0; i < 2; i++) {
+      queue[i].alloc = vk_default_allocator();
+      list_inithead(&queue[i].cmds);
+      record(&queue[i], pipelines);
+   }
+
+   unsigned num_cmds = count_cmds(&queue[1]);
+   lvp_prune_cmd_queue(&queue[1]);
+   unsigned num_pruned = num_cmds - count_cmds(&queue[1]);
+
+   model_execute(&reference, &queue[0]);
+   model_execute(&pruned, &queue[1]);
+
+   if (reference.num_draws != pruned.num_draws) {
+      fprintf(stderr, "draw count changed: %u -> %u\n",
+              reference.num_draws, pruned.num_draws);
+      ret = 1;
+   }
+
+   for (unsigned i = 0; i < MIN2(reference.num_draws, pruned.num_draws); i++) {
+      if (memcmp(&reference.draws[i], &pruned.draws[i], sizeof(struct model_state))) {
+         fprintf(stderr, "state of draw %u changed by pruning\n", i);
+         ret = 1;
+      }
+   }
+
+   /* Two rebinds of p[0], one of p[2], one viewport, one stencil reference
+    * and one viewport with count.
+    */
+   if (num_pruned != 6) {
+      fprintf(stderr, "pruned %u commands, expected 6\n", num_pruned);
+      ret = 1;
+   }
+
+   for (unsigned i = 0; i < 2; i++)
+      vk_free_queue(&queue[i]);
+
+   return ret;
+}
@@ -0,0 +1,337 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Fragment shading throughput benchmark.
+ *
+ * Draws full screen textured and blended quads with depth testing, and
+ * reports the number of shaded pixels per second. With llvmpipe, this is
+ * run once for each fragment vector width, to compare the 16-wide AVX-512
+ * path (LP_FS_VECTOR_WIDTH=512) against the native AVX2 one.
+ *
+ * Usage: fs-throughput [frames [widths...]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_shader_tokens.h"
+#include "pipe/p_state.h"
+#include "cso_cache/cso_context.h"
+#include "pipe-loader/pipe_loader.h"
+#include "util/box.h"
+#include "util/macros.h"
+#include "util/os_time.h"
+#include "util/u_draw_quad.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_sampler.h"
+#include "util/u_simple_shaders.h"
+
+#define WIDTH 1024
+#define HEIGHT 1024
+#define QUADS_PER_FRAME 8
+#define TEX_SIZE 256
+
+struct program
+{
+   struct pipe_loader_device *dev;
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   struct cso_context *cso;
+
+   struct pipe_blend_state blend;
+   struct pipe_depth_stencil_alpha_state depthstencil;
+   struct pipe_rasterizer_state rasterizer;
+   struct pipe_sampler_state sampler;
+   struct pipe_viewport_state viewport;
+   struct pipe_framebuffer_state framebuffer;
+   struct cso_velems_state velem;
+
+   void *vs;
+   void *fs;
+
+   struct pipe_resource *vbuf;
+   struct pipe_resource *target;
+   struct pipe_resource *zs;
+   struct pipe_resource *tex;
+   struct pipe_sampler_view *view;
+};
+
+static struct pipe_resource *
+create_texture(struct pipe_screen *screen, enum pipe_format format,
+               unsigned width, unsigned height, unsigned bind)
+{
+   struct pipe_resource tmpl;
+
+   memset(&tmpl, 0, sizeof(tmpl));
+   tmpl.target = PIPE_TEXTURE_2D;
+   tmpl.format = format;
+   tmpl.width0 = width;
+   tmpl.height0 = height;
+   tmpl.depth0 = 1;
+   tmpl.array_size = 1;
+   tmpl.bind = bind;
+
+   return screen->resource_create(screen, &tmpl);
+}
+
+static struct pipe_surface *
+create_surface(struct pipe_context *pipe, struct pipe_resource *res)
+{
+   struct pipe_surface tmpl;
+
+   memset(&tmpl, 0, sizeof(tmpl));
+   tmpl.format = res->format;
+
+   return pipe->create_surface(pipe, res, &tmpl);
+}
+
+static bool
+init_prog(struct program *p)
+{
+   if (!pipe_loader_probe(&p->dev, 1, false))
+      return false;
+
+   p->screen = pipe_loader_create_screen(p->dev, false);
+   if (!p->screen)
+      return false;
+
+   p->pipe = p->screen->context_create(p->screen, NULL, 0);
+   p->cso = cso_create_context(p->pipe, 0);
+
+   /* full screen quad, position and texcoord */
+   {
+      float vertices[4][2][4] = {
+         { {  1.0f,  1.0f, 0.5f, 1.0f }, { 1.0f, 1.0f, 0.0f, 1.0f } },
+         { { -1.0f,  1.0f, 0.5f, 1.0f }, { 0.0f, 1.0f, 0.0f, 1.0f } },
+         { { -1.0f, -1.0f, 0.5f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } },
+         { {  1.0f, -1.0f, 0.5f, 1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f } },
+      };
+
+      p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+                                   PIPE_USAGE_DEFAULT, sizeof(vertices));
+      pipe_buffer_write(p->pipe, p->vbuf, 0, sizeof(vertices), vertices);
+   }
+
+   p->target = create_texture(p->screen, PIPE_FORMAT_B8G8R8A8_UNORM,
+                              WIDTH, HEIGHT, PIPE_BIND_RENDER_TARGET);
+   p->zs = create_texture(p->screen, PIPE_FORMAT_Z24_UNORM_S8_UINT,
+                          WIDTH, HEIGHT, PIPE_BIND_DEPTH_STENCIL);
+
+   /* sampler texture, a pattern so that texels differ */
+   {
+      struct pipe_sampler_view v_tmpl;
+      struct pipe_transfer *t;
+      struct pipe_box box;
+
+      p->tex = create_texture(p->screen, PIPE_FORMAT_B8G8R8A8_UNORM,
+                              TEX_SIZE, TEX_SIZE, PIPE_BIND_SAMPLER_VIEW);
+
+      u_box_2d(0, 0, TEX_SIZE, TEX_SIZE, &box);
+      uint8_t *map = p->pipe->texture_map(p->pipe, p->tex, 0, PIPE_MAP_WRITE,
+                                          &box, &t);
+      for (unsigned y = 0; y < TEX_SIZE; y++) {
+         uint32_t *row = (uint32_t *)(map + y * t->stride);
+         for (unsigned x = 0; x < TEX_SIZE; x++)
+            row[x] = 0x80000000 | (x << 16) | (y << 8) | ((x ^ y) & 0xff);
+      }
+      p->pipe->texture_unmap(p->pipe, t);
+
+      u_sampler_view_default_template(&v_tmpl, p->tex, p->tex->format);
+      p->view = p->pipe->create_sampler_view(p->pipe, p->tex, &v_tmpl);
+   }
+
+   /* alpha blending */
+   memset(&p->blend, 0, sizeof(p->blend));
+   p->blend.rt[0].blend_enable = 1;
+   p->blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+   p->blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+   p->blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   p->blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+   p->blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+   p->blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_ZERO;
+   p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+   /* every quad passes the depth test, so that every pixel is shaded */
+   memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+   p->depthstencil.depth_enabled = 1;
+   p->depthstencil.depth_writemask = 1;
+   p->depthstencil.depth_func = PIPE_FUNC_LEQUAL;
+
+   memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+   p->rasterizer.cull_face = PIPE_FACE_NONE;
+   p->rasterizer.half_pixel_center = 1;
+   p->rasterizer.bottom_edge_rule = 1;
+   p->rasterizer.depth_clip_near = 1;
+   p->rasterizer.depth_clip_far = 1;
+
+   memset(&p->sampler, 0, sizeof(p->sampler));
+   p->sampler.wrap_s = PIPE_TEX_WRAP_REPEAT;
+   p->sampler.wrap_t = PIPE_TEX_WRAP_REPEAT;
+   p->sampler.wrap_r = PIPE_TEX_WRAP_REPEAT;
+   p->sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+   p->sampler.min_img_filter = PIPE_TEX_FILTER_LINEAR;
+   p->sampler.mag_img_filter = PIPE_TEX_FILTER_LINEAR;
+
+   memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+   p->framebuffer.width = WIDTH;
+   p->framebuffer.height = HEIGHT;
+   p->framebuffer.nr_cbufs = 1;
+   p->framebuffer.cbufs[0] = create_surface(p->pipe, p->target);
+   p->framebuffer.zsbuf = create_surface(p->pipe, p->zs);
+
+   memset(&p->viewport, 0, sizeof(p->viewport));
+   p->viewport.scale[0] = WIDTH / 2.0f;
+   p->viewport.scale[1] = HEIGHT / 2.0f;
+   p->viewport.scale[2] = 0.5f;
+   p->viewport.translate[0] = WIDTH / 2.0f;
+   p->viewport.translate[1] = HEIGHT / 2.0f;
+   p->viewport.translate[2] = 0.5f;
+   p->viewport.swizzle_x = PIPE_VIEWPORT_SWIZZLE_POSITIVE_X;
+   p->viewport.swizzle_y = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Y;
+   p->viewport.swizzle_z = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Z;
+   p->viewport.swizzle_w = PIPE_VIEWPORT_SWIZZLE_POSITIVE_W;
+
+   memset(&p->velem, 0, sizeof(p->velem));
+   p->velem.count = 2;
+   for (unsigned i = 0; i < 2; i++) {
+      p->velem.velems[i].src_offset = i * 4 * sizeof(float);
+      p->velem.velems[i].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+      p->velem.velems[i].src_stride = 2 * 4 * sizeof(float);
+   }
+
+   {
+      const enum tgsi_semantic semantic_names[] =
+         { TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_GENERIC };
+      const unsigned semantic_indexes[] = { 0, 0 };
+      p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names,
+                                                  semantic_indexes, false);
+   }
+
+   p->fs = util_make_fragment_tex_shader(p->pipe, TGSI_TEXTURE_2D,
+                                         TGSI_RETURN_TYPE_FLOAT,
+                                         TGSI_RETURN_TYPE_FLOAT, false,
+                                         false);
+
+   return true;
+}
+
+static void
+close_prog(struct program *p)
+{
+   if (p->cso) {
+      cso_destroy_context(p->cso);
+
+      p->pipe->delete_vs_state(p->pipe, p->vs);
+      p->pipe->delete_fs_state(p->pipe, p->fs);
+
+      pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+      pipe_surface_reference(&p->framebuffer.zsbuf, NULL);
+      pipe_sampler_view_reference(&p->view, NULL);
+      pipe_resource_reference(&p->target, NULL);
+      pipe_resource_reference(&p->zs, NULL);
+      pipe_resource_reference(&p->tex, NULL);
+      pipe_resource_reference(&p->vbuf, NULL);
+
+      p->pipe->destroy(p->pipe);
+   }
+   if (p->screen)
+      p->screen->destroy(p->screen);
+   if (p->dev)
+      pipe_loader_release(&p->dev, 1);
+
+   FREE(p);
+}
+
+static void
+finish(struct program *p)
+{
+   struct pipe_fence_handle *fence = NULL;
+
+   p->pipe->flush(p->pipe, &fence, 0);
+   p->screen->fence_finish(p->screen, NULL, fence, OS_TIMEOUT_INFINITE);
+   p->screen->fence_reference(p->screen, &fence, NULL);
+}
+
+static void
+draw_frame(struct program *p)
+{
+   const union pipe_color_union clear_color = { .f = { 0.3, 0.1, 0.3, 1.0 } };
+
+   p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR | PIPE_CLEAR_DEPTHSTENCIL, NULL,
+                  &clear_color, 1.0, 0);
+
+   for (unsigned i = 0; i < QUADS_PER_FRAME; i++) {
+      util_draw_vertex_buffer(p->pipe, p->cso, p->vbuf, 0, false,
+                              MESA_PRIM_QUADS,
+                              4,  /* verts */
+                              2); /* attribs/vert */
+   }
+}
+
+static void
+run(struct program *p, unsigned frames, const char *width)
+{
+   const struct pipe_sampler_state *samplers[] = { &p->sampler };
+
+   cso_set_framebuffer(p->cso, &p->framebuffer);
+   cso_set_blend(p->cso, &p->blend);
+   cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+   cso_set_rasterizer(p->cso, &p->rasterizer);
+   cso_set_viewport(p->cso, &p->viewport);
+   cso_set_samplers(p->cso, PIPE_SHADER_FRAGMENT, 1, samplers);
+   p->pipe->set_sampler_views(p->pipe, PIPE_SHADER_FRAGMENT, 0, 1, 0, false,
+                              &p->view);
+   cso_set_fragment_shader_handle(p->cso, p->fs);
+   cso_set_vertex_shader_handle(p->cso, p->vs);
+   cso_set_vertex_elements(p->cso, &p->velem);
+
+   /* compile the shader variants outside of the timed frames */
+   draw_frame(p);
+   finish(p);
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < frames; i++)
+      draw_frame(p);
+   finish(p);
+
+   double elapsed = (os_time_get_nano() - start) / 1000000000.0;
+   double pixels = (double)frames * QUADS_PER_FRAME * WIDTH * HEIGHT;
+
+   printf("%s LP_FS_VECTOR_WIDTH=%s: %8.1f Mpixels/s, %6.1f frames/s\n",
+          p->screen->get_name(p->screen), width,
+          pixels / elapsed / 1000000.0, frames / elapsed);
+   fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned frames = argc > 1 ? atoi(argv[1]) : 100;
+   const char *default_widths[] = { "256", "512" };
+   const char **widths = argc > 2 ? (const char **)&argv[2] : default_widths;
+   unsigned num_widths = argc > 2 ? argc - 2 : ARRAY_SIZE(default_widths);
+   int ret = EXIT_SUCCESS;
+
+   for (unsigned i = 0; i < num_widths; i++) {
+      struct program *p = CALLOC_STRUCT(program);
+
+      /* llvmpipe reads it when creating the screen */
+      setenv("LP_FS_VECTOR_WIDTH", widths[i], 1);
+
+      if (init_prog(p))
+         run(p, frames, widths[i]);
+      else
+         ret = EXIT_FAILURE;
+
+      close_prog(p);
+   }
+
+   return ret;
+}
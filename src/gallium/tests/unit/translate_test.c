@@ -47,6 +47,162 @@ static double rand_double()
 
 char cpu_caps_override_env[128];
 
+static bool
+is_test_format(enum pipe_format format)
+{
+   const struct util_format_description* desc = util_format_description(format);
+
+   return util_format_fetch_rgba_func(format)
+          && util_format_pack_description(format)->pack_rgba_float
+          && desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB
+          && desc->layout == UTIL_FORMAT_LAYOUT_PLAIN
+          && translate_is_output_format_supported(format);
+}
+
+/* Run all entry points of the avx2 translate on vertex counts around its
+ * groups of 8 vertices, and check that it writes exactly what the generic
+ * translate writes. Only float outputs are compared, as the generic
+ * translate truncates to normalized formats instead of rounding.
+ */
+static void
+test_avx2_vs_generic(const unsigned char *byte_buffer,
+                     const float *float_buffer,
+                     const double *double_buffer,
+                     const uint16_t *half_buffer,
+                     unsigned *passed, unsigned *total)
+{
+   static const unsigned counts[] = {1, 7, 8, 9, 17};
+   static const char *entry_points[] = {"run", "run_elts", "run_elts16", "run_elts8"};
+   const unsigned max_count = 17;
+   struct translate_key key;
+   unsigned char *output[2];
+   unsigned elts[17];
+   uint16_t elts16[17];
+   uint8_t elts8[17];
+   unsigned output_format;
+   unsigned input_format;
+   unsigned i, j, k, n;
+
+   for (i = 0; i < 2; ++i)
+      output[i] = align_malloc(4096, 4096);
+
+   memset(&key, 0, sizeof(key));
+   key.nr_elements = 1;
+   key.element[0].type = TRANSLATE_ELEMENT_NORMAL;
+
+   for (output_format = 1; output_format < PIPE_FORMAT_COUNT; ++output_format)
+   {
+      const struct util_format_description* output_format_desc = util_format_description(output_format);
+      unsigned output_format_size;
+
+      if (!is_test_format(output_format)
+          || !util_format_is_float(output_format))
+         continue;
+
+      output_format_size = util_format_get_stride(output_format, 1);
+
+      for (input_format = 1; input_format < PIPE_FORMAT_COUNT; ++input_format)
+      {
+         const struct util_format_description* input_format_desc = util_format_description(input_format);
+         const unsigned char *input;
+         unsigned input_format_size;
+         struct translate* translate[2];
+         unsigned fail = 0;
+
+         if (!is_test_format(input_format))
+            continue;
+
+         input_format_size = util_format_get_stride(input_format, 1);
+
+         key.element[0].input_format = input_format;
+         key.element[0].output_format = output_format;
+         key.output_stride = output_format_size;
+         translate[0] = translate_avx2_create(&key);
+         translate[1] = translate_generic_create(&key);
+         if (!translate[0] || !translate[1])
+         {
+            if (translate[0])
+               translate[0]->release(translate[0]);
+            if (translate[1])
+               translate[1]->release(translate[1]);
+            continue;
+         }
+
+         if (input_format_desc->channel[0].type != UTIL_FORMAT_TYPE_FLOAT)
+            input = byte_buffer;
+         else if (input_format_desc->channel[0].size == 64)
+            input = (const unsigned char*)double_buffer;
+         else if (input_format_desc->channel[0].size == 16)
+            input = (const unsigned char*)half_buffer;
+         else
+            input = (const unsigned char*)float_buffer;
+
+         for (n = 0; n < ARRAY_SIZE(counts) && !fail; ++n)
+         {
+            unsigned count = counts[n];
+
+            /* A permutation of the vertices, as 5 is prime to all counts. */
+            for (i = 0; i < count; ++i)
+            {
+               elts[i] = (i * 5 + 3) % count;
+               elts16[i] = elts[i];
+               elts8[i] = elts[i];
+            }
+
+            for (k = 0; k < ARRAY_SIZE(entry_points) && !fail; ++k)
+            {
+               for (j = 0; j < 2; ++j)
+               {
+                  struct translate *t = translate[j];
+
+                  memset(output[j], 0xcd, (max_count + 1) * output_format_size);
+                  t->set_buffer(t, 0, input, input_format_size, count);
+
+                  switch (k)
+                  {
+                  case 0:
+                     t->run(t, 1, count, 0, 0, output[j]);
+                     break;
+                  case 1:
+                     t->run_elts(t, elts, count, 0, 0, output[j]);
+                     break;
+                  case 2:
+                     t->run_elts16(t, elts16, count, 0, 0, output[j]);
+                     break;
+                  case 3:
+                     t->run_elts8(t, elts8, count, 0, 0, output[j]);
+                     break;
+                  }
+               }
+
+               /* This also checks that nothing is written past the end. */
+               if (memcmp(output[0], output[1], (max_count + 1) * output_format_size))
+               {
+                  fail = 1;
+                  printf("FAIL[AVX2]: %s -> %s, %s of %u vertices\n",
+                         input_format_desc->name, output_format_desc->name,
+                         entry_points[k], count);
+               }
+            }
+         }
+
+         if (!fail)
+         {
+            printf("PASS[AVX2]: %s -> %s\n",
+                   input_format_desc->name, output_format_desc->name);
+            ++*passed;
+         }
+         ++*total;
+
+         translate[1]->release(translate[1]);
+         translate[0]->release(translate[0]);
+      }
+   }
+
+   for (i = 0; i < 2; ++i)
+      align_free(output[i]);
+}
+
 int main(int argc, char** argv)
 {
    struct translate *(*create_fn)(const struct translate_key *key) = 0;
@@ -76,6 +232,8 @@ int main(int argc, char** argv)
       create_fn = translate_generic_create;
    else if (!strcmp(argv[1], "x86"))
       create_fn = translate_sse2_create;
+   else if (!strcmp(argv[1], "avx2"))
+      create_fn = translate_avx2_create;
    else
    {
       const char *translate_options[] = {
@@ -99,7 +257,7 @@ int main(int argc, char** argv)
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [default|generic|x86|nosse|sse|sse2|sse3|ssse3|sse4.1|avx]\n");
+      printf("Usage: ./translate_test [default|generic|x86|avx2|nosse|sse|sse2|sse3|ssse3|sse4.1|avx]\n");
       return 2;
    }
 
@@ -293,6 +451,10 @@ int main(int argc, char** argv)
       }
    }
 
+   if (create_fn == translate_avx2_create)
+      test_avx2_vs_generic(byte_buffer, float_buffer, double_buffer,
+                           half_buffer, &passed, &total);
+
    printf("%u/%u tests passed for translate_%s\n", passed, total, argv[1]);
 
    for (i = 1; i < ARRAY_SIZE(buffer); ++i)
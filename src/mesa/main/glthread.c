@@ -158,6 +158,56 @@ glthread_unmarshal_batch(void *job, void *gdata, int thread_index)
    p_atomic_inc(&ctx->GLThread.stats.num_batches);
 }
 
+/**
+ * The glthread queue job. It executes submitted batches in order until the
+ * ring is empty and then returns, so that submitting a batch while the job
+ * is running doesn't go through the locked job queue of util_queue.
+ */
+static void
+glthread_ring_consume(void *job, void *gdata, int thread_index)
+{
+   struct gl_context *ctx = (struct gl_context*)job;
+   struct glthread_state *glthread = &ctx->GLThread;
+
+   while (true) {
+      while (glthread->ring_tail != p_atomic_read(&glthread->ring_head)) {
+         struct glthread_batch *batch =
+            &glthread->batches[glthread->ring_tail % MARSHAL_MAX_BATCHES];
+
+         glthread_unmarshal_batch(batch, gdata, thread_index);
+         glthread->ring_tail++;
+         util_queue_fence_signal(&batch->fence);
+      }
+
+      /* Clearing ring_active must be ordered before reading ring_head again,
+       * which pairs with glthread_ring_submit. If a batch was submitted in
+       * the meantime, either we take it or the app thread has already
+       * queued a new job for it.
+       */
+      p_atomic_xchg(&glthread->ring_active, 0);
+
+      if (glthread->ring_tail == p_atomic_read(&glthread->ring_head) ||
+          p_atomic_cmpxchg(&glthread->ring_active, 0, 1) != 0)
+         return;
+   }
+}
+
+/* Publish the next batch to the worker and queue the consumer job if it
+ * isn't running. This doesn't take any lock while the job is running.
+ */
+static void
+glthread_ring_submit(struct gl_context *ctx)
+{
+   struct glthread_state *glthread = &ctx->GLThread;
+
+   p_atomic_inc(&glthread->ring_head);
+
+   if (!p_atomic_xchg(&glthread->ring_active, 1)) {
+      util_queue_add_job(&glthread->queue, ctx, NULL,
+                         glthread_ring_consume, NULL, 0);
+   }
+}
+
 static void
 glthread_apply_thread_sched_policy(struct gl_context *ctx, bool initialization)
 {
@@ -218,8 +268,10 @@ _mesa_glthread_init(struct gl_context *ctx)
        !screen->get_param(screen, PIPE_CAP_ALLOW_MAPPED_BUFFERS_DURING_EXECUTION))
       return;
 
-   if (!util_queue_init(&glthread->queue, "gl", MARSHAL_MAX_BATCHES - 2,
-                        1, 0, NULL)) {
+   /* The queue only ever holds the initialization job and one ring
+    * consumer job.
+    */
+   if (!util_queue_init(&glthread->queue, "gl", 2, 1, 0, NULL)) {
       return;
    }
 
@@ -245,6 +297,10 @@ _mesa_glthread_init(struct gl_context *ctx)
    glthread->used = 0;
    glthread->stats.queue = &glthread->queue;
 
+   glthread->ring_head = 0;
+   glthread->ring_tail = 0;
+   glthread->ring_active = 0;
+
    _mesa_glthread_init_call_fence(&glthread->LastProgramChangeBatch);
    _mesa_glthread_init_call_fence(&glthread->LastDListChangeBatchIndex);
 
@@ -373,11 +429,18 @@ _mesa_glthread_flush_batch(struct gl_context *ctx)
 
    struct glthread_batch *next = glthread->next_batch;
 
-   util_queue_add_job(&glthread->queue, next, &next->fence,
-                      glthread_unmarshal_batch, NULL, 0);
+   util_queue_fence_reset(&next->fence);
+   glthread_ring_submit(ctx);
+
    glthread->last = glthread->next;
    glthread->next = (glthread->next + 1) % MARSHAL_MAX_BATCHES;
    glthread->next_batch = &glthread->batches[glthread->next];
+
+   /* The batch about to be filled must have been executed, which the old
+    * job queue ensured by blocking when full. It only waits when the ring is
+    * full, like the job queue did.
+    */
+   util_queue_fence_wait(&glthread->next_batch->fence);
 }
 
 /**
@@ -229,6 +229,15 @@ struct glthread_state
    /** Index of the batch being filled and about to be submitted. */
    unsigned next;
 
+   /**
+    * Single-producer single-consumer ring of submitted batches. The worker
+    * thread executes batches[ring_tail % MARSHAL_MAX_BATCHES] while
+    * ring_tail != ring_head and returns from its queue job otherwise.
+    */
+   uint32_t ring_head;   /**< Number of batches submitted, app thread only. */
+   uint32_t ring_tail;   /**< Number of batches executed, worker only. */
+   uint32_t ring_active; /**< Whether a consumer job is queued or running. */
+
    /** Number of uint64_t elements filled already. */
    unsigned used;
 
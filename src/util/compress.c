@@ -36,8 +36,12 @@
 
 #ifdef HAVE_ZSTD
 #include "zstd.h"
+#include "zdict.h"
 #endif
 
+#include <stdlib.h>
+
+#include "c11/threads.h"
 #include "util/compress.h"
 #include "util/perf/cpu_trace.h"
 #include "macros.h"
@@ -166,4 +170,169 @@ util_compress_inflate(const uint8_t *in_data, size_t in_data_size,
 #endif
 }
 
+struct util_compress_dict {
+#ifdef HAVE_ZSTD
+   ZSTD_CDict *cdict;
+   ZSTD_DDict *ddict;
+
+   /* Contexts reused by all users of the dictionary. Threads that find them
+    * busy use a temporary context instead of waiting.
+    */
+   mtx_t cctx_lock;
+   ZSTD_CCtx *cctx;
+   mtx_t dctx_lock;
+   ZSTD_DCtx *dctx;
+#endif
+};
+
+/**
+ * Create a dictionary from the output of util_compress_dict_train().
+ * Returns NULL if dictionaries aren't supported.
+ */
+struct util_compress_dict *
+util_compress_dict_create(const void *dict_data, size_t dict_size)
+{
+#ifdef HAVE_ZSTD
+   struct util_compress_dict *dict = calloc(1, sizeof(*dict));
+   if (!dict)
+      return NULL;
+
+   mtx_init(&dict->cctx_lock, mtx_plain);
+   mtx_init(&dict->dctx_lock, mtx_plain);
+
+   dict->cdict = ZSTD_createCDict(dict_data, dict_size, ZSTD_COMPRESSION_LEVEL);
+   dict->ddict = ZSTD_createDDict(dict_data, dict_size);
+   dict->cctx = ZSTD_createCCtx();
+   dict->dctx = ZSTD_createDCtx();
+   if (!dict->cdict || !dict->ddict || !dict->cctx || !dict->dctx) {
+      util_compress_dict_destroy(dict);
+      return NULL;
+   }
+
+   return dict;
+#else
+   return NULL;
+#endif
+}
+
+void
+util_compress_dict_destroy(struct util_compress_dict *dict)
+{
+   if (!dict)
+      return;
+
+#ifdef HAVE_ZSTD
+   ZSTD_freeCCtx(dict->cctx);
+   ZSTD_freeDCtx(dict->dctx);
+   ZSTD_freeCDict(dict->cdict);
+   ZSTD_freeDDict(dict->ddict);
+   mtx_destroy(&dict->cctx_lock);
+   mtx_destroy(&dict->dctx_lock);
+#endif
+   free(dict);
+}
+
+/**
+ * Return the ID that zstd stores in every frame compressed with the
+ * dictionary, or 0 if there's no dictionary.
+ */
+unsigned
+util_compress_dict_id(const struct util_compress_dict *dict)
+{
+#ifdef HAVE_ZSTD
+   if (dict)
+      return ZSTD_getDictID_fromCDict(dict->cdict);
+#endif
+   return 0;
+}
+
+/**
+ * Train a dictionary from num_samples samples stored back to back, and
+ * return its size, or 0 on failure.
+ */
+size_t
+util_compress_dict_train(void *dict_data, size_t dict_capacity,
+                         const void *samples, const size_t *sample_sizes,
+                         unsigned num_samples)
+{
+   MESA_TRACE_FUNC();
+#ifdef HAVE_ZSTD
+   size_t ret = ZDICT_trainFromBuffer(dict_data, dict_capacity, samples,
+                                      sample_sizes, num_samples);
+   if (ZDICT_isError(ret))
+      return 0;
+
+   return ret;
+#else
+   return 0;
+#endif
+}
+
+/* Compress data with an optional dictionary and return the size of the
+ * compressed data.
+ */
+size_t
+util_compress_deflate_dict(struct util_compress_dict *dict,
+                           const uint8_t *in_data, size_t in_data_size,
+                           uint8_t *out_data, size_t out_buff_size)
+{
+#ifdef HAVE_ZSTD
+   if (dict) {
+      MESA_TRACE_FUNC();
+      bool locked = mtx_trylock(&dict->cctx_lock) == thrd_success;
+      ZSTD_CCtx *cctx = locked ? dict->cctx : ZSTD_createCCtx();
+      size_t ret = 0;
+
+      if (cctx) {
+         ret = ZSTD_compress_usingCDict(cctx, out_data, out_buff_size,
+                                        in_data, in_data_size, dict->cdict);
+      }
+
+      if (locked)
+         mtx_unlock(&dict->cctx_lock);
+      else
+         ZSTD_freeCCtx(cctx);
+
+      if (!cctx || ZSTD_isError(ret))
+         return 0;
+
+      return ret;
+   }
+#endif
+   return util_compress_deflate(in_data, in_data_size, out_data, out_buff_size);
+}
+
+/**
+ * Decompresses data with an optional dictionary, returns true if
+ * successful. Fails if the data was compressed with a different
+ * dictionary.
+ */
+bool
+util_compress_inflate_dict(struct util_compress_dict *dict,
+                           const uint8_t *in_data, size_t in_data_size,
+                           uint8_t *out_data, size_t out_data_size)
+{
+#ifdef HAVE_ZSTD
+   if (dict) {
+      MESA_TRACE_FUNC();
+      bool locked = mtx_trylock(&dict->dctx_lock) == thrd_success;
+      ZSTD_DCtx *dctx = locked ? dict->dctx : ZSTD_createDCtx();
+      size_t ret = 0;
+
+      if (dctx) {
+         ret = ZSTD_decompress_usingDDict(dctx, out_data, out_data_size,
+                                          in_data, in_data_size, dict->ddict);
+      }
+
+      if (locked)
+         mtx_unlock(&dict->dctx_lock);
+      else
+         ZSTD_freeDCtx(dctx);
+
+      return dctx && !ZSTD_isError(ret);
+   }
+#endif
+   return util_compress_inflate(in_data, in_data_size, out_data, out_data_size);
+}
+
 #endif
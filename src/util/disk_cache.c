@@ -48,6 +48,7 @@
 #include "util/compiler.h"
 
 #include "disk_cache.h"
+#include "disk_cache_mem.h"
 #include "disk_cache_os.h"
 
 /* The cache version should be bumped whenever a change is made to the
@@ -92,6 +93,33 @@ disk_cache_init_queue(struct disk_cache *cache)
                           UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY, NULL);
 }
 
+/* Parse a size given as a number optionally followed by K, M or G, with
+ * gigabytes being assumed if there is no suffix. Returns 0 on error.
+ */
+static uint64_t
+disk_cache_parse_size(const char *str)
+{
+   char *end;
+   uint64_t size = strtoul(str, &end, 10);
+
+   if (end == str)
+      return 0;
+
+   switch (*end) {
+   case 'K':
+   case 'k':
+      return size * 1024;
+   case 'M':
+   case 'm':
+      return size * 1024*1024;
+   case '\0':
+   case 'G':
+   case 'g':
+   default:
+      return size * 1024*1024*1024;
+   }
+}
+
 static struct disk_cache *
 disk_cache_type_create(const char *gpu_name,
                        const char *driver_id,
@@ -175,30 +203,8 @@ disk_cache_type_create(const char *gpu_name,
    }
    #endif
 
-   if (max_size_str) {
-      char *end;
-      max_size = strtoul(max_size_str, &end, 10);
-      if (end == max_size_str) {
-         max_size = 0;
-      } else {
-         switch (*end) {
-         case 'K':
-         case 'k':
-            max_size *= 1024;
-            break;
-         case 'M':
-         case 'm':
-            max_size *= 1024*1024;
-            break;
-         case '\0':
-         case 'G':
-         case 'g':
-         default:
-            max_size *= 1024*1024*1024;
-            break;
-         }
-      }
-   }
+   if (max_size_str)
+      max_size = disk_cache_parse_size(max_size_str);
 
    /* Default to 1GB for maximum cache size. */
    if (max_size == 0) {
@@ -250,6 +256,9 @@ disk_cache_type_create(const char *gpu_name,
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
+   if (!cache->path_init_failed)
+      disk_cache_load_dict(cache);
+
    ralloc_free(local);
 
    return cache;
@@ -305,6 +314,18 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
                                                    DISK_CACHE_SINGLE_FILE);
    }
 
+   /* The in-memory cache is shared by all caches of the process. Keys
+    * include the driver keys blob, so entries of different drivers can't
+    * collide.
+    */
+   if (!cache->path_init_failed) {
+      const char *mem_size_str = getenv("MESA_SHADER_CACHE_MEM_SIZE");
+      uint64_t mem_size = mem_size_str ? disk_cache_parse_size(mem_size_str) : 0;
+
+      if (mem_size)
+         cache->mem_cache = disk_cache_mem_ref(mem_size);
+   }
+
    return cache;
 }
 
@@ -315,6 +336,17 @@ disk_cache_destroy(struct disk_cache *cache)
       printf("disk shader cache:  hits = %u, misses = %u\n",
              cache->stats.hits,
              cache->stats.misses);
+
+      if (cache->mem_cache) {
+         struct disk_cache_mem_stats mem_stats;
+
+         disk_cache_mem_get_stats(cache->mem_cache, &mem_stats);
+         printf("memory shader cache:  hits = %"PRIu64", misses = %"PRIu64
+                ", evictions = %"PRIu64", entries = %"PRIu64
+                ", size = %"PRIu64"\n",
+                mem_stats.hits, mem_stats.misses, mem_stats.evictions,
+                mem_stats.entries, mem_stats.size);
+      }
    }
 
    if (cache && util_queue_is_initialized(&cache->cache_queue)) {
@@ -331,6 +363,21 @@ disk_cache_destroy(struct disk_cache *cache)
          mesa_cache_db_multipart_close(&cache->cache_db);
 
       disk_cache_destroy_mmap(cache);
+
+      if (cache->dict_samples.enabled) {
+         disk_cache_train_dict(cache);
+         util_dynarray_fini(&cache->dict_samples.data);
+         util_dynarray_fini(&cache->dict_samples.sizes);
+         simple_mtx_destroy(&cache->dict_samples.mtx);
+      }
+
+      util_compress_dict_destroy(cache->compress_dict);
+   }
+
+   /* Queued jobs read the memory cache, so it goes after the queue. */
+   if (cache) {
+      disk_cache_mem_unref(cache->mem_cache);
+      cache->mem_cache = NULL;
    }
 
    ralloc_free(cache);
@@ -345,6 +392,9 @@ disk_cache_wait_for_idle(struct disk_cache *cache)
 void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
+   if (cache->mem_cache)
+      disk_cache_mem_remove(cache->mem_cache, key);
+
    if (cache->type == DISK_CACHE_DATABASE) {
       mesa_cache_db_multipart_entry_remove(&cache->cache_db, key);
       return;
@@ -439,6 +489,9 @@ cache_put(void *job, void *gdata, int thread_index)
    char *filename = NULL;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+   if (dc_job->cache->dict_samples.enabled)
+      disk_cache_add_dict_sample(dc_job->cache, dc_job->data, dc_job->size);
+
    if (dc_job->cache->blob_put_cb) {
       blob_put_compressed(dc_job->cache, dc_job->key, dc_job->data, dc_job->size);
    } else if (dc_job->cache->type == DISK_CACHE_SINGLE_FILE) {
@@ -483,7 +536,8 @@ blob_put_compressed(struct disk_cache *cache, const cache_key key,
    entry->uncompressed_size = size;
 
    size_t compressed_size =
-         util_compress_deflate(data, size, entry->compressed_data, max_buf);
+         util_compress_deflate_dict(cache->compress_dict, data, size,
+                                    entry->compressed_data, max_buf);
    if (!compressed_size)
       goto out;
 
@@ -531,8 +585,9 @@ blob_get_compressed(struct disk_cache *cache, const cache_key key,
    }
 
    unsigned compressed_size = entry_size - sizeof(*entry);
-   bool ret = util_compress_inflate(entry->compressed_data, compressed_size,
-                                    data, entry->uncompressed_size);
+   bool ret = util_compress_inflate_dict(cache->compress_dict,
+                                         entry->compressed_data, compressed_size,
+                                         data, entry->uncompressed_size);
    if (!ret) {
       free(data);
       free(entry);
@@ -555,6 +610,9 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    if (!util_queue_is_initialized(&cache->cache_queue))
       return;
 
+   if (cache->mem_cache)
+      disk_cache_mem_put(cache->mem_cache, key, data, size);
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, (void*)data, size, cache_item_metadata, false);
 
@@ -575,6 +633,9 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
       return;
    }
 
+   if (cache->mem_cache)
+      disk_cache_mem_put(cache->mem_cache, key, data, size);
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, data, size, cache_item_metadata, true);
 
@@ -593,6 +654,12 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    if (size)
       *size = 0;
 
+   if (cache->mem_cache) {
+      buf = disk_cache_mem_get(cache->mem_cache, key, size);
+      if (buf)
+         goto out;
+   }
+
    if (cache->foz_ro_cache)
       buf = disk_cache_load_item_foz(cache->foz_ro_cache, key, size);
 
@@ -610,6 +677,10 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       }
    }
 
+   if (buf && size && cache->mem_cache)
+      disk_cache_mem_put(cache->mem_cache, key, buf, *size);
+
+out:
    if (unlikely(cache->stats.enabled)) {
       if (buf)
          p_atomic_inc(&cache->stats.hits);
@@ -620,6 +691,144 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return buf;
 }
 
+struct disk_cache_get_job {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   cache_key key;
+
+   /* Loaded item, owned by the job until claimed. */
+   void *data;
+   size_t size;
+};
+
+struct disk_cache_batch {
+   unsigned num_jobs;
+   struct disk_cache_get_job jobs[];
+};
+
+static void
+cache_get(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_get_job *dc_job = (struct disk_cache_get_job *) job;
+
+   dc_job->data = disk_cache_get(dc_job->cache, dc_job->key, &dc_job->size);
+}
+
+struct disk_cache_batch *
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys)
+{
+   struct disk_cache_batch *batch = (struct disk_cache_batch *)
+      calloc(1, sizeof(*batch) + num_keys * sizeof(batch->jobs[0]));
+
+   if (!batch)
+      return NULL;
+
+   batch->num_jobs = num_keys;
+
+   for (unsigned i = 0; i < num_keys; i++) {
+      struct disk_cache_get_job *dc_job = &batch->jobs[i];
+
+      dc_job->cache = cache;
+      memcpy(dc_job->key, keys[i], sizeof(cache_key));
+      util_queue_fence_init(&dc_job->fence);
+
+      /* Without a queue there's nothing to load from, leave the job
+       * signalled and empty.
+       */
+      if (util_queue_is_initialized(&cache->cache_queue)) {
+         util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
+                            cache_get, NULL, 0);
+      }
+   }
+
+   return batch;
+}
+
+bool
+disk_cache_batch_is_ready(struct disk_cache_batch *batch, unsigned index)
+{
+   assert(index < batch->num_jobs);
+
+   return util_queue_fence_is_signalled(&batch->jobs[index].fence);
+}
+
+void *
+disk_cache_batch_get(struct disk_cache_batch *batch, unsigned index,
+                     size_t *size)
+{
+   struct disk_cache_get_job *dc_job = &batch->jobs[index];
+
+   assert(index < batch->num_jobs);
+
+   util_queue_fence_wait(&dc_job->fence);
+
+   void *data = dc_job->data;
+   if (size)
+      *size = data ? dc_job->size : 0;
+
+   dc_job->data = NULL;
+
+   return data;
+}
+
+void
+disk_cache_batch_destroy(struct disk_cache_batch *batch)
+{
+   if (!batch)
+      return;
+
+   for (unsigned i = 0; i < batch->num_jobs; i++) {
+      util_queue_fence_wait(&batch->jobs[i].fence);
+      util_queue_fence_destroy(&batch->jobs[i].fence);
+      free(batch->jobs[i].data);
+   }
+
+   free(batch);
+}
+
+static void
+cache_prefetch(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_get_job *dc_job = (struct disk_cache_get_job *) job;
+
+   /* disk_cache_get() leaves a copy in the in-memory cache. */
+   free(disk_cache_get(dc_job->cache, dc_job->key, &dc_job->size));
+}
+
+static void
+destroy_get_job(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_get_job *dc_job = (struct disk_cache_get_job *) job;
+
+   util_queue_fence_destroy(&dc_job->fence);
+   free(job);
+}
+
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   if (!cache->mem_cache || !util_queue_is_initialized(&cache->cache_queue))
+      return;
+
+   for (unsigned i = 0; i < num_keys; i++) {
+      struct disk_cache_get_job *dc_job = (struct disk_cache_get_job *)
+         calloc(1, sizeof(*dc_job));
+
+      if (!dc_job)
+         return;
+
+      dc_job->cache = cache;
+      memcpy(dc_job->key, keys[i], sizeof(cache_key));
+      util_queue_fence_init(&dc_job->fence);
+      util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
+                         cache_prefetch, destroy_get_job, 0);
+   }
+}
+
 void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -78,6 +78,7 @@ struct cache_item_metadata {
 };
 
 struct disk_cache;
+struct disk_cache_batch;
 
 #ifdef HAVE_DLADDR
 static inline bool
@@ -229,6 +230,53 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Start retrieving the items stored under the \num_keys names in \keys.
+ *
+ * The lookups, including reading and decompressing the items, run in
+ * parallel on the cache's thread queue. Each item can be claimed with
+ * disk_cache_batch_get() as soon as it has been loaded, in any order.
+ *
+ * \return A batch that must be destroyed with disk_cache_batch_destroy(),
+ * or NULL on allocation failure, in which case the caller should fall back
+ * to disk_cache_get().
+ */
+struct disk_cache_batch *
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys);
+
+/**
+ * Return whether the item \index of \batch has finished loading.
+ */
+bool
+disk_cache_batch_is_ready(struct disk_cache_batch *batch, unsigned index);
+
+/**
+ * Wait for the item \index of \batch and take ownership of it.
+ *
+ * Same semantics as disk_cache_get() otherwise. Each item can only be
+ * claimed once, later calls return NULL.
+ */
+void *
+disk_cache_batch_get(struct disk_cache_batch *batch, unsigned index,
+                     size_t *size);
+
+/**
+ * Wait for all pending lookups of \batch and free it, along with any item
+ * that hasn't been claimed.
+ */
+void
+disk_cache_batch_destroy(struct disk_cache_batch *batch);
+
+/**
+ * Load the items stored under the \num_keys names in \keys in the
+ * background, so that later lookups find them in the in-memory cache.
+ * Does nothing unless the in-memory cache is enabled.
+ */
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -304,6 +352,37 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline struct disk_cache_batch *
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys)
+{
+   return NULL;
+}
+
+static inline bool
+disk_cache_batch_is_ready(struct disk_cache_batch *batch, unsigned index)
+{
+   return true;
+}
+
+static inline void *
+disk_cache_batch_get(struct disk_cache_batch *batch, unsigned index,
+                     size_t *size)
+{
+   return NULL;
+}
+
+static inline void
+disk_cache_batch_destroy(struct disk_cache_batch *batch)
+{
+}
+
+static inline void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -0,0 +1,293 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/disk_cache_mem.h"
+#include "util/hash_table.h"
+#include "util/list.h"
+#include "util/macros.h"
+#include "util/simple_mtx.h"
+#include "util/u_atomic.h"
+
+#define DISK_CACHE_MEM_NUM_SHARDS 32
+
+struct disk_cache_mem_entry {
+   struct list_head link;
+   int32_t refcount;
+   cache_key key;
+   size_t size;
+   uint8_t data[];
+};
+
+struct disk_cache_mem_shard {
+   simple_mtx_t mtx;
+   struct hash_table *entries;
+
+   /* Most recently used entries first. */
+   struct list_head lru;
+
+   uint64_t size;
+   uint64_t max_size;
+};
+
+struct disk_cache_mem {
+   struct disk_cache_mem_shard shards[DISK_CACHE_MEM_NUM_SHARDS];
+
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+};
+
+static simple_mtx_t global_mtx = SIMPLE_MTX_INITIALIZER;
+static struct disk_cache_mem *global_mem;
+static unsigned global_refcount;
+
+/* Cache keys are SHA-1 hashes, so any of their bytes are good hash values.
+ * The first word selects the shard, the second one the hash table bucket.
+ */
+static uint32_t
+key_word(const uint8_t *key, unsigned index)
+{
+   uint32_t word;
+   memcpy(&word, key + index * sizeof(word), sizeof(word));
+   return word;
+}
+
+static uint32_t
+key_hash(const void *key)
+{
+   return key_word(key, 1);
+}
+
+static bool
+key_equals(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+static struct disk_cache_mem_shard *
+get_shard(struct disk_cache_mem *mem, const cache_key key)
+{
+   return &mem->shards[key_word(key, 0) % DISK_CACHE_MEM_NUM_SHARDS];
+}
+
+static void
+entry_unref(struct disk_cache_mem_entry *entry)
+{
+   if (p_atomic_dec_zero(&entry->refcount))
+      free(entry);
+}
+
+/* Must be called with the shard lock held. */
+static void
+shard_remove_entry(struct disk_cache_mem_shard *shard,
+                   struct disk_cache_mem_entry *entry)
+{
+   _mesa_hash_table_remove_key(shard->entries, entry->key);
+   list_del(&entry->link);
+   shard->size -= entry->size;
+   entry_unref(entry);
+}
+
+struct disk_cache_mem *
+disk_cache_mem_create(uint64_t max_size)
+{
+   struct disk_cache_mem *mem = calloc(1, sizeof(*mem));
+   if (!mem)
+      return NULL;
+
+   for (unsigned i = 0; i < DISK_CACHE_MEM_NUM_SHARDS; i++) {
+      struct disk_cache_mem_shard *shard = &mem->shards[i];
+
+      shard->entries = _mesa_hash_table_create(NULL, key_hash, key_equals);
+      if (!shard->entries) {
+         disk_cache_mem_destroy(mem);
+         return NULL;
+      }
+
+      simple_mtx_init(&shard->mtx, mtx_plain);
+      list_inithead(&shard->lru);
+      shard->max_size = max_size / DISK_CACHE_MEM_NUM_SHARDS;
+   }
+
+   return mem;
+}
+
+void
+disk_cache_mem_destroy(struct disk_cache_mem *mem)
+{
+   if (!mem)
+      return;
+
+   for (unsigned i = 0; i < DISK_CACHE_MEM_NUM_SHARDS; i++) {
+      struct disk_cache_mem_shard *shard = &mem->shards[i];
+
+      if (!shard->entries)
+         break;
+
+      list_for_each_entry_safe(struct disk_cache_mem_entry, entry,
+                               &shard->lru, link)
+         entry_unref(entry);
+
+      _mesa_hash_table_destroy(shard->entries, NULL);
+      simple_mtx_destroy(&shard->mtx);
+   }
+
+   free(mem);
+}
+
+struct disk_cache_mem *
+disk_cache_mem_ref(uint64_t max_size)
+{
+   struct disk_cache_mem *mem;
+
+   simple_mtx_lock(&global_mtx);
+
+   if (!global_mem && max_size)
+      global_mem = disk_cache_mem_create(max_size);
+
+   mem = global_mem;
+   if (mem)
+      global_refcount++;
+
+   simple_mtx_unlock(&global_mtx);
+
+   return mem;
+}
+
+void
+disk_cache_mem_unref(struct disk_cache_mem *mem)
+{
+   if (!mem)
+      return;
+
+   simple_mtx_lock(&global_mtx);
+
+   assert(mem == global_mem && global_refcount > 0);
+   if (--global_refcount == 0) {
+      disk_cache_mem_destroy(global_mem);
+      global_mem = NULL;
+   }
+
+   simple_mtx_unlock(&global_mtx);
+}
+
+void *
+disk_cache_mem_get(struct disk_cache_mem *mem, const cache_key key,
+                   size_t *size)
+{
+   struct disk_cache_mem_shard *shard = get_shard(mem, key);
+   struct disk_cache_mem_entry *entry = NULL;
+
+   simple_mtx_lock(&shard->mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(shard->entries, key);
+   if (he) {
+      entry = he->data;
+      list_move_to(&entry->link, &shard->lru);
+      p_atomic_inc(&entry->refcount);
+   }
+
+   simple_mtx_unlock(&shard->mtx);
+
+   if (!entry) {
+      p_atomic_inc(&mem->misses);
+      return NULL;
+   }
+
+   /* The reference keeps the entry alive even if it's evicted meanwhile. */
+   void *data = malloc(entry->size);
+   if (data) {
+      memcpy(data, entry->data, entry->size);
+      if (size)
+         *size = entry->size;
+      p_atomic_inc(&mem->hits);
+   } else {
+      p_atomic_inc(&mem->misses);
+   }
+
+   entry_unref(entry);
+
+   return data;
+}
+
+void
+disk_cache_mem_put(struct disk_cache_mem *mem, const cache_key key,
+                   const void *data, size_t size)
+{
+   struct disk_cache_mem_shard *shard = get_shard(mem, key);
+
+   /* Don't keep returning an older item stored under this key. */
+   if (size > shard->max_size) {
+      disk_cache_mem_remove(mem, key);
+      return;
+   }
+
+   struct disk_cache_mem_entry *entry = malloc(sizeof(*entry) + size);
+   if (!entry) {
+      disk_cache_mem_remove(mem, key);
+      return;
+   }
+
+   entry->refcount = 1;
+   memcpy(entry->key, key, CACHE_KEY_SIZE);
+   entry->size = size;
+   memcpy(entry->data, data, size);
+
+   simple_mtx_lock(&shard->mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(shard->entries, key);
+   if (he)
+      shard_remove_entry(shard, he->data);
+
+   while (shard->size + size > shard->max_size) {
+      struct disk_cache_mem_entry *lru =
+         list_last_entry(&shard->lru, struct disk_cache_mem_entry, link);
+
+      shard_remove_entry(shard, lru);
+      p_atomic_inc(&mem->evictions);
+   }
+
+   _mesa_hash_table_insert(shard->entries, entry->key, entry);
+   list_add(&entry->link, &shard->lru);
+   shard->size += size;
+
+   simple_mtx_unlock(&shard->mtx);
+}
+
+void
+disk_cache_mem_remove(struct disk_cache_mem *mem, const cache_key key)
+{
+   struct disk_cache_mem_shard *shard = get_shard(mem, key);
+
+   simple_mtx_lock(&shard->mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(shard->entries, key);
+   if (he)
+      shard_remove_entry(shard, he->data);
+
+   simple_mtx_unlock(&shard->mtx);
+}
+
+void
+disk_cache_mem_get_stats(struct disk_cache_mem *mem,
+                         struct disk_cache_mem_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+
+   stats->hits = p_atomic_read(&mem->hits);
+   stats->misses = p_atomic_read(&mem->misses);
+   stats->evictions = p_atomic_read(&mem->evictions);
+
+   for (unsigned i = 0; i < DISK_CACHE_MEM_NUM_SHARDS; i++) {
+      struct disk_cache_mem_shard *shard = &mem->shards[i];
+
+      simple_mtx_lock(&shard->mtx);
+      stats->entries += _mesa_hash_table_num_entries(shard->entries);
+      stats->size += shard->size;
+      simple_mtx_unlock(&shard->mtx);
+   }
+}
@@ -0,0 +1,77 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Process-wide in-memory cache sitting in front of the on-disk shader cache
+ * backends.
+ *
+ * Entries are spread over independently locked shards by key, each shard
+ * keeping its own LRU list and a slice of the total size budget. Lookups
+ * only hold the shard lock long enough to find and reference an entry; the
+ * copy handed back to the caller is made outside of it.
+ */
+
+#ifndef DISK_CACHE_MEM_H
+#define DISK_CACHE_MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/disk_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct disk_cache_mem;
+
+struct disk_cache_mem_stats {
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+   uint64_t entries;
+   uint64_t size;
+};
+
+struct disk_cache_mem *
+disk_cache_mem_create(uint64_t max_size);
+
+void
+disk_cache_mem_destroy(struct disk_cache_mem *mem);
+
+/**
+ * Return a reference to the process-wide memory cache, creating it with
+ * max_size bytes if it doesn't exist yet. Returns NULL if max_size is 0
+ * and no memory cache exists.
+ */
+struct disk_cache_mem *
+disk_cache_mem_ref(uint64_t max_size);
+
+void
+disk_cache_mem_unref(struct disk_cache_mem *mem);
+
+/**
+ * Look up key and return a malloc'ed copy of the cached data, or NULL.
+ */
+void *
+disk_cache_mem_get(struct disk_cache_mem *mem, const cache_key key,
+                   size_t *size);
+
+void
+disk_cache_mem_put(struct disk_cache_mem *mem, const cache_key key,
+                   const void *data, size_t size);
+
+void
+disk_cache_mem_remove(struct disk_cache_mem *mem, const cache_key key);
+
+void
+disk_cache_mem_get_stats(struct disk_cache_mem *mem,
+                         struct disk_cache_mem_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_MEM_H */
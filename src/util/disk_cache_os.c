@@ -100,6 +100,7 @@ disk_cache_get_function_identifier(void *ptr, struct mesa_sha1 *ctx)
 
 #include "util/blob.h"
 #include "util/crc32.h"
+#include "util/os_file.h"
 #include "util/u_debug.h"
 #include "util/ralloc.h"
 #include "util/rand_xor.h"
@@ -606,8 +607,9 @@ parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
 
       memcpy(uncompressed_data, data, cache_data_size);
    } else {
-      if (!util_compress_inflate(data, cache_data_size, uncompressed_data,
-                                 cf_data->uncompressed_size))
+      if (!util_compress_inflate_dict(cache->compress_dict,
+                                      data, cache_data_size, uncompressed_data,
+                                      cf_data->uncompressed_size))
          goto fail;
    }
 
@@ -647,8 +649,17 @@ disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size)
 
     uint8_t *uncompressed_data =
        parse_and_validate_cache_item(cache, data, sb.st_size, size);
-   if (!uncompressed_data)
+   if (!uncompressed_data) {
+      /* Writers skip keys whose file exists, so items that fail to
+       * decompress, typically because they were compressed with a previous
+       * dictionary, would never get replaced.
+       */
+      close(fd);
+      fd = -1;
+      disk_cache_evict_item(cache, filename);
+      filename = NULL;
       goto fail;
+   }
 
    free(data);
    free(filename);
@@ -706,8 +717,9 @@ create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
       if (compressed_data == NULL)
          return false;
       compressed_size =
-         util_compress_deflate(dc_job->data, dc_job->size,
-                              compressed_data, max_buf);
+         util_compress_deflate_dict(dc_job->cache->compress_dict,
+                                    dc_job->data, dc_job->size,
+                                    compressed_data, max_buf);
       if (compressed_size == 0)
          goto fail;
    }
@@ -1011,12 +1023,41 @@ disk_cache_enabled()
    return true;
 }
 
+/* Fossilize DBs are append only, so entries compressed with a dictionary
+ * can't be replaced when the dictionary changes. Instead, they are stored
+ * under a key derived from the key and the dictionary ID, and entries of
+ * older dictionaries are never looked up again. Entries compressed without
+ * a dictionary keep their key since any dictionary can decompress them.
+ */
+static bool
+disk_cache_get_foz_key(struct disk_cache *cache, const cache_key key,
+                       cache_key foz_key)
+{
+   uint32_t dict_id = util_compress_dict_id(cache->compress_dict);
+   struct mesa_sha1 ctx;
+
+   if (!dict_id)
+      return false;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, key, CACHE_KEY_SIZE);
+   _mesa_sha1_update(&ctx, &dict_id, sizeof(dict_id));
+   _mesa_sha1_final(&ctx, foz_key);
+   return true;
+}
+
 void *
 disk_cache_load_item_foz(struct disk_cache *cache, const cache_key key,
                          size_t *size)
 {
    size_t cache_tem_size = 0;
-   void *cache_item = foz_read_entry(&cache->foz_db, key, &cache_tem_size);
+   void *cache_item = NULL;
+   cache_key foz_key;
+
+   if (disk_cache_get_foz_key(cache, key, foz_key))
+      cache_item = foz_read_entry(&cache->foz_db, foz_key, &cache_tem_size);
+   if (!cache_item)
+      cache_item = foz_read_entry(&cache->foz_db, key, &cache_tem_size);
    if (!cache_item)
       return NULL;
 
@@ -1036,7 +1077,12 @@ disk_cache_write_item_to_disk_foz(struct disk_cache_put_job *dc_job)
    if (!create_cache_item_header_and_blob(dc_job, &cache_blob))
       return false;
 
-   bool r = foz_write_entry(&dc_job->cache->foz_db, dc_job->key,
+   cache_key foz_key;
+   const uint8_t *key = dc_job->key;
+   if (disk_cache_get_foz_key(dc_job->cache, dc_job->key, foz_key))
+      key = foz_key;
+
+   bool r = foz_write_entry(&dc_job->cache->foz_db, key,
                             cache_blob.data, cache_blob.size);
 
    blob_finish(&cache_blob);
@@ -1163,6 +1209,12 @@ disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
        parse_and_validate_cache_item(cache, cache_item, cache_tem_size, size);
    free(cache_item);
 
+   /* Entries that fail to decompress, typically because they were
+    * compressed with a previous dictionary, would never get replaced.
+    */
+   if (!uncompressed_data)
+      mesa_cache_db_multipart_entry_remove(&cache->cache_db, key);
+
    return uncompressed_data;
 }
 
@@ -1250,6 +1302,125 @@ disk_cache_delete_old_cache(void)
 finish:
    ralloc_free(ctx);
 }
+
+/* Dictionaries are trained from at most this much sample data. */
+#define DICT_SAMPLES_MAX_SIZE (16 * 1024 * 1024)
+
+/* Training needs a reasonable number of samples to be useful at all. */
+#define DICT_SAMPLES_MIN_COUNT 64
+
+/* The recommended size of zstd dictionaries. */
+#define DICT_MAX_SIZE (112 * 1024)
+
+/* Every driver gets its own dictionary next to the cache files, named
+ * after the driver keys so that different Mesa builds don't share it.
+ */
+static char *
+disk_cache_get_dict_filename(void *mem_ctx, struct disk_cache *cache)
+{
+   unsigned char sha1[20];
+   char buf[41];
+
+   _mesa_sha1_compute(cache->driver_keys_blob, cache->driver_keys_blob_size,
+                      sha1);
+   _mesa_sha1_format(buf, sha1);
+
+   return ralloc_asprintf(mem_ctx, "%s/%s.zdict", cache->path, buf);
+}
+
+void
+disk_cache_load_dict(struct disk_cache *cache)
+{
+   void *ctx = ralloc_context(NULL);
+   size_t size;
+
+   if (cache->compression_disabled)
+      goto finish;
+
+   cache->dict_samples.enabled =
+      debug_get_bool_option("MESA_SHADER_CACHE_DICT_TRAIN", false);
+   if (cache->dict_samples.enabled) {
+      simple_mtx_init(&cache->dict_samples.mtx, mtx_plain);
+      util_dynarray_init(&cache->dict_samples.data, NULL);
+      util_dynarray_init(&cache->dict_samples.sizes, NULL);
+   }
+
+   char *filename = disk_cache_get_dict_filename(ctx, cache);
+   char *dict = os_read_file(filename, &size);
+   if (!dict)
+      goto finish;
+
+   cache->compress_dict = util_compress_dict_create(dict, size);
+   free(dict);
+
+finish:
+   ralloc_free(ctx);
+}
+
+void
+disk_cache_add_dict_sample(struct disk_cache *cache, const void *data,
+                           size_t size)
+{
+   simple_mtx_lock(&cache->dict_samples.mtx);
+
+   if (cache->dict_samples.data.size + size <= DICT_SAMPLES_MAX_SIZE) {
+      void *sample = util_dynarray_grow_bytes(&cache->dict_samples.data,
+                                              1, size);
+      if (sample) {
+         memcpy(sample, data, size);
+         util_dynarray_append(&cache->dict_samples.sizes, size_t, size);
+      }
+   }
+
+   simple_mtx_unlock(&cache->dict_samples.mtx);
+}
+
+/* Train a new dictionary from the collected samples and replace the
+ * current one on disk. Items compressed with the previous dictionary can't
+ * be decompressed anymore. The multi file and Mesa-DB caches remove them
+ * when they fail to load so that they get written again, and the single
+ * file cache stores items under a key that depends on the dictionary.
+ */
+void
+disk_cache_train_dict(struct disk_cache *cache)
+{
+   void *ctx = ralloc_context(NULL);
+   unsigned num_samples =
+      util_dynarray_num_elements(&cache->dict_samples.sizes, size_t);
+   void *dict = NULL;
+
+   if (num_samples < DICT_SAMPLES_MIN_COUNT)
+      goto finish;
+
+   dict = malloc(DICT_MAX_SIZE);
+   if (!dict)
+      goto finish;
+
+   size_t dict_size =
+      util_compress_dict_train(dict, DICT_MAX_SIZE,
+                               cache->dict_samples.data.data,
+                               cache->dict_samples.sizes.data, num_samples);
+   if (!dict_size)
+      goto finish;
+
+   /* Write to a temporary file and rename it, so that other processes
+    * never see a partial dictionary.
+    */
+   char *filename = disk_cache_get_dict_filename(ctx, cache);
+   char *tmp_filename = ralloc_asprintf(ctx, "%s.%d", filename, getpid());
+
+   FILE *file = fopen(tmp_filename, "wb");
+   if (!file)
+      goto finish;
+
+   bool written = fwrite(dict, 1, dict_size, file) == dict_size;
+   if (fclose(file) || !written || rename(tmp_filename, filename))
+      unlink(tmp_filename);
+
+finish:
+   free(dict);
+   ralloc_free(ctx);
+}
 #endif
 
 #endif /* ENABLE_SHADER_CACHE */
@@ -24,6 +24,7 @@
 #ifndef DISK_CACHE_OS_H
 #define DISK_CACHE_OS_H
 
+#include "util/u_dynarray.h"
 #include "util/u_queue.h"
 
 #if DETECT_OS_WINDOWS
@@ -104,6 +105,20 @@ struct disk_cache {
 
    /* Internal RO FOZ cache for combined use of RO and RW caches. */
    struct disk_cache *foz_ro_cache;
+
+   /* Process-wide in-memory cache in front of the backends, if enabled. */
+   struct disk_cache_mem *mem_cache;
+
+   /* Compression dictionary trained for this driver, if any. */
+   struct util_compress_dict *compress_dict;
+
+   /* Uncompressed items collected to train a new dictionary. */
+   struct {
+      bool enabled;
+      simple_mtx_t mtx;
+      struct util_dynarray data;
+      struct util_dynarray sizes;
+   } dict_samples;
 };
 
 struct cache_entry_file_data {
@@ -184,6 +199,16 @@ disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache);
 void
 disk_cache_delete_old_cache(void);
 
+void
+disk_cache_load_dict(struct disk_cache *cache);
+
+void
+disk_cache_add_dict_sample(struct disk_cache *cache, const void *data,
+                           size_t size);
+
+void
+disk_cache_train_dict(struct disk_cache *cache);
+
 #ifdef __cplusplus
 }
 #endif
@@ -36,7 +36,9 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -45,6 +47,8 @@
 #include <sys/inotify.h>
 #endif
 
+#include "util/bitscan.h"
+#include "util/u_atomic.h"
 #include "util/u_debug.h"
 
 #include "crc32.h"
@@ -61,6 +65,38 @@ static const uint8_t stream_reference_magic_and_version[FOZ_REF_MAGIC_SIZE] = {
    0, 0, 0, FOSSILIZE_FORMAT_VERSION, /* 4 bytes to use for versioning. */
 };
 
+/* Hash string + payload header + offset of an entry in a foz db idx. */
+#define FOZ_IDX_ENTRY_SIZE (FOSSILIZE_BLOB_HASH_LENGTH + \
+                            sizeof(struct foz_payload_header) + \
+                            sizeof(uint64_t))
+
+#define FOZ_HASH_VERSION 1
+#define FOZ_HASH_MIN_LOG2_CAPACITY 12
+#define FOZ_HASH_MAX_LOG2_CAPACITY 32
+
+static const char foz_hash_magic[8] = {
+   'M', 'E', 'S', 'A', 'F', 'O', 'Z', 'H',
+};
+
+/* Header of the hash table file of a writable shard. Only the process
+ * allowed to append to the shard writes it; other processes map it read
+ * only and verify every hit against the key stored in the foz db, so a
+ * racy read can only turn into a miss.
+ */
+struct foz_hash_header {
+   char magic[8];
+   uint32_t version;
+   uint32_t log2_capacity;
+   uint64_t idx_size;        /* Bytes of the idx covered by the table */
+   uint64_t num_entries;
+   uint8_t last_entry[FOZ_IDX_ENTRY_SIZE]; /* Idx entry ending at idx_size */
+};
+
+struct foz_hash_slot {
+   uint64_t hash;            /* 0 for empty slots */
+   uint64_t offset;
+};
+
 /* Mesa uses 160bit hashes to identify cache entries, a hash of this size
  * makes collisions virtually impossible for our use case. However the foz db
  * format uses a 64bit hash table to lookup file offsets for reading cache
@@ -78,6 +114,16 @@ truncate_hash_to_64bits(const uint8_t *cache_key)
    return hash;
 }
 
+static uint64_t
+hash_str_to_64bits(const char *hash_str)
+{
+   char str[17];
+
+   memcpy(str, hash_str, 16);
+   str[16] = '\0';
+   return strtoull(str, NULL, 16);
+}
+
 static bool
 check_files_opened_successfully(FILE *file, FILE *db_idx)
 {
@@ -114,6 +160,25 @@ create_foz_db_filenames(const char *cache_path,
 }
 
 
+static bool
+check_foz_magic(FILE *db_idx)
+{
+   uint8_t magic[FOZ_REF_MAGIC_SIZE];
+   if (fread(magic, 1, FOZ_REF_MAGIC_SIZE, db_idx) != FOZ_REF_MAGIC_SIZE)
+      return false;
+
+   if (memcmp(magic, stream_reference_magic_and_version,
+              FOZ_REF_MAGIC_SIZE - 1))
+      return false;
+
+   int version = magic[FOZ_REF_MAGIC_SIZE - 1];
+   if (version > FOSSILIZE_FORMAT_VERSION ||
+       version < FOSSILIZE_FORMAT_MIN_COMPAT_VERSION)
+      return false;
+
+   return true;
+}
+
 /* This looks at stuff that was added to the index since the last time we looked at it. This is safe
  * to do without locking the file as we assume the file is append only */
 static void
@@ -122,6 +187,19 @@ update_foz_index(struct foz_db *foz_db, FILE *db_idx, unsigned file_idx)
    uint64_t offset = ftell(db_idx);
    fseek(db_idx, 0, SEEK_END);
    uint64_t len = ftell(db_idx);
+
+   /* A shard of another process that wasn't initialized yet when we loaded
+    * it, check the magic before parsing anything.
+    */
+   if (offset == 0) {
+      rewind(db_idx);
+      if (len < FOZ_REF_MAGIC_SIZE || !check_foz_magic(db_idx)) {
+         rewind(db_idx);
+         return;
+      }
+      offset = FOZ_REF_MAGIC_SIZE;
+   }
+
    uint64_t parsed_offset = offset;
 
    if (offset == len)
@@ -204,6 +282,335 @@ static int lock_file_with_timeout(FILE *f, int64_t timeout)
    return err;
 }
 
+static size_t
+foz_hash_file_size(unsigned log2_capacity)
+{
+   return sizeof(struct foz_hash_header) +
+          (sizeof(struct foz_hash_slot) << log2_capacity);
+}
+
+static struct foz_hash_slot *
+foz_hash_slots(struct foz_hash_header *header)
+{
+   return (struct foz_hash_slot *)(header + 1);
+}
+
+static void
+foz_hash_close(struct foz_db_hash *hash)
+{
+   if (hash->map) {
+      munmap(hash->map, hash->map_size);
+      close(hash->fd);
+   }
+
+   memset(hash, 0, sizeof(*hash));
+}
+
+/* Takes ownership of fd. */
+static bool
+foz_hash_map(struct foz_db_hash *hash, int fd, bool writable)
+{
+   struct stat st;
+   if (fstat(fd, &st) == -1 ||
+       st.st_size < (off_t)sizeof(struct foz_hash_header))
+      goto fail;
+
+   void *map = mmap(NULL, st.st_size,
+                    writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                    MAP_SHARED, fd, 0);
+   if (map == MAP_FAILED)
+      goto fail;
+
+   struct foz_hash_header *header = map;
+   if (memcmp(header->magic, foz_hash_magic, sizeof(foz_hash_magic)) ||
+       header->version != FOZ_HASH_VERSION ||
+       header->log2_capacity < FOZ_HASH_MIN_LOG2_CAPACITY ||
+       header->log2_capacity > FOZ_HASH_MAX_LOG2_CAPACITY ||
+       foz_hash_file_size(header->log2_capacity) != st.st_size) {
+      munmap(map, st.st_size);
+      goto fail;
+   }
+
+   hash->fd = fd;
+   hash->map = map;
+   hash->map_size = st.st_size;
+   hash->writable = writable;
+   hash->dev = st.st_dev;
+   hash->ino = st.st_ino;
+   return true;
+
+fail:
+   close(fd);
+   return false;
+}
+
+static bool
+foz_hash_open(struct foz_db *foz_db, unsigned shard, bool writable)
+{
+   int fd = open(foz_db->hash_filename[shard],
+                 (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+   if (fd == -1)
+      return false;
+
+   return foz_hash_map(&foz_db->hash[shard], fd, writable);
+}
+
+/* Check that the table still belongs to the idx, it's stale if the idx got
+ * deleted and recreated behind its back.
+ */
+static bool
+foz_hash_validate(struct foz_hash_header *header, FILE *db_idx,
+                  uint64_t *idx_size)
+{
+   struct stat st;
+   if (fstat(fileno(db_idx), &st) == -1)
+      return false;
+
+   uint64_t size = p_atomic_read(&header->idx_size);
+   if (size < FOZ_REF_MAGIC_SIZE || size > st.st_size)
+      return false;
+
+   if (size > FOZ_REF_MAGIC_SIZE) {
+      uint8_t entry[FOZ_IDX_ENTRY_SIZE];
+
+      if (pread(fileno(db_idx), entry, sizeof(entry),
+                size - sizeof(entry)) != sizeof(entry) ||
+          memcmp(entry, header->last_entry, sizeof(entry)))
+         return false;
+   }
+
+   *idx_size = size;
+   return true;
+}
+
+static bool
+foz_hash_lookup(struct foz_hash_header *header, uint64_t hash,
+                uint64_t *offset)
+{
+   struct foz_hash_slot *slots = foz_hash_slots(header);
+   uint64_t mask = (1ull << header->log2_capacity) - 1;
+   uint64_t key = hash ? hash : 1;
+
+   for (uint64_t i = 0; i <= mask; i++) {
+      struct foz_hash_slot *slot = &slots[(key + i) & mask];
+      uint64_t slot_hash = __atomic_load_n(&slot->hash, __ATOMIC_ACQUIRE);
+
+      if (slot_hash == key) {
+         *offset = slot->offset;
+         return true;
+      }
+
+      if (slot_hash == 0)
+         break;
+   }
+
+   return false;
+}
+
+static void
+foz_hash_insert(struct foz_hash_header *header, uint64_t hash,
+                uint64_t offset)
+{
+   struct foz_hash_slot *slots = foz_hash_slots(header);
+   uint64_t mask = (1ull << header->log2_capacity) - 1;
+   uint64_t key = hash ? hash : 1;
+
+   for (uint64_t i = 0; i <= mask; i++) {
+      struct foz_hash_slot *slot = &slots[(key + i) & mask];
+
+      /* Keep the first entry with this hash, like the idx readers do. */
+      if (slot->hash == key)
+         return;
+
+      if (slot->hash == 0) {
+         /* Readers in other processes must never see the hash before the
+          * offset.
+          */
+         slot->offset = offset;
+         __atomic_store_n(&slot->hash, key, __ATOMIC_RELEASE);
+         header->num_entries++;
+         return;
+      }
+   }
+}
+
+/* Write a new table with room for 1 << log2_capacity entries, filled with
+ * the entries of the current one if any, and atomically replace the file.
+ */
+static bool
+foz_hash_create(struct foz_db *foz_db, unsigned shard, unsigned log2_capacity)
+{
+   struct foz_db_hash *hash = &foz_db->hash[shard];
+   struct foz_db_hash new_hash;
+   char *tmp_filename;
+
+   if (log2_capacity > FOZ_HASH_MAX_LOG2_CAPACITY)
+      return false;
+
+   if (asprintf(&tmp_filename, "%s.tmp", foz_db->hash_filename[shard]) == -1)
+      return false;
+
+   int fd = open(tmp_filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd == -1)
+      goto fail;
+
+   size_t size = foz_hash_file_size(log2_capacity);
+   if (ftruncate(fd, size) == -1) {
+      close(fd);
+      goto fail_unlink;
+   }
+
+   struct foz_hash_header header = {
+      .version = FOZ_HASH_VERSION,
+      .log2_capacity = log2_capacity,
+      .idx_size = FOZ_REF_MAGIC_SIZE,
+   };
+   memcpy(header.magic, foz_hash_magic, sizeof(foz_hash_magic));
+
+   if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      close(fd);
+      goto fail_unlink;
+   }
+
+   if (!foz_hash_map(&new_hash, fd, true))
+      goto fail_unlink;
+
+   if (hash->map) {
+      struct foz_hash_header *old_header = hash->map;
+      struct foz_hash_header *new_header = new_hash.map;
+      struct foz_hash_slot *slots = foz_hash_slots(old_header);
+
+      for (uint64_t i = 0; i < (1ull << old_header->log2_capacity); i++) {
+         if (slots[i].hash)
+            foz_hash_insert(new_header, slots[i].hash, slots[i].offset);
+      }
+
+      memcpy(new_header->last_entry, old_header->last_entry,
+             sizeof(new_header->last_entry));
+      new_header->idx_size = old_header->idx_size;
+   }
+
+   if (rename(tmp_filename, foz_db->hash_filename[shard]) == -1) {
+      foz_hash_close(&new_hash);
+      goto fail_unlink;
+   }
+
+   free(tmp_filename);
+   foz_hash_close(hash);
+   *hash = new_hash;
+   return true;
+
+fail_unlink:
+   unlink(tmp_filename);
+fail:
+   free(tmp_filename);
+   return false;
+}
+
+/* Map the on-disk hash table of a shard and skip the part of the idx it
+ * covers, so that only entries appended since it was last updated have to
+ * be parsed.
+ */
+static void
+foz_hash_load(struct foz_db *foz_db, unsigned shard)
+{
+   FILE *db_idx = foz_db->shard_idx[shard];
+   uint64_t idx_size;
+
+   if (!foz_db->hash_filename[shard] || !foz_hash_open(foz_db, shard, false))
+      return;
+
+   if (!foz_hash_validate(foz_db->hash[shard].map, db_idx, &idx_size)) {
+      foz_hash_close(&foz_db->hash[shard]);
+      return;
+   }
+
+   if (idx_size > ftell(db_idx))
+      fseek(db_idx, idx_size, SEEK_SET);
+}
+
+/* Add the entries appended to the idx of the write shard to its hash
+ * table, creating it if needed. Must only be called by the process
+ * currently allowed to append to the shard, with the foz_db mutex held.
+ */
+static void
+foz_hash_update(struct foz_db *foz_db)
+{
+   unsigned shard = foz_db->write_shard;
+   struct foz_db_hash *hash = &foz_db->hash[shard];
+   FILE *db_idx = foz_db->db_idx;
+   int idx_fd = fileno(db_idx);
+   uint64_t idx_size;
+
+   if (!foz_db->hash_filename[shard])
+      return;
+
+   /* Other processes appending to shard 0 may have replaced the table. */
+   if (hash->map) {
+      struct stat file_st, map_st;
+
+      if (stat(foz_db->hash_filename[shard], &file_st) == -1 ||
+          fstat(hash->fd, &map_st) == -1 ||
+          file_st.st_dev != map_st.st_dev ||
+          file_st.st_ino != map_st.st_ino || !hash->writable)
+         foz_hash_close(hash);
+   }
+
+   if (!hash->map) {
+      if (!foz_hash_open(foz_db, shard, true) ||
+          !foz_hash_validate(hash->map, db_idx, &idx_size)) {
+         foz_hash_close(hash);
+         if (!foz_hash_create(foz_db, shard, FOZ_HASH_MIN_LOG2_CAPACITY))
+            return;
+      }
+   }
+
+   struct stat st;
+   if (fstat(idx_fd, &st) == -1)
+      return;
+
+   uint8_t buf[FOZ_IDX_ENTRY_SIZE * 64];
+   uint64_t pos = ((struct foz_hash_header *)hash->map)->idx_size;
+
+   while (pos + FOZ_IDX_ENTRY_SIZE <= st.st_size) {
+      size_t num_bytes = MIN2(sizeof(buf), st.st_size - pos);
+      ssize_t read_bytes = pread(idx_fd, buf, num_bytes, pos);
+
+      if (read_bytes < FOZ_IDX_ENTRY_SIZE)
+         return;
+
+      for (uint8_t *entry = buf;
+           entry + FOZ_IDX_ENTRY_SIZE <= buf + read_bytes;
+           entry += FOZ_IDX_ENTRY_SIZE) {
+         struct foz_hash_header *header = hash->map;
+         struct foz_payload_header payload_header;
+         uint64_t offset;
+
+         memcpy(&payload_header, entry + FOSSILIZE_BLOB_HASH_LENGTH,
+                sizeof(payload_header));
+         memcpy(&offset, entry + FOZ_IDX_ENTRY_SIZE - sizeof(offset),
+                sizeof(offset));
+
+         /* Corrupt entry, stop where update_foz_index() stops. */
+         if (payload_header.payload_size != sizeof(uint64_t))
+            return;
+
+         /* Keep the load factor below 1/2. */
+         if ((header->num_entries + 1) * 2 > (1ull << header->log2_capacity)) {
+            if (!foz_hash_create(foz_db, shard, header->log2_capacity + 1))
+               return;
+            header = hash->map;
+         }
+
+         foz_hash_insert(header, hash_str_to_64bits((char *)entry), offset);
+
+         memcpy(header->last_entry, entry, FOZ_IDX_ENTRY_SIZE);
+         pos += FOZ_IDX_ENTRY_SIZE;
+         __atomic_store_n(&header->idx_size, pos, __ATOMIC_RELEASE);
+      }
+   }
+}
+
 static bool
 load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
              bool read_only)
@@ -216,6 +623,15 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
    /* Try not to take the lock if len >= the size of the header, but if it is smaller we take the
     * lock to potentially initialize the files. */
    if (len < sizeof(stream_reference_magic_and_version)) {
+      /* Shards of other processes are initialized by their owner, we pick
+       * them up once that happened.
+       */
+      if (file_idx > 0 && file_idx < foz_db->num_shards &&
+          !(foz_db->owns_write_shard && file_idx == foz_db->write_shard)) {
+         foz_db->alive = true;
+         return true;
+      }
+
       /* Wait for 100 ms in case of contention, after that we prioritize getting the app started. */
       int err = lock_file_with_timeout(foz_db->file[file_idx], 100000000);
       if (err == -1)
@@ -228,19 +644,8 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
    }
 
    if (len != 0) {
-      uint8_t magic[FOZ_REF_MAGIC_SIZE];
-      if (fread(magic, 1, FOZ_REF_MAGIC_SIZE, db_idx) != FOZ_REF_MAGIC_SIZE)
-         goto fail;
-
-      if (memcmp(magic, stream_reference_magic_and_version,
-                 FOZ_REF_MAGIC_SIZE - 1))
-         goto fail;
-
-      int version = magic[FOZ_REF_MAGIC_SIZE - 1];
-      if (version > FOSSILIZE_FORMAT_VERSION ||
-          version < FOSSILIZE_FORMAT_MIN_COMPAT_VERSION)
+      if (!check_foz_magic(db_idx))
          goto fail;
-
    } else {
       /* Appending to a fresh file. Make sure we have the magic. */
       if (fwrite(stream_reference_magic_and_version, 1,
@@ -259,6 +664,10 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
 
    flock(fileno(foz_db->file[file_idx]), LOCK_UN);
 
+   /* Skip the part of the idx covered by the on-disk hash table. */
+   if (file_idx < foz_db->num_shards)
+      foz_hash_load(foz_db, file_idx);
+
    if (foz_db->updater.thrd) {
    /* If MESA_DISK_CACHE_READ_ONLY_FOZ_DBS_DYNAMIC_LIST is enabled, access to
     * the foz_db hash table requires locking to prevent racing between this
@@ -281,7 +690,7 @@ fail:
 static void
 load_foz_dbs_ro(struct foz_db *foz_db, char *foz_dbs_ro)
 {
-   uint8_t file_idx = 1;
+   uint8_t file_idx = MAX2(foz_db->num_shards, 1);
    char *filename = NULL;
    char *idx_filename = NULL;
 
@@ -489,6 +898,79 @@ foz_dbs_list_updater_init(struct foz_db *foz_db, char *list_filename)
 }
 #endif
 
+/* Open a writable shard. Shard 0 is the historical foz_cache db shared by
+ * all processes, which serialize their writes with a flock per write. The
+ * other shards are each owned by a single process for as long as it keeps
+ * the db open, so appending to them doesn't need any file locking.
+ */
+static bool
+open_foz_shard(struct foz_db *foz_db, unsigned shard)
+{
+   char *name = NULL;
+   char *filename = NULL;
+   char *idx_filename = NULL;
+
+   if (shard == 0)
+      name = strdup("foz_cache");
+   else if (asprintf(&name, "foz_cache_%u", shard) == -1)
+      name = NULL;
+
+   if (!name)
+      return false;
+
+   bool ok = create_foz_db_filenames(foz_db->cache_path, name,
+                                     &filename, &idx_filename);
+   free(name);
+   if (!ok)
+      return false;
+
+   /* With a single shard every process appends to the same idx and parses
+    * it anyway, a hash table wouldn't save anything.
+    */
+   if (foz_db->num_shards > 1) {
+      ok = asprintf(&foz_db->hash_filename[shard], "%s.hash",
+                    idx_filename) != -1;
+      if (!ok)
+         foz_db->hash_filename[shard] = NULL;
+   }
+
+   foz_db->file[shard] = fopen(filename, "a+b");
+   foz_db->shard_idx[shard] = fopen(idx_filename, "a+b");
+
+   free(filename);
+   free(idx_filename);
+
+   if (!ok || foz_db->file[shard] == NULL ||
+       foz_db->shard_idx[shard] == NULL)
+      return false;
+
+   if (shard > 0 && !foz_db->owns_write_shard &&
+       flock(fileno(foz_db->shard_idx[shard]), LOCK_EX | LOCK_NB) == 0) {
+      foz_db->write_shard = shard;
+      foz_db->owns_write_shard = true;
+   }
+
+   if (!load_foz_dbs(foz_db, foz_db->shard_idx[shard], shard, false))
+      return false;
+
+   /* Drop whatever a previous owner killed in the middle of a write left
+    * behind, otherwise our entries would be appended after it and never be
+    * found.
+    */
+   if (foz_db->owns_write_shard && shard == foz_db->write_shard) {
+      FILE *db_idx = foz_db->shard_idx[shard];
+      long parsed_offset = ftell(db_idx);
+
+      fseek(db_idx, 0, SEEK_END);
+      if (ftell(db_idx) > parsed_offset &&
+          ftruncate(fileno(db_idx), parsed_offset) == -1)
+         return false;
+      fseek(db_idx, parsed_offset, SEEK_SET);
+   }
+
+   return true;
+}
+
 /* Here we open mesa cache foz dbs files. If the files exist we load the index
  * db into a hash table. The index db contains the offsets needed to later
  * read cache entries from the foz db containing the actual cache entries.
@@ -496,9 +978,6 @@ foz_dbs_list_updater_init(struct foz_db *foz_db, char *list_filename)
 bool
 foz_prepare(struct foz_db *foz_db, char *cache_path)
 {
-   char *filename = NULL;
-   char *idx_filename = NULL;
-
    simple_mtx_init(&foz_db->mtx, mtx_plain);
    simple_mtx_init(&foz_db->flock_mtx, mtx_plain);
    foz_db->mem_ctx = ralloc_context(NULL);
@@ -509,21 +988,17 @@ foz_prepare(struct foz_db *foz_db, char *cache_path)
     * create them.
     */
    if (debug_get_bool_option("MESA_DISK_CACHE_SINGLE_FILE", false)) {
-      if (!create_foz_db_filenames(cache_path, "foz_cache",
-                                   &filename, &idx_filename))
-         goto fail;
-
-      foz_db->file[0] = fopen(filename, "a+b");
-      foz_db->db_idx = fopen(idx_filename, "a+b");
-
-      free(filename);
-      free(idx_filename);
+      foz_db->num_shards =
+         CLAMP(debug_get_num_option("MESA_DISK_CACHE_SINGLE_FILE_SHARDS", 1),
+               1, FOZ_MAX_SHARDS);
 
-      if (foz_db->file[0] == NULL || foz_db->db_idx == NULL)
-         goto fail;
+      for (unsigned i = 0; i < foz_db->num_shards; i++) {
+         if (!open_foz_shard(foz_db, i))
+            goto fail;
+      }
 
-      if (!load_foz_dbs(foz_db, foz_db->db_idx, 0, false))
-         goto fail;
+      /* All shards are taken by other processes, fall back to shard 0. */
+      foz_db->db_idx = foz_db->shard_idx[foz_db->write_shard];
    }
 
    char *foz_dbs_ro = getenv("MESA_DISK_CACHE_READ_ONLY_FOZ_DBS");
@@ -560,8 +1035,14 @@ foz_destroy(struct foz_db *foz_db)
    }
 #endif
 
-   if (foz_db->db_idx)
-      fclose(foz_db->db_idx);
+   for (unsigned i = 0; i < foz_db->num_shards; i++) {
+      foz_hash_close(&foz_db->hash[i]);
+      free(foz_db->hash_filename[i]);
+
+      /* Also releases the ownership of our shard. */
+      if (foz_db->shard_idx[i])
+         fclose(foz_db->shard_idx[i]);
+   }
    for (unsigned i = 0; i < FOZ_MAX_DBS; i++) {
       if (foz_db->file[i])
          fclose(foz_db->file[i]);
@@ -577,6 +1058,131 @@ foz_destroy(struct foz_db *foz_db)
    memset(foz_db, 0, sizeof(*foz_db));
 }
 
+/* Map the hash table of a shard written by another process again if it
+ * was created or replaced since we mapped it. Must be called with the
+ * foz_db mutex held.
+ */
+static void
+foz_hash_refresh(struct foz_db *foz_db, unsigned shard)
+{
+   struct foz_db_hash *hash = &foz_db->hash[shard];
+   struct stat st;
+   uint64_t idx_size;
+
+   /* foz_hash_update takes care of the table we write to. */
+   if (hash->writable)
+      return;
+
+   if (stat(foz_db->hash_filename[shard], &st) == -1 ||
+       (st.st_dev == hash->dev && st.st_ino == hash->ino))
+      return;
+
+   foz_hash_close(hash);
+   if (foz_hash_open(foz_db, shard, false) &&
+       !foz_hash_validate(hash->map, foz_db->shard_idx[shard], &idx_size))
+      foz_hash_close(hash);
+
+   /* Don't try to map a table we rejected again. */
+   if (!hash->map) {
+      hash->dev = st.st_dev;
+      hash->ino = st.st_ino;
+   }
+}
+
+/* Return the mask of the shards whose idx changed since we last parsed it.
+ * Other processes only append to a shard, and only replace its hash table
+ * after appending, so the others have nothing new for us.
+ */
+static uint32_t
+foz_changed_shards(struct foz_db *foz_db)
+{
+   uint32_t changed = 0;
+
+   for (unsigned i = 0; i < foz_db->num_shards; i++) {
+      struct stat st;
+
+      if (fstat(fileno(foz_db->shard_idx[i]), &st) == -1 ||
+          st.st_size != foz_db->shard_idx_size[i] ||
+          st.st_mtim.tv_sec != foz_db->shard_idx_mtime[i].tv_sec ||
+          st.st_mtim.tv_nsec != foz_db->shard_idx_mtime[i].tv_nsec)
+         changed |= BITFIELD_BIT(i);
+   }
+
+   return changed;
+}
+
+/* Parse the entries appended to the idx of the changed shards. */
+static void
+foz_update_shards(struct foz_db *foz_db, uint32_t changed)
+{
+   u_foreach_bit(i, changed) {
+      FILE *db_idx = foz_db->shard_idx[i];
+      struct stat st;
+
+      /* Stat before parsing, so that anything appended meanwhile is
+       * picked up next time.
+       */
+      bool stat_ok = fstat(fileno(db_idx), &st) == 0;
+
+      update_foz_index(foz_db, db_idx, i);
+
+      if (stat_ok) {
+         foz_db->shard_idx_size[i] = st.st_size;
+         foz_db->shard_idx_mtime[i] = st.st_mtim;
+      }
+   }
+}
+
+/* Look the entry up in the on-disk hash tables of the writable shards and add
+ * it to the index hash table if it's there. Only the tables of changed shards
+ * can have been replaced. Must be called with the foz_db mutex held.
+ */
+static struct foz_db_entry *
+foz_hash_find_entry(struct foz_db *foz_db, uint32_t changed,
+                    const uint8_t *cache_key_160bit, uint64_t hash)
+{
+   if (foz_db->num_shards < 2)
+      return NULL;
+
+   for (unsigned i = 0; i < foz_db->num_shards; i++) {
+      char hash_str[FOSSILIZE_BLOB_HASH_LENGTH];
+      char key_str[FOSSILIZE_BLOB_HASH_LENGTH + 1];
+      uint64_t offset;
+
+      if (changed & BITFIELD_BIT(i))
+         foz_hash_refresh(foz_db, i);
+
+      if (!foz_db->hash[i].map ||
+          !foz_hash_lookup(foz_db->hash[i].map, hash, &offset))
+         continue;
+
+      /* The hash string of the entry is stored right before its header,
+       * check it to make sure the table wasn't lying.
+       */
+      if (offset < FOZ_REF_MAGIC_SIZE + FOSSILIZE_BLOB_HASH_LENGTH ||
+          fseek(foz_db->file[i], offset - FOSSILIZE_BLOB_HASH_LENGTH,
+                SEEK_SET) < 0 ||
+          fread(hash_str, 1, sizeof(hash_str), foz_db->file[i]) !=
+          sizeof(hash_str))
+         continue;
+
+      _mesa_sha1_format(key_str, cache_key_160bit);
+      if (memcmp(hash_str, key_str, sizeof(hash_str)))
+         continue;
+
+      struct foz_db_entry *entry = ralloc(foz_db->mem_ctx,
+                                          struct foz_db_entry);
+      entry->file_idx = i;
+      entry->offset = offset;
+      memcpy(entry->key, cache_key_160bit, sizeof(entry->key));
+      _mesa_hash_table_u64_insert(foz_db->index_db, hash, entry);
+
+      return entry;
+   }
+
+   return NULL;
+}
+
 /* Here we lookup a cache entry in the index hash table. If an entry is found
  * we use the retrieved offset to read the cache entry from disk.
  */
@@ -595,9 +1201,14 @@ foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
 
    struct foz_db_entry *entry =
       _mesa_hash_table_u64_search(foz_db->index_db, hash);
-   if (!entry && foz_db->db_idx) {
-      update_foz_index(foz_db, foz_db->db_idx, 0);
-      entry = _mesa_hash_table_u64_search(foz_db->index_db, hash);
+   if (!entry && foz_db->num_shards) {
+      uint32_t changed = foz_changed_shards(foz_db);
+
+      entry = foz_hash_find_entry(foz_db, changed, cache_key_160bit, hash);
+      if (!entry && changed) {
+         foz_update_shards(foz_db, changed);
+         entry = _mesa_hash_table_u64_search(foz_db->index_db, hash);
+      }
    }
    if (!entry) {
       simple_mtx_unlock(&foz_db->mtx);
@@ -655,8 +1266,10 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                 const void *blob, size_t blob_size)
 {
    uint64_t hash = truncate_hash_to_64bits(cache_key_160bit);
+   unsigned shard = foz_db->write_shard;
+   FILE *file = foz_db->file[shard];
 
-   if (!foz_db->alive || !foz_db->file[0])
+   if (!foz_db->alive || !foz_db->db_idx)
       return false;
 
    /* The flock is per-fd, not per thread, we do it outside of the main mutex to avoid having to
@@ -666,19 +1279,29 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
 
    /* Wait for 1 second. This is done outside of the main mutex as I believe there is more potential
     * for file contention than mtx contention of significant length. */
-   int err = lock_file_with_timeout(foz_db->file[0], 1000000000);
-   if (err == -1)
-      goto fail_file;
+   if (!foz_db->owns_write_shard) {
+      int err = lock_file_with_timeout(file, 1000000000);
+      if (err == -1)
+         goto fail_file;
+   }
 
    simple_mtx_lock(&foz_db->mtx);
 
-   update_foz_index(foz_db, foz_db->db_idx, 0);
+   update_foz_index(foz_db, foz_db->db_idx, shard);
 
+   /* The entry may also have been written to the shard of another process
+    * since we last parsed its idx.
+    */
    struct foz_db_entry *entry =
       _mesa_hash_table_u64_search(foz_db->index_db, hash);
+   if (!entry && foz_db->num_shards > 1) {
+      entry = foz_hash_find_entry(foz_db, foz_changed_shards(foz_db),
+                                  cache_key_160bit, hash);
+   }
    if (entry) {
       simple_mtx_unlock(&foz_db->mtx);
-      flock(fileno(foz_db->file[0]), LOCK_UN);
+      if (!foz_db->owns_write_shard)
+         flock(fileno(file), LOCK_UN);
       simple_mtx_unlock(&foz_db->flock_mtx);
       return NULL;
    }
@@ -690,27 +1313,27 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    header.payload_size = blob_size;
    header.crc = util_hash_crc32(blob, blob_size);
 
-   fseek(foz_db->file[0], 0, SEEK_END);
+   fseek(file, 0, SEEK_END);
 
    /* Write hash header to db */
    char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1]; /* 40 digits + null */
    _mesa_sha1_format(hash_str, cache_key_160bit);
-   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, foz_db->file[0]) !=
+   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, file) !=
        FOSSILIZE_BLOB_HASH_LENGTH)
       goto fail;
 
-   uint64_t offset = ftell(foz_db->file[0]);
+   uint64_t offset = ftell(file);
 
    /* Write db entry header */
-   if (fwrite(&header, 1, sizeof(header), foz_db->file[0]) != sizeof(header))
+   if (fwrite(&header, 1, sizeof(header), file) != sizeof(header))
       goto fail;
 
    /* Now write the db entry blob */
-   if (fwrite(blob, 1, blob_size, foz_db->file[0]) != blob_size)
+   if (fwrite(blob, 1, blob_size, file) != blob_size)
       goto fail;
 
    /* Flush everything to file to reduce chance of cache corruption */
-   fflush(foz_db->file[0]);
+   fflush(file);
 
    /* Write hash header to index db */
    if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, foz_db->db_idx) !=
@@ -733,15 +1356,18 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    /* Flush everything to file to reduce chance of cache corruption */
    fflush(foz_db->db_idx);
 
+   foz_hash_update(foz_db);
+
    entry = ralloc(foz_db->mem_ctx, struct foz_db_entry);
    entry->header = header;
    entry->offset = offset;
-   entry->file_idx = 0;
+   entry->file_idx = shard;
    _mesa_sha1_hex_to_sha1(entry->key, hash_str);
    _mesa_hash_table_u64_insert(foz_db->index_db, hash, entry);
 
    simple_mtx_unlock(&foz_db->mtx);
-   flock(fileno(foz_db->file[0]), LOCK_UN);
+   if (!foz_db->owns_write_shard)
+      flock(fileno(file), LOCK_UN);
    simple_mtx_unlock(&foz_db->flock_mtx);
 
    return true;
@@ -749,7 +1375,8 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
 fail:
    simple_mtx_unlock(&foz_db->mtx);
 fail_file:
-   flock(fileno(foz_db->file[0]), LOCK_UN);
+   if (!foz_db->owns_write_shard)
+      flock(fileno(file), LOCK_UN);
    simple_mtx_unlock(&foz_db->flock_mtx);
    return false;
 }
@@ -44,11 +44,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "simple_mtx.h"
 
+/* Max number of writable DB shards */
+#define FOZ_MAX_SHARDS 8
+
 /* Max number of DBs our implementation can read from at once */
-#define FOZ_MAX_DBS 9 /* Default DB + 8 Read only DBs */
+#define FOZ_MAX_DBS (FOZ_MAX_SHARDS + 8) /* Writable shards + 8 Read only DBs */
 
 #define FOSSILIZE_BLOB_HASH_LENGTH 40
 
@@ -83,9 +87,30 @@ struct foz_dbs_list_updater {
    thrd_t thrd;
 };
 
+/* On-disk open addressing hash table mapping truncated 64bit hashes to
+ * entry offsets, kept next to the idx of each writable shard. It covers the
+ * idx up to idx_size so opening a DB doesn't have to parse the whole idx.
+ */
+struct foz_db_hash {
+   int fd;
+   void *map;
+   size_t map_size;
+   bool writable;
+   uint64_t dev, ino;   /* Identify the file last mapped or rejected */
+};
+
 struct foz_db {
    FILE *file[FOZ_MAX_DBS];          /* An array of all foz dbs */
-   FILE *db_idx;                     /* The default writable foz db idx */
+   FILE *db_idx;                     /* The writable foz db idx */
+   FILE *shard_idx[FOZ_MAX_SHARDS];  /* Idx of all writable shards */
+   struct foz_db_hash hash[FOZ_MAX_SHARDS];
+   char *hash_filename[FOZ_MAX_SHARDS]; /* Only used with several shards */
+   /* Size and mtime of each shard idx when we last parsed it */
+   uint64_t shard_idx_size[FOZ_MAX_SHARDS];
+   struct timespec shard_idx_mtime[FOZ_MAX_SHARDS];
+   unsigned num_shards;
+   unsigned write_shard;             /* Shard this process appends to */
+   bool owns_write_shard;            /* Write shard is locked for our exclusive use */
    simple_mtx_t mtx;                 /* Mutex for file/hash table read/writes */
    simple_mtx_t flock_mtx;           /* Mutex for flocking the file for writes */
    void *mem_ctx;
@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "crc32.h"
@@ -26,11 +28,17 @@
 #include "os_time.h"
 #include "ralloc.h"
 #include "u_debug.h"
+#include "u_math.h"
 #include "u_qsort.h"
 
 #define MESA_CACHE_DB_VERSION          1
 #define MESA_CACHE_DB_MAGIC            "MESA_DB"
 
+/* File mappings grow in steps of this size to avoid remapping the files
+ * after every write.
+ */
+#define MESA_CACHE_DB_MAP_GRANULARITY  (4 * 1024 * 1024)
+
 struct PACKED mesa_db_file_header {
    char magic[8];
    uint32_t version;
@@ -56,8 +64,14 @@ struct mesa_index_db_hash_entry {
    uint64_t last_access_time;
    uint32_t size;
    bool evicted;
+   bool accessed;
 };
 
+static uint32_t blob_file_size(uint32_t blob_size)
+{
+   return sizeof(struct mesa_cache_db_file_entry) + blob_size;
+}
+
 static inline bool mesa_db_seek_end(FILE *file)
 {
    return !fseek(file, 0, SEEK_END);
@@ -96,18 +110,27 @@ mesa_db_reopen_file(struct mesa_cache_db_file *db_file);
 static void
 mesa_db_close_file(struct mesa_cache_db_file *db_file);
 
+static void
+mesa_db_flush_access_times(struct mesa_cache_db *db);
+
 static int
-mesa_db_flock(FILE *file, int op)
+mesa_db_flock_fd(int fd, int op)
 {
    int ret;
 
    do {
-      ret = flock(fileno(file), op);
+      ret = flock(fd, op);
    } while (ret < 0 && errno == EINTR);
 
    return ret;
 }
 
+static int
+mesa_db_flock(FILE *file, int op)
+{
+   return mesa_db_flock_fd(fileno(file), op);
+}
+
 static bool
 mesa_db_lock(struct mesa_cache_db *db)
 {
@@ -123,6 +146,8 @@ mesa_db_lock(struct mesa_cache_db *db)
    if (mesa_db_flock(db->index.file, LOCK_EX) < 0)
       goto unlock_cache;
 
+   mesa_db_flush_access_times(db);
+
    return true;
 
 unlock_cache:
@@ -318,6 +343,7 @@ mesa_db_update_index(struct mesa_cache_db *db)
       hash_entry->index_db_file_offset = db->index.offset;
       hash_entry->last_access_time = index_entry->last_access_time;
       hash_entry->size = index_entry->size;
+      hash_entry->accessed = false;
 
       _mesa_hash_table_u64_insert(db->index_db, index_entry->hash, hash_entry);
 
@@ -333,9 +359,182 @@ error:
    return ret;
 }
 
+static void
+mesa_db_unmap_file(struct mesa_cache_db_file *db_file)
+{
+   if (db_file->map)
+      munmap((void *)db_file->map, db_file->map_capacity);
+
+   db_file->map = NULL;
+   db_file->map_size = 0;
+   db_file->map_capacity = 0;
+}
+
+static bool
+mesa_db_open_map_fd(struct mesa_cache_db_file *db_file)
+{
+   if (db_file->map_fd < 0)
+      db_file->map_fd = open(db_file->path, O_RDONLY | O_CLOEXEC);
+
+   return db_file->map_fd >= 0;
+}
+
+/* Take shared locks on both files for the duration of a mapped lookup.
+ * Writers truncate the files only while holding exclusive locks, so the
+ * mappings can't shrink under the reader while these are held.
+ */
+static bool
+mesa_db_lock_mapped(struct mesa_cache_db *db)
+{
+   if (!mesa_db_open_map_fd(&db->cache) ||
+       !mesa_db_open_map_fd(&db->index))
+      return false;
+
+   if (mesa_db_flock_fd(db->cache.map_fd, LOCK_SH) < 0)
+      return false;
+
+   if (mesa_db_flock_fd(db->index.map_fd, LOCK_SH) < 0) {
+      mesa_db_flock_fd(db->cache.map_fd, LOCK_UN);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+mesa_db_unlock_mapped(struct mesa_cache_db *db)
+{
+   mesa_db_flock_fd(db->index.map_fd, LOCK_UN);
+   mesa_db_flock_fd(db->cache.map_fd, LOCK_UN);
+}
+
+/* Make the mapping cover the whole file, which may have been grown or
+ * shrunk by other processes since the last call. Must be called with the
+ * shared lock held, so that the size stays valid until the unlock.
+ */
+static bool
+mesa_db_map_file(struct mesa_cache_db_file *db_file)
+{
+   struct stat st;
+
+   if (fstat(db_file->map_fd, &st) < 0 ||
+       st.st_size < sizeof(struct mesa_db_file_header)) {
+      mesa_db_unmap_file(db_file);
+      return false;
+   }
+
+   if (st.st_size > db_file->map_capacity) {
+      size_t capacity = align64(st.st_size, MESA_CACHE_DB_MAP_GRANULARITY);
+      void *map;
+
+      mesa_db_unmap_file(db_file);
+
+      map = mmap(NULL, capacity, PROT_READ, MAP_SHARED, db_file->map_fd, 0);
+      if (map == MAP_FAILED)
+         return false;
+
+      db_file->map = map;
+      db_file->map_capacity = capacity;
+   }
+
+   db_file->map_size = st.st_size;
+
+   return true;
+}
+
+static uint64_t
+mesa_db_mapped_uuid(struct mesa_cache_db_file *db_file)
+{
+   const struct mesa_db_file_header *header =
+      (const struct mesa_db_file_header *)db_file->map;
+
+   return header->uuid;
+}
+
+/* Add the index entries appended since the last update, reading them
+ * straight from the index file mapping.
+ */
+static void
+mesa_db_update_index_mapped(struct mesa_cache_db *db)
+{
+   const struct mesa_index_db_file_entry *index_entry;
+   struct mesa_index_db_hash_entry *hash_entry;
+
+   while (db->index.offset + sizeof(*index_entry) <= db->index.map_size) {
+      index_entry = (const struct mesa_index_db_file_entry *)
+         (db->index.map + db->index.offset);
+
+      /* Stop at entries that are still being written, or whose blob isn't
+       * visible in the cache file yet. They are picked up next time.
+       */
+      if (!mesa_db_index_entry_valid((struct mesa_index_db_file_entry *)index_entry) ||
+          index_entry->cache_db_file_offset + blob_file_size(index_entry->size) >
+          db->cache.map_size)
+         break;
+
+      hash_entry = ralloc(db->mem_ctx, struct mesa_index_db_hash_entry);
+      if (!hash_entry)
+         break;
+
+      hash_entry->cache_db_file_offset = index_entry->cache_db_file_offset;
+      hash_entry->index_db_file_offset = db->index.offset;
+      hash_entry->last_access_time = index_entry->last_access_time;
+      hash_entry->size = index_entry->size;
+      hash_entry->accessed = false;
+
+      _mesa_hash_table_u64_insert(db->index_db, index_entry->hash, hash_entry);
+
+      db->index.offset += sizeof(*index_entry);
+   }
+}
+
+/* Write the access times of entries read through the mappings back to the
+ * index file. Must be called with the files locked.
+ */
+static void
+mesa_db_flush_access_times(struct mesa_cache_db *db)
+{
+   struct mesa_index_db_file_entry index_entry;
+
+   if (!util_dynarray_num_elements(&db->accessed_entries,
+                                   struct mesa_index_db_hash_entry *))
+      return;
+
+   /* The index was rewritten by someone else, the offsets are stale. */
+   if (mesa_db_uuid_changed(db))
+      goto out;
+
+   util_dynarray_foreach(&db->accessed_entries,
+                         struct mesa_index_db_hash_entry *, entry) {
+      struct mesa_index_db_hash_entry *hash_entry = *entry;
+
+      if (!mesa_db_seek(db->index.file, hash_entry->index_db_file_offset) ||
+          !mesa_db_read(db->index.file, &index_entry) ||
+          !mesa_db_index_entry_valid(&index_entry) ||
+          index_entry.cache_db_file_offset != hash_entry->cache_db_file_offset)
+         break;
+
+      index_entry.last_access_time = hash_entry->last_access_time;
+
+      if (!mesa_db_seek(db->index.file, hash_entry->index_db_file_offset) ||
+          !mesa_db_write(db->index.file, &index_entry))
+         break;
+   }
+
+   fflush(db->index.file);
+
+out:
+   util_dynarray_foreach(&db->accessed_entries,
+                         struct mesa_index_db_hash_entry *, entry)
+      (*entry)->accessed = false;
+
+   util_dynarray_clear(&db->accessed_entries);
+}
+
 static void
 mesa_db_hash_table_reset(struct mesa_cache_db *db)
 {
+   util_dynarray_clear(&db->accessed_entries);
    _mesa_hash_table_u64_clear(db->index_db);
    ralloc_free(db->mem_ctx);
    db->mem_ctx = ralloc_context(NULL);
@@ -443,6 +642,11 @@ mesa_db_open_file(struct mesa_cache_db_file *db_file,
       return false;
    }
 
+   db_file->map_fd = -1;
+   db_file->map = NULL;
+   db_file->map_size = 0;
+   db_file->map_capacity = 0;
+
    return true;
 }
 
@@ -474,6 +678,10 @@ mesa_db_free_file(struct mesa_cache_db_file *db_file)
    if (db_file->file)
       fclose(db_file->file);
 
+   mesa_db_unmap_file(db_file);
+   if (db_file->map_fd >= 0)
+      close(db_file->map_fd);
+
    free(db_file->path);
 }
 
@@ -520,11 +728,6 @@ entry_sort_offset(const void *_a, const void *_b, void *arg)
    return a->cache_db_file_offset > b->cache_db_file_offset ? 1 : -1;
 }
 
-static uint32_t blob_file_size(uint32_t blob_size)
-{
-   return sizeof(struct mesa_cache_db_file_entry) + blob_size;
-}
-
 static bool
 mesa_db_compact(struct mesa_cache_db *db, int64_t blob_size,
                 struct mesa_index_db_hash_entry *remove_entry)
@@ -696,6 +899,10 @@ mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
       goto close_index;
 
    simple_mtx_init(&db->flock_mtx, mtx_plain);
+   util_dynarray_init(&db->accessed_entries, NULL);
+
+   db->mmap_reads = debug_get_bool_option("MESA_DISK_CACHE_DATABASE_MMAP",
+                                          false);
 
    db->index_db = _mesa_hash_table_u64_create(NULL);
    if (!db->index_db)
@@ -709,6 +916,7 @@ mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
 destroy_hash:
    _mesa_hash_table_u64_destroy(db->index_db);
 destroy_mtx:
+   util_dynarray_fini(&db->accessed_entries);
    simple_mtx_destroy(&db->flock_mtx);
 
    ralloc_free(db->mem_ctx);
@@ -739,6 +947,13 @@ mesa_db_wipe_path(const char *cache_path)
 void
 mesa_cache_db_close(struct mesa_cache_db *db)
 {
+   /* Write back pending access times */
+   if (util_dynarray_num_elements(&db->accessed_entries,
+                                  struct mesa_index_db_hash_entry *) &&
+       mesa_db_lock(db))
+      mesa_db_unlock(db);
+
+   util_dynarray_fini(&db->accessed_entries);
    _mesa_hash_table_u64_destroy(db->index_db);
    simple_mtx_destroy(&db->flock_mtx);
    ralloc_free(db->mem_ctx);
@@ -760,6 +975,97 @@ mesa_cache_db_file_entry_size(void)
    return sizeof(struct mesa_cache_db_file_entry);
 }
 
+/* Look up an entry through the file mappings, holding shared file locks
+ * instead of the exclusive ones taken by the locked path. Returns false if
+ * the database changed in a way that requires the locked path to reload
+ * it, true otherwise with *data set to a copy of the entry's blob on a hit.
+ */
+static bool
+mesa_db_read_entry_mapped(struct mesa_cache_db *db,
+                          const uint8_t *cache_key_160bit,
+                          size_t *size, void **data)
+{
+   uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
+   const struct mesa_cache_db_file_entry *cache_entry;
+   struct mesa_index_db_hash_entry *hash_entry;
+   bool done = false;
+   void *blob;
+
+   *data = NULL;
+
+   simple_mtx_lock(&db->flock_mtx);
+
+   if (!db->alive) {
+      done = true;
+      goto out;
+   }
+
+   if (!mesa_db_lock_mapped(db))
+      goto out;
+
+   /* Compaction by any writer replaces the UUID in the file headers. */
+   if (!mesa_db_map_file(&db->cache) ||
+       !mesa_db_map_file(&db->index) ||
+       mesa_db_mapped_uuid(&db->cache) != db->uuid ||
+       mesa_db_mapped_uuid(&db->index) != db->uuid)
+      goto unlock;
+
+   mesa_db_update_index_mapped(db);
+
+   hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
+   if (!hash_entry) {
+      done = true;
+      goto unlock;
+   }
+
+   if (hash_entry->cache_db_file_offset + blob_file_size(hash_entry->size) >
+       db->cache.map_size)
+      goto unlock;
+
+   cache_entry = (const struct mesa_cache_db_file_entry *)
+      (db->cache.map + hash_entry->cache_db_file_offset);
+
+   if (!mesa_db_cache_entry_valid((struct mesa_cache_db_file_entry *)cache_entry) ||
+       cache_entry->size != hash_entry->size)
+      goto unlock;
+
+   if (memcmp(cache_entry->key, cache_key_160bit, sizeof(cache_entry->key))) {
+      done = true;
+      goto unlock;
+   }
+
+   blob = malloc(cache_entry->size);
+   if (!blob) {
+      done = true;
+      goto unlock;
+   }
+
+   memcpy(blob, cache_entry + 1, cache_entry->size);
+
+   if (util_hash_crc32(blob, cache_entry->size) != cache_entry->crc) {
+      free(blob);
+      goto unlock;
+   }
+
+   hash_entry->last_access_time = os_time_get_nano();
+   if (!hash_entry->accessed) {
+      hash_entry->accessed = true;
+      util_dynarray_append(&db->accessed_entries,
+                           struct mesa_index_db_hash_entry *, hash_entry);
+   }
+
+   *size = cache_entry->size;
+   *data = blob;
+   done = true;
+
+unlock:
+   mesa_db_unlock_mapped(db);
+out:
+   simple_mtx_unlock(&db->flock_mtx);
+
+   return done;
+}
+
 void *
 mesa_cache_db_read_entry(struct mesa_cache_db *db,
                          const uint8_t *cache_key_160bit,
@@ -771,6 +1077,10 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
    struct mesa_index_db_hash_entry *hash_entry;
    void *data = NULL;
 
+   if (db->mmap_reads &&
+       mesa_db_read_entry_mapped(db, cache_key_160bit, size, &data))
+      return data;
+
    if (!mesa_db_lock(db))
       return NULL;
 
@@ -906,6 +1216,7 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
    hash_entry->index_db_file_offset = ftell(db->index.file);
    hash_entry->last_access_time = index_entry.last_access_time;
    hash_entry->size = index_entry.size;
+   hash_entry->accessed = false;
 
    if (!mesa_db_write(db->cache.file, &cache_entry) ||
        !mesa_db_write_data(db->cache.file, blob, blob_size) ||
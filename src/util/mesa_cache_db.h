@@ -16,6 +16,7 @@
 
 #include "detect_os.h"
 #include "simple_mtx.h"
+#include "u_dynarray.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +27,12 @@ struct mesa_cache_db_file {
    char *path;
    off_t offset;
    uint64_t uuid;
+
+   /* Read-only mapping used when mmap reads are enabled */
+   int map_fd;
+   const uint8_t *map;
+   size_t map_size;
+   size_t map_capacity;
 };
 
 struct mesa_cache_db {
@@ -37,6 +44,13 @@ struct mesa_cache_db {
    void *mem_ctx;
    uint64_t uuid;
    bool alive;
+
+   /* Serve reads from file mappings without taking the file locks.
+    * Access times of the entries read this way are written back the
+    * next time the files get locked.
+    */
+   bool mmap_reads;
+   struct util_dynarray accessed_entries;
 };
 
 #if DETECT_OS_WINDOWS == 0
@@ -41,6 +41,7 @@
 #include "util/detect_os.h"
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
+#include "util/disk_cache_mem.h"
 #include "util/disk_cache_os.h"
 #include "util/ralloc.h"
 
@@ -537,6 +538,268 @@ test_put_and_get_between_instances(const char *driver_id)
    disk_cache_destroy(cache2);
 }
 
+static void
+test_put_and_get_between_shards(const char *driver_id)
+{
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   char hash_file[PATH_MAX];
+   char *result;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   /* Each instance takes its own shard. */
+   struct disk_cache *cache1 = disk_cache_create("test_between_shards",
+                                                 driver_id, 0);
+   struct disk_cache *cache2 = disk_cache_create("test_between_shards",
+                                                 driver_id, 0);
+
+   EXPECT_NE(cache1->foz_db.write_shard, cache2->foz_db.write_shard);
+
+   disk_cache_compute_key(cache1, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache1, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache1);
+
+   disk_cache_compute_key(cache2, string, sizeof(string), string_key);
+
+   /* A miss remembers the state of every shard, an entry appended after it
+    * must still be found.
+    */
+   result = (char *) disk_cache_get(cache1, string_key, &size);
+   EXPECT_EQ(result, nullptr) << "disk_cache_get(cache1) before the put";
+
+   disk_cache_put(cache2, string_key, string, sizeof(string), NULL);
+   disk_cache_wait_for_idle(cache2);
+
+   result = (char *) disk_cache_get(cache1, string_key, &size);
+   EXPECT_STREQ(string, result) << "disk_cache_get(cache1) after a miss";
+   free(result);
+
+   /* cache2 must not append an entry that is already in the shard of
+    * cache1, even though it hasn't parsed that shard's idx yet.
+    */
+   char idx_file[PATH_MAX];
+   struct stat idx_st_before, idx_st_after;
+   snprintf(idx_file, sizeof(idx_file), "%s/foz_cache_%u_idx.foz",
+            cache2->path, cache2->foz_db.write_shard);
+   EXPECT_EQ(stat(idx_file, &idx_st_before), 0);
+   disk_cache_put(cache2, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache2);
+   EXPECT_EQ(stat(idx_file, &idx_st_after), 0);
+   EXPECT_EQ(idx_st_before.st_size, idx_st_after.st_size)
+      << "entry of other shard written again";
+
+   result = (char *) disk_cache_get(cache2, blob_key, &size);
+   EXPECT_STREQ(blob, result) << "disk_cache_get(cache2) of item of other shard";
+   free(result);
+
+   snprintf(hash_file, sizeof(hash_file), "%s/foz_cache_%u_idx.foz.hash",
+            cache1->path, cache1->foz_db.write_shard);
+   EXPECT_EQ(access(hash_file, F_OK), 0) << "shard hash table missing";
+
+   disk_cache_destroy(cache1);
+   disk_cache_destroy(cache2);
+
+   /* A new instance only finds the entries through the on-disk hash tables,
+    * as it doesn't parse the part of the idx they cover.
+    */
+   struct disk_cache *cache3 = disk_cache_create("test_between_shards",
+                                                 driver_id, 0);
+
+   result = (char *) disk_cache_get(cache3, blob_key, &size);
+   EXPECT_STREQ(blob, result) << "disk_cache_get(cache3) of first shard item";
+   EXPECT_EQ(size, sizeof(blob));
+   free(result);
+
+   result = (char *) disk_cache_get(cache3, string_key, &size);
+   EXPECT_STREQ(string, result) << "disk_cache_get(cache3) of second shard item";
+   EXPECT_EQ(size, sizeof(string));
+   free(result);
+
+   disk_cache_destroy(cache3);
+}
+
+static void
+test_single_shard_no_hash_table(const char *driver_id)
+{
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char hash_file[PATH_MAX];
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   struct disk_cache *cache = disk_cache_create("test_no_hash_table",
+                                                driver_id, 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   snprintf(hash_file, sizeof(hash_file), "%s/foz_cache_idx.foz.hash",
+            cache->path);
+   EXPECT_NE(access(hash_file, F_OK), 0) << "hash table of a single shard";
+
+   disk_cache_destroy(cache);
+}
+
+static void
+test_get_batch(const char *driver_id)
+{
+   char blobs[4][32];
+   cache_key keys[5];
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   struct disk_cache *cache = disk_cache_create("test_get_batch",
+                                                driver_id, 0);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(blobs); i++) {
+      snprintf(blobs[i], sizeof(blobs[i]), "This is batched blob %u", i);
+      disk_cache_compute_key(cache, blobs[i], sizeof(blobs[i]), keys[i]);
+      disk_cache_put(cache, keys[i], blobs[i], sizeof(blobs[i]), NULL);
+   }
+
+   /* The last key is never stored. */
+   disk_cache_compute_key(cache, "missing", 8, keys[4]);
+
+   disk_cache_wait_for_idle(cache);
+
+   struct disk_cache_batch *batch =
+      disk_cache_get_batch(cache, keys, ARRAY_SIZE(keys));
+   ASSERT_NE(batch, nullptr) << "disk_cache_get_batch";
+
+   /* Claim the items out of order. */
+   for (int i = ARRAY_SIZE(blobs) - 1; i >= 0; i--) {
+      char *result = (char *) disk_cache_batch_get(batch, i, &size);
+      EXPECT_STREQ(result, blobs[i]) << "disk_cache_batch_get of existing item";
+      EXPECT_EQ(size, sizeof(blobs[i])) << "disk_cache_batch_get size";
+      free(result);
+
+      EXPECT_TRUE(disk_cache_batch_is_ready(batch, i));
+      EXPECT_EQ(disk_cache_batch_get(batch, i, &size), nullptr)
+         << "disk_cache_batch_get of claimed item";
+   }
+
+   EXPECT_EQ(disk_cache_batch_get(batch, 4, &size), nullptr)
+      << "disk_cache_batch_get of non-existent item";
+   EXPECT_EQ(size, 0);
+
+   disk_cache_batch_destroy(batch);
+
+   /* Unclaimed items are freed with the batch. */
+   batch = disk_cache_get_batch(cache, keys, ARRAY_SIZE(keys));
+   disk_cache_batch_destroy(batch);
+
+   disk_cache_destroy(cache);
+}
+
+/* Lookups still queued when the cache is destroyed must not touch it
+ * afterwards.
+ */
+static void
+test_get_batch_destroy_pending(const char *driver_id)
+{
+   char blobs[16][32];
+   cache_key keys[16];
+   size_t size;
+
+   struct disk_cache *cache = disk_cache_create("test_get_batch_pending",
+                                                driver_id, 0);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(blobs); i++) {
+      snprintf(blobs[i], sizeof(blobs[i]), "This is pending blob %u", i);
+      disk_cache_compute_key(cache, blobs[i], sizeof(blobs[i]), keys[i]);
+      disk_cache_put(cache, keys[i], blobs[i], sizeof(blobs[i]), NULL);
+   }
+
+   disk_cache_wait_for_idle(cache);
+
+   struct disk_cache_batch *batch =
+      disk_cache_get_batch(cache, keys, ARRAY_SIZE(keys));
+   ASSERT_NE(batch, nullptr) << "disk_cache_get_batch";
+
+   disk_cache_destroy(cache);
+
+   /* The lookups were finished by the destruction. */
+   for (unsigned i = 0; i < ARRAY_SIZE(blobs); i += 2) {
+      EXPECT_TRUE(disk_cache_batch_is_ready(batch, i));
+      char *result = (char *) disk_cache_batch_get(batch, i, &size);
+      EXPECT_STREQ(result, blobs[i]) << "disk_cache_batch_get after destroy";
+      free(result);
+   }
+
+   disk_cache_batch_destroy(batch);
+}
+
+static void
+test_prefetch(const char *driver_id)
+{
+   char blobs[8][32];
+   cache_key keys[9];
+   size_t size;
+
+   setenv("MESA_SHADER_CACHE_MEM_SIZE", "1M", 1);
+
+   struct disk_cache *cache = disk_cache_create("test_prefetch",
+                                                driver_id, 0);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(blobs); i++) {
+      snprintf(blobs[i], sizeof(blobs[i]), "This is prefetched blob %u", i);
+      disk_cache_compute_key(cache, blobs[i], sizeof(blobs[i]), keys[i]);
+      disk_cache_put(cache, keys[i], blobs[i], sizeof(blobs[i]), NULL);
+   }
+
+   /* The last key is never stored. */
+   disk_cache_compute_key(cache, "missing", 8, keys[8]);
+
+   disk_cache_wait_for_idle(cache);
+
+   /* Start over with an empty memory cache. */
+   disk_cache_destroy(cache);
+   EXPECT_EQ(disk_cache_mem_ref(0), nullptr);
+
+   cache = disk_cache_create("test_prefetch", driver_id, 0);
+   struct disk_cache_mem *mem = disk_cache_mem_ref(0);
+   ASSERT_NE(mem, nullptr) << "memory cache of the new instance";
+
+   for (unsigned i = 0; i < ARRAY_SIZE(keys); i++)
+      EXPECT_EQ(disk_cache_mem_get(mem, keys[i], &size), nullptr);
+
+   disk_cache_prefetch(cache, keys, ARRAY_SIZE(keys));
+   disk_cache_wait_for_idle(cache);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(blobs); i++) {
+      char *result = (char *) disk_cache_mem_get(mem, keys[i], &size);
+      EXPECT_STREQ(result, blobs[i]) << "prefetched item in the memory cache";
+      EXPECT_EQ(size, sizeof(blobs[i]));
+      free(result);
+   }
+
+   EXPECT_EQ(disk_cache_mem_get(mem, keys[8], &size), nullptr)
+      << "prefetch of non-existent item";
+
+   disk_cache_mem_unref(mem);
+
+   /* Prefetches still queued when the cache is destroyed. */
+   disk_cache_prefetch(cache, keys, ARRAY_SIZE(keys));
+   disk_cache_destroy(cache);
+
+   EXPECT_EQ(disk_cache_mem_ref(0), nullptr)
+      << "memory cache released with the last cache";
+
+   unsetenv("MESA_SHADER_CACHE_MEM_SIZE");
+}
+
 static void
 test_put_and_get_between_instances_with_eviction(const char *driver_id)
 {
@@ -733,6 +996,12 @@ run_tests:
 
    test_put_key_and_get_key(driver_id);
 
+   test_get_batch(driver_id);
+
+   test_get_batch_destroy_pending(driver_id);
+
+   test_prefetch(driver_id);
+
    setenv("MESA_DISK_CACHE_MULTI_FILE", "false", 1);
 
    int err = rmrf_local(CACHE_TEST_TMP);
@@ -773,6 +1042,14 @@ run_tests:
 
    test_put_and_get_between_instances(driver_id);
 
+   test_get_batch(driver_id);
+
+   test_get_batch_destroy_pending(driver_id);
+
+   test_prefetch(driver_id);
+
+   test_single_shard_no_hash_table(driver_id);
+
    setenv("MESA_DISK_CACHE_SINGLE_FILE", "false", 1);
 
    int err = rmrf_local(CACHE_TEST_TMP);
@@ -785,6 +1062,32 @@ run_tests:
 #endif
 }
 
+TEST_F(Cache, SingleFileShards)
+{
+   const char *driver_id = "make_check_uncompressed";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_DISK_CACHE_SINGLE_FILE_SHARDS", "4", 1);
+
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME_SF, driver_id);
+
+   test_put_and_get(false, driver_id);
+
+   test_put_and_get_between_instances(driver_id);
+
+   test_put_and_get_between_shards(driver_id);
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE_SHARDS");
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "false", 1);
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
 TEST_F(Cache, Database)
 {
    const char *driver_id = "make_check_uncompressed";
@@ -814,6 +1117,12 @@ TEST_F(Cache, Database)
 
    test_put_and_get_between_instances(driver_id);
 
+   test_get_batch(driver_id);
+
+   test_get_batch_destroy_pending(driver_id);
+
+   test_prefetch(driver_id);
+
    test_put_and_get_between_instances_with_eviction(driver_id);
 
    test_put_big_sized_entry_to_empty_cache(driver_id);
@@ -825,6 +1134,53 @@ TEST_F(Cache, Database)
 #endif
 }
 
+TEST_F(Cache, Default)
+{
+   const char *driver_id = "make_check";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   /* No backend selected, with compression. */
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME_DB, driver_id);
+
+   test_get_batch(driver_id);
+
+   test_get_batch_destroy_pending(driver_id);
+
+   test_prefetch(driver_id);
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
+TEST_F(Cache, DatabaseMmap)
+{
+   const char *driver_id = "make_check_uncompressed";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   setenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS", "1", 1);
+   setenv("MESA_DISK_CACHE_DATABASE_MMAP", "true", 1);
+
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME_DB, driver_id);
+
+   test_put_and_get(true, driver_id);
+
+   test_put_and_get_between_instances(driver_id);
+
+   test_put_and_get_between_instances_with_eviction(driver_id);
+
+   unsetenv("MESA_DISK_CACHE_DATABASE_MMAP");
+   unsetenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS");
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
 TEST_F(Cache, Combined)
 {
    const char *driver_id = "make_check";
@@ -1478,3 +1834,66 @@ TEST_F(Cache, DeleteOldCache)
    rmdir(dir_name);
 #endif
 }
+
+TEST_F(Cache, Memory)
+{
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   struct disk_cache_mem_stats stats;
+   uint8_t blob[1024];
+   cache_key keys[64];
+   size_t size;
+
+   memset(blob, 0xaa, sizeof(blob));
+   for (unsigned i = 0; i < ARRAY_SIZE(keys); i++)
+      _mesa_sha1_compute(&i, sizeof(i), keys[i]);
+
+   /* Room for a single blob per shard at most. */
+   struct disk_cache_mem *mem = disk_cache_mem_create(48 * 1024);
+   ASSERT_NE(mem, nullptr);
+
+   EXPECT_EQ(disk_cache_mem_get(mem, keys[0], &size), nullptr);
+
+   disk_cache_mem_put(mem, keys[0], blob, sizeof(blob));
+   void *result = disk_cache_mem_get(mem, keys[0], &size);
+   ASSERT_NE(result, nullptr);
+   EXPECT_EQ(size, sizeof(blob));
+   EXPECT_EQ(memcmp(result, blob, sizeof(blob)), 0);
+   free(result);
+
+   disk_cache_mem_remove(mem, keys[0]);
+   EXPECT_EQ(disk_cache_mem_get(mem, keys[0], &size), nullptr);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(keys); i++)
+      disk_cache_mem_put(mem, keys[i], blob, sizeof(blob));
+
+   disk_cache_mem_get_stats(mem, &stats);
+   EXPECT_EQ(stats.hits, 1);
+   EXPECT_EQ(stats.misses, 2);
+   EXPECT_GT(stats.evictions, 0);
+   EXPECT_EQ(stats.entries + stats.evictions, ARRAY_SIZE(keys));
+   EXPECT_LE(stats.size, 48 * 1024);
+
+   /* Blobs larger than a shard are never cached, and replace what was
+    * stored under their key.
+    */
+   uint8_t *big = (uint8_t *) calloc(1, 64 * 1024);
+   disk_cache_mem_put(mem, keys[0], blob, sizeof(blob));
+   disk_cache_mem_put(mem, keys[0], big, 64 * 1024);
+   EXPECT_EQ(disk_cache_mem_get(mem, keys[0], &size), nullptr)
+      << "disk_cache_mem_get of item replaced by a too large one";
+   free(big);
+
+   disk_cache_mem_destroy(mem);
+
+   /* The process-wide cache only exists while referenced. */
+   EXPECT_EQ(disk_cache_mem_ref(0), nullptr);
+   mem = disk_cache_mem_ref(1024 * 1024);
+   ASSERT_NE(mem, nullptr);
+   EXPECT_EQ(disk_cache_mem_ref(0), mem);
+   disk_cache_mem_unref(mem);
+   disk_cache_mem_unref(mem);
+   EXPECT_EQ(disk_cache_mem_ref(0), nullptr);
+#endif
+}
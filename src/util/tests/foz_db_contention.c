@@ -0,0 +1,172 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Fossilize DB multi-process write contention benchmark.
+ *
+ * Forks a number of processes that all append entries to the same single
+ * file cache directory at once, then checks that a freshly opened DB finds
+ * every entry. Reports the aggregated write rate and the time it takes to
+ * open the DB, for the historical single shared DB and for per-process
+ * shards.
+ *
+ * Usage: foz_db_contention [processes [entries per process [shards]]]
+ */
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "util/fossilize_db.h"
+#include "util/mesa-sha1.h"
+#include "util/os_time.h"
+
+#define BLOB_SIZE 256
+
+static void
+entry_key(unsigned process, unsigned entry, uint8_t key[20])
+{
+   char str[64];
+
+   snprintf(str, sizeof(str), "process %u entry %u", process, entry);
+   _mesa_sha1_compute(str, strlen(str), key);
+}
+
+static void
+entry_blob(unsigned process, unsigned entry, uint8_t *blob)
+{
+   for (unsigned i = 0; i < BLOB_SIZE; i++)
+      blob[i] = process * 31 + entry * 7 + i;
+}
+
+static int
+write_entries(char *path, unsigned process, unsigned num_entries)
+{
+   struct foz_db foz_db = {0};
+   uint8_t blob[BLOB_SIZE];
+   uint8_t key[20];
+
+   if (!foz_prepare(&foz_db, path))
+      return 1;
+
+   for (unsigned i = 0; i < num_entries; i++) {
+      entry_key(process, i, key);
+      entry_blob(process, i, blob);
+      if (!foz_write_entry(&foz_db, key, blob, sizeof(blob))) {
+         foz_destroy(&foz_db);
+         return 1;
+      }
+   }
+
+   foz_destroy(&foz_db);
+   return 0;
+}
+
+static unsigned
+read_entries(char *path, unsigned num_processes, unsigned num_entries,
+             double *open_ms)
+{
+   struct foz_db foz_db = {0};
+   uint8_t blob[BLOB_SIZE];
+   uint8_t key[20];
+   unsigned found = 0;
+
+   int64_t start = os_time_get_nano();
+   if (!foz_prepare(&foz_db, path))
+      return 0;
+   *open_ms = (os_time_get_nano() - start) / 1000000.0;
+
+   for (unsigned p = 0; p < num_processes; p++) {
+      for (unsigned i = 0; i < num_entries; i++) {
+         size_t size;
+
+         entry_key(p, i, key);
+         entry_blob(p, i, blob);
+
+         void *data = foz_read_entry(&foz_db, key, &size);
+         if (data && size == sizeof(blob) && !memcmp(data, blob, size))
+            found++;
+         free(data);
+      }
+   }
+
+   foz_destroy(&foz_db);
+   return found;
+}
+
+static int
+remove_entry(const char *path, const struct stat *sb, int typeflag,
+             struct FTW *ftwbuf)
+{
+   return remove(path);
+}
+
+static bool
+run(unsigned num_processes, unsigned num_entries, unsigned num_shards)
+{
+   char path[] = "/tmp/foz_db_contention_XXXXXX";
+   char shards[16];
+   bool success = true;
+
+   if (!mkdtemp(path))
+      return false;
+
+   snprintf(shards, sizeof(shards), "%u", num_shards);
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_DISK_CACHE_SINGLE_FILE_SHARDS", shards, 1);
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned p = 0; p < num_processes; p++) {
+      pid_t pid = fork();
+      if (pid == 0)
+         _exit(write_entries(path, p, num_entries));
+      if (pid == -1)
+         success = false;
+   }
+
+   int status;
+   while (wait(&status) > 0) {
+      if (!WIFEXITED(status) || WEXITSTATUS(status))
+         success = false;
+   }
+
+   double elapsed = (os_time_get_nano() - start) / 1000000000.0;
+
+   double open_ms = 0.0;
+   unsigned total = num_processes * num_entries;
+   unsigned found = read_entries(path, num_processes, num_entries, &open_ms);
+   if (found != total)
+      success = false;
+
+   printf("%s: processes %3u shards %u: %10.0f writes/s, "
+          "open %8.3f ms, %u/%u entries found\n",
+          success ? "PASS" : "FAIL", num_processes, num_shards,
+          total / elapsed, open_ms, found, total);
+   fflush(stdout);
+
+   nftw(path, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+
+   return success;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_processes = argc > 1 ? atoi(argv[1]) : 4;
+   unsigned num_entries = argc > 2 ? atoi(argv[2]) : 1024;
+   unsigned num_shards = argc > 3 ? atoi(argv[3]) : FOZ_MAX_SHARDS;
+   bool success = true;
+
+   /* The historical layout, every process appending to the same DB. */
+   if (!run(num_processes, num_entries, 1))
+      success = false;
+
+   if (num_shards > 1 && !run(num_processes, num_entries, num_shards))
+      success = false;
+
+   return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -14,7 +14,14 @@ bool
 util_thread_scheduler_enabled(void)
 {
 #if DETECT_ARCH_X86 || DETECT_ARCH_X86_64
-   return util_get_cpu_caps()->num_L3_caches > 1 ||
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   /* L3 chasing is only known to help on AMD Zen. Other CPUs may know their
+    * L3 topology from sysfs, which is only used to pin worker pool threads.
+    */
+   return (caps->num_L3_caches > 1 &&
+           caps->family >= CPU_AMD_ZEN1_ZEN2 &&
+           caps->family < CPU_AMD_LAST) ||
           debug_get_option_pin_threads();
 #else
    return false;
@@ -89,3 +96,28 @@ util_thread_sched_apply_policy(thrd_t thread, enum util_thread_name name,
    return false;
 #endif
 }
+
+/**
+ * Pin the calling thread, which is thread "thread_index" of a worker pool
+ * of "num_threads" threads, to one L3 cache domain.
+ *
+ * The pool is spread evenly across all L3 caches, with consecutive thread
+ * indices sharing a domain. Memory first touched by the thread after this
+ * call is then allocated on the node the domain belongs to.
+ *
+ * Nothing is done if only one L3 cache is known.
+ */
+bool
+util_thread_sched_pin_pool_thread(unsigned thread_index, unsigned num_threads)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   if (caps->num_L3_caches <= 1 || !caps->L3_affinity_mask ||
+       thread_index >= num_threads)
+      return false;
+
+   unsigned L3_cache = (uint64_t)thread_index * caps->num_L3_caches / num_threads;
+
+   return util_set_current_thread_affinity(caps->L3_affinity_mask[L3_cache],
+                                           NULL, caps->num_cpu_mask_bits);
+}
@@ -28,4 +28,7 @@ bool
 util_thread_sched_apply_policy(thrd_t thread, enum util_thread_name name,
                                unsigned app_thread_cpu, unsigned *sched_state);
 
+bool
+util_thread_sched_pin_pool_thread(unsigned thread_index, unsigned num_threads);
+
 #endif
@@ -496,6 +496,90 @@ check_os_loongarch64_support(void)
 #endif /* DETECT_ARCH_LOONGARCH64 */
 
 
+#if DETECT_OS_LINUX
+/**
+ * Build the CPU <-> L3 cache mapping from sysfs. This works on any
+ * architecture and vendor, and is used when the CPUID based detection
+ * didn't find anything. Only worker pools pin their threads with it, the
+ * L3 chasing of util_thread_scheduler_enabled stays limited to AMD Zen.
+ */
+static void
+get_cpu_topology_sysfs(void)
+{
+   uint32_t L3_found[UTIL_MAX_CPUS];
+   unsigned num_L3_caches = 0;
+   util_affinity_mask *L3_affinity_masks = NULL;
+   uint16_t cpu_to_L3[UTIL_MAX_CPUS];
+
+   memset(cpu_to_L3, 0xff, sizeof(cpu_to_L3));
+
+   for (int16_t i = 0; i < util_cpu_caps.max_cpus && i < UTIL_MAX_CPUS; i++) {
+      char name[PATH_MAX];
+      size_t size = 0;
+
+      snprintf(name, sizeof(name),
+               "/sys/devices/system/cpu/cpu%u/cache/index3/level", i);
+      char *level = os_read_file(name, &size);
+      if (!level)
+         continue;
+      bool is_L3 = strtoul(level, NULL, 10) == 3;
+      free(level);
+      if (!is_L3)
+         continue;
+
+      snprintf(name, sizeof(name),
+               "/sys/devices/system/cpu/cpu%u/cache/index3/id", i);
+      char *id = os_read_file(name, &size);
+      if (!id)
+         continue;
+      uint32_t l3_id = strtoul(id, NULL, 10);
+      free(id);
+
+      int idx = -1;
+      for (unsigned c = 0; c < num_L3_caches; c++) {
+         if (L3_found[c] == l3_id) {
+            idx = c;
+            break;
+         }
+      }
+      if (idx == -1) {
+         util_affinity_mask *masks =
+            realloc(L3_affinity_masks, sizeof(util_affinity_mask) * (num_L3_caches + 1));
+         if (!masks) {
+            free(L3_affinity_masks);
+            return;
+         }
+         L3_affinity_masks = masks;
+         idx = num_L3_caches;
+         L3_found[num_L3_caches++] = l3_id;
+         memset(&L3_affinity_masks[idx], 0, sizeof(util_affinity_mask));
+      }
+      cpu_to_L3[i] = idx;
+      L3_affinity_masks[idx][i / 32] |= 1u << (i % 32);
+   }
+
+   /* A single L3 is what the defaults already describe. */
+   if (num_L3_caches <= 1) {
+      free(L3_affinity_masks);
+      return;
+   }
+
+   util_cpu_caps.num_L3_caches = num_L3_caches;
+   util_cpu_caps.L3_affinity_mask = L3_affinity_masks;
+   memcpy(util_cpu_caps.cpu_to_L3, cpu_to_L3, sizeof(cpu_to_L3));
+
+   if (debug_get_option_dump_cpu()) {
+      fprintf(stderr, "CPU <-> L3 cache mapping (sysfs):\n");
+      for (unsigned i = 0; i < util_cpu_caps.num_L3_caches; i++) {
+         fprintf(stderr, "  - L3 %u mask = ", i);
+         for (int j = util_cpu_caps.max_cpus - 1; j >= 0; j -= 32)
+            fprintf(stderr, "%08x ", util_cpu_caps.L3_affinity_mask[i][j / 32]);
+         fprintf(stderr, "\n");
+      }
+   }
+}
+#endif
+
 static void
 get_cpu_topology(void)
 {
@@ -653,6 +737,11 @@ get_cpu_topology(void)
       }
    }
 #endif
+
+#if DETECT_OS_LINUX
+   if (!util_cpu_caps.L3_affinity_mask)
+      get_cpu_topology_sysfs();
+#endif
 }
 
 static